@@ -2,16 +2,52 @@ import { App, DataFlow, DeviceManager, IntentFlow } from '@google/local-home-sdk
 
 const APP_ID = 'sea-local-home';
 const DEFAULT_DEVICE_ID = 'sea.sea';
-const DEFAULT_HOSTNAME = 'sea.local';
+// A QUERY answer is reused while the reading it carries is younger than this. A reading the
+// device already reports as old is kept only briefly, since its next measurement may be close.
+const QUERY_FRESH_MS = 10_000;
+const QUERY_MIN_TTL_MS = 1_000;
 
 interface CustomData {
   deviceId: string;
-  hostname?: string;
   port?: number;
 }
 
+// Firmware answer to the UDP discovery packet (main/include/local_discovery.h)
+interface DiscoveryReply {
+  id: string;
+  port: number;
+  fw?: string;
+  model?: string;
+}
+
+// GET /api/google/state: the snapshot fields plus how old they are
+interface DeviceState {
+  cached?: boolean;
+  age_ms?: number;
+  [key: string]: unknown;
+}
+
+interface CachedState {
+  states: Record<string, unknown>;
+  expiresAt: number;
+}
+
+interface DeviceCommand {
+  index: number;
+  command: IntentFlow.ExecuteRequestCommands;
+}
+
+interface DeviceBatch {
+  customData?: CustomData;
+  commands: DeviceCommand[];
+}
+
 class SeaLocalHome {
   private readonly deviceManager: DeviceManager;
+  private readonly stateCache = new Map<string, CachedState>();
+  private readonly stateInFlight = new Map<string, Promise<Record<string, unknown>>>();
+  // Bumped by EXECUTE; a GET started under an older epoch must not fill the cache
+  private readonly stateEpoch = new Map<string, number>();
 
   constructor(private readonly app: App) {
     this.deviceManager = app.getDeviceManager();
@@ -25,10 +61,6 @@ class SeaLocalHome {
     return data?.port || 80;
   }
 
-  private hostnameFromData(data?: CustomData): string {
-    return data?.hostname || DEFAULT_HOSTNAME;
-  }
-
   private async sendHttpRequest<T>(options: {
     deviceId: string;
     method: 'GET' | 'POST';
@@ -56,73 +88,105 @@ class SeaLocalHome {
     return JSON.parse(json) as T;
   }
 
+  // Reply to the UDP scan (see the scan config in README): hex-encoded JSON from the firmware
+  private parseDiscoveryReply(hex?: string): DiscoveryReply | undefined {
+    if (!hex || hex.length % 2 !== 0) {
+      return undefined;
+    }
+    const bytes = new Uint8Array(hex.length / 2);
+    for (let i = 0; i < bytes.length; i++) {
+      bytes[i] = parseInt(hex.substr(i * 2, 2), 16);
+    }
+    try {
+      const reply = JSON.parse(new TextDecoder().decode(bytes)) as DiscoveryReply;
+      return typeof reply.id === 'string' ? reply : undefined;
+    } catch (err) {
+      return undefined;
+    }
+  }
+
   private async onIdentify(request: IntentFlow.IdentifyRequest): Promise<IntentFlow.IdentifyResponse> {
     console.log('[LocalHome] Identify request', JSON.stringify(request));
-    const payload = request.inputs?.[0]?.payload;
-    const deviceInfo = payload?.device?.deviceInfo;
-    const id = payload?.device?.id || DEFAULT_DEVICE_ID;
-
-    const device: IntentFlow.Device = {
-      id,
-      deviceInfo: {
-        manufacturer: 'SeaMonitor',
-        model: 'SeaSensor-ESP32',
-        hwVersion: 'revA',
-        swVersion: 'local-bridge-0.1',
-      },
-      type: 'action.devices.types.SENSOR',
-      traits: ['action.devices.traits.SensorState', 'action.devices.traits.OnOff'],
-      attributes: {
-        sensorStatesSupported: [
-          { name: 'airTemperatureC', unit: 'C' },
-          { name: 'humidityPercent', unit: '%' },
-          { name: 'waterTemperatureC', unit: 'C' },
-          { name: 'waterLevelCm', unit: 'cm' },
-          { name: 'airPressureHpa', unit: 'hPa' },
-          { name: 'batteryPercent', unit: '%' },
-        ],
-      },
-      customData: {
-        deviceId: id,
-        hostname: DEFAULT_HOSTNAME,
-        port: 80,
-        ...deviceInfo,
-      },
-    };
+    const scanned = request.inputs?.[0]?.payload?.device;
+    const udpData = scanned?.udpScanData?.data;
+    const reply = this.parseDiscoveryReply(udpData);
+    if (udpData && !reply) {
+      throw new Error(`Not a SeaSensor discovery reply: ${udpData}`);
+    }
+    // Matches otherDeviceIds in the firmware's SYNC answer
+    const id = reply?.id || scanned?.id || DEFAULT_DEVICE_ID;
 
     return {
       intent: request.intent,
+      requestId: request.requestId,
       payload: {
         device: {
           id,
-          deviceInfo: device.deviceInfo,
-          manufacturer: device.deviceInfo?.manufacturer,
-          model: device.deviceInfo?.model,
+          verificationId: id,
+          deviceInfo: {
+            manufacturer: 'SeaMonitor',
+            model: reply?.model || 'esp32-dock',
+            hwVersion: '1',
+            swVersion: reply?.fw || 'unknown',
+          },
         },
-        deviceId: id,
-        verificationId: id,
       },
     } as IntentFlow.IdentifyResponse;
   }
 
+  private stateTtlMs(state: DeviceState): number {
+    const ageMs = typeof state.age_ms === 'number' ? state.age_ms : QUERY_FRESH_MS;
+    return Math.max(QUERY_MIN_TTL_MS, QUERY_FRESH_MS - ageMs);
+  }
+
+  // One GET per device and freshness window; callers that arrive while it runs share it
+  private fetchState(deviceId: string, customData?: CustomData): Promise<Record<string, unknown>> {
+    const cached = this.stateCache.get(deviceId);
+    if (cached && cached.expiresAt > Date.now()) {
+      return Promise.resolve(cached.states);
+    }
+    const pending = this.stateInFlight.get(deviceId);
+    if (pending) {
+      return pending;
+    }
+    const epoch = this.stateEpoch.get(deviceId) || 0;
+    const request = (async () => {
+      try {
+        const state = await this.sendHttpRequest<DeviceState>({
+          deviceId,
+          method: 'GET',
+          path: '/api/google/state',
+          customData,
+        });
+        const { cached: _cached, age_ms: _ageMs, ...states } = state;
+        if ((this.stateEpoch.get(deviceId) || 0) === epoch) {
+          this.stateCache.set(deviceId, { states, expiresAt: Date.now() + this.stateTtlMs(state) });
+        }
+        return states;
+      } finally {
+        // After an EXECUTE the entry may already belong to a newer GET
+        if ((this.stateEpoch.get(deviceId) || 0) === epoch) {
+          this.stateInFlight.delete(deviceId);
+        }
+      }
+    })();
+    this.stateInFlight.set(deviceId, request);
+    return request;
+  }
+
   private async onQuery(request: IntentFlow.QueryRequest): Promise<IntentFlow.QueryResponse> {
     console.log('[LocalHome] Query request', JSON.stringify(request));
     const devices = request.inputs[0]?.payload?.devices || [];
     const payload: Record<string, IntentFlow.CommandResponseStates> = {};
 
-    for (const device of devices) {
+    await Promise.all(devices.map(async (device) => {
       const customData = device.customData as CustomData | undefined;
       const deviceId = device.id || customData?.deviceId || DEFAULT_DEVICE_ID;
       try {
-        const state = await this.sendHttpRequest<{ [key: string]: unknown }>({
-          deviceId,
-          method: 'GET',
-          path: '/api/google/state',
-          customData,
-        });
+        const states = await this.fetchState(deviceId, customData);
         payload[deviceId] = {
           status: 'SUCCESS',
-          ...state,
+          ...states,
         } as IntentFlow.CommandResponseStates;
       } catch (err) {
         console.error('[LocalHome] Query failed', err);
@@ -131,7 +195,7 @@ class SeaLocalHome {
           errorCode: 'deviceOffline',
         } as IntentFlow.CommandResponseStates;
       }
-    }
+    }));
 
     return {
       requestId: request.requestId,
@@ -141,42 +205,86 @@ class SeaLocalHome {
     };
   }
 
-  private async onExecute(request: IntentFlow.ExecuteRequest): Promise<IntentFlow.ExecuteResponse> {
-    console.log('[LocalHome] Execute request', JSON.stringify(request));
-    const commands = request.inputs[0]?.payload?.commands || [];
-    const results: IntentFlow.ExecuteResponseCommands[] = [];
+  // Splits the commands per target device, so each device gets all of its commands in one POST
+  private batchByDevice(commands: IntentFlow.ExecuteRequestCommands[]): Map<string, DeviceBatch> {
+    const batches = new Map<string, DeviceBatch>();
+    commands.forEach((command, index) => {
+      const devices = command.devices?.length ? command.devices : [{ id: DEFAULT_DEVICE_ID }];
+      for (const device of devices) {
+        const customData = device.customData as CustomData | undefined;
+        const deviceId = device.id || customData?.deviceId || DEFAULT_DEVICE_ID;
+        let batch = batches.get(deviceId);
+        if (!batch) {
+          batch = { customData, commands: [] };
+          batches.set(deviceId, batch);
+        }
+        batch.commands.push({ index, command: { ...command, devices: [device] } });
+      }
+    });
+    return batches;
+  }
 
-    for (const command of commands) {
-      const ids = command.devices?.map((d) => d.id || DEFAULT_DEVICE_ID) || [DEFAULT_DEVICE_ID];
-      const customData = command.devices?.[0]?.customData as CustomData | undefined;
-      try {
-        const body = {
-          requestId: request.requestId,
+  private async executeBatch(
+    requestId: string,
+    deviceId: string,
+    batch: DeviceBatch,
+  ): Promise<Array<{ index: number; result: IntentFlow.ExecuteResponseCommands }>> {
+    try {
+      const response = await this.sendHttpRequest<{
+        payload?: { commands?: IntentFlow.ExecuteResponseCommands[] };
+      }>({
+        deviceId,
+        method: 'POST',
+        path: '/api/google/homegraph',
+        body: {
+          requestId,
           inputs: [{
             intent: 'action.devices.EXECUTE',
-            payload: { commands: [command] },
+            payload: { commands: batch.commands.map((c) => c.command) },
           }],
-        };
-        await this.sendHttpRequest({
-          deviceId: ids[0],
-          method: 'POST',
-          path: '/api/google/homegraph',
-          body,
-          customData,
-        });
-        results.push({
-          ids,
-          status: 'SUCCESS',
-        });
-      } catch (err) {
-        console.error('[LocalHome] Execute failed', err);
-        results.push({
-          ids,
+        },
+        customData: batch.customData,
+      });
+      // The device answers one entry per command, in order
+      const answers = response.payload?.commands || [];
+      return batch.commands.map((c, i) => ({
+        index: c.index,
+        result: {
+          ...answers[i],
+          ids: [deviceId],
+          status: answers[i]?.status || 'SUCCESS',
+        } as IntentFlow.ExecuteResponseCommands,
+      }));
+    } catch (err) {
+      console.error('[LocalHome] Execute failed', err);
+      return batch.commands.map((c) => ({
+        index: c.index,
+        result: {
+          ids: [deviceId],
           status: 'ERROR',
           errorCode: 'deviceOffline',
-        });
-      }
+        } as IntentFlow.ExecuteResponseCommands,
+      }));
+    } finally {
+      // Commands change state (OnOff, Measure), so the next QUERY must ask the device; a GET
+      // already running may carry the pre-command state, so it is detached from the cache too
+      this.stateEpoch.set(deviceId, (this.stateEpoch.get(deviceId) || 0) + 1);
+      this.stateCache.delete(deviceId);
+      this.stateInFlight.delete(deviceId);
     }
+  }
+
+  private async onExecute(request: IntentFlow.ExecuteRequest): Promise<IntentFlow.ExecuteResponse> {
+    console.log('[LocalHome] Execute request', JSON.stringify(request));
+    const commands = request.inputs[0]?.payload?.commands || [];
+    const batches = this.batchByDevice(commands);
+
+    const answered = await Promise.all(
+      [...batches].map(([deviceId, batch]) => this.executeBatch(request.requestId, deviceId, batch)),
+    );
+    const results = ([] as typeof answered[number]).concat(...answered)
+      .sort((a, b) => a.index - b.index)
+      .map((entry) => entry.result);
 
     return {
       requestId: request.requestId,
@@ -0,0 +1,147 @@
+#!/usr/bin/env node
+// Intent latency of the built app against mock devices: npm run bench [-- options]
+//
+// Loads build/index.js with a stand-in for the Local Home runtime whose DeviceManager sends
+// real HTTP to tools/mock_device.js, then times QUERY (cold and within the freshness window)
+// and a multi-command EXECUTE. Also reports how many requests reached the devices per intent.
+'use strict';
+
+const http = require('http');
+const Module = require('module');
+const path = require('path');
+const { createMockDevice } = require('./mock_device');
+
+function parseArgs(argv) {
+  const args = { devices: 3, commands: 3, iterations: 50, latencyMs: 60 };
+  for (let i = 0; i < argv.length; i += 2) {
+    const value = Number(argv[i + 1]);
+    if (argv[i] === '--devices') args.devices = value;
+    else if (argv[i] === '--commands') args.commands = value;
+    else if (argv[i] === '--iterations') args.iterations = value;
+    else if (argv[i] === '--latency-ms') args.latencyMs = value;
+    else throw new Error(`unknown option ${argv[i]}`);
+  }
+  return args;
+}
+
+// Just enough of @google/local-home-sdk for the app to run under node
+function sdkStub(apps) {
+  class HttpRequestData {}
+  class App {
+    constructor(id) {
+      this.id = id;
+      this.handlers = {};
+      apps.push(this);
+    }
+    getDeviceManager() {
+      return {
+        send: (request) => new Promise((resolve, reject) => {
+          const req = http.request({
+            host: '127.0.0.1',
+            port: request.port,
+            method: request.method,
+            path: request.path,
+            headers: { 'Content-Type': 'application/json' },
+          }, (res) => {
+            const chunks = [];
+            res.on('data', (chunk) => chunks.push(chunk));
+            res.on('end', () => resolve({ data: new Uint8Array(Buffer.concat(chunks)) }));
+          });
+          req.on('error', reject);
+          req.end(request.data);
+        }),
+      };
+    }
+    onIdentify(fn) { this.handlers.identify = fn; return this; }
+    onExecute(fn) { this.handlers.execute = fn; return this; }
+    onQuery(fn) { this.handlers.query = fn; return this; }
+    listen() { return Promise.resolve(); }
+  }
+  return { App, DataFlow: { HttpRequestData, DataType: { JSON: 'json' } } };
+}
+
+function loadApp() {
+  const apps = [];
+  const sdk = sdkStub(apps);
+  const load = Module._load;
+  Module._load = function (request, ...rest) {
+    return request === '@google/local-home-sdk' ? sdk : load.call(this, request, ...rest);
+  };
+  try {
+    require(path.join(__dirname, '..', 'build', 'index.js'));
+  } finally {
+    Module._load = load;
+  }
+  return apps[0];
+}
+
+function percentile(sorted, pct) {
+  const idx = Math.min(sorted.length - 1, Math.round((pct / 100) * (sorted.length - 1)));
+  return sorted[idx];
+}
+
+async function time(name, iterations, mocks, fn) {
+  mocks.forEach((m) => m.resetStats());
+  const ms = [];
+  for (let i = 0; i < iterations; i++) {
+    const start = process.hrtime.bigint();
+    await fn(i);
+    ms.push(Number(process.hrtime.bigint() - start) / 1e6);
+  }
+  ms.sort((a, b) => a - b);
+  const sent = mocks.reduce((sum, m) => sum + Object.values(m.stats).reduce((a, b) => a + b, 0), 0);
+  console.log(`${name.padEnd(28)}${percentile(ms, 50).toFixed(1).padStart(9)}`
+    + `${percentile(ms, 99).toFixed(1).padStart(9)}${(sent / iterations).toFixed(2).padStart(12)}`);
+}
+
+async function main() {
+  const args = parseArgs(process.argv.slice(2));
+  const mocks = [];
+  for (let d = 0; d < args.devices; d++) {
+    const mock = createMockDevice({ latencyMs: args.latencyMs });
+    await new Promise((resolve) => mock.server.listen(0, '127.0.0.1', resolve));
+    mock.port = mock.server.address().port;
+    mocks.push(mock);
+  }
+  const app = loadApp();
+  const log = console.log;
+  const quiet = (fn) => async (i) => {
+    console.log = () => {};
+    try { await fn(i); } finally { console.log = log; }
+  };
+
+  // Fresh device IDs make every cold QUERY miss the cache
+  const devices = (prefix) => mocks.map((m, d) => ({
+    id: `${prefix}-${d}`,
+    customData: { deviceId: `${prefix}-${d}`, port: m.port },
+  }));
+  const query = (ids) => app.handlers.query({
+    requestId: 'bench',
+    inputs: [{ intent: 'action.devices.QUERY', payload: { devices: ids } }],
+  });
+  const warm = devices('warm');
+  const target = devices('exec')[0];
+  const commands = Array.from({ length: args.commands }, (_, c) => ({
+    devices: [target],
+    execution: [c % 2
+      ? { command: 'com.seasensor.commands.Measure', params: {} }
+      : { command: 'action.devices.commands.OnOff', params: { on: true } }],
+  }));
+
+  log(`${args.devices} devices, ${args.latencyMs} ms per device request, ${args.iterations} runs`);
+  log(`${'intent'.padEnd(28)}${'p50 ms'.padStart(9)}${'p99 ms'.padStart(9)}${'reqs/intent'.padStart(12)}`);
+  await time('QUERY cold', args.iterations, mocks, quiet((i) => query(devices(`cold${i}`))));
+  await quiet(() => query(warm))();
+  await time('QUERY within freshness', args.iterations, mocks, quiet(() => query(warm)));
+  await time(`EXECUTE ${args.commands} commands`, args.iterations, mocks, quiet(() => app.handlers.execute({
+    requestId: 'bench',
+    inputs: [{ intent: 'action.devices.EXECUTE', payload: { commands } }],
+  })));
+
+  mocks.forEach((m) => m.server.close());
+}
+
+main().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
@@ -0,0 +1,141 @@
+#!/usr/bin/env node
+// Stand-in for a SeaSensor on the LAN:
+//   node tools/mock_device.js [--port 8080] [--latency-ms 60] [--discovery-port 3311]
+//
+// Answers GET /api/google/state and POST /api/google/homegraph (EXECUTE) the way the firmware
+// does. Requests are served one at a time with a fixed delay, like the single httpd task on
+// the ESP32 behind Wi-Fi. GET /mock/stats returns how many requests each path has seen.
+// The UDP discovery packet is answered like the firmware's local_discovery responder, so
+// tools/discovery_probe.py (repository root) can run against it.
+'use strict';
+
+const dgram = require('dgram');
+const http = require('http');
+
+const DISCOVERY_PACKET = 'SEASENSOR_DISCOVER';
+
+function parseArgs(argv) {
+  const args = { port: 8080, latencyMs: 60, intervalS: 60, discoveryPort: 3311 };
+  for (let i = 0; i < argv.length; i += 2) {
+    const value = Number(argv[i + 1]);
+    if (argv[i] === '--port') args.port = value;
+    else if (argv[i] === '--latency-ms') args.latencyMs = value;
+    else if (argv[i] === '--interval-s') args.intervalS = value;
+    else if (argv[i] === '--discovery-port') args.discoveryPort = value;
+    else throw new Error(`unknown option ${argv[i]}`);
+  }
+  return args;
+}
+
+function listenForDiscovery(discoveryPort, httpPort) {
+  const socket = dgram.createSocket('udp4');
+  socket.on('message', (msg, rinfo) => {
+    if (msg.toString() !== DISCOVERY_PACKET) {
+      return;
+    }
+    const reply = JSON.stringify({ id: 'sea.sea', port: httpPort, fw: 'mock', model: 'esp32-dock' });
+    socket.send(reply, rinfo.port, rinfo.address);
+  });
+  socket.bind(discoveryPort);
+  return socket;
+}
+
+function createMockDevice({ latencyMs = 60, intervalS = 60 } = {}) {
+  const startedAt = Date.now();
+  const stats = {};
+  let seq = 1;
+  let automation = true;
+  let busyUntil = 0;
+
+  function snapshot() {
+    // A new reading every intervalS; age_ms counts from the last one
+    const sinceStart = Date.now() - startedAt;
+    const ageMs = sinceStart % (intervalS * 1000);
+    return {
+      cached: true,
+      age_ms: ageMs,
+      water_temp_c: 14.2,
+      sea_level_cm: 112.5,
+      air_temp_c: 17.8,
+      humidity_percent: 71.0,
+      air_pressure_hpa: 1012.3,
+      battery_percent: 86.0,
+      seq: seq + Math.floor(sinceStart / (intervalS * 1000)),
+    };
+  }
+
+  function execute(body) {
+    const commands = body.inputs?.[0]?.payload?.commands || [];
+    return commands.map((command) => {
+      const ids = (command.devices || []).map((d) => d.id);
+      for (const exec of command.execution || []) {
+        if (exec.command === 'action.devices.commands.OnOff') {
+          automation = exec.params?.on !== false;
+        } else if (exec.command !== 'com.seasensor.commands.Measure') {
+          return { ids, status: 'ERROR', errorCode: 'functionNotSupported' };
+        }
+      }
+      return { ids, status: 'SUCCESS', states: { on: automation, online: true } };
+    });
+  }
+
+  function route(method, path, body) {
+    if (method === 'GET' && path === '/api/google/state') {
+      return [200, snapshot()];
+    }
+    if (method === 'POST' && path === '/api/google/homegraph') {
+      const parsed = JSON.parse(body);
+      return [200, { requestId: parsed.requestId, payload: { commands: execute(parsed) } }];
+    }
+    if (method === 'GET' && path === '/mock/stats') {
+      return [200, stats];
+    }
+    return [404, { error: 'not found' }];
+  }
+
+  const server = http.createServer((req, res) => {
+    let body = '';
+    req.on('data', (chunk) => { body += chunk; });
+    req.on('end', () => {
+      const key = `${req.method} ${req.url}`;
+      if (req.url !== '/mock/stats') {
+        stats[key] = (stats[key] || 0) + 1;
+      }
+      // Serialize like httpd: each request waits for the ones ahead of it
+      const now = Date.now();
+      busyUntil = Math.max(busyUntil, now) + latencyMs;
+      setTimeout(() => {
+        let status;
+        let payload;
+        try {
+          [status, payload] = route(req.method, req.url, body);
+        } catch (err) {
+          [status, payload] = [400, { error: String(err) }];
+        }
+        res.writeHead(status, { 'Content-Type': 'application/json' });
+        res.end(JSON.stringify(payload));
+      }, busyUntil - now);
+    });
+  });
+
+  return {
+    server,
+    stats,
+    resetStats() {
+      for (const key of Object.keys(stats)) delete stats[key];
+    },
+  };
+}
+
+module.exports = { createMockDevice, listenForDiscovery };
+
+if (require.main === module) {
+  const args = parseArgs(process.argv.slice(2));
+  const { server } = createMockDevice(args);
+  server.listen(args.port, () => {
+    console.log(`mock SeaSensor on :${args.port}, ${args.latencyMs} ms per request`);
+  });
+  if (args.discoveryPort) {
+    listenForDiscovery(args.discoveryPort, args.port);
+  }
+}
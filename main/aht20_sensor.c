@@ -3,9 +3,17 @@
 #include "esp_check.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
 
 #define TAG "aht20"
 #define AHT20_ADDR 0x38
+#define AHT20_STATUS_BUSY 0x80
+#define AHT20_STATUS_CALIBRATED 0x08
+#define AHT20_INIT_DELAY_MS 10
+#define AHT20_RESET_DELAY_MS 20
+#define AHT20_FIRST_POLL_MS 40
+#define AHT20_POLL_MS 10
+#define AHT20_MEASURE_TIMEOUT_MS 150
 
 static bool s_ready = false;
 static i2c_port_t s_port = I2C_NUM_0;
@@ -39,29 +47,59 @@ static esp_err_t aht20_read_bytes(uint8_t *data, size_t len)
     return err;
 }
 
+static uint8_t aht20_crc8(const uint8_t *data, size_t len)
+{
+    // CRC-8/NRSC-5 as specified in the datasheet: poly x^8+x^5+x^4+1 (0x31), init 0xFF
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static esp_err_t aht20_read_status(uint8_t *status)
+{
+    return aht20_read_bytes(status, 1);
+}
+
+static esp_err_t aht20_calibrate(void)
+{
+    // Init command: 0xBE, 0x08, 0x00
+    uint8_t init_cmd[] = {0xBE, 0x08, 0x00};
+    ESP_RETURN_ON_ERROR(aht20_write(init_cmd, sizeof(init_cmd)), TAG, "init");
+    vTaskDelay(pdMS_TO_TICKS(AHT20_INIT_DELAY_MS));
+
+    uint8_t status = 0;
+    ESP_RETURN_ON_ERROR(aht20_read_status(&status), TAG, "status");
+    return (status & AHT20_STATUS_CALIBRATED) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
 esp_err_t aht20_init(i2c_port_t port, gpio_num_t sda_pin, gpio_num_t scl_pin)
 {
     s_port = port;
     s_sda = sda_pin;
     s_scl = scl_pin;
+    s_ready = false;
 
-    // Ensure bus configured (driver already installed elsewhere)
-    i2c_cmd_handle_t ping = i2c_cmd_link_create();
-    i2c_master_start(ping);
-    i2c_master_write_byte(ping, (AHT20_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_stop(ping);
-    i2c_master_cmd_begin(s_port, ping, pdMS_TO_TICKS(50));
-    i2c_cmd_link_delete(ping);
-
-    // Send soft reset
-    uint8_t reset_cmd = 0xBA;
-    ESP_RETURN_ON_ERROR(aht20_write(&reset_cmd, 1), TAG, "reset");
-    vTaskDelay(pdMS_TO_TICKS(20));
+    // Bus is configured by the BME280 driver; a status read doubles as presence check.
+    uint8_t status = 0;
+    ESP_RETURN_ON_ERROR(aht20_read_status(&status), TAG, "status");
+    if ((status & AHT20_STATUS_CALIBRATED) && !(status & AHT20_STATUS_BUSY)) {
+        s_ready = true;
+        ESP_LOGI(TAG, "AHT20 ready at 0x%02X (calibrated)", AHT20_ADDR);
+        return ESP_OK;
+    }
 
-    // Init command: 0xBE, 0x08, 0x00
-    uint8_t init_cmd[] = {0xBE, 0x08, 0x00};
-    ESP_RETURN_ON_ERROR(aht20_write(init_cmd, sizeof(init_cmd)), TAG, "init");
-    vTaskDelay(pdMS_TO_TICKS(10));
+    if (aht20_calibrate() != ESP_OK) {
+        // Calibration did not stick: soft reset and try once more
+        uint8_t reset_cmd = 0xBA;
+        ESP_RETURN_ON_ERROR(aht20_write(&reset_cmd, 1), TAG, "reset");
+        vTaskDelay(pdMS_TO_TICKS(AHT20_RESET_DELAY_MS));
+        ESP_RETURN_ON_ERROR(aht20_calibrate(), TAG, "calibrate");
+    }
 
     s_ready = true;
     ESP_LOGI(TAG, "AHT20 ready at 0x%02X", AHT20_ADDR);
@@ -77,13 +115,38 @@ esp_err_t aht20_read(float *temperature_c, float *humidity_percent)
     // Trigger measurement: 0xAC, 0x33, 0x00
     uint8_t measure_cmd[] = {0xAC, 0x33, 0x00};
     ESP_RETURN_ON_ERROR(aht20_write(measure_cmd, sizeof(measure_cmd)), TAG, "measure");
-    vTaskDelay(pdMS_TO_TICKS(80));
 
-    uint8_t raw[6];
-    ESP_RETURN_ON_ERROR(aht20_read_bytes(raw, sizeof(raw)), TAG, "read");
+    // Conversion typically finishes well before the 80 ms worst case; poll the busy bit.
+    // Each poll reads the whole frame so the ready poll also delivers the sample.
+    uint8_t raw[7];
+    int64_t start_us = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(AHT20_FIRST_POLL_MS));
+    while (true) {
+        ESP_RETURN_ON_ERROR(aht20_read_bytes(raw, sizeof(raw)), TAG, "read");
+        if (!(raw[0] & AHT20_STATUS_BUSY)) {
+            break;
+        }
+        if (esp_timer_get_time() - start_us > AHT20_MEASURE_TIMEOUT_MS * 1000) {
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(AHT20_POLL_MS));
+    }
+
+    if (aht20_crc8(raw, 6) != raw[6]) {
+        ESP_LOGW(TAG, "CRC mismatch (got 0x%02X)", raw[6]);
+        return ESP_ERR_INVALID_CRC;
+    }
+    if (!(raw[0] & AHT20_STATUS_CALIBRATED)) {
+        // Sensor lost its calibration (brown-out); have it re-run init
+        s_ready = false;
+        return ESP_ERR_INVALID_STATE;
+    }
 
     uint32_t hum_raw = ((uint32_t)raw[1] << 12) | ((uint32_t)raw[2] << 4) | (raw[3] >> 4);
     uint32_t temp_raw = (((uint32_t)raw[3] & 0x0F) << 16) | ((uint32_t)raw[4] << 8) | raw[5];
+    if ((hum_raw == 0 && temp_raw == 0) || (hum_raw == 0xFFFFF && temp_raw == 0xFFFFF)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
 
     float hum = (hum_raw / 1048576.0f) * 100.0f;
     float temp = ((temp_raw / 1048576.0f) * 200.0f) - 50.0f;
@@ -96,5 +159,6 @@ esp_err_t aht20_read(float *temperature_c, float *humidity_percent)
     if (temperature_c) {
         *temperature_c = temp;
     }
+    ESP_LOGD(TAG, "sample ready after %lld ms", (long long)((esp_timer_get_time() - start_us) / 1000));
     return ESP_OK;
 }
@@ -0,0 +1,215 @@
+#include "air_fusion.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEALTH_INITIAL 0.5f
+#define HEALTH_GAIN 0.2f        // fraction of the gap to 1.0 recovered per good sample
+#define HEALTH_DECAY 0.5f       // multiplier per failed read
+#define RESIDUAL_ALPHA 0.2f     // EWMA weight for per-sensor disagreement with the fused value
+#define TEMP_AGREE_C 1.0f       // residual at which a sensor's temperature weight is halved
+#define HUM_AGREE_PCT 5.0f      // same for humidity
+#define TREND_SLOT_US (15LL * 60 * 1000000) // minimum spacing of stored samples
+#define TREND_SLOTS 15          // 14 x 15 min = 3.5 h: covers span + tolerance at the densest spacing
+#define TREND_SPAN_US (3LL * 60 * 60 * 1000000)
+#define TREND_TOLERANCE_US (30LL * 60 * 1000000) // reference sample must lie this close to now - 3 h
+
+typedef struct {
+    float health;
+    float temp_residual;
+    float hum_residual;
+} sensor_state_t;
+
+typedef struct {
+    float pressure_hpa;
+    int64_t time_us;
+} trend_slot_t;
+
+static sensor_state_t s_bme;
+static sensor_state_t s_aht;
+static float s_altitude_m;
+static bool s_have_temp;
+static bool s_have_hum;
+static float s_fused_temp;
+static float s_fused_hum;
+static trend_slot_t s_trend[TREND_SLOTS];
+static uint8_t s_trend_head;  // next slot to write
+static uint8_t s_trend_count;
+
+void air_fusion_init(float station_altitude_m)
+{
+    memset(&s_bme, 0, sizeof(s_bme));
+    memset(&s_aht, 0, sizeof(s_aht));
+    s_bme.health = HEALTH_INITIAL;
+    s_aht.health = HEALTH_INITIAL;
+    s_altitude_m = station_altitude_m;
+    s_have_temp = false;
+    s_have_hum = false;
+    s_trend_head = 0;
+    s_trend_count = 0;
+}
+
+static bool reading_usable(const air_fusion_reading_t *reading)
+{
+    // Datasheet operating ranges; anything outside is a bus/calibration glitch, not weather.
+    if (!reading || !reading->attempted || !reading->valid) {
+        return false;
+    }
+    if (!(reading->temperature_c >= -40.0f && reading->temperature_c <= 85.0f)) {
+        return false;
+    }
+    if (reading->has_humidity && !(reading->humidity_percent >= 0.0f && reading->humidity_percent <= 100.0f)) {
+        return false;
+    }
+    if (reading->has_pressure && !(reading->pressure_hpa >= 300.0f && reading->pressure_hpa <= 1100.0f)) {
+        return false;
+    }
+    return true;
+}
+
+static void update_health(sensor_state_t *state, const air_fusion_reading_t *reading, bool usable)
+{
+    if (!reading || !reading->attempted) {
+        return;
+    }
+    if (usable) {
+        state->health += (1.0f - state->health) * HEALTH_GAIN;
+    } else {
+        state->health *= HEALTH_DECAY;
+    }
+}
+
+static float ewma(float prev, float sample)
+{
+    return prev + RESIDUAL_ALPHA * (sample - prev);
+}
+
+static float sensor_weight(const sensor_state_t *state, float residual, float agree_scale)
+{
+    // Healthy sensors that track the consensus dominate; one drifting away fades out smoothly.
+    return state->health / (1.0f + residual / agree_scale);
+}
+
+static bool fuse_channel(bool use_b, float value_b, float weight_b,
+                         bool use_a, float value_a, float weight_a, float *out)
+{
+    float wsum = (use_b ? weight_b : 0.0f) + (use_a ? weight_a : 0.0f);
+    if (wsum <= 0.0f) {
+        return false;
+    }
+    float acc = (use_b ? weight_b * value_b : 0.0f) + (use_a ? weight_a * value_a : 0.0f);
+    *out = acc / wsum;
+    return true;
+}
+
+static float dew_point(float temp_c, float rh_percent)
+{
+    // Magnus-Tetens with Sonntag (1990) constants, good to ~0.35 C for -45..60 C
+    if (rh_percent <= 0.0f) {
+        return NAN;
+    }
+    const float a = 17.62f;
+    const float b = 243.12f;
+    float gamma = logf(rh_percent / 100.0f) + (a * temp_c) / (b + temp_c);
+    return (b * gamma) / (a - gamma);
+}
+
+static float sea_level_pressure(float station_hpa, float temp_c)
+{
+    if (s_altitude_m == 0.0f) {
+        return station_hpa;
+    }
+    // Hypsometric reduction with the standard lapse rate
+    const float lapse_h = 0.0065f * s_altitude_m;
+    return station_hpa * powf(1.0f - lapse_h / (temp_c + lapse_h + 273.15f), -5.257f);
+}
+
+static float update_trend(float msl_hpa, int64_t now_us)
+{
+    uint8_t newest = (uint8_t)((s_trend_head + TREND_SLOTS - 1) % TREND_SLOTS);
+    if (s_trend_count == 0 || now_us - s_trend[newest].time_us >= TREND_SLOT_US) {
+        s_trend[s_trend_head] = (trend_slot_t){ .pressure_hpa = msl_hpa, .time_us = now_us };
+        s_trend_head = (uint8_t)((s_trend_head + 1) % TREND_SLOTS);
+        if (s_trend_count < TREND_SLOTS) {
+            s_trend_count++;
+        }
+    }
+    // Slots are only as dense as the air interval allows, so pick the sample nearest to three
+    // hours ago by its timestamp and scale the change to exactly three hours
+    const trend_slot_t *ref = NULL;
+    int64_t best_err = TREND_TOLERANCE_US;
+    for (uint8_t i = 0; i < s_trend_count; ++i) {
+        const trend_slot_t *slot = &s_trend[i];
+        int64_t err = llabs(now_us - slot->time_us - TREND_SPAN_US);
+        if (err <= best_err) {
+            best_err = err;
+            ref = slot;
+        }
+    }
+    if (!ref) {
+        return NAN;
+    }
+    return (msl_hpa - ref->pressure_hpa) * (float)((double)TREND_SPAN_US / (double)(now_us - ref->time_us));
+}
+
+void air_fusion_update(const air_fusion_reading_t *bme, const air_fusion_reading_t *aht,
+                       int64_t now_us, air_fusion_output_t *out)
+{
+    bool b_ok = reading_usable(bme);
+    bool a_ok = reading_usable(aht);
+    update_health(&s_bme, bme, b_ok);
+    update_health(&s_aht, aht, a_ok);
+
+    if (s_have_temp) {
+        if (b_ok) {
+            s_bme.temp_residual = ewma(s_bme.temp_residual, fabsf(bme->temperature_c - s_fused_temp));
+        }
+        if (a_ok) {
+            s_aht.temp_residual = ewma(s_aht.temp_residual, fabsf(aht->temperature_c - s_fused_temp));
+        }
+    }
+    bool b_hum = b_ok && bme->has_humidity;
+    bool a_hum = a_ok && aht->has_humidity;
+    if (s_have_hum) {
+        if (b_hum) {
+            s_bme.hum_residual = ewma(s_bme.hum_residual, fabsf(bme->humidity_percent - s_fused_hum));
+        }
+        if (a_hum) {
+            s_aht.hum_residual = ewma(s_aht.hum_residual, fabsf(aht->humidity_percent - s_fused_hum));
+        }
+    }
+
+    memset(out, 0, sizeof(*out));
+    float temp = 0.0f;
+    if (fuse_channel(b_ok, b_ok ? bme->temperature_c : 0.0f, sensor_weight(&s_bme, s_bme.temp_residual, TEMP_AGREE_C),
+                     a_ok, a_ok ? aht->temperature_c : 0.0f, sensor_weight(&s_aht, s_aht.temp_residual, TEMP_AGREE_C),
+                     &temp)) {
+        s_fused_temp = temp;
+        s_have_temp = true;
+        out->have_temperature = true;
+    }
+    float hum = 0.0f;
+    if (fuse_channel(b_hum, b_hum ? bme->humidity_percent : 0.0f, sensor_weight(&s_bme, s_bme.hum_residual, HUM_AGREE_PCT),
+                     a_hum, a_hum ? aht->humidity_percent : 0.0f, sensor_weight(&s_aht, s_aht.hum_residual, HUM_AGREE_PCT),
+                     &hum)) {
+        s_fused_hum = hum;
+        s_have_hum = true;
+        out->have_humidity = true;
+    }
+
+    out->temperature_c = s_fused_temp;
+    out->humidity_percent = s_fused_hum;
+    out->have_pressure = b_ok && bme->has_pressure;
+    out->pressure_hpa = out->have_pressure ? bme->pressure_hpa : 0.0f;
+    out->dew_point_c = (s_have_temp && s_have_hum) ? dew_point(s_fused_temp, s_fused_hum) : NAN;
+    if (out->have_pressure) {
+        out->sea_level_pressure_hpa = sea_level_pressure(out->pressure_hpa, s_fused_temp);
+        out->pressure_trend_hpa_3h = update_trend(out->sea_level_pressure_hpa, now_us);
+    } else {
+        out->sea_level_pressure_hpa = NAN;
+        out->pressure_trend_hpa_3h = NAN;
+    }
+    out->bme_health = s_bme.health;
+    out->aht_health = s_aht.health;
+}
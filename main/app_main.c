@@ -10,6 +10,7 @@
 #include "wifi_manager.h"
 #include "web_server.h"
 #include "google_bridge.h"
+#include "local_discovery.h"
 
 #include "esp_event.h"
 #include "esp_log.h"
@@ -63,6 +64,7 @@ static void publish_latest_snapshot(void)
     sensor_manager_get_snapshot(&snapshot);
     mqtt_bridge_publish_snapshot(&snapshot);
     google_bridge_publish_snapshot(&snapshot);
+    web_server_publish_snapshot(&snapshot);
     wifi_status_t wifi_status = wifi_manager_get_status();
     display_manager_show_snapshot(&snapshot, &wifi_status);
 }
@@ -100,21 +102,24 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     ESP_ERROR_CHECK(config_store_init());
-    measurement_config_t config = config_store_get();
+    const measurement_config_t *config = config_store_acquire(NULL); // copied by display and scheduler init
 
     ESP_ERROR_CHECK(power_manager_init());
     ESP_ERROR_CHECK(sensor_manager_init());
-    ESP_ERROR_CHECK(mqtt_bridge_init());
-    google_bridge_update_config(&config);
     ESP_ERROR_CHECK(google_bridge_init());
-    ESP_ERROR_CHECK(wifi_manager_init(&config));
+    ESP_ERROR_CHECK(wifi_manager_init());
+    ESP_ERROR_CHECK(mqtt_bridge_init());
     ESP_ERROR_CHECK(web_server_start());
-    ESP_ERROR_CHECK(display_manager_init(&config));
+    if (local_discovery_start(WEB_SERVER_PORT) != ESP_OK) {
+        ESP_LOGW(TAG, "Local Home discovery unavailable; mDNS only");
+    }
+    ESP_ERROR_CHECK(display_manager_init(config));
     // I2C-skann etter at bussen er startet av sensor/display-init
     i2c_scan_and_log();
     start_button_task();
 
-    ESP_ERROR_CHECK(scheduler_init(&config));
+    ESP_ERROR_CHECK(scheduler_init(config));
+    config_store_release(config);
     register_scheduled_tasks();
 
     ESP_LOGI(TAG, "SeaSensor firmware started");
@@ -6,34 +6,214 @@
 #include "hal/adc_types.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
 
 #define TAG "battery"
 #define BATTERY_ADC_UNIT ADC_UNIT_1
 #define BATTERY_ADC_CHANNEL ADC_CHANNEL_4 // GPIO32
 #define BATTERY_DIVIDER_R1 220000.0f
 #define BATTERY_DIVIDER_R2 100000.0f
-#define BATTERY_MIN_V 3.3f
-#define BATTERY_MAX_V 4.2f
+#define BATTERY_BURSTS 4
+#define BATTERY_SAMPLES_PER_BURST 8
+#define BATTERY_BURST_GAP_MS 10      // spread bursts so a single TX frame cannot hit all of them
+#define BATTERY_DROOP_REJECT_MV 15   // at the ADC pin; bursts this far below the best one saw TX sag
+#define BATTERY_SOC_TAU_S 120.0f     // SoC smoothing time constant
+#define BATTERY_SLOPE_BUCKET_S 3600  // SoC is averaged per hour ...
+#define BATTERY_SLOPE_BUCKETS 24     // ... and the slope fitted over the last day of hours
+#define BATTERY_SLOPE_MIN_BUCKETS 3
+#define BATTERY_MAX_FORECAST_DAYS 365.0f
 
 static adc_oneshot_unit_handle_t s_adc_handle;
 static adc_cali_handle_t s_cali_handle;
 static bool s_ready = false;
 
+// Resting OCV of a 1S Li-ion (NMC) cell; the 3.7-3.9 V plateau holds most of the capacity
+static const battery_ocv_point_t k_default_curve[] = {
+    {3270, 0},  {3610, 5},  {3690, 10}, {3710, 15}, {3730, 20}, {3750, 25}, {3770, 30},
+    {3790, 35}, {3800, 40}, {3820, 45}, {3840, 50}, {3850, 55}, {3870, 60}, {3910, 65},
+    {3950, 70}, {3980, 75}, {4020, 80}, {4080, 85}, {4110, 90}, {4150, 95}, {4200, 100},
+};
+static battery_ocv_point_t s_curve[BATTERY_OCV_MAX_POINTS];
+static size_t s_curve_len;
+
+static battery_status_t s_status;
+static bool s_have_soc = false;
+static int64_t s_last_us;
+static int64_t s_bucket_start_us;
+static float s_bucket_sum;
+static int64_t s_bucket_offset_sum_us; // sample times relative to s_bucket_start_us
+static uint32_t s_bucket_count;
+
+typedef struct {
+    float percent;   // mean SoC of the bucket
+    int64_t time_us; // mean sample time; buckets span >= 1 h, more with long battery intervals
+} soc_bucket_t;
+
+static soc_bucket_t s_hourly[BATTERY_SLOPE_BUCKETS]; // closed buckets, oldest overwritten
+static uint8_t s_hourly_head;
+static uint8_t s_hourly_count;
+
 static float scale_voltage(float measured_v)
 {
     const float ratio = (BATTERY_DIVIDER_R1 + BATTERY_DIVIDER_R2) / BATTERY_DIVIDER_R2;
     return measured_v * ratio;
 }
 
-static float voltage_to_percent(float vbatt)
+float battery_monitor_voltage_to_percent(float vbatt)
+{
+    float mv = vbatt * 1000.0f;
+    if (mv <= s_curve[0].millivolts) {
+        return s_curve[0].percent;
+    }
+    for (size_t i = 1; i < s_curve_len; ++i) {
+        if (mv < s_curve[i].millivolts) {
+            const battery_ocv_point_t *lo = &s_curve[i - 1];
+            const battery_ocv_point_t *hi = &s_curve[i];
+            float t = (mv - lo->millivolts) / (float)(hi->millivolts - lo->millivolts);
+            return lo->percent + t * (float)(hi->percent - lo->percent);
+        }
+    }
+    return s_curve[s_curve_len - 1].percent;
+}
+
+esp_err_t battery_monitor_set_curve(const battery_ocv_point_t *points, size_t count)
+{
+    if (!points || count < 2 || count > BATTERY_OCV_MAX_POINTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 1; i < count; ++i) {
+        if (points[i].millivolts <= points[i - 1].millivolts || points[i].percent < points[i - 1].percent) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    memcpy(s_curve, points, count * sizeof(*points));
+    s_curve_len = count;
+    return ESP_OK;
+}
+
+static int raw_to_mv(int raw)
+{
+    int mv = 0;
+    if (s_cali_handle) {
+        adc_cali_raw_to_voltage(s_cali_handle, raw, &mv);
+    } else {
+        // Approximate: default 12-bit, 3.3 V reference
+        mv = (int)((float)raw / 4095.0f * 3300.0f);
+    }
+    return mv;
+}
+
+static esp_err_t sample_pin_mv(float *out_mv, int *kept_bursts)
+{
+    // Wi-Fi TX bursts sag the supply for a few ms and drag ADC readings down. Sample in short
+    // bursts spread over ~30 ms and drop any burst that sits clearly below the best one.
+    int burst_mv[BATTERY_BURSTS];
+    int best_mv = 0;
+    for (int b = 0; b < BATTERY_BURSTS; ++b) {
+        int sum = 0;
+        for (int i = 0; i < BATTERY_SAMPLES_PER_BURST; ++i) {
+            int raw = 0;
+            ESP_RETURN_ON_ERROR(adc_oneshot_read(s_adc_handle, BATTERY_ADC_CHANNEL, &raw), TAG, "adc read");
+            sum += raw;
+        }
+        burst_mv[b] = raw_to_mv((sum + BATTERY_SAMPLES_PER_BURST / 2) / BATTERY_SAMPLES_PER_BURST);
+        if (burst_mv[b] > best_mv) {
+            best_mv = burst_mv[b];
+        }
+        if (b + 1 < BATTERY_BURSTS) {
+            vTaskDelay(pdMS_TO_TICKS(BATTERY_BURST_GAP_MS));
+        }
+    }
+    int sum_mv = 0;
+    int kept = 0;
+    for (int b = 0; b < BATTERY_BURSTS; ++b) {
+        if (burst_mv[b] >= best_mv - BATTERY_DROOP_REJECT_MV) {
+            sum_mv += burst_mv[b];
+            kept++;
+        }
+    }
+    *out_mv = (float)sum_mv / (float)kept;
+    *kept_bursts = kept;
+    return ESP_OK;
+}
+
+static float fit_slope_per_day(void)
+{
+    // Least-squares slope of the bucket means against their mean sample times (days since the
+    // oldest bucket), so irregular or long battery intervals do not skew the rate
+    size_t n = s_hourly_count;
+    size_t first = (s_hourly_head + BATTERY_SLOPE_BUCKETS - n) % BATTERY_SLOPE_BUCKETS;
+    int64_t t0_us = s_hourly[first].time_us;
+    float mean_x = 0.0f;
+    float mean_y = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        const soc_bucket_t *b = &s_hourly[(first + i) % BATTERY_SLOPE_BUCKETS];
+        mean_x += (float)(b->time_us - t0_us) / 86400e6f;
+        mean_y += b->percent;
+    }
+    mean_x /= (float)n;
+    mean_y /= (float)n;
+    float sxy = 0.0f;
+    float sxx = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        const soc_bucket_t *b = &s_hourly[(first + i) % BATTERY_SLOPE_BUCKETS];
+        float dx = (float)(b->time_us - t0_us) / 86400e6f - mean_x;
+        sxy += dx * (b->percent - mean_y);
+        sxx += dx * dx;
+    }
+    return sxx > 0.0f ? sxy / sxx : 0.0f;
+}
+
+static void update_state(float vbatt, int64_t now_us)
 {
-    if (vbatt <= BATTERY_MIN_V) {
-        return 0.0f;
+    float soc = battery_monitor_voltage_to_percent(vbatt);
+    s_status.voltage = vbatt;
+    if (!s_have_soc) {
+        s_status.percent = soc;
+        s_bucket_start_us = now_us;
+        s_have_soc = true;
+    } else {
+        // Time-based EWMA so the smoothing does not depend on the battery interval
+        float dt = (float)(now_us - s_last_us) / 1e6f;
+        float alpha = dt / (BATTERY_SOC_TAU_S + dt);
+        s_status.percent += alpha * (soc - s_status.percent);
     }
-    if (vbatt >= BATTERY_MAX_V) {
-        return 100.0f;
+    s_last_us = now_us;
+    s_bucket_sum += s_status.percent;
+    s_bucket_offset_sum_us += now_us - s_bucket_start_us;
+    s_bucket_count++;
+
+    if (now_us - s_bucket_start_us < (int64_t)BATTERY_SLOPE_BUCKET_S * 1000000LL) {
+        return;
+    }
+    s_hourly[s_hourly_head] = (soc_bucket_t){
+        .percent = s_bucket_sum / (float)s_bucket_count,
+        .time_us = s_bucket_start_us + s_bucket_offset_sum_us / s_bucket_count,
+    };
+    s_hourly_head = (uint8_t)((s_hourly_head + 1) % BATTERY_SLOPE_BUCKETS);
+    if (s_hourly_count < BATTERY_SLOPE_BUCKETS) {
+        s_hourly_count++;
+    }
+    s_bucket_start_us = now_us;
+    s_bucket_sum = 0.0f;
+    s_bucket_offset_sum_us = 0;
+    s_bucket_count = 0;
+    if (s_hourly_count < BATTERY_SLOPE_MIN_BUCKETS) {
+        return;
+    }
+
+    s_status.percent_per_day = fit_slope_per_day();
+    if (s_status.percent_per_day < 0.0f) {
+        float remaining = s_status.percent / -s_status.percent_per_day;
+        s_status.days_remaining = remaining > BATTERY_MAX_FORECAST_DAYS ? BATTERY_MAX_FORECAST_DAYS : remaining;
+    } else {
+        s_status.days_remaining = NAN; // charging or flat
     }
-    return (vbatt - BATTERY_MIN_V) / (BATTERY_MAX_V - BATTERY_MIN_V) * 100.0f;
 }
 
 esp_err_t battery_monitor_init(void)
@@ -67,6 +247,21 @@ esp_err_t battery_monitor_init(void)
     s_cali_handle = NULL;
 #endif
 
+    if (s_curve_len == 0) {
+        battery_monitor_set_curve(k_default_curve, sizeof(k_default_curve) / sizeof(k_default_curve[0]));
+    }
+    s_status = (battery_status_t){
+        .voltage = NAN,
+        .percent = NAN,
+        .percent_per_day = NAN,
+        .days_remaining = NAN,
+    };
+    s_have_soc = false;
+    s_bucket_sum = 0.0f;
+    s_bucket_offset_sum_us = 0;
+    s_bucket_count = 0;
+    s_hourly_head = 0;
+    s_hourly_count = 0;
     s_ready = true;
     return ESP_OK;
 }
@@ -76,25 +271,26 @@ esp_err_t battery_monitor_read(float *voltage, float *percent)
     if (!s_ready) {
         return ESP_ERR_INVALID_STATE;
     }
-    int raw = 0;
-    esp_err_t err = adc_oneshot_read(s_adc_handle, BATTERY_ADC_CHANNEL, &raw);
-    if (err != ESP_OK) {
-        return err;
-    }
-    int mv = 0;
-    if (s_cali_handle) {
-        adc_cali_raw_to_voltage(s_cali_handle, raw, &mv);
-    } else {
-        // Approximate: default 12-bit, 3.3 V reference
-        mv = (int)((float)raw / 4095.0f * 3300.0f);
-    }
-    float measured_v = mv / 1000.0f;
-    float vbatt = scale_voltage(measured_v);
+    int64_t start_us = esp_timer_get_time();
+    float pin_mv = 0.0f;
+    int kept = 0;
+    ESP_RETURN_ON_ERROR(sample_pin_mv(&pin_mv, &kept), TAG, "sample");
+    int64_t sampled_us = esp_timer_get_time();
+    update_state(scale_voltage(pin_mv / 1000.0f), sampled_us);
+    ESP_LOGD(TAG, "%.3f V %.1f%% (%d/%d bursts, sample %" PRId64 " us, compute %" PRId64 " us)", s_status.voltage,
+             s_status.percent, kept, BATTERY_BURSTS, sampled_us - start_us, esp_timer_get_time() - sampled_us);
     if (voltage) {
-        *voltage = vbatt;
+        *voltage = s_status.voltage;
     }
     if (percent) {
-        *percent = voltage_to_percent(vbatt);
+        *percent = s_status.percent;
     }
     return ESP_OK;
 }
+
+void battery_monitor_get_status(battery_status_t *out)
+{
+    if (out) {
+        *out = s_status;
+    }
+}
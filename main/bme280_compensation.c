@@ -0,0 +1,125 @@
+#include "bme280_compensation.h"
+
+#include <string.h>
+
+void bme280_comp_parse_calib(const uint8_t block1[26], const uint8_t block2[7], bme280_calib_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->dig_T1 = (uint16_t)((block1[1] << 8) | block1[0]);
+    out->dig_T2 = (int16_t)((block1[3] << 8) | block1[2]);
+    out->dig_T3 = (int16_t)((block1[5] << 8) | block1[4]);
+
+    out->dig_P1 = (uint16_t)((block1[7] << 8) | block1[6]);
+    out->dig_P2 = (int16_t)((block1[9] << 8) | block1[8]);
+    out->dig_P3 = (int16_t)((block1[11] << 8) | block1[10]);
+    out->dig_P4 = (int16_t)((block1[13] << 8) | block1[12]);
+    out->dig_P5 = (int16_t)((block1[15] << 8) | block1[14]);
+    out->dig_P6 = (int16_t)((block1[17] << 8) | block1[16]);
+    out->dig_P7 = (int16_t)((block1[19] << 8) | block1[18]);
+    out->dig_P8 = (int16_t)((block1[21] << 8) | block1[20]);
+    out->dig_P9 = (int16_t)((block1[23] << 8) | block1[22]);
+
+    if (!block2) {
+        return; // BMP280: no humidity trimming
+    }
+    out->dig_H1 = block1[25];
+    out->dig_H2 = (int16_t)((block2[1] << 8) | block2[0]);
+    out->dig_H3 = block2[2];
+    // H4/H5 are signed 12-bit values sharing 0xE5; the MSB byte carries the sign.
+    out->dig_H4 = (int16_t)(((int8_t)block2[3] * 16) | (block2[4] & 0x0F));
+    out->dig_H5 = (int16_t)(((int8_t)block2[5] * 16) | (block2[4] >> 4));
+    out->dig_H6 = (int8_t)block2[6];
+}
+
+void bme280_comp_build_table(const bme280_calib_t *calib, bool has_humidity, bme280_comp_table_t *table)
+{
+    table->t1 = (int32_t)calib->dig_T1;
+    table->t1_x2 = (int32_t)calib->dig_T1 << 1;
+    table->t2 = calib->dig_T2;
+    table->t3 = calib->dig_T3;
+    table->p1 = (int32_t)calib->dig_P1;
+    table->p2 = calib->dig_P2;
+    table->p3 = calib->dig_P3;
+    table->p4_s16 = (int32_t)calib->dig_P4 * 65536;
+    table->p5 = calib->dig_P5;
+    table->p6 = calib->dig_P6;
+    table->p7 = calib->dig_P7;
+    table->p8 = calib->dig_P8;
+    table->p9 = calib->dig_P9;
+    table->h1 = calib->dig_H1;
+    table->h2 = calib->dig_H2;
+    table->h3 = calib->dig_H3;
+    table->h4_s20 = (int32_t)calib->dig_H4 * 1048576;
+    table->h5 = calib->dig_H5;
+    table->h6 = calib->dig_H6;
+    table->has_humidity = has_humidity;
+}
+
+void bme280_comp_unpack_raw(const uint8_t data[8], bme280_raw_sample_t *out)
+{
+    out->adc_P = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+    out->adc_T = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+    out->adc_H = ((int32_t)data[6] << 8) | data[7];
+}
+
+int32_t bme280_comp_t_fine(const bme280_comp_table_t *table, int32_t adc_T)
+{
+    int32_t var1 = (((adc_T >> 3) - table->t1_x2) * table->t2) >> 11;
+    int32_t d = (adc_T >> 4) - table->t1;
+    int32_t var2 = (((d * d) >> 12) * table->t3) >> 14;
+    return var1 + var2;
+}
+
+static uint32_t compensate_pressure(const bme280_comp_table_t *table, int32_t adc_P, int32_t t_fine)
+{
+    int32_t var1 = (t_fine >> 1) - 64000;
+    int32_t var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * table->p6;
+    var2 = var2 + ((var1 * table->p5) << 1);
+    var2 = (var2 >> 2) + table->p4_s16;
+    var1 = (((table->p3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((table->p2 * var1) >> 1)) >> 18;
+    var1 = ((32768 + var1) * table->p1) >> 15;
+    if (var1 == 0) {
+        return 0; // avoid division by zero on blank calibration
+    }
+    uint32_t p = ((uint32_t)(1048576 - adc_P) - (uint32_t)(var2 >> 12)) * 3125U;
+    if (p < 0x80000000U) {
+        p = (p << 1) / (uint32_t)var1;
+    } else {
+        p = (p / (uint32_t)var1) * 2U;
+    }
+    var1 = (table->p9 * (int32_t)(((p >> 3) * (p >> 3)) >> 13)) >> 12;
+    var2 = ((int32_t)(p >> 2) * table->p8) >> 13;
+    return (uint32_t)((int32_t)p + ((var1 + var2 + table->p7) >> 4));
+}
+
+static uint32_t compensate_humidity_q10(const bme280_comp_table_t *table, int32_t adc_H, int32_t t_fine)
+{
+    int32_t v = t_fine - 76800;
+    v = (((((adc_H << 14) - table->h4_s20 - (table->h5 * v)) + 16384) >> 15) *
+         (((((((v * table->h6) >> 10) * (((v * table->h3) >> 11) + 32768)) >> 10) + 2097152) * table->h2 + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * table->h1) >> 4);
+    v = v < 0 ? 0 : v;
+    v = v > 419430400 ? 419430400 : v;
+    return (uint32_t)(v >> 12);
+}
+
+void bme280_comp_sample(const bme280_comp_table_t *table, const bme280_raw_sample_t *raw, bme280_fixed_sample_t *out)
+{
+    int32_t t_fine = bme280_comp_t_fine(table, raw->adc_T);
+    out->temperature_centi_c = (t_fine * 5 + 128) >> 8;
+    out->pressure_pa = compensate_pressure(table, raw->adc_P, t_fine);
+    if (table->has_humidity) {
+        // Q22.10 %RH -> milli-%RH, rounded; max 102400 * 1000 fits comfortably in 32 bits
+        out->humidity_milli_pct = (compensate_humidity_q10(table, raw->adc_H, t_fine) * 1000U + 512U) >> 10;
+    } else {
+        out->humidity_milli_pct = 0;
+    }
+}
+
+void bme280_comp_batch(const bme280_comp_table_t *table, const bme280_raw_sample_t *raw,
+                       bme280_fixed_sample_t *out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        bme280_comp_sample(table, &raw[i], &out[i]);
+    }
+}
@@ -1,42 +1,38 @@
 #include "bme280_sensor.h"
 
+#include "bme280_compensation.h"
 #include "esp_check.h"
+#include "esp_cpu.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
+#include <string.h>
 
 #define TAG "bme280"
 #define BME280_DEFAULT_ADDR 0x76
 #define BME280_ALT_ADDR 0x77
 #define I2C_TIMEOUT_MS 100
 
-typedef struct {
-    uint16_t dig_T1;
-    int16_t dig_T2;
-    int16_t dig_T3;
-    uint16_t dig_P1;
-    int16_t dig_P2;
-    int16_t dig_P3;
-    int16_t dig_P4;
-    int16_t dig_P5;
-    int16_t dig_P6;
-    int16_t dig_P7;
-    int16_t dig_P8;
-    int16_t dig_P9;
-    uint8_t dig_H1;
-    int16_t dig_H2;
-    uint8_t dig_H3;
-    int16_t dig_H4;
-    int16_t dig_H5;
-    int8_t dig_H6;
-} bme280_calib_data_t;
-
-static bme280_calib_data_t s_calib;
+#define BME280_REG_CTRL_HUM 0xF2
+#define BME280_REG_STATUS 0xF3
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_REG_CONFIG 0xF5
+#define BME280_REG_DATA 0xF7
+#define BME280_DATA_LEN 8
+#define BME280_CTRL_MODE_SLEEP 0x00
+#define BME280_CTRL_MODE_FORCED 0x01
+#define BME280_CTRL_MODE_NORMAL 0x03
+
+static bme280_comp_table_t s_comp;
 static bool s_driver_ready = false;
 static bool s_calib_ready = false;
 static i2c_port_t s_port = I2C_NUM_0;
 static uint8_t s_addr = BME280_ALT_ADDR; // prefer 0x77 (observed on module)
 static bool s_is_bmp280 = false; // false = BME280 (temp+hum+press), true = BMP280 (temp+press only)
+static bme280_settings_t s_settings = BME280_DEFAULT_SETTINGS();
+static bool s_settings_applied = false; // false after reset: registers hold power-on defaults
+static int64_t s_first_sample_us = 0;   // normal mode: first conversion is valid after this time
 
 static esp_err_t i2c_bus_init(i2c_port_t port, gpio_num_t sda_pin, gpio_num_t scl_pin)
 {
@@ -120,123 +116,137 @@ static esp_err_t probe_address(uint8_t addr)
 static esp_err_t read_calibration(void)
 {
     uint8_t buf1[26];
+    uint8_t buf2[7];
     ESP_RETURN_ON_ERROR(i2c_read(s_addr, 0x88, buf1, sizeof(buf1)), TAG, "calib block1");
-
-    s_calib.dig_T1 = (uint16_t)((buf1[1] << 8) | buf1[0]);
-    s_calib.dig_T2 = (int16_t)((buf1[3] << 8) | buf1[2]);
-    s_calib.dig_T3 = (int16_t)((buf1[5] << 8) | buf1[4]);
-
-    s_calib.dig_P1 = (uint16_t)((buf1[7] << 8) | buf1[6]);
-    s_calib.dig_P2 = (int16_t)((buf1[9] << 8) | buf1[8]);
-    s_calib.dig_P3 = (int16_t)((buf1[11] << 8) | buf1[10]);
-    s_calib.dig_P4 = (int16_t)((buf1[13] << 8) | buf1[12]);
-    s_calib.dig_P5 = (int16_t)((buf1[15] << 8) | buf1[14]);
-    s_calib.dig_P6 = (int16_t)((buf1[17] << 8) | buf1[16]);
-    s_calib.dig_P7 = (int16_t)((buf1[19] << 8) | buf1[18]);
-    s_calib.dig_P8 = (int16_t)((buf1[21] << 8) | buf1[20]);
-    s_calib.dig_P9 = (int16_t)((buf1[23] << 8) | buf1[22]);
     if (!s_is_bmp280) {
-        s_calib.dig_H1 = buf1[25];
-        uint8_t buf2[7];
         ESP_RETURN_ON_ERROR(i2c_read(s_addr, 0xE1, buf2, sizeof(buf2)), TAG, "calib block2");
-        s_calib.dig_H2 = (int16_t)((buf2[1] << 8) | buf2[0]);
-        s_calib.dig_H3 = buf2[2];
-        s_calib.dig_H4 = (int16_t)((buf2[3] << 4) | (buf2[4] & 0x0F));
-        s_calib.dig_H5 = (int16_t)((buf2[5] << 4) | (buf2[4] >> 4));
-        s_calib.dig_H6 = (int8_t)buf2[6];
-    } else {
-        s_calib.dig_H1 = 0;
-        s_calib.dig_H2 = 0;
-        s_calib.dig_H3 = 0;
-        s_calib.dig_H4 = 0;
-        s_calib.dig_H5 = 0;
-        s_calib.dig_H6 = 0;
     }
 
+    bme280_calib_t calib;
+    bme280_comp_parse_calib(buf1, s_is_bmp280 ? NULL : buf2, &calib);
+    bme280_comp_build_table(&calib, !s_is_bmp280, &s_comp);
     s_calib_ready = true;
     return ESP_OK;
 }
 
-static float compensate_temperature(int32_t adc_T, int32_t *t_fine)
+static uint8_t settings_ctrl_meas(const bme280_settings_t *settings, uint8_t mode_bits)
 {
-    int32_t var1 = ((((adc_T >> 3) - ((int32_t)s_calib.dig_T1 << 1))) * ((int32_t)s_calib.dig_T2)) >> 11;
-    int32_t var2 = (((((adc_T >> 4) - ((int32_t)s_calib.dig_T1)) * ((adc_T >> 4) - ((int32_t)s_calib.dig_T1))) >> 12) *
-                    ((int32_t)s_calib.dig_T3)) >> 14;
-    *t_fine = var1 + var2;
-    float T = (float)((*t_fine * 5 + 128) >> 8);
-    return T / 100.0f;
+    return (uint8_t)(((settings->osrs_t & 0x07) << 5) | ((settings->osrs_p & 0x07) << 2) | mode_bits);
 }
 
-static float compensate_pressure(int32_t adc_P, int32_t t_fine)
+static uint8_t settings_config(const bme280_settings_t *settings)
 {
-    int64_t var1 = ((int64_t)t_fine) - 128000;
-    int64_t var2 = var1 * var1 * (int64_t)s_calib.dig_P6;
-    var2 = var2 + ((var1 * (int64_t)s_calib.dig_P5) << 17);
-    var2 = var2 + (((int64_t)s_calib.dig_P4) << 35);
-    var1 = ((var1 * var1 * (int64_t)s_calib.dig_P3) >> 8) + ((var1 * (int64_t)s_calib.dig_P2) << 12);
-    var1 = (((((int64_t)1) << 47) + var1) * (int64_t)s_calib.dig_P1) >> 33;
-
-    if (var1 == 0) {
-        return 0.0f;
-    }
-
-    int64_t p = 1048576 - adc_P;
-    p = (((p << 31) - var2) * 3125) / var1;
-    var1 = ((int64_t)s_calib.dig_P9 * (p >> 13) * (p >> 13)) >> 25;
-    var2 = ((int64_t)s_calib.dig_P8 * p) >> 19;
-    p = ((p + var1 + var2) >> 8) + (((int64_t)s_calib.dig_P7) << 4);
+    return (uint8_t)(((settings->standby & 0x07) << 5) | ((settings->filter & 0x07) << 2));
+}
 
-    return (float)p / 25600.0f; // hPa
+static bool settings_equal(const bme280_settings_t *a, const bme280_settings_t *b)
+{
+    return a->mode == b->mode &&
+           a->osrs_t == b->osrs_t &&
+           a->osrs_p == b->osrs_p &&
+           a->osrs_h == b->osrs_h &&
+           a->filter == b->filter &&
+           a->standby == b->standby;
 }
 
-static float compensate_humidity(int32_t adc_H, int32_t t_fine)
+uint32_t bme280_sensor_measurement_time_us(const bme280_settings_t *settings)
 {
-    if (s_is_bmp280) {
-        return 0.0f;
+    // Datasheet appendix B: t_measure,max = 1.25 + 2.3*T + (2.3*P + 0.575) + (2.3*H + 0.575) ms
+    static const uint8_t k_osrs_factor[] = {0, 1, 2, 4, 8, 16};
+    if (!settings) {
+        return 0;
+    }
+    uint32_t t = k_osrs_factor[settings->osrs_t <= BME280_OSRS_X16 ? settings->osrs_t : BME280_OSRS_X16];
+    uint32_t p = k_osrs_factor[settings->osrs_p <= BME280_OSRS_X16 ? settings->osrs_p : BME280_OSRS_X16];
+    uint32_t h = s_is_bmp280 ? 0 : k_osrs_factor[settings->osrs_h <= BME280_OSRS_X16 ? settings->osrs_h : BME280_OSRS_X16];
+    uint32_t us = 1250 + 2300 * t;
+    if (p) {
+        us += 2300 * p + 575;
     }
-    int32_t v_x1_u32r = t_fine - 76800;
-    v_x1_u32r = (((((adc_H << 14) - (((int32_t)s_calib.dig_H4) << 20) - (((int32_t)s_calib.dig_H5) * v_x1_u32r)) + 16384) >> 15) *
-                 (((((((v_x1_u32r * ((int32_t)s_calib.dig_H6)) >> 10) * (((v_x1_u32r * ((int32_t)s_calib.dig_H3)) >> 11) + 32768)) >> 10) + 2097152) *
-                    ((int32_t)s_calib.dig_H2) + 8192) >> 14));
-    v_x1_u32r = v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((int32_t)s_calib.dig_H1)) >> 4);
-    v_x1_u32r = v_x1_u32r < 0 ? 0 : v_x1_u32r;
-    v_x1_u32r = v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r;
-    float h = (float)(v_x1_u32r >> 12) / 1024.0f;
-    if (h > 100.0f) {
-        h = 100.0f;
+    if (h) {
+        us += 2300 * h + 575;
     }
-    return h;
+    return us;
 }
 
-static esp_err_t trigger_measurement(void)
+static void sleep_at_least_us(uint32_t us)
 {
-    const uint8_t ctrl_meas = (0x02 << 5) |     // x2 oversampling temperature
-                              (0x03 << 2) |     // x4 oversampling pressure
-                              0x01;             // forced mode
-    const uint8_t config = (0x02 << 2);         // IIR filter coeff = 4
+    // Round up and add one tick: a one-tick vTaskDelay may return almost immediately.
+    const uint32_t tick_us = 1000000U / configTICK_RATE_HZ;
+    vTaskDelay((TickType_t)((us + tick_us - 1) / tick_us) + 1);
+}
+
+static esp_err_t apply_settings(const bme280_settings_t *settings)
+{
+    if (s_settings_applied && settings_equal(settings, &s_settings)) {
+        return ESP_OK;
+    }
+
+    // config is only reliably written in sleep mode, so park the sensor first when streaming.
+    if (s_settings_applied && s_settings.mode == BME280_MODE_NORMAL) {
+        const uint8_t sleep_meas = settings_ctrl_meas(&s_settings, BME280_CTRL_MODE_SLEEP);
+        ESP_RETURN_ON_ERROR(i2c_write(s_addr, BME280_REG_CTRL_MEAS, &sleep_meas, 1), TAG, "sleep");
+    }
 
-    ESP_RETURN_ON_ERROR(i2c_write(s_addr, 0xF5, &config, 1), TAG, "config");
+    // Register writes are (reg, value) pairs; one transaction covers config, ctrl_hum and ctrl_meas.
+    // ctrl_hum only latches on the following ctrl_meas write, which is why it comes before it.
+    const uint8_t mode_bits = (settings->mode == BME280_MODE_NORMAL) ? BME280_CTRL_MODE_NORMAL : BME280_CTRL_MODE_SLEEP;
+    uint8_t pairs[5];
+    size_t len = 0;
+    pairs[len++] = settings_config(settings);
     if (!s_is_bmp280) {
-        const uint8_t ctrl_hum = 0x01;          // x1 oversampling humidity
-        ESP_RETURN_ON_ERROR(i2c_write(s_addr, 0xF2, &ctrl_hum, 1), TAG, "ctrl_hum");
+        pairs[len++] = BME280_REG_CTRL_HUM;
+        pairs[len++] = (uint8_t)(settings->osrs_h & 0x07);
+    }
+    pairs[len++] = BME280_REG_CTRL_MEAS;
+    pairs[len++] = settings_ctrl_meas(settings, mode_bits);
+    ESP_RETURN_ON_ERROR(i2c_write(s_addr, BME280_REG_CONFIG, pairs, len), TAG, "settings");
+
+    s_settings = *settings;
+    s_settings_applied = true;
+    if (settings->mode == BME280_MODE_NORMAL) {
+        s_first_sample_us = esp_timer_get_time() + bme280_sensor_measurement_time_us(settings);
     }
-    ESP_RETURN_ON_ERROR(i2c_write(s_addr, 0xF4, &ctrl_meas, 1), TAG, "ctrl_meas");
+    ESP_LOGI(TAG, "Settings applied: mode=%s osrs t/p/h=%d/%d/%d filter=%d standby=%d (t_meas=%luus)",
+             settings->mode == BME280_MODE_NORMAL ? "normal" : "forced",
+             settings->osrs_t, settings->osrs_p, settings->osrs_h, settings->filter, settings->standby,
+             (unsigned long)bme280_sensor_measurement_time_us(settings));
     return ESP_OK;
 }
 
-static esp_err_t wait_for_measurement(void)
+static esp_err_t read_forced_sample(uint8_t *data)
 {
-    for (int i = 0; i < 30; ++i) {
-        uint8_t status = 0;
-        ESP_RETURN_ON_ERROR(i2c_read(s_addr, 0xF3, &status, 1), TAG, "status");
-        if ((status & 0x08) == 0) {
+    const uint8_t ctrl_meas = settings_ctrl_meas(&s_settings, BME280_CTRL_MODE_FORCED);
+    ESP_RETURN_ON_ERROR(i2c_write(s_addr, BME280_REG_CTRL_MEAS, &ctrl_meas, 1), TAG, "trigger");
+
+    const uint32_t wait_us = bme280_sensor_measurement_time_us(&s_settings);
+    sleep_at_least_us(wait_us);
+
+    // One burst from status (0xF3) through hum_lsb (0xFE) confirms completion and fetches the sample.
+    uint8_t burst[BME280_REG_DATA + BME280_DATA_LEN - BME280_REG_STATUS];
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        ESP_RETURN_ON_ERROR(i2c_read(s_addr, BME280_REG_STATUS, burst, sizeof(burst)), TAG, "read data");
+        const uint8_t status = burst[0];
+        const uint8_t mode_bits = burst[BME280_REG_CTRL_MEAS - BME280_REG_STATUS] & 0x03;
+        if ((status & 0x08) == 0 && mode_bits == BME280_CTRL_MODE_SLEEP) {
+            memcpy(data, &burst[BME280_REG_DATA - BME280_REG_STATUS], BME280_DATA_LEN);
             return ESP_OK;
         }
-        vTaskDelay(pdMS_TO_TICKS(5));
+        sleep_at_least_us(wait_us / 4);
     }
     return ESP_ERR_TIMEOUT;
 }
 
+static esp_err_t read_normal_sample(uint8_t *data)
+{
+    int64_t remaining_us = s_first_sample_us - esp_timer_get_time();
+    if (remaining_us > 0) {
+        sleep_at_least_us((uint32_t)remaining_us);
+    }
+    ESP_RETURN_ON_ERROR(i2c_read(s_addr, BME280_REG_DATA, data, BME280_DATA_LEN), TAG, "read data");
+    return ESP_OK;
+}
+
 esp_err_t bme280_sensor_init(i2c_port_t port, gpio_num_t sda_pin, gpio_num_t scl_pin)
 {
     s_port = port;
@@ -254,40 +264,95 @@ esp_err_t bme280_sensor_init(i2c_port_t port, gpio_num_t sda_pin, gpio_num_t scl
     vTaskDelay(pdMS_TO_TICKS(5));
 
     ESP_RETURN_ON_ERROR(read_calibration(), TAG, "calib");
+    s_settings_applied = false;
     s_driver_ready = true;
     ESP_LOGI(TAG, "Detected BME280 at 0x%02X", s_addr);
     return ESP_OK;
 }
 
-esp_err_t bme280_sensor_read(float *temperature_c, float *humidity_percent, float *pressure_hpa)
+esp_err_t bme280_sensor_configure(const bme280_settings_t *settings)
 {
+    if (!settings) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_driver_ready) {
+        // Remember the choice; it is written on the first read after init
+        s_settings = *settings;
+        s_settings_applied = false;
+        return ESP_OK;
+    }
+    return apply_settings(settings);
+}
+
+esp_err_t bme280_sensor_read_raw(bme280_raw_sample_t *out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
     if (!s_driver_ready || !s_calib_ready) {
         return ESP_ERR_INVALID_STATE;
     }
+    if (!s_settings_applied) {
+        ESP_RETURN_ON_ERROR(apply_settings(&s_settings), TAG, "settings");
+    }
 
-    ESP_RETURN_ON_ERROR(trigger_measurement(), TAG, "trigger");
-    ESP_RETURN_ON_ERROR(wait_for_measurement(), TAG, "wait");
+    uint8_t data[BME280_DATA_LEN];
+    if (s_settings.mode == BME280_MODE_NORMAL) {
+        ESP_RETURN_ON_ERROR(read_normal_sample(data), TAG, "normal sample");
+    } else {
+        ESP_RETURN_ON_ERROR(read_forced_sample(data), TAG, "forced sample");
+    }
 
-    uint8_t data[8];
-    ESP_RETURN_ON_ERROR(i2c_read(s_addr, 0xF7, data, sizeof(data)), TAG, "read data");
+    bme280_comp_unpack_raw(data, out);
+    if (out->adc_T == 0x80000) {
+        // Reset value of the data registers: no conversion has completed yet (or the sensor
+        // lost power and fell back to sleep), so rewrite the settings on the next read.
+        s_settings_applied = false;
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
 
-    int32_t adc_P = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
-    int32_t adc_T = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
-    int32_t adc_H = ((int32_t)data[6] << 8) | data[7];
+const bme280_comp_table_t *bme280_sensor_comp_table(void)
+{
+    return s_calib_ready ? &s_comp : NULL;
+}
 
-    int32_t t_fine = 0;
-    float temp = compensate_temperature(adc_T, &t_fine);
-    float pressure = compensate_pressure(adc_P, t_fine);
-    float humidity = compensate_humidity(adc_H, t_fine);
+esp_err_t bme280_sensor_read_fixed(bme280_fixed_sample_t *out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bme280_raw_sample_t raw;
+    ESP_RETURN_ON_ERROR(bme280_sensor_read_raw(&raw), TAG, "raw");
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    bme280_comp_sample(&s_comp, &raw, out);
+    ESP_LOGD(TAG, "compensation took %lu cycles", (unsigned long)(esp_cpu_get_cycle_count() - start));
+    return ESP_OK;
+}
+
+bool bme280_sensor_has_humidity(void)
+{
+    return s_driver_ready && !s_is_bmp280;
+}
+
+esp_err_t bme280_sensor_read(float *temperature_c, float *humidity_percent, float *pressure_hpa)
+{
+    bme280_fixed_sample_t sample;
+    esp_err_t err = bme280_sensor_read_fixed(&sample);
+    if (err != ESP_OK) {
+        return err;
+    }
 
     if (temperature_c) {
-        *temperature_c = temp;
+        *temperature_c = sample.temperature_centi_c / 100.0f;
     }
     if (humidity_percent) {
-        *humidity_percent = humidity;
+        *humidity_percent = sample.humidity_milli_pct / 1000.0f;
     }
     if (pressure_hpa) {
-        *pressure_hpa = pressure;
+        *pressure_hpa = sample.pressure_pa / 100.0f;
     }
 
     return ESP_OK;
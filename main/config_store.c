@@ -2,8 +2,16 @@
 
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 
@@ -14,6 +22,8 @@
 #define KEY_AIR "int_a"
 #define KEY_SEA "int_s"
 #define KEY_DISPLAY "disp_sec"
+#define KEY_DISPLAY_OFF "disp_off"
+#define KEY_DISPLAY_DIM "disp_dim"
 #define KEY_NAME "dev_name"
 #define KEY_WIFI "int_wifi"
 #define KEY_WEB "int_web"
@@ -24,10 +34,80 @@
 #define KEY_OFF_WATER "off_w"
 #define KEY_OFF_SEA "off_s"
 #define KEY_OFF_AIR "off_a"
-#define CONFIG_VERSION 6
+#define KEY_RECORD "cfg"
+#define CONFIG_LEGACY_VERSION 6 // last layout with one NVS key per field
+#define CONFIG_RECORD_VERSION 7
+#define CONFIG_RECORD_MAGIC 0x4353 // "SC"
+#define CONFIG_RECORD_MAX_LEN 512  // room for records written by newer firmware
 #define DISPLAY_ON_SECONDS_MAX 3600U
+#define DISPLAY_OFF_SECONDS_MAX 43200U
+
+// On-flash record: header + payload, little-endian and packed. Fields are only ever
+// appended; a shorter payload from older firmware is read over a defaults-filled record,
+// and changes in meaning get a step in migrate_record().
+typedef struct __attribute__((packed)) {
+    uint16_t minutes;
+    uint8_t seconds;
+} record_interval_t;
+
+typedef struct __attribute__((packed)) {
+    record_interval_t battery;
+    record_interval_t air;
+    record_interval_t sea;
+    record_interval_t wifi;
+    record_interval_t web_ui;
+    uint16_t display_on_seconds;
+    uint16_t display_off_seconds;
+    uint8_t display_dim;
+    char device_name[CONFIG_STORE_MAX_NAME_LEN];
+    char wifi_ssid[CONFIG_STORE_MAX_WIFI_SSID_LEN];
+    char wifi_password[CONFIG_STORE_MAX_WIFI_PASS_LEN];
+    uint32_t screen_items[2];
+    int32_t offsets_milli[3]; // water, sea level, air
+    char mqtt_uri[CONFIG_STORE_MAX_MQTT_URI_LEN];
+    char mqtt_username[CONFIG_STORE_MAX_MQTT_USER_LEN];
+    char mqtt_password[CONFIG_STORE_MAX_MQTT_PASS_LEN];
+    char mqtt_topic[CONFIG_STORE_MAX_MQTT_TOPIC_LEN];
+} config_record_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t length; // payload bytes
+    uint32_t crc;    // CRC-32 of the payload
+} config_record_header_t;
+
+static const char *const k_legacy_keys[] = {
+    KEY_VERSION, KEY_BATT, KEY_AIR, KEY_SEA, KEY_DISPLAY, KEY_DISPLAY_OFF, KEY_DISPLAY_DIM, KEY_NAME, KEY_WIFI,
+    KEY_WEB, KEY_WIFI_SSID, KEY_WIFI_PASS, KEY_SCR1, KEY_SCR2, KEY_OFF_WATER, KEY_OFF_SEA, KEY_OFF_AIR,
+};
 
-static measurement_config_t s_config;
+// Published generations live in a small ring: config_store_set fills a slot that is neither
+// current nor pinned by config_store_acquire and then swaps the pointer. The slot that was
+// current is therefore not reused by the next set, only by a later one, unless it is pinned.
+#define CONFIG_PUBLISH_SLOTS 4
+#define CONFIG_PUBLISH_WAIT_MS 10 // every free slot pinned: poll until a reader releases one
+
+typedef struct {
+    measurement_config_t cfg;
+    uint32_t generation;
+    _Atomic uint32_t readers; // config_store_acquire pins
+} published_config_t;
+
+typedef struct {
+    config_store_listener_t fn;
+    void *ctx;
+} config_listener_t;
+
+static measurement_config_t s_config; // working copy while loading
+static published_config_t s_published[CONFIG_PUBLISH_SLOTS];
+static published_config_t *_Atomic s_current = &s_published[0];
+static config_listener_t s_listeners[CONFIG_STORE_MAX_LISTENERS];
+static size_t s_listener_count;
+static SemaphoreHandle_t s_write_lock; // one writer at a time: NVS diff cache, ring slot, listeners
+static uint8_t s_stored[sizeof(config_record_header_t) + sizeof(config_record_t)]; // last record in NVS
+static size_t s_stored_len; // 0 until a record is known to be in NVS
 static const char *const k_screen_item_names[SCREEN_ITEM_COUNT] = {
     [SCREEN_ITEM_WATER_TEMP] = "water_temp",
     [SCREEN_ITEM_SEA_LEVEL] = "sea_level",
@@ -121,6 +201,16 @@ static uint16_t default_display_on_seconds(void)
     return 30;
 }
 
+static uint16_t default_display_off_seconds(void)
+{
+    return 600;
+}
+
+static const char *default_mqtt_topic(void)
+{
+    return "seasensor";
+}
+
 static const char *default_device_name(void)
 {
     return "sea";
@@ -163,6 +253,14 @@ static uint16_t sanitize_display_on_seconds(uint16_t seconds)
     return seconds;
 }
 
+static uint16_t sanitize_display_off_seconds(uint16_t seconds)
+{
+    if (seconds > DISPLAY_OFF_SECONDS_MAX) {
+        return DISPLAY_OFF_SECONDS_MAX;
+    }
+    return seconds;
+}
+
 static uint32_t sanitize_screen_mask(uint32_t mask, size_t index)
 {
     uint32_t valid_mask = (SCREEN_ITEM_COUNT >= 32) ? 0xFFFFFFFFU : ((1U << SCREEN_ITEM_COUNT) - 1U);
@@ -176,20 +274,24 @@ static uint32_t sanitize_screen_mask(uint32_t mask, size_t index)
     return mask;
 }
 
-static void load_defaults(void)
+static void load_defaults(measurement_config_t *cfg)
 {
-    s_config.battery = default_fast_interval();
-    s_config.air = default_fast_interval();
-    s_config.sea = default_fast_interval();
-    s_config.wifi = default_wifi_interval();
-    s_config.web_ui = default_web_interval();
-    s_config.display_on_seconds = default_display_on_seconds();
-    strlcpy(s_config.device_name, default_device_name(), sizeof(s_config.device_name));
-    strlcpy(s_config.wifi_ssid, default_wifi_ssid(), sizeof(s_config.wifi_ssid));
-    strlcpy(s_config.wifi_password, default_wifi_password(), sizeof(s_config.wifi_password));
-    s_config.screen_items[0] = default_screen_mask(0);
-    s_config.screen_items[1] = default_screen_mask(1);
-    s_config.offsets = (measurement_offsets_t){0};
+    cfg->battery = default_fast_interval();
+    cfg->air = default_fast_interval();
+    cfg->sea = default_fast_interval();
+    cfg->wifi = default_wifi_interval();
+    cfg->web_ui = default_web_interval();
+    cfg->display_on_seconds = default_display_on_seconds();
+    cfg->display_off_seconds = default_display_off_seconds();
+    cfg->display_dim = true;
+    strlcpy(cfg->device_name, default_device_name(), sizeof(cfg->device_name));
+    strlcpy(cfg->wifi_ssid, default_wifi_ssid(), sizeof(cfg->wifi_ssid));
+    strlcpy(cfg->wifi_password, default_wifi_password(), sizeof(cfg->wifi_password));
+    cfg->screen_items[0] = default_screen_mask(0);
+    cfg->screen_items[1] = default_screen_mask(1);
+    cfg->offsets = (measurement_offsets_t){0};
+    cfg->mqtt = (mqtt_settings_t){0};
+    strlcpy(cfg->mqtt.topic, default_mqtt_topic(), sizeof(cfg->mqtt.topic));
 }
 
 static esp_err_t ensure_nvs_ready(void)
@@ -214,6 +316,19 @@ static float clampf_range(float value, float min, float max)
     return value;
 }
 
+static void sanitize_mqtt_topic(char *topic)
+{
+    topic[CONFIG_STORE_MAX_MQTT_TOPIC_LEN - 1] = '\0';
+    size_t len = strlen(topic);
+    while (len > 0 && topic[len - 1] == '/') {
+        topic[--len] = '\0';
+    }
+    // A base topic is published to, so wildcards are never valid in it
+    if (len == 0 || strpbrk(topic, "+#") != NULL) {
+        strlcpy(topic, default_mqtt_topic(), CONFIG_STORE_MAX_MQTT_TOPIC_LEN);
+    }
+}
+
 static void normalize_config(measurement_config_t *cfg)
 {
     config_store_normalize_interval(&cfg->battery);
@@ -222,6 +337,7 @@ static void normalize_config(measurement_config_t *cfg)
     config_store_normalize_interval(&cfg->wifi);
     config_store_normalize_interval(&cfg->web_ui);
     cfg->display_on_seconds = sanitize_display_on_seconds(cfg->display_on_seconds);
+    cfg->display_off_seconds = sanitize_display_off_seconds(cfg->display_off_seconds);
     sanitize_device_name(cfg->device_name);
     cfg->wifi_ssid[CONFIG_STORE_MAX_WIFI_SSID_LEN - 1] = '\0';
     cfg->wifi_password[CONFIG_STORE_MAX_WIFI_PASS_LEN - 1] = '\0';
@@ -230,61 +346,57 @@ static void normalize_config(measurement_config_t *cfg)
     cfg->offsets.water_temp_c = clampf_range(cfg->offsets.water_temp_c, -20.0f, 20.0f);
     cfg->offsets.sea_level_cm = clampf_range(cfg->offsets.sea_level_cm, -200.0f, 200.0f);
     cfg->offsets.air_temp_c = clampf_range(cfg->offsets.air_temp_c, -20.0f, 20.0f);
+    cfg->mqtt.uri[CONFIG_STORE_MAX_MQTT_URI_LEN - 1] = '\0';
+    cfg->mqtt.username[CONFIG_STORE_MAX_MQTT_USER_LEN - 1] = '\0';
+    cfg->mqtt.password[CONFIG_STORE_MAX_MQTT_PASS_LEN - 1] = '\0';
+    sanitize_mqtt_topic(cfg->mqtt.topic);
 }
 
-static esp_err_t load_from_nvs(void)
+// Reads the per-key layout used up to CONFIG_LEGACY_VERSION; false if there is none to import
+static bool load_legacy_keys(nvs_handle_t handle, measurement_config_t *cfg)
 {
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGI(TAG, "No stored configuration, using defaults");
-        load_defaults();
-        return ESP_OK;
-    }
-    ESP_RETURN_ON_ERROR(err, TAG, "nvs_open");
-
     int32_t version = 0;
-    err = nvs_get_i32(handle, KEY_VERSION, &version);
-    if (err != ESP_OK || version != CONFIG_VERSION) {
-        ESP_LOGW(TAG, "Config version mismatch (stored=%ld, expected=%d)", version, CONFIG_VERSION);
-        nvs_close(handle);
-        load_defaults();
-        return ESP_OK;
+    esp_err_t err = nvs_get_i32(handle, KEY_VERSION, &version);
+    if (err != ESP_OK || version != CONFIG_LEGACY_VERSION) {
+        if (err == ESP_OK) {
+            ESP_LOGW(TAG, "Legacy config version %" PRId32 " not importable, using defaults", version);
+        }
+        return false;
     }
 
     size_t len = sizeof(measurement_interval_t);
-    err = nvs_get_blob(handle, KEY_BATT, &s_config.battery, &len);
+    err = nvs_get_blob(handle, KEY_BATT, &cfg->battery, &len);
     if (err != ESP_OK || len != sizeof(measurement_interval_t)) {
         ESP_LOGW(TAG, "Failed to load battery interval, using default");
-        s_config.battery = default_fast_interval();
+        cfg->battery = default_fast_interval();
     }
 
     len = sizeof(measurement_interval_t);
-    err = nvs_get_blob(handle, KEY_AIR, &s_config.air, &len);
+    err = nvs_get_blob(handle, KEY_AIR, &cfg->air, &len);
     if (err != ESP_OK || len != sizeof(measurement_interval_t)) {
         ESP_LOGW(TAG, "Failed to load air interval, using default");
-        s_config.air = default_fast_interval();
+        cfg->air = default_fast_interval();
     }
 
     len = sizeof(measurement_interval_t);
-    err = nvs_get_blob(handle, KEY_SEA, &s_config.sea, &len);
+    err = nvs_get_blob(handle, KEY_SEA, &cfg->sea, &len);
     if (err != ESP_OK || len != sizeof(measurement_interval_t)) {
         ESP_LOGW(TAG, "Failed to load sea interval, using default");
-        s_config.sea = default_fast_interval();
+        cfg->sea = default_fast_interval();
     }
 
     len = sizeof(measurement_interval_t);
-    err = nvs_get_blob(handle, KEY_WIFI, &s_config.wifi, &len);
+    err = nvs_get_blob(handle, KEY_WIFI, &cfg->wifi, &len);
     if (err != ESP_OK || len != sizeof(measurement_interval_t)) {
         ESP_LOGW(TAG, "Failed to load Wi-Fi interval, using default");
-        s_config.wifi = default_wifi_interval();
+        cfg->wifi = default_wifi_interval();
     }
 
     len = sizeof(measurement_interval_t);
-    err = nvs_get_blob(handle, KEY_WEB, &s_config.web_ui, &len);
+    err = nvs_get_blob(handle, KEY_WEB, &cfg->web_ui, &len);
     if (err != ESP_OK || len != sizeof(measurement_interval_t)) {
         ESP_LOGW(TAG, "Failed to load Web UI interval, using default");
-        s_config.web_ui = default_web_interval();
+        cfg->web_ui = default_web_interval();
     }
 
     uint16_t display_seconds = default_display_on_seconds();
@@ -292,124 +404,429 @@ static esp_err_t load_from_nvs(void)
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to load display-on duration, using default");
     }
-    s_config.display_on_seconds = sanitize_display_on_seconds(display_seconds);
+    cfg->display_on_seconds = sanitize_display_on_seconds(display_seconds);
 
-    size_t name_len = sizeof(s_config.device_name);
-    err = nvs_get_str(handle, KEY_NAME, s_config.device_name, &name_len);
+    // Added without a version bump: older stores simply lack the keys and get the defaults
+    uint16_t display_off = default_display_off_seconds();
+    nvs_get_u16(handle, KEY_DISPLAY_OFF, &display_off);
+    cfg->display_off_seconds = sanitize_display_off_seconds(display_off);
+    uint8_t display_dim = 1;
+    nvs_get_u8(handle, KEY_DISPLAY_DIM, &display_dim);
+    cfg->display_dim = display_dim != 0;
+
+    size_t name_len = sizeof(cfg->device_name);
+    err = nvs_get_str(handle, KEY_NAME, cfg->device_name, &name_len);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to load device name, using default");
-        strlcpy(s_config.device_name, default_device_name(), sizeof(s_config.device_name));
+        strlcpy(cfg->device_name, default_device_name(), sizeof(cfg->device_name));
     }
-    sanitize_device_name(s_config.device_name);
+    sanitize_device_name(cfg->device_name);
 
-    size_t ssid_len = sizeof(s_config.wifi_ssid);
-    err = nvs_get_str(handle, KEY_WIFI_SSID, s_config.wifi_ssid, &ssid_len);
+    size_t ssid_len = sizeof(cfg->wifi_ssid);
+    err = nvs_get_str(handle, KEY_WIFI_SSID, cfg->wifi_ssid, &ssid_len);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to load Wi-Fi SSID, using default");
-        strlcpy(s_config.wifi_ssid, default_wifi_ssid(), sizeof(s_config.wifi_ssid));
+        strlcpy(cfg->wifi_ssid, default_wifi_ssid(), sizeof(cfg->wifi_ssid));
     }
 
-    size_t pass_len = sizeof(s_config.wifi_password);
-    err = nvs_get_str(handle, KEY_WIFI_PASS, s_config.wifi_password, &pass_len);
+    size_t pass_len = sizeof(cfg->wifi_password);
+    err = nvs_get_str(handle, KEY_WIFI_PASS, cfg->wifi_password, &pass_len);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to load Wi-Fi password, using default");
-        strlcpy(s_config.wifi_password, default_wifi_password(), sizeof(s_config.wifi_password));
+        strlcpy(cfg->wifi_password, default_wifi_password(), sizeof(cfg->wifi_password));
     }
 
     uint32_t screen_mask = 0;
     err = nvs_get_u32(handle, KEY_SCR1, &screen_mask);
     if (err == ESP_OK) {
-        s_config.screen_items[0] = screen_mask;
+        cfg->screen_items[0] = screen_mask;
     } else {
-        s_config.screen_items[0] = default_screen_mask(0);
+        cfg->screen_items[0] = default_screen_mask(0);
     }
     err = nvs_get_u32(handle, KEY_SCR2, &screen_mask);
     if (err == ESP_OK) {
-        s_config.screen_items[1] = screen_mask;
+        cfg->screen_items[1] = screen_mask;
     } else {
-        s_config.screen_items[1] = default_screen_mask(1);
+        cfg->screen_items[1] = default_screen_mask(1);
     }
 
     int32_t offset_raw = 0;
     if (nvs_get_i32(handle, KEY_OFF_WATER, &offset_raw) == ESP_OK) {
-        s_config.offsets.water_temp_c = offset_raw / 1000.0f;
+        cfg->offsets.water_temp_c = offset_raw / 1000.0f;
     } else {
-        s_config.offsets.water_temp_c = 0.0f;
+        cfg->offsets.water_temp_c = 0.0f;
     }
     if (nvs_get_i32(handle, KEY_OFF_SEA, &offset_raw) == ESP_OK) {
-        s_config.offsets.sea_level_cm = offset_raw / 1000.0f;
+        cfg->offsets.sea_level_cm = offset_raw / 1000.0f;
     } else {
-        s_config.offsets.sea_level_cm = 0.0f;
+        cfg->offsets.sea_level_cm = 0.0f;
     }
     if (nvs_get_i32(handle, KEY_OFF_AIR, &offset_raw) == ESP_OK) {
-        s_config.offsets.air_temp_c = offset_raw / 1000.0f;
+        cfg->offsets.air_temp_c = offset_raw / 1000.0f;
     } else {
-        s_config.offsets.air_temp_c = 0.0f;
+        cfg->offsets.air_temp_c = 0.0f;
+    }
+
+    return true;
+}
+
+static record_interval_t interval_to_record(measurement_interval_t interval)
+{
+    return (record_interval_t){.minutes = interval.minutes, .seconds = interval.seconds};
+}
+
+static measurement_interval_t interval_from_record(record_interval_t interval)
+{
+    return (measurement_interval_t){.minutes = interval.minutes, .seconds = interval.seconds};
+}
+
+static void config_to_record(const measurement_config_t *cfg, config_record_t *rec)
+{
+    // Zero first so padding in the strings never differs between two encodings of one config
+    memset(rec, 0, sizeof(*rec));
+    rec->battery = interval_to_record(cfg->battery);
+    rec->air = interval_to_record(cfg->air);
+    rec->sea = interval_to_record(cfg->sea);
+    rec->wifi = interval_to_record(cfg->wifi);
+    rec->web_ui = interval_to_record(cfg->web_ui);
+    rec->display_on_seconds = cfg->display_on_seconds;
+    rec->display_off_seconds = cfg->display_off_seconds;
+    rec->display_dim = cfg->display_dim ? 1 : 0;
+    strlcpy(rec->device_name, cfg->device_name, sizeof(rec->device_name));
+    strlcpy(rec->wifi_ssid, cfg->wifi_ssid, sizeof(rec->wifi_ssid));
+    strlcpy(rec->wifi_password, cfg->wifi_password, sizeof(rec->wifi_password));
+    rec->screen_items[0] = cfg->screen_items[0];
+    rec->screen_items[1] = cfg->screen_items[1];
+    rec->offsets_milli[0] = (int32_t)lrintf(cfg->offsets.water_temp_c * 1000.0f);
+    rec->offsets_milli[1] = (int32_t)lrintf(cfg->offsets.sea_level_cm * 1000.0f);
+    rec->offsets_milli[2] = (int32_t)lrintf(cfg->offsets.air_temp_c * 1000.0f);
+    strlcpy(rec->mqtt_uri, cfg->mqtt.uri, sizeof(rec->mqtt_uri));
+    strlcpy(rec->mqtt_username, cfg->mqtt.username, sizeof(rec->mqtt_username));
+    strlcpy(rec->mqtt_password, cfg->mqtt.password, sizeof(rec->mqtt_password));
+    strlcpy(rec->mqtt_topic, cfg->mqtt.topic, sizeof(rec->mqtt_topic));
+}
+
+static void record_to_config(const config_record_t *rec, measurement_config_t *cfg)
+{
+    cfg->battery = interval_from_record(rec->battery);
+    cfg->air = interval_from_record(rec->air);
+    cfg->sea = interval_from_record(rec->sea);
+    cfg->wifi = interval_from_record(rec->wifi);
+    cfg->web_ui = interval_from_record(rec->web_ui);
+    cfg->display_on_seconds = rec->display_on_seconds;
+    cfg->display_off_seconds = rec->display_off_seconds;
+    cfg->display_dim = rec->display_dim != 0;
+    strlcpy(cfg->device_name, rec->device_name, sizeof(cfg->device_name));
+    strlcpy(cfg->wifi_ssid, rec->wifi_ssid, sizeof(cfg->wifi_ssid));
+    strlcpy(cfg->wifi_password, rec->wifi_password, sizeof(cfg->wifi_password));
+    cfg->screen_items[0] = rec->screen_items[0];
+    cfg->screen_items[1] = rec->screen_items[1];
+    cfg->offsets.water_temp_c = rec->offsets_milli[0] / 1000.0f;
+    cfg->offsets.sea_level_cm = rec->offsets_milli[1] / 1000.0f;
+    cfg->offsets.air_temp_c = rec->offsets_milli[2] / 1000.0f;
+    strlcpy(cfg->mqtt.uri, rec->mqtt_uri, sizeof(cfg->mqtt.uri));
+    strlcpy(cfg->mqtt.username, rec->mqtt_username, sizeof(cfg->mqtt.username));
+    strlcpy(cfg->mqtt.password, rec->mqtt_password, sizeof(cfg->mqtt.password));
+    strlcpy(cfg->mqtt.topic, rec->mqtt_topic, sizeof(cfg->mqtt.topic));
+}
+
+static size_t encode_record(const measurement_config_t *cfg, uint8_t *out)
+{
+    config_record_t rec;
+    config_to_record(cfg, &rec);
+    config_record_header_t hdr = {
+        .magic = CONFIG_RECORD_MAGIC,
+        .version = CONFIG_RECORD_VERSION,
+        .length = sizeof(rec),
+        .crc = esp_crc32_le(0, (const uint8_t *)&rec, sizeof(rec)),
+    };
+    memcpy(out, &hdr, sizeof(hdr));
+    memcpy(out + sizeof(hdr), &rec, sizeof(rec));
+    return sizeof(hdr) + sizeof(rec);
+}
+
+static bool migrate_record(uint8_t version, config_record_t *rec)
+{
+    // One case per past record version, each falling through to the next step, e.g.
+    //   case 7: rec->new_field = convert(rec->old_field); // fall through
+    (void)rec;
+    switch (version) {
+        case CONFIG_RECORD_VERSION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool decode_record(const uint8_t *data, size_t len, measurement_config_t *out)
+{
+    config_record_header_t hdr;
+    if (len < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.magic != CONFIG_RECORD_MAGIC || hdr.length != len - sizeof(hdr)) {
+        ESP_LOGW(TAG, "Config record malformed (%u bytes)", (unsigned)len);
+        return false;
+    }
+    if (esp_crc32_le(0, data + sizeof(hdr), hdr.length) != hdr.crc) {
+        ESP_LOGW(TAG, "Config record CRC mismatch");
+        return false;
+    }
+
+    measurement_config_t defaults;
+    load_defaults(&defaults);
+    config_record_t rec;
+    config_to_record(&defaults, &rec);
+    memcpy(&rec, data + sizeof(hdr), hdr.length < sizeof(rec) ? hdr.length : sizeof(rec));
+    if (hdr.version > CONFIG_RECORD_VERSION) {
+        // Written by newer firmware: the fields this build knows are still a valid prefix
+        ESP_LOGW(TAG, "Config record v%u is newer than v%d, reading known fields", hdr.version,
+                 CONFIG_RECORD_VERSION);
+    } else if (!migrate_record(hdr.version, &rec)) {
+        ESP_LOGW(TAG, "No migration from config record v%u", hdr.version);
+        return false;
+    }
+    record_to_config(&rec, out);
+    return true;
+}
+
+static esp_err_t erase_legacy_keys(nvs_handle_t handle)
+{
+    for (size_t i = 0; i < sizeof(k_legacy_keys) / sizeof(k_legacy_keys[0]); ++i) {
+        esp_err_t err = nvs_erase_key(handle, k_legacy_keys[i]);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t write_record(const measurement_config_t *cfg, bool drop_legacy)
+{
+    uint8_t record[sizeof(s_stored)];
+    size_t len = encode_record(cfg, record);
+    if (!drop_legacy && len == s_stored_len && memcmp(record, s_stored, len) == 0) {
+        return ESP_OK; // identical to what is already in flash
     }
 
+    int64_t start_us = esp_timer_get_time();
+    nvs_handle_t handle;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle), TAG, "nvs_open");
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_ERROR(nvs_set_blob(handle, KEY_RECORD, record, len), out, TAG, "set record");
+    if (drop_legacy) {
+        ESP_GOTO_ON_ERROR(erase_legacy_keys(handle), out, TAG, "erase legacy keys");
+    }
+    ESP_GOTO_ON_ERROR(nvs_commit(handle), out, TAG, "nvs_commit");
+    memcpy(s_stored, record, len);
+    s_stored_len = len;
+    ESP_LOGI(TAG, "Config record v%d saved (%u bytes) in %lld us", CONFIG_RECORD_VERSION, (unsigned)len,
+             (long long)(esp_timer_get_time() - start_us));
+
+out:
+    nvs_close(handle);
+    return ret;
+}
+
+static esp_err_t load_from_nvs(void)
+{
+    load_defaults(&s_config);
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No stored configuration, using defaults");
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "nvs_open");
+
+    uint8_t record[CONFIG_RECORD_MAX_LEN];
+    size_t len = sizeof(record);
+    err = nvs_get_blob(handle, KEY_RECORD, record, &len);
+    if (err == ESP_OK && decode_record(record, len, &s_config)) {
+        nvs_close(handle);
+        normalize_config(&s_config);
+        // Only a current-format record counts as stored; anything else is rewritten on next save
+        if (len == sizeof(s_stored) && record[offsetof(config_record_header_t, version)] == CONFIG_RECORD_VERSION) {
+            memcpy(s_stored, record, len);
+            s_stored_len = len;
+        }
+        return ESP_OK;
+    }
+
+    bool legacy = err == ESP_ERR_NVS_NOT_FOUND && load_legacy_keys(handle, &s_config);
     nvs_close(handle);
+    if (!legacy) {
+        load_defaults(&s_config);
+        return ESP_OK;
+    }
     normalize_config(&s_config);
+    ESP_LOGI(TAG, "Migrating per-key config v%d to record v%d", CONFIG_LEGACY_VERSION, CONFIG_RECORD_VERSION);
+    esp_err_t werr = write_record(&s_config, true);
+    if (werr != ESP_OK) {
+        ESP_LOGW(TAG, "Config migration not persisted: %s", esp_err_to_name(werr));
+    }
     return ESP_OK;
 }
 
+static const published_config_t *publish(const measurement_config_t *cfg)
+{
+    published_config_t *cur = atomic_load(&s_current);
+    published_config_t *next = NULL;
+    while (!next) {
+        for (size_t i = 1; i < CONFIG_PUBLISH_SLOTS && !next; ++i) {
+            published_config_t *slot = &s_published[(cur - s_published + i) % CONFIG_PUBLISH_SLOTS];
+            if (atomic_load(&slot->readers) == 0) {
+                next = slot;
+            }
+        }
+        if (!next) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_PUBLISH_WAIT_MS));
+        }
+    }
+    next->cfg = *cfg;
+    next->generation = cur->generation + 1;
+    atomic_store(&s_current, next);
+    return next;
+}
+
 esp_err_t config_store_init(void)
 {
     ESP_RETURN_ON_ERROR(ensure_nvs_ready(), TAG, "nvs_flash_init");
+    s_write_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(s_write_lock, ESP_ERR_NO_MEM, TAG, "write lock");
+    int64_t start_us = esp_timer_get_time();
     ESP_RETURN_ON_ERROR(load_from_nvs(), TAG, "load_from_nvs");
+    publish(&s_config);
+    ESP_LOGI(TAG, "Config loaded in %lld us", (long long)(esp_timer_get_time() - start_us));
     return ESP_OK;
 }
 
 measurement_config_t config_store_get(void)
 {
-    return s_config;
+    return atomic_load(&s_current)->cfg;
+}
+
+const measurement_config_t *config_store_current(uint32_t *generation)
+{
+    const published_config_t *cur = atomic_load(&s_current);
+    if (generation) {
+        *generation = cur->generation;
+    }
+    return &cur->cfg;
 }
 
-static esp_err_t write_interval(nvs_handle_t handle, const char *key, const measurement_interval_t *interval)
+const measurement_config_t *config_store_acquire(uint32_t *generation)
 {
-    return nvs_set_blob(handle, key, interval, sizeof(*interval));
+    while (true) {
+        published_config_t *cur = atomic_load(&s_current);
+        atomic_fetch_add(&cur->readers, 1);
+        // A writer only fills slots that are not current; if this one is still current after
+        // the pin, no writer can have been filling it and none will until it is released
+        if (atomic_load(&s_current) == cur) {
+            if (generation) {
+                *generation = cur->generation;
+            }
+            return &cur->cfg;
+        }
+        atomic_fetch_sub(&cur->readers, 1);
+    }
+}
+
+void config_store_release(const measurement_config_t *cfg)
+{
+    if (!cfg) {
+        return;
+    }
+    published_config_t *slot = (published_config_t *)((const char *)cfg - offsetof(published_config_t, cfg));
+    atomic_fetch_sub(&slot->readers, 1);
+}
+
+uint32_t config_store_generation(void)
+{
+    return atomic_load(&s_current)->generation;
+}
+
+esp_err_t config_store_subscribe(config_store_listener_t listener, void *ctx)
+{
+    if (!listener) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_listener_count >= CONFIG_STORE_MAX_LISTENERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_listeners[s_listener_count++] = (config_listener_t){.fn = listener, .ctx = ctx};
+    return ESP_OK;
 }
 
 esp_err_t config_store_set(const measurement_config_t *cfg)
 {
     measurement_config_t updated = *cfg;
     normalize_config(&updated);
-    nvs_handle_t handle;
-    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle), TAG, "nvs_open");
-
-    esp_err_t ret = ESP_OK;
-    ESP_GOTO_ON_ERROR(nvs_set_i32(handle, KEY_VERSION, CONFIG_VERSION), out, TAG, "set version");
-    ESP_GOTO_ON_ERROR(write_interval(handle, KEY_BATT, &updated.battery), out, TAG, "set batt");
-    ESP_GOTO_ON_ERROR(write_interval(handle, KEY_AIR, &updated.air), out, TAG, "set air");
-    ESP_GOTO_ON_ERROR(write_interval(handle, KEY_SEA, &updated.sea), out, TAG, "set sea");
-    ESP_GOTO_ON_ERROR(write_interval(handle, KEY_WIFI, &updated.wifi), out, TAG, "set wifi");
-    ESP_GOTO_ON_ERROR(write_interval(handle, KEY_WEB, &updated.web_ui), out, TAG, "set web");
-    ESP_GOTO_ON_ERROR(nvs_set_u16(handle, KEY_DISPLAY, updated.display_on_seconds), out, TAG, "set display");
-    ESP_GOTO_ON_ERROR(nvs_set_str(handle, KEY_NAME, updated.device_name), out, TAG, "set name");
-    ESP_GOTO_ON_ERROR(nvs_set_str(handle, KEY_WIFI_SSID, updated.wifi_ssid), out, TAG, "set wifi ssid");
-    ESP_GOTO_ON_ERROR(nvs_set_str(handle, KEY_WIFI_PASS, updated.wifi_password), out, TAG, "set wifi pass");
-    ESP_GOTO_ON_ERROR(nvs_set_u32(handle, KEY_SCR1, updated.screen_items[0]), out, TAG, "set scr1");
-    ESP_GOTO_ON_ERROR(nvs_set_u32(handle, KEY_SCR2, updated.screen_items[1]), out, TAG, "set scr2");
-    int32_t water_milli = (int32_t)lrintf(updated.offsets.water_temp_c * 1000.0f);
-    int32_t sea_milli = (int32_t)lrintf(updated.offsets.sea_level_cm * 1000.0f);
-    int32_t air_milli = (int32_t)lrintf(updated.offsets.air_temp_c * 1000.0f);
-    ESP_GOTO_ON_ERROR(nvs_set_i32(handle, KEY_OFF_WATER, water_milli), out, TAG, "set off water");
-    ESP_GOTO_ON_ERROR(nvs_set_i32(handle, KEY_OFF_SEA, sea_milli), out, TAG, "set off sea");
-    ESP_GOTO_ON_ERROR(nvs_set_i32(handle, KEY_OFF_AIR, air_milli), out, TAG, "set off air");
-    ESP_GOTO_ON_ERROR(nvs_commit(handle), out, TAG, "nvs_commit");
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    esp_err_t err = write_record(&updated, false);
+    if (err != ESP_OK) {
+        xSemaphoreGive(s_write_lock);
+        ESP_LOGE(TAG, "write record: %s", esp_err_to_name(err));
+        return err;
+    }
 
-    s_config = updated;
-    nvs_close(handle);
+    uint32_t changed = config_store_diff(&atomic_load(&s_current)->cfg, &updated);
+    if (changed != 0) {
+        const published_config_t *pub = publish(&updated);
+        for (size_t i = 0; i < s_listener_count; ++i) {
+            s_listeners[i].fn(&pub->cfg, changed, s_listeners[i].ctx);
+        }
+    }
+    xSemaphoreGive(s_write_lock);
     return ESP_OK;
-
-out:
-    nvs_close(handle);
-    return ret;
 }
 
 void config_store_reset_defaults(void)
 {
-    load_defaults();
-    (void)config_store_set(&s_config);
+    measurement_config_t defaults;
+    load_defaults(&defaults);
+    (void)config_store_set(&defaults);
+}
+
+void config_store_normalize(measurement_config_t *cfg)
+{
+    if (cfg) {
+        normalize_config(cfg);
+    }
+}
+
+static bool interval_equal(measurement_interval_t a, measurement_interval_t b)
+{
+    return a.minutes == b.minutes && a.seconds == b.seconds;
+}
+
+uint32_t config_store_diff(const measurement_config_t *a, const measurement_config_t *b)
+{
+    uint32_t mask = 0;
+    if (!interval_equal(a->battery, b->battery)) mask |= CONFIG_FIELD_BATTERY_INTERVAL;
+    if (!interval_equal(a->air, b->air)) mask |= CONFIG_FIELD_AIR_INTERVAL;
+    if (!interval_equal(a->sea, b->sea)) mask |= CONFIG_FIELD_SEA_INTERVAL;
+    if (!interval_equal(a->wifi, b->wifi)) mask |= CONFIG_FIELD_WIFI_INTERVAL;
+    if (!interval_equal(a->web_ui, b->web_ui)) mask |= CONFIG_FIELD_WEB_UI_INTERVAL;
+    if (a->display_on_seconds != b->display_on_seconds) mask |= CONFIG_FIELD_DISPLAY_ON;
+    if (a->display_off_seconds != b->display_off_seconds) mask |= CONFIG_FIELD_DISPLAY_OFF;
+    if (a->display_dim != b->display_dim) mask |= CONFIG_FIELD_DISPLAY_DIM;
+    if (strcmp(a->device_name, b->device_name) != 0) mask |= CONFIG_FIELD_DEVICE_NAME;
+    if (strcmp(a->wifi_ssid, b->wifi_ssid) != 0) mask |= CONFIG_FIELD_WIFI_SSID;
+    if (strcmp(a->wifi_password, b->wifi_password) != 0) mask |= CONFIG_FIELD_WIFI_PASSWORD;
+    if (a->screen_items[0] != b->screen_items[0] || a->screen_items[1] != b->screen_items[1]) {
+        mask |= CONFIG_FIELD_SCREENS;
+    }
+    if (a->offsets.water_temp_c != b->offsets.water_temp_c || a->offsets.sea_level_cm != b->offsets.sea_level_cm ||
+        a->offsets.air_temp_c != b->offsets.air_temp_c) {
+        mask |= CONFIG_FIELD_OFFSETS;
+    }
+    if (strcmp(a->mqtt.uri, b->mqtt.uri) != 0 || strcmp(a->mqtt.username, b->mqtt.username) != 0 ||
+        strcmp(a->mqtt.password, b->mqtt.password) != 0 || strcmp(a->mqtt.topic, b->mqtt.topic) != 0) {
+        mask |= CONFIG_FIELD_MQTT;
+    }
+    return mask;
 }
 
 uint32_t config_store_interval_to_seconds(measurement_interval_t interval)
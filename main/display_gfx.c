@@ -0,0 +1,175 @@
+#include "display_gfx.h"
+
+#include <math.h>
+#include <string.h>
+
+#define GLYPH_COLUMNS (DISPLAY_GFX_FONT_WIDTH - 1)
+
+static const uint8_t g_font_6x8[][GLYPH_COLUMNS] = {
+#include "font5x7.inc"
+};
+
+static const uint8_t *glyph_for(char c)
+{
+    if (c < 32 || c > 126) {
+        c = '?';
+    }
+    return g_font_6x8[c - 32];
+}
+
+void display_gfx_clear(uint8_t *fb)
+{
+    memset(fb, 0, DISPLAY_GFX_FB_SIZE);
+}
+
+void display_gfx_char(uint8_t *fb, int x, int y, char c)
+{
+    const uint8_t *glyph = glyph_for(c);
+    if ((y & 7) == 0 && y >= 0 && y < DISPLAY_GFX_HEIGHT && x >= 0 && x + GLYPH_COLUMNS <= DISPLAY_GFX_WIDTH) {
+        // Page-aligned and fully visible: a glyph is exactly five column bytes
+        memcpy(&fb[(y / 8) * DISPLAY_GFX_WIDTH + x], glyph, GLYPH_COLUMNS);
+        return;
+    }
+    for (int col = 0; col < GLYPH_COLUMNS; ++col) {
+        int target_col = x + col;
+        if (target_col < 0 || target_col >= DISPLAY_GFX_WIDTH) {
+            continue;
+        }
+        uint8_t column_bits = glyph[col];
+        for (int row = 0; row < DISPLAY_GFX_FONT_HEIGHT; ++row) {
+            int target_row = y + row;
+            if (target_row < 0 || target_row >= DISPLAY_GFX_HEIGHT) {
+                continue;
+            }
+            if (column_bits & (1 << row)) {
+                fb[target_col + (target_row / 8) * DISPLAY_GFX_WIDTH] |= (1 << (target_row & 7));
+            }
+        }
+    }
+}
+
+int display_gfx_text(uint8_t *fb, int x, int y, const char *text)
+{
+    while (*text && x <= DISPLAY_GFX_WIDTH - DISPLAY_GFX_FONT_WIDTH) {
+        display_gfx_char(fb, x, y, *text++);
+        x += DISPLAY_GFX_FONT_WIDTH;
+    }
+    return x;
+}
+
+static uint32_t stretch_column(uint8_t bits, int scale)
+{
+    // Repeat every bit `scale` times: bit r lands on rows r*scale .. r*scale+scale-1
+    uint32_t out = 0;
+    uint32_t run = (1u << scale) - 1;
+    for (int row = 0; row < 8; ++row) {
+        if (bits & (1u << row)) {
+            out |= run << (row * scale);
+        }
+    }
+    return out;
+}
+
+int display_gfx_text_scaled(uint8_t *fb, int x, int page, const char *text, int scale)
+{
+    if (scale < 2 || scale > 3 || page < 0 || page + scale > DISPLAY_GFX_PAGES) {
+        return x;
+    }
+    const int advance = DISPLAY_GFX_FONT_WIDTH * scale;
+    while (*text && x + GLYPH_COLUMNS * scale <= DISPLAY_GFX_WIDTH) {
+        const uint8_t *glyph = glyph_for(*text++);
+        for (int col = 0; col < GLYPH_COLUMNS; ++col) {
+            uint32_t column = stretch_column(glyph[col], scale);
+            for (int p = 0; p < scale; ++p) {
+                uint8_t *dst = &fb[(page + p) * DISPLAY_GFX_WIDTH + x + col * scale];
+                memset(dst, (uint8_t)(column >> (8 * p)), (size_t)scale);
+            }
+        }
+        x += advance;
+    }
+    return x;
+}
+
+void display_spark_push(display_spark_ring_t *ring, float value, int64_t now_us, int64_t bucket_us)
+{
+    if (!isfinite(value)) {
+        return;
+    }
+    float scaled = roundf(value * 10.0f);
+    int16_t v = scaled > INT16_MAX ? INT16_MAX : (scaled < INT16_MIN ? INT16_MIN : (int16_t)scaled);
+    if (ring->count > 0 && now_us - ring->bucket_start_us < bucket_us) {
+        uint16_t last = (uint16_t)((ring->head + DISPLAY_SPARK_CAPACITY - 1) % DISPLAY_SPARK_CAPACITY);
+        if (v < ring->lo[last]) {
+            ring->lo[last] = v;
+        }
+        if (v > ring->hi[last]) {
+            ring->hi[last] = v;
+        }
+    } else {
+        ring->lo[ring->head] = v;
+        ring->hi[ring->head] = v;
+        ring->head = (uint16_t)((ring->head + 1) % DISPLAY_SPARK_CAPACITY);
+        if (ring->count < DISPLAY_SPARK_CAPACITY) {
+            ring->count++;
+        }
+        ring->bucket_start_us = now_us;
+    }
+    ring->revision++;
+}
+
+static void draw_vline(uint8_t *fb, int x, int y0, int y1)
+{
+    // Inclusive y0 <= y1; fills whole page bytes where the span covers them
+    for (int page = y0 / 8; page <= y1 / 8; ++page) {
+        int top = y0 > page * 8 ? y0 - page * 8 : 0;
+        int bottom = y1 < page * 8 + 7 ? y1 - page * 8 : 7;
+        uint8_t mask = (uint8_t)((0xFFu << top) & (0xFFu >> (7 - bottom)));
+        fb[page * DISPLAY_GFX_WIDTH + x] |= mask;
+    }
+}
+
+void display_gfx_sparkline(uint8_t *fb, int x, int page, int width, int pages,
+                           const display_spark_ring_t *ring, int16_t min_span)
+{
+    size_t n = ring->count;
+    if (n == 0 || width <= 0 || pages <= 0 || x < 0 || x + width > DISPLAY_GFX_WIDTH ||
+        page < 0 || page + pages > DISPLAY_GFX_PAGES) {
+        return;
+    }
+    size_t first = (ring->head + DISPLAY_SPARK_CAPACITY - n) % DISPLAY_SPARK_CAPACITY;
+
+    int32_t lo = INT16_MAX;
+    int32_t hi = INT16_MIN;
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = (first + i) % DISPLAY_SPARK_CAPACITY;
+        lo = ring->lo[idx] < lo ? ring->lo[idx] : lo;
+        hi = ring->hi[idx] > hi ? ring->hi[idx] : hi;
+    }
+    if (hi - lo < min_span) {
+        // Flat data: centre it in a minimum span instead of amplifying noise to full height
+        int32_t pad = (min_span - (hi - lo)) / 2;
+        lo -= pad;
+        hi = lo + min_span;
+    }
+    const int32_t span = hi - lo;
+    const int top = page * 8;
+    const int rows = pages * 8 - 1;
+
+    size_t cols = n < (size_t)width ? n : (size_t)width;
+    int x0 = x + width - (int)cols;
+    for (size_t c = 0; c < cols; ++c) {
+        // Column c covers buckets [start, end); with n <= width that is exactly one bucket
+        size_t start = (n <= (size_t)width) ? c : c * n / (size_t)width;
+        size_t end = (n <= (size_t)width) ? c + 1 : (c + 1) * n / (size_t)width;
+        int32_t col_lo = INT16_MAX;
+        int32_t col_hi = INT16_MIN;
+        for (size_t i = start; i < end; ++i) {
+            size_t idx = (first + i) % DISPLAY_SPARK_CAPACITY;
+            col_lo = ring->lo[idx] < col_lo ? ring->lo[idx] : col_lo;
+            col_hi = ring->hi[idx] > col_hi ? ring->hi[idx] : col_hi;
+        }
+        int y_hi = top + rows - (int)((col_hi - lo) * rows / span);
+        int y_lo = top + rows - (int)((col_lo - lo) * rows / span);
+        draw_vline(fb, x0 + (int)c, y_hi, y_lo);
+    }
+}
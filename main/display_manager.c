@@ -1,10 +1,15 @@
 #include "display_manager.h"
 
+#include "display_gfx.h"
+#include "i2c_scan.h"
 #include "power_manager.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "driver/i2c.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "lwip/inet.h"
 #include <string.h>
 #include <stdio.h>
@@ -13,20 +18,77 @@
 #define TAG "display"
 
 #define SSD1306_ADDR 0x3C
-#define DISPLAY_WIDTH 128
-#define DISPLAY_HEIGHT 64
-#define FONT_WIDTH 6
-#define FONT_HEIGHT 8
-#define MAX_LINES (DISPLAY_HEIGHT / FONT_HEIGHT)
+#define DISPLAY_WIDTH DISPLAY_GFX_WIDTH
+#define DISPLAY_PAGES DISPLAY_GFX_PAGES
+#define MAX_LINES DISPLAY_GFX_PAGES
+#define LINE_CHARS 32
 #define I2C_PORT I2C_NUM_0
-#define I2C_TIMEOUT_MS 1000
+#define I2C_PROBE_TIMEOUT_MS 20
+#define I2C_BASE_TIMEOUT_MS 20
+#define I2C_BYTES_PER_MS 10        // ~100 kHz SCL incl. ACK bits
+#define DISPLAY_RETRY_INITIAL_MS 10000
+#define DISPLAY_RETRY_MAX_MS 600000
 #define DISPLAY_WAKE_DELAY_MS 20
-#define DISPLAY_SCREEN_COUNT 2
+#define DISPLAY_DIM_LEAD_S 5 // dimmed this long before panel sleep
+#define SSD1306_CONTRAST_NORMAL 0xCF
+#define SSD1306_CONTRAST_DIM 0x01
+#define DISPLAY_SCREEN_COUNT 3 // two configurable text screens + the graph screen
+#define DISPLAY_GRAPH_SCREEN 2
+#define SPARK_BUCKET_US (5LL * 60 * 1000000) // 256 buckets ~ 21 h of history
+#define SPARK_SEA_MIN_SPAN 20                // 2 cm full scale at minimum
+#define SPARK_PRESSURE_MIN_SPAN 20           // 2 hPa
+#define DISPLAY_QUEUE_LEN 8
+#define DISPLAY_TASK_STACK 4096
+#define DISPLAY_TASK_PRIO 6 // above the scheduler workers so screen switches are not queued behind a measurement
 
+typedef enum {
+    DISPLAY_CMD_SNAPSHOT = 0,
+    DISPLAY_CMD_NEXT_SCREEN,
+    DISPLAY_CMD_CONFIG,
+    DISPLAY_CMD_IDLE, // idle timer expired: step one state down the power ladder
+} display_cmd_type_t;
+
+// Power ladder: ACTIVE -> DIMMED (optional) -> ASLEEP (panel off, GDDRAM kept) -> OFF (domain gated)
+typedef enum {
+    DISPLAY_POWER_OFF = 0,
+    DISPLAY_POWER_ASLEEP,
+    DISPLAY_POWER_DIMMED,
+    DISPLAY_POWER_ACTIVE,
+} display_power_state_t;
+
+typedef struct {
+    display_cmd_type_t type;
+    union {
+        struct {
+            sensor_snapshot_t snapshot;
+            wifi_status_t wifi;
+        } show;
+        struct {
+            uint16_t display_on_seconds;
+            uint16_t display_off_seconds;
+            bool display_dim;
+            uint32_t screen_items[2];
+        } config;
+    };
+} display_cmd_t;
+
+// Everything below is owned by the display task once it is running; other contexts only
+// talk to it through s_queue.
 static measurement_config_t s_display_cfg;
-static bool s_display_powered = false;
-static esp_timer_handle_t s_sleep_timer;
-static uint8_t s_framebuffer[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+static QueueHandle_t s_queue;
+static bool s_display_powered = false; // domain on and controller initialised
+static display_power_state_t s_power_state = DISPLAY_POWER_OFF;
+static esp_timer_handle_t s_idle_timer;
+static int64_t s_idle_due_us;
+static uint8_t s_framebuffer[DISPLAY_GFX_FB_SIZE];
+static uint8_t s_sent[DISPLAY_GFX_FB_SIZE]; // what the panel GDDRAM holds
+static bool s_sent_valid = false;
+static uint8_t s_tx_buffer[1 + DISPLAY_GFX_FB_SIZE];
+static display_spark_ring_t s_sea_ring;
+static display_spark_ring_t s_pressure_ring;
+static char s_shown_lines[MAX_LINES][LINE_CHARS];
+static int s_shown_screen = -1;
+static display_flush_stats_t s_stats;
 static sensor_snapshot_t s_last_snapshot;
 static sensor_snapshot_t s_filtered_snapshot;
 static bool s_have_filtered = false;
@@ -35,45 +97,137 @@ static float s_pending_level = 0.0f;
 static wifi_status_t s_last_wifi;
 static bool s_have_snapshot = false;
 static uint8_t s_active_screen = 0;
+static i2c_backoff_t s_backoff;
 
-static const uint8_t g_font_6x8[][FONT_WIDTH - 1] = {
-#include "font5x7.inc"
-};
+static void display_post(const display_cmd_t *cmd)
+{
+    if (!s_queue || xQueueSend(s_queue, cmd, 0) != pdTRUE) {
+        ESP_LOGD(TAG, "Display queue full, dropping cmd %d", cmd->type);
+    }
+}
 
-static void display_sleep_cb(void *arg)
+static void display_idle_cb(void *arg)
 {
     (void)arg;
+    display_cmd_t cmd = {.type = DISPLAY_CMD_IDLE};
+    display_post(&cmd);
+}
+
+static TickType_t i2c_timeout_for(size_t len)
+{
+    // Budget the wire time of the transfer plus a fixed margin, never less than two ticks.
+    TickType_t ticks = pdMS_TO_TICKS(I2C_BASE_TIMEOUT_MS + len / I2C_BYTES_PER_MS);
+    return ticks < 2 ? 2 : ticks;
+}
+
+static void mark_display_failed(esp_err_t err)
+{
+    ESP_LOGW(TAG, "SSD1306 I2C error (%s), backing off", esp_err_to_name(err));
+    i2c_backoff_fail(&s_backoff, DISPLAY_RETRY_INITIAL_MS, DISPLAY_RETRY_MAX_MS);
     power_manager_set(POWER_DOMAIN_DISPLAY, false);
     s_display_powered = false;
+    s_power_state = DISPLAY_POWER_OFF;
+    s_sent_valid = false;
 }
 
-static esp_err_t ssd1306_write_cmd(uint8_t cmd)
+static esp_err_t ssd1306_write_cmds(const uint8_t *cmds, size_t len)
 {
-    uint8_t data[2] = {0x00, cmd};
-    return i2c_master_write_to_device(I2C_PORT, SSD1306_ADDR, data, sizeof(data), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    // Control byte 0x00 (Co=0, D/C#=0): every following byte is a command, one transaction
+    uint8_t buffer[32];
+    if (len + 1 > sizeof(buffer)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    buffer[0] = 0x00;
+    memcpy(&buffer[1], cmds, len);
+    return i2c_master_write_to_device(I2C_PORT, SSD1306_ADDR, buffer, len + 1, i2c_timeout_for(len + 1));
 }
 
-static esp_err_t ssd1306_write_data(const uint8_t *data, size_t len)
+static esp_err_t ssd1306_flush_window(int page0, int page1, int col0, int col1)
 {
-    if (len == 0) {
-        return ESP_OK;
+    // One addressing transaction, then the whole window as one data transaction. Horizontal
+    // addressing mode wraps col1 -> col0 on the next page, so the bytes go out row by row.
+    const uint8_t window[] = {
+        0x21, (uint8_t)col0, (uint8_t)col1,
+        0x22, (uint8_t)page0, (uint8_t)page1,
+    };
+    esp_err_t err = ssd1306_write_cmds(window, sizeof(window));
+    if (err != ESP_OK) {
+        return err;
     }
+    size_t width = (size_t)(col1 - col0 + 1);
+    size_t len = 1;
+    s_tx_buffer[0] = 0x40; // Co=0, D/C#=1: data stream
+    for (int page = page0; page <= page1; ++page) {
+        memcpy(&s_tx_buffer[len], &s_framebuffer[page * DISPLAY_WIDTH + col0], width);
+        len += width;
+    }
+    err = i2c_master_write_to_device(I2C_PORT, SSD1306_ADDR, s_tx_buffer, len, i2c_timeout_for(len));
+    if (err == ESP_OK) {
+        s_stats.last_bytes += sizeof(window) + 1 + len;
+    }
+    return err;
+}
+
+static bool page_dirty_range(int page, int *col0, int *col1)
+{
+    const uint8_t *cur = &s_framebuffer[page * DISPLAY_WIDTH];
+    const uint8_t *sent = &s_sent[page * DISPLAY_WIDTH];
+    if (s_sent_valid && memcmp(cur, sent, DISPLAY_WIDTH) == 0) {
+        return false;
+    }
+    if (!s_sent_valid) {
+        *col0 = 0;
+        *col1 = DISPLAY_WIDTH - 1;
+        return true;
+    }
+    int first = 0;
+    while (cur[first] == sent[first]) {
+        ++first;
+    }
+    int last = DISPLAY_WIDTH - 1;
+    while (cur[last] == sent[last]) {
+        --last;
+    }
+    *col0 = first;
+    *col1 = last;
+    return true;
+}
+
+static esp_err_t ssd1306_flush(void)
+{
+    // Diff against the shadow of what the panel holds and send only the changed column span
+    // of each dirty page; runs of adjacent dirty pages share one window (union of spans).
+    int64_t start_us = esp_timer_get_time();
+    s_stats.last_bytes = 0;
     esp_err_t err = ESP_OK;
-    size_t offset = 0;
-    uint8_t buffer[17];
-    buffer[0] = 0x40;
-    while (offset < len) {
-        size_t chunk = len - offset;
-        if (chunk > 16) {
-            chunk = 16;
+    int page = 0;
+    while (page < DISPLAY_PAGES && err == ESP_OK) {
+        int col0;
+        int col1;
+        if (!page_dirty_range(page, &col0, &col1)) {
+            ++page;
+            continue;
         }
-        memcpy(&buffer[1], data + offset, chunk);
-        err = i2c_master_write_to_device(I2C_PORT, SSD1306_ADDR, buffer, chunk + 1, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-        if (err != ESP_OK) {
-            return err;
+        int page1 = page;
+        int next0;
+        int next1;
+        while (page1 + 1 < DISPLAY_PAGES && page_dirty_range(page1 + 1, &next0, &next1)) {
+            col0 = next0 < col0 ? next0 : col0;
+            col1 = next1 > col1 ? next1 : col1;
+            ++page1;
         }
-        offset += chunk;
+        err = ssd1306_flush_window(page, page1, col0, col1);
+        page = page1 + 1;
     }
+    if (err != ESP_OK) {
+        s_sent_valid = false;
+        return err;
+    }
+    memcpy(s_sent, s_framebuffer, sizeof(s_sent));
+    s_sent_valid = true;
+    s_stats.last_flush_us = (uint32_t)(esp_timer_get_time() - start_us);
+    s_stats.flushes++;
+    ESP_LOGD(TAG, "Flush: %u bytes in %u us", (unsigned)s_stats.last_bytes, (unsigned)s_stats.last_flush_us);
     return ESP_OK;
 }
 
@@ -90,7 +244,7 @@ static esp_err_t ssd1306_hw_init(void)
         0xA1,
         0xC8,
         0xDA, 0x12,
-        0x81, 0xCF,
+        0x81, SSD1306_CONTRAST_NORMAL,
         0xD9, 0xF1,
         0xDB, 0x40,
         0xA4,
@@ -98,94 +252,142 @@ static esp_err_t ssd1306_hw_init(void)
         0x2E,
         0xAF,
     };
-    for (size_t i = 0; i < sizeof(init_cmds); ++i) {
-        ESP_RETURN_ON_ERROR(ssd1306_write_cmd(init_cmds[i]), TAG, "init cmd");
-    }
-    return ESP_OK;
+    return ssd1306_write_cmds(init_cmds, sizeof(init_cmds));
 }
 
-static void clear_buffer(void)
+static void ip_to_string(const esp_ip4_addr_t *ip, char *out, size_t len)
 {
-    memset(s_framebuffer, 0, sizeof(s_framebuffer));
+    if (!ip || ip->addr == 0) {
+        strlcpy(out, "-", len);
+        return;
+    }
+    snprintf(out, len, IPSTR, IP2STR(ip));
 }
 
-static void draw_char(int x, int y, char c)
+static void ensure_powered(void)
 {
-    if (c < 32 || c > 126) {
-        c = '?';
+    if (s_display_powered || !i2c_backoff_ready(&s_backoff)) {
+        return;
     }
-    const uint8_t *glyph = g_font_6x8[c - 32];
-    for (int col = 0; col < FONT_WIDTH - 1; ++col) {
-        int target_col = x + col;
-        if (target_col < 0 || target_col >= DISPLAY_WIDTH) {
-            continue;
-        }
-        uint8_t column_bits = glyph[col];
-        for (int row = 0; row < FONT_HEIGHT; ++row) {
-            int target_row = y + row;
-            if (target_row < 0 || target_row >= DISPLAY_HEIGHT) {
-                continue;
-            }
-            int byte_index = target_col + (target_row / 8) * DISPLAY_WIDTH;
-            if (column_bits & (1 << row)) {
-                s_framebuffer[byte_index] |= (1 << (target_row & 7));
-            }
-        }
+    power_manager_set(POWER_DOMAIN_DISPLAY, true);
+    vTaskDelay(pdMS_TO_TICKS(DISPLAY_WAKE_DELAY_MS));
+    esp_err_t err = i2c_probe_address(I2C_PORT, SSD1306_ADDR, I2C_PROBE_TIMEOUT_MS);
+    if (err == ESP_OK) {
+        err = ssd1306_hw_init();
     }
+    if (err != ESP_OK) {
+        mark_display_failed(err);
+        return;
+    }
+    i2c_backoff_reset(&s_backoff);
+    s_display_powered = true;
+    s_power_state = DISPLAY_POWER_ACTIVE;
+    s_sent_valid = false; // GDDRAM content is undefined after power-up
 }
 
-static void draw_text_line(int line, const char *text)
+static void set_power_state(display_power_state_t target)
 {
-    if (line < 0 || line >= MAX_LINES) {
+    // Panel sleep keeps the controller powered and GDDRAM intact, so waking is a single
+    // 4-6 byte command transaction (<1 ms at 100 kHz) and needs no redraw.
+    static const uint8_t sleep_cmds[] = {0xAE, 0x8D, 0x10};
+    static const uint8_t wake_cmds[] = {0x8D, 0x14, 0x81, SSD1306_CONTRAST_NORMAL, 0xAF};
+    static const uint8_t dim_cmds[] = {0x81, SSD1306_CONTRAST_DIM};
+    static const uint8_t undim_cmds[] = {0x81, SSD1306_CONTRAST_NORMAL};
+
+    if (target == s_power_state) {
+        return;
+    }
+    if (target == DISPLAY_POWER_OFF) {
+        power_manager_set(POWER_DOMAIN_DISPLAY, false);
+        s_display_powered = false;
+        s_power_state = DISPLAY_POWER_OFF;
+        s_sent_valid = false;
         return;
     }
-    int x = 0;
-    int y = line * FONT_HEIGHT;
-    while (*text && x < DISPLAY_WIDTH - FONT_WIDTH) {
-        draw_char(x, y, *text++);
-        x += FONT_WIDTH;
+    if (s_power_state == DISPLAY_POWER_OFF) {
+        ensure_powered();
+        if (!s_display_powered) {
+            return;
+        }
+    }
+    esp_err_t err = ESP_OK;
+    if (target == DISPLAY_POWER_ASLEEP) {
+        err = ssd1306_write_cmds(sleep_cmds, sizeof(sleep_cmds));
+    } else if (s_power_state == DISPLAY_POWER_ASLEEP) {
+        err = ssd1306_write_cmds(wake_cmds, sizeof(wake_cmds));
+        if (err == ESP_OK && target == DISPLAY_POWER_DIMMED) {
+            err = ssd1306_write_cmds(dim_cmds, sizeof(dim_cmds));
+        }
+    } else if (s_power_state != target) {
+        err = (target == DISPLAY_POWER_DIMMED) ? ssd1306_write_cmds(dim_cmds, sizeof(dim_cmds))
+                                                : ssd1306_write_cmds(undim_cmds, sizeof(undim_cmds));
+    }
+    if (err != ESP_OK) {
+        mark_display_failed(err);
+        return;
     }
+    s_power_state = target;
 }
 
-static void ip_to_string(const esp_ip4_addr_t *ip, char *out, size_t len)
+static void arm_idle_timer(uint32_t seconds)
 {
-    if (!ip || ip->addr == 0) {
-        strlcpy(out, "-", len);
+    if (!s_idle_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = display_idle_cb,
+            .name = "display_idle"
+        };
+        esp_timer_create(&args, &s_idle_timer);
+    }
+    esp_timer_stop(s_idle_timer);
+    if (seconds == 0) {
+        s_idle_due_us = 0;
         return;
     }
-    snprintf(out, len, IPSTR, IP2STR(ip));
+    s_idle_due_us = esp_timer_get_time() + (int64_t)seconds * 1000000LL;
+    esp_timer_start_once(s_idle_timer, (uint64_t)seconds * 1000000ULL);
 }
 
-static void ensure_powered(void)
+static bool dim_enabled(void)
 {
-    if (!s_display_powered) {
-        power_manager_set(POWER_DOMAIN_DISPLAY, true);
-        vTaskDelay(pdMS_TO_TICKS(DISPLAY_WAKE_DELAY_MS));
-        if (ssd1306_hw_init() == ESP_OK) {
-            s_display_powered = true;
-        } else {
-            ESP_LOGE(TAG, "SSD1306 init failed");
-        }
-    }
+    return s_display_cfg.display_dim && s_display_cfg.display_on_seconds > DISPLAY_DIM_LEAD_S;
 }
 
-static void schedule_sleep(void)
+static void mark_activity(void)
 {
+    set_power_state(DISPLAY_POWER_ACTIVE);
     if (s_display_cfg.display_on_seconds == 0) {
-        if (s_sleep_timer) {
-            esp_timer_stop(s_sleep_timer);
-        }
+        arm_idle_timer(0); // always on
         return;
     }
-    if (!s_sleep_timer) {
-        const esp_timer_create_args_t args = {
-            .callback = display_sleep_cb,
-            .name = "display_sleep"
-        };
-        esp_timer_create(&args, &s_sleep_timer);
+    arm_idle_timer(dim_enabled() ? s_display_cfg.display_on_seconds - DISPLAY_DIM_LEAD_S
+                                 : s_display_cfg.display_on_seconds);
+}
+
+static void step_idle(void)
+{
+    // A tick queued just before new activity re-armed the timer is stale; ignore it
+    if (s_idle_due_us == 0 || esp_timer_get_time() + 100000 < s_idle_due_us) {
+        return;
+    }
+    s_idle_due_us = 0;
+    switch (s_power_state) {
+        case DISPLAY_POWER_ACTIVE:
+            if (dim_enabled()) {
+                set_power_state(DISPLAY_POWER_DIMMED);
+                arm_idle_timer(DISPLAY_DIM_LEAD_S);
+                break;
+            }
+            // fall through
+        case DISPLAY_POWER_DIMMED:
+            set_power_state(DISPLAY_POWER_ASLEEP);
+            arm_idle_timer(s_display_cfg.display_off_seconds);
+            break;
+        case DISPLAY_POWER_ASLEEP:
+            set_power_state(DISPLAY_POWER_OFF);
+            break;
+        case DISPLAY_POWER_OFF:
+            break;
     }
-    esp_timer_stop(s_sleep_timer);
-    esp_timer_start_once(s_sleep_timer, (uint64_t)s_display_cfg.display_on_seconds * 1000000ULL);
 }
 
 static void format_line(screen_item_t item, const sensor_snapshot_t *snapshot, const wifi_status_t *wifi, char *out, size_t len)
@@ -224,10 +426,8 @@ static void format_line(screen_item_t item, const sensor_snapshot_t *snapshot, c
     }
 }
 
-static void render_screen(uint8_t screen_index)
+static int format_text_screen(uint8_t screen_index, char lines[MAX_LINES][LINE_CHARS])
 {
-    clear_buffer();
-    char line_buf[32];
     int line = 0;
     for (size_t bit = 0; bit < SCREEN_ITEM_COUNT && line < MAX_LINES; ++bit) {
         uint32_t mask = config_store_screen_item_bit(bit);
@@ -235,17 +435,75 @@ static void render_screen(uint8_t screen_index)
             continue;
         }
         if (s_display_cfg.screen_items[screen_index] & mask) {
-            format_line((screen_item_t)bit, &s_last_snapshot, &s_last_wifi, line_buf, sizeof(line_buf));
-            draw_text_line(line++, line_buf);
+            format_line((screen_item_t)bit, &s_last_snapshot, &s_last_wifi, lines[line], LINE_CHARS);
+            line++;
         }
     }
-    ssd1306_write_cmd(0x21);
-    ssd1306_write_cmd(0);
-    ssd1306_write_cmd(DISPLAY_WIDTH - 1);
-    ssd1306_write_cmd(0x22);
-    ssd1306_write_cmd(0);
-    ssd1306_write_cmd((DISPLAY_HEIGHT / 8) - 1);
-    ssd1306_write_data(s_framebuffer, sizeof(s_framebuffer));
+    return line;
+}
+
+static void format_graph_screen(char lines[MAX_LINES][LINE_CHARS])
+{
+    // Line 0: 3x headline, line 1: pressure caption, line 2: ring revisions (redraw key only)
+    if (isfinite(s_last_snapshot.sea_level_cm)) {
+        snprintf(lines[0], LINE_CHARS, "%.1f", s_last_snapshot.sea_level_cm);
+    } else {
+        strlcpy(lines[0], "--.-", LINE_CHARS);
+    }
+    if (isfinite(s_last_snapshot.pressure_trend_hpa_3h)) {
+        snprintf(lines[1], LINE_CHARS, "Trykk %4.0fhPa %+.1f", s_last_snapshot.air_pressure_hpa,
+                 s_last_snapshot.pressure_trend_hpa_3h);
+    } else {
+        snprintf(lines[1], LINE_CHARS, "Trykk %4.0fhPa", s_last_snapshot.air_pressure_hpa);
+    }
+    snprintf(lines[2], LINE_CHARS, "%u/%u", (unsigned)s_sea_ring.revision, (unsigned)s_pressure_ring.revision);
+}
+
+static void draw_graph_screen(char lines[MAX_LINES][LINE_CHARS])
+{
+    // Pages 0-2 sea level headline, 3-4 sea sparkline, 5 pressure text, 6-7 pressure sparkline
+    int x = display_gfx_text_scaled(s_framebuffer, 0, 0, lines[0], 3);
+    display_gfx_text(s_framebuffer, x, 2 * 8, "cm");
+    display_gfx_sparkline(s_framebuffer, 0, 3, DISPLAY_WIDTH, 2, &s_sea_ring, SPARK_SEA_MIN_SPAN);
+    display_gfx_text(s_framebuffer, 0, 5 * 8, lines[1]);
+    display_gfx_sparkline(s_framebuffer, 0, 6, DISPLAY_WIDTH, 2, &s_pressure_ring, SPARK_PRESSURE_MIN_SPAN);
+}
+
+static void render_screen(uint8_t screen_index)
+{
+    char lines[MAX_LINES][LINE_CHARS];
+    memset(lines, 0, sizeof(lines));
+    int line_count = 0;
+    if (screen_index == DISPLAY_GRAPH_SCREEN) {
+        format_graph_screen(lines);
+    } else {
+        line_count = format_text_screen(screen_index, lines);
+    }
+    if (s_sent_valid && s_shown_screen == screen_index && memcmp(lines, s_shown_lines, sizeof(lines)) == 0) {
+        // Same content as on the panel: no redraw, no bus traffic
+        s_stats.skipped++;
+        return;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    display_gfx_clear(s_framebuffer);
+    if (screen_index == DISPLAY_GRAPH_SCREEN) {
+        draw_graph_screen(lines);
+    } else {
+        for (int i = 0; i < line_count; ++i) {
+            display_gfx_text(s_framebuffer, 0, i * DISPLAY_GFX_FONT_HEIGHT, lines[i]);
+        }
+    }
+    s_stats.last_render_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    esp_err_t err = ssd1306_flush();
+    if (err != ESP_OK) {
+        // Stop at the first failed transfer so an unplugged panel costs one timeout, not 70
+        mark_display_failed(err);
+        return;
+    }
+    memcpy(s_shown_lines, lines, sizeof(lines));
+    s_shown_screen = screen_index;
 }
 
 static void filter_snapshot_display(const sensor_snapshot_t *incoming)
@@ -288,17 +546,98 @@ static void filter_snapshot_display(const sensor_snapshot_t *incoming)
     s_last_snapshot = s_filtered_snapshot;
 }
 
+static void apply_cmd(const display_cmd_t *cmd, bool *render, bool *idle)
+{
+    switch (cmd->type) {
+        case DISPLAY_CMD_SNAPSHOT:
+            // Filter sees every snapshot even when several renders collapse into one
+            filter_snapshot_display(&cmd->show.snapshot);
+            display_spark_push(&s_sea_ring, s_last_snapshot.sea_level_cm, esp_timer_get_time(), SPARK_BUCKET_US);
+            display_spark_push(&s_pressure_ring, s_last_snapshot.air_pressure_hpa, esp_timer_get_time(),
+                               SPARK_BUCKET_US);
+            s_last_wifi = cmd->show.wifi;
+            s_have_snapshot = true;
+            *render = true;
+            *idle = false;
+            break;
+        case DISPLAY_CMD_NEXT_SCREEN:
+            if (s_have_snapshot) {
+                s_active_screen = (s_active_screen + 1) % DISPLAY_SCREEN_COUNT;
+                *render = true;
+                *idle = false;
+            }
+            break;
+        case DISPLAY_CMD_CONFIG:
+            s_display_cfg.display_on_seconds = cmd->config.display_on_seconds;
+            s_display_cfg.display_off_seconds = cmd->config.display_off_seconds;
+            s_display_cfg.display_dim = cmd->config.display_dim;
+            memcpy(s_display_cfg.screen_items, cmd->config.screen_items, sizeof(s_display_cfg.screen_items));
+            s_shown_screen = -1; // screen items may have changed
+            *render = *render || (s_have_snapshot && s_power_state >= DISPLAY_POWER_DIMMED);
+            break;
+        case DISPLAY_CMD_IDLE:
+            *idle = true;
+            break;
+    }
+}
+
+static void display_task(void *ctx)
+{
+    (void)ctx;
+    display_cmd_t cmd;
+    while (true) {
+        if (xQueueReceive(s_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        // Drain whatever else queued up meanwhile and render once for the whole burst
+        bool render = false;
+        bool idle = false;
+        do {
+            apply_cmd(&cmd, &render, &idle);
+        } while (xQueueReceive(s_queue, &cmd, 0) == pdTRUE);
+
+        if (idle) {
+            step_idle();
+        }
+        if (!render || !s_have_snapshot) {
+            continue;
+        }
+        mark_activity();
+        if (s_power_state == DISPLAY_POWER_ACTIVE) {
+            render_screen(s_active_screen);
+        }
+    }
+}
+
+static void on_config_changed(const measurement_config_t *config, uint32_t changed, void *ctx)
+{
+    (void)ctx;
+    if (changed & CONFIG_FIELDS_DISPLAY) {
+        display_manager_update_config(config);
+    }
+}
+
 esp_err_t display_manager_init(const measurement_config_t *config)
 {
     if (!config) {
         return ESP_ERR_INVALID_ARG;
     }
     s_display_cfg = *config;
-    power_manager_set(POWER_DOMAIN_DISPLAY, true);
-    vTaskDelay(pdMS_TO_TICKS(DISPLAY_WAKE_DELAY_MS));
-    ESP_RETURN_ON_ERROR(ssd1306_hw_init(), TAG, "ssd1306");
-    s_display_powered = true;
-    return ESP_OK;
+    s_queue = xQueueCreate(DISPLAY_QUEUE_LEN, sizeof(display_cmd_t));
+    if (!s_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    ensure_powered();
+    if (s_display_powered) {
+        mark_activity(); // start the idle ladder even if no snapshot arrives
+    } else {
+        // Missing panel is not fatal; it is retried with backoff on later refreshes
+        ESP_LOGW(TAG, "SSD1306 not responding at 0x%02X", SSD1306_ADDR);
+    }
+    if (xTaskCreate(display_task, "display", DISPLAY_TASK_STACK, NULL, DISPLAY_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return config_store_subscribe(on_config_changed, NULL);
 }
 
 void display_manager_update_config(const measurement_config_t *config)
@@ -306,36 +645,34 @@ void display_manager_update_config(const measurement_config_t *config)
     if (!config) {
         return;
     }
-    s_display_cfg = *config;
+    display_cmd_t cmd = {.type = DISPLAY_CMD_CONFIG};
+    cmd.config.display_on_seconds = config->display_on_seconds;
+    cmd.config.display_off_seconds = config->display_off_seconds;
+    cmd.config.display_dim = config->display_dim;
+    memcpy(cmd.config.screen_items, config->screen_items, sizeof(cmd.config.screen_items));
+    display_post(&cmd);
 }
 
-void display_manager_show_snapshot(const sensor_snapshot_t *snapshot, const wifi_status_t *wifi_status)
+void display_manager_get_flush_stats(display_flush_stats_t *out)
 {
-    if (!snapshot || !wifi_status) {
-        return;
+    if (out) {
+        *out = s_stats;
     }
-    filter_snapshot_display(snapshot);
-    s_last_wifi = *wifi_status;
-    s_have_snapshot = true;
+}
 
-    ensure_powered();
-    schedule_sleep();
-    if (!s_display_powered) {
+void display_manager_show_snapshot(const sensor_snapshot_t *snapshot, const wifi_status_t *wifi_status)
+{
+    if (!snapshot || !wifi_status) {
         return;
     }
-    render_screen(s_active_screen);
+    display_cmd_t cmd = {.type = DISPLAY_CMD_SNAPSHOT};
+    cmd.show.snapshot = *snapshot;
+    cmd.show.wifi = *wifi_status;
+    display_post(&cmd);
 }
 
 void display_manager_next_screen(void)
 {
-    if (!s_have_snapshot) {
-        return;
-    }
-    s_active_screen = (s_active_screen + 1) % DISPLAY_SCREEN_COUNT;
-    ensure_powered();
-    schedule_sleep();
-    if (!s_display_powered) {
-        return;
-    }
-    render_screen(s_active_screen);
+    display_cmd_t cmd = {.type = DISPLAY_CMD_NEXT_SCREEN};
+    display_post(&cmd);
 }
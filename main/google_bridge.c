@@ -19,12 +19,6 @@ static char s_device_id[64];
 static char s_friendly_name[64];
 static bool s_automation_enabled = true;
 
-static void set_identity_defaults(void)
-{
-    strlcpy(s_device_id, "sea.monitor", sizeof(s_device_id));
-    strlcpy(s_friendly_name, DEFAULT_DEVICE_NAME, sizeof(s_friendly_name));
-}
-
 static void update_identity_from_config(const measurement_config_t *cfg)
 {
     const char *name = (cfg && cfg->device_name[0]) ? cfg->device_name : "sea";
@@ -66,6 +60,14 @@ static void log_snapshot(const sensor_snapshot_t *snapshot)
              snapshot->battery_voltage);
 }
 
+static void on_config_changed(const measurement_config_t *cfg, uint32_t changed, void *ctx)
+{
+    (void)ctx;
+    if (changed & CONFIG_FIELDS_GOOGLE) {
+        update_identity_from_config(cfg);
+    }
+}
+
 esp_err_t google_bridge_init(void)
 {
     s_mutex = xSemaphoreCreateMutex();
@@ -73,11 +75,11 @@ esp_err_t google_bridge_init(void)
         ESP_LOGE(TAG, "Failed to create mutex");
         return ESP_ERR_NO_MEM;
     }
-    set_identity_defaults();
+    update_identity_from_config(config_store_current(NULL));
     s_has_snapshot = false;
     s_last_update_us = 0;
     ESP_LOGI(TAG, "Google bridge ready (local REST placeholder)");
-    return ESP_OK;
+    return config_store_subscribe(on_config_changed, NULL);
 }
 
 void google_bridge_publish_snapshot(const sensor_snapshot_t *snapshot)
@@ -113,11 +115,6 @@ bool google_bridge_get_last_snapshot(sensor_snapshot_t *out, int64_t *timestamp_
     return has_snapshot;
 }
 
-void google_bridge_update_config(const measurement_config_t *cfg)
-{
-    update_identity_from_config(cfg);
-}
-
 const char *google_bridge_device_id(void)
 {
     return s_device_id[0] ? s_device_id : "sea.monitor";
@@ -0,0 +1,96 @@
+#include "http_limiter.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+#define LIMITER_SLOTS 12        // distinct client/class pairs tracked at once
+#define MILLI_TOKENS 1000
+
+typedef struct {
+    uint32_t client; // IPv4 address, or a hash of a native IPv6 one; 0 = free slot
+    uint8_t bucket_class;
+    uint32_t milli_tokens;
+    int64_t last_us;
+} limiter_slot_t;
+
+static limiter_slot_t s_slots[LIMITER_SLOTS];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool client_key(httpd_req_t *req, uint32_t *key)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&addr, &len) != 0) {
+        return false;
+    }
+    if (addr.ss_family == AF_INET) {
+        memcpy(key, &((struct sockaddr_in *)&addr)->sin_addr, sizeof(*key));
+    } else if (addr.ss_family == AF_INET6) {
+        // httpd listens on IPv6; IPv4 peers arrive v4-mapped and keep their address as key
+        const uint8_t *a = (const uint8_t *)&((struct sockaddr_in6 *)&addr)->sin6_addr;
+        static const uint8_t k_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+        if (memcmp(a, k_mapped, sizeof(k_mapped)) == 0) {
+            memcpy(key, a + 12, sizeof(*key));
+        } else {
+            uint32_t h = 2166136261u; // FNV-1a
+            for (size_t i = 0; i < 16; ++i) {
+                h = (h ^ a[i]) * 16777619u;
+            }
+            *key = h;
+        }
+    } else {
+        return false;
+    }
+    if (*key == 0) {
+        *key = 1;
+    }
+    return true;
+}
+
+bool http_limiter_allow(httpd_req_t *req, uint8_t bucket_class, const http_limit_t *limit)
+{
+    uint32_t key;
+    if (!limit || !client_key(req, &key)) {
+        return true;
+    }
+    const uint32_t capacity = (uint32_t)limit->burst * MILLI_TOKENS;
+    int64_t now_us = esp_timer_get_time();
+    bool allowed;
+
+    portENTER_CRITICAL(&s_lock);
+    limiter_slot_t *slot = NULL;
+    limiter_slot_t *oldest = &s_slots[0];
+    for (size_t i = 0; i < LIMITER_SLOTS; ++i) {
+        if (s_slots[i].client == key && s_slots[i].bucket_class == bucket_class) {
+            slot = &s_slots[i];
+            break;
+        }
+        if (s_slots[i].last_us < oldest->last_us) {
+            oldest = &s_slots[i];
+        }
+    }
+    if (!slot) {
+        slot = oldest;
+        *slot = (limiter_slot_t){
+            .client = key,
+            .bucket_class = bucket_class,
+            .milli_tokens = capacity,
+            .last_us = now_us,
+        };
+    }
+    // per_minute tokens per 60 s, i.e. per_minute milli-tokens per 60 ms
+    int64_t refill = (now_us - slot->last_us) * limit->per_minute / 60000;
+    if (refill > 0) {
+        uint64_t tokens = slot->milli_tokens + (uint64_t)refill;
+        slot->milli_tokens = tokens > capacity ? capacity : (uint32_t)tokens;
+        slot->last_us = now_us;
+    }
+    allowed = slot->milli_tokens >= MILLI_TOKENS;
+    if (allowed) {
+        slot->milli_tokens -= MILLI_TOKENS;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return allowed;
+}
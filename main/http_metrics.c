@@ -0,0 +1,342 @@
+#include "http_metrics.h"
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEAP_CAPS MALLOC_CAP_8BIT
+
+// Upper bounds of the finite latency buckets, in microseconds
+static const uint32_t k_bucket_us[HTTP_METRICS_BUCKETS] = {
+    5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000,
+};
+static const char *const k_bucket_le[HTTP_METRICS_BUCKETS] = {
+    "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5",
+};
+
+typedef struct {
+    http_endpoint_stats_t *stats; // NULL while no request is measured on this socket
+    int64_t start_us;
+    uint32_t tx_bytes; // running total for the connection, bumped by metrics_send
+    uint32_t tx_start;
+    uint16_t status;   // parsed from the status line of the current response
+    uint8_t holds;     // begin + each detach; the last end records the request
+    bool failed;
+} socket_slot_t;
+
+static socket_slot_t s_slots[CONFIG_LWIP_MAX_SOCKETS];
+static SemaphoreHandle_t s_lock; // stats, slot bookkeeping and the heap monitor window
+static uint32_t s_in_flight;
+
+static socket_slot_t *slot_for(int sockfd)
+{
+    int idx = sockfd - LWIP_SOCKET_OFFSET;
+    if (idx < 0 || idx >= CONFIG_LWIP_MAX_SOCKETS) {
+        return NULL;
+    }
+    return &s_slots[idx];
+}
+
+static int metrics_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    (void)hd;
+    if (!buf) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    // Same behaviour as httpd's default send, plus byte and status accounting
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    socket_slot_t *slot = slot_for(sockfd);
+    if (slot) {
+        // Only one task sends on a socket at a time, so the plain updates do not race
+        if (slot->stats && slot->status == 0 && ret >= 12 && memcmp(buf, "HTTP/1.1 ", 9) == 0) {
+            slot->status = (uint16_t)strtoul(buf + 9, NULL, 10);
+        }
+        slot->tx_bytes += (uint32_t)ret;
+    }
+    return ret;
+}
+
+esp_err_t http_metrics_session_open(httpd_handle_t hd, int sockfd)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    socket_slot_t *slot = slot_for(sockfd);
+    if (slot) {
+        *slot = (socket_slot_t){0};
+    }
+    return httpd_sess_set_send_override(hd, sockfd, metrics_send);
+}
+
+void http_metrics_request_begin(httpd_req_t *req, http_endpoint_stats_t *stats)
+{
+    socket_slot_t *slot = slot_for(httpd_req_to_sockfd(req));
+    if (!slot || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_in_flight++ == 0) {
+        // One window covers all overlapping requests, so each one gets a conservative low-water
+        heap_caps_monitor_local_minimum_free_size_start();
+    }
+    slot->stats = stats;
+    slot->start_us = esp_timer_get_time();
+    slot->tx_start = slot->tx_bytes;
+    slot->status = 0;
+    slot->holds = 1;
+    slot->failed = false;
+    xSemaphoreGive(s_lock);
+}
+
+void http_metrics_request_detach(httpd_req_t *req)
+{
+    socket_slot_t *slot = slot_for(httpd_req_to_sockfd(req));
+    if (!slot || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (slot->stats) {
+        slot->holds++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void record(socket_slot_t *slot)
+{
+    http_endpoint_stats_t *stats = slot->stats;
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - slot->start_us);
+    size_t bucket = 0;
+    while (bucket < HTTP_METRICS_BUCKETS && elapsed_us > k_bucket_us[bucket]) {
+        ++bucket;
+    }
+    stats->requests++;
+    stats->duration_us_sum += elapsed_us;
+    stats->duration_buckets[bucket]++;
+    stats->response_bytes += slot->tx_bytes - slot->tx_start;
+    if (slot->failed || slot->status >= 400) {
+        stats->errors++;
+    }
+    uint32_t low = (uint32_t)heap_caps_get_minimum_free_size(HEAP_CAPS);
+    if (stats->heap_low_water == 0 || low < stats->heap_low_water) {
+        stats->heap_low_water = low;
+    }
+    slot->stats = NULL;
+}
+
+void http_metrics_request_end(httpd_req_t *req, esp_err_t handler_err)
+{
+    socket_slot_t *slot = slot_for(httpd_req_to_sockfd(req));
+    if (!slot || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (slot->stats) {
+        slot->failed |= handler_err != ESP_OK;
+        if (--slot->holds == 0) {
+            record(slot);
+            if (--s_in_flight == 0) {
+                heap_caps_monitor_local_minimum_free_size_stop();
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void count_on_slot(httpd_req_t *req, bool shed)
+{
+    socket_slot_t *slot = slot_for(httpd_req_to_sockfd(req));
+    if (!slot || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (slot->stats) {
+        if (shed) {
+            slot->stats->shed++;
+        } else {
+            slot->stats->coalesced++;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void http_metrics_count_shed(httpd_req_t *req)
+{
+    count_on_slot(req, true);
+}
+
+void http_metrics_count_coalesced(httpd_req_t *req)
+{
+    count_on_slot(req, false);
+}
+
+void metrics_text_init(metrics_text_t *t, char *buf, size_t cap, metrics_text_flush_fn flush, void *ctx)
+{
+    *t = (metrics_text_t){
+        .buf = buf,
+        .cap = cap,
+        .flush = flush,
+        .ctx = ctx,
+        .err = ESP_OK,
+    };
+}
+
+static bool flush_text(metrics_text_t *t)
+{
+    if (t->len == 0) {
+        return true;
+    }
+    esp_err_t err = t->flush(t->ctx, t->buf, t->len);
+    if (err != ESP_OK) {
+        t->err = err;
+        return false;
+    }
+    t->len = 0;
+    return true;
+}
+
+void metrics_text_printf(metrics_text_t *t, const char *fmt, ...)
+{
+    // A line is formatted straight into the free tail; if it does not fit, flush and retry once
+    for (int attempt = 0; attempt < 2 && t->err == ESP_OK; ++attempt) {
+        size_t room = t->cap - t->len;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(&t->buf[t->len], room, fmt, args);
+        va_end(args);
+        if (n < 0) {
+            t->err = ESP_FAIL;
+            return;
+        }
+        if ((size_t)n < room) {
+            t->len += (size_t)n;
+            return;
+        }
+        if (t->len == 0) {
+            t->err = ESP_ERR_INVALID_SIZE; // a single line longer than the buffer
+            return;
+        }
+        if (!flush_text(t)) {
+            return;
+        }
+    }
+}
+
+void metrics_text_gauge(metrics_text_t *t, const char *name, const char *help, double value)
+{
+    if (!isfinite(value)) {
+        return;
+    }
+    metrics_text_printf(t, "# HELP %s %s\n# TYPE %s gauge\n%s %.10g\n", name, help, name, name, value);
+}
+
+void metrics_text_counter(metrics_text_t *t, const char *name, const char *help, uint64_t value)
+{
+    metrics_text_printf(t, "# HELP %s %s\n# TYPE %s counter\n%s %" PRIu64 "\n", name, help, name, name, value);
+}
+
+esp_err_t metrics_text_finish(metrics_text_t *t)
+{
+    if (t->err == ESP_OK) {
+        flush_text(t);
+    }
+    return t->err;
+}
+
+static void write_family(metrics_text_t *t, const char *name, const char *type, const char *help)
+{
+    metrics_text_printf(t, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void http_metrics_write(metrics_text_t *t, const http_endpoint_stats_t *stats, size_t count)
+{
+    // Copy under the lock so one scrape sees consistent counters, then format without it
+    http_endpoint_stats_t *copy = malloc(count * sizeof(*copy));
+    if (!copy) {
+        t->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    memcpy(copy, stats, count * sizeof(*copy));
+    uint32_t in_flight = s_in_flight;
+    if (s_lock) {
+        xSemaphoreGive(s_lock);
+    }
+
+#define LABELS "{method=\"%s\",path=\"%s\"}"
+    write_family(t, "seasensor_http_requests_total", "counter", "HTTP requests completed per endpoint.");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_text_printf(t, "seasensor_http_requests_total" LABELS " %" PRIu32 "\n", copy[i].method,
+                            copy[i].path, copy[i].requests);
+    }
+    write_family(t, "seasensor_http_request_errors_total", "counter",
+                 "Requests that failed in the handler or got a 4xx/5xx status.");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_text_printf(t, "seasensor_http_request_errors_total" LABELS " %" PRIu32 "\n", copy[i].method,
+                            copy[i].path, copy[i].errors);
+    }
+    write_family(t, "seasensor_http_shed_total", "counter",
+                 "Rate-limited requests answered from cache instead of in full.");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_text_printf(t, "seasensor_http_shed_total" LABELS " %" PRIu32 "\n", copy[i].method, copy[i].path,
+                            copy[i].shed);
+    }
+    write_family(t, "seasensor_http_coalesced_total", "counter",
+                 "Requests answered with a payload serialized once and shared with other requests.");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_text_printf(t, "seasensor_http_coalesced_total" LABELS " %" PRIu32 "\n", copy[i].method,
+                            copy[i].path, copy[i].coalesced);
+    }
+    write_family(t, "seasensor_http_response_bytes_total", "counter", "Bytes sent per endpoint, headers included.");
+    for (size_t i = 0; i < count; ++i) {
+        metrics_text_printf(t, "seasensor_http_response_bytes_total" LABELS " %" PRIu64 "\n", copy[i].method,
+                            copy[i].path, copy[i].response_bytes);
+    }
+    write_family(t, "seasensor_http_request_duration_seconds", "histogram",
+                 "Time from handler start until the response is sent.");
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t cumulative = 0;
+        for (size_t b = 0; b <= HTTP_METRICS_BUCKETS; ++b) {
+            cumulative += copy[i].duration_buckets[b];
+            metrics_text_printf(t, "seasensor_http_request_duration_seconds_bucket{method=\"%s\",path=\"%s\",le=\"%s\"} %" PRIu32 "\n",
+                                copy[i].method, copy[i].path, b < HTTP_METRICS_BUCKETS ? k_bucket_le[b] : "+Inf",
+                                cumulative);
+        }
+        metrics_text_printf(t, "seasensor_http_request_duration_seconds_sum" LABELS " %.6f\n", copy[i].method,
+                            copy[i].path, copy[i].duration_us_sum / 1e6);
+        metrics_text_printf(t, "seasensor_http_request_duration_seconds_count" LABELS " %" PRIu32 "\n",
+                            copy[i].method, copy[i].path, copy[i].requests);
+    }
+    write_family(t, "seasensor_http_heap_low_water_bytes", "gauge",
+                 "Lowest free heap observed while a request to the endpoint was in flight.");
+    for (size_t i = 0; i < count; ++i) {
+        if (copy[i].requests > 0) {
+            metrics_text_printf(t, "seasensor_http_heap_low_water_bytes" LABELS " %" PRIu32 "\n", copy[i].method,
+                                copy[i].path, copy[i].heap_low_water);
+        }
+    }
+#undef LABELS
+    free(copy);
+
+    metrics_text_gauge(t, "seasensor_http_requests_in_flight", "Requests currently being handled.", in_flight);
+    metrics_text_gauge(t, "seasensor_heap_free_bytes", "Free heap right now.",
+                       (double)heap_caps_get_free_size(HEAP_CAPS));
+    metrics_text_gauge(t, "seasensor_heap_largest_free_block_bytes", "Largest allocatable heap block.",
+                       (double)heap_caps_get_largest_free_block(HEAP_CAPS));
+    metrics_text_gauge(t, "seasensor_uptime_seconds", "Time since boot.", esp_timer_get_time() / 1e6);
+}
@@ -2,23 +2,60 @@
 
 #include "driver/i2c.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #define TAG "i2c_scan"
+#define I2C_SCAN_TIMEOUT_MS 20
+
+esp_err_t i2c_probe_address(i2c_port_t port, uint8_t addr, uint32_t timeout_ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+    if (ticks < 2) {
+        ticks = 2; // a 1-tick timeout may expire at the next tick boundary
+    }
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(port, cmd, ticks);
+    i2c_cmd_link_delete(cmd);
+    return err;
+}
+
+bool i2c_backoff_ready(const i2c_backoff_t *backoff)
+{
+    return backoff->retry_at_us == 0 || esp_timer_get_time() >= backoff->retry_at_us;
+}
+
+void i2c_backoff_fail(i2c_backoff_t *backoff, uint32_t initial_ms, uint32_t max_ms)
+{
+    if (backoff->delay_ms == 0) {
+        backoff->delay_ms = initial_ms;
+    } else if (backoff->delay_ms < max_ms) {
+        backoff->delay_ms = (backoff->delay_ms * 2 > max_ms) ? max_ms : backoff->delay_ms * 2;
+    }
+    backoff->retry_at_us = esp_timer_get_time() + (int64_t)backoff->delay_ms * 1000;
+}
+
+void i2c_backoff_reset(i2c_backoff_t *backoff)
+{
+    backoff->retry_at_us = 0;
+    backoff->delay_ms = 0;
+}
 
 void i2c_scan_and_log(void)
 {
     int found = 0;
     ESP_LOGI(TAG, "Scanning I2C bus (0x03..0x77) on I2C_NUM_0");
     for (int addr = 0x03; addr <= 0x77; ++addr) {
-        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-        i2c_master_stop(cmd);
-        esp_err_t err = i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(100));
-        i2c_cmd_link_delete(cmd);
+        esp_err_t err = i2c_probe_address(I2C_NUM_0, (uint8_t)addr, I2C_SCAN_TIMEOUT_MS);
         if (err == ESP_OK) {
             ESP_LOGI(TAG, "Found device at 0x%02X", addr);
             found++;
+        } else if (err == ESP_ERR_TIMEOUT) {
+            // Bus is stuck (SDA/SCL held low); every further address would time out too
+            ESP_LOGW(TAG, "I2C bus timeout at 0x%02X, aborting scan", addr);
+            break;
         }
     }
     if (!found) {
@@ -1,2 +1,20 @@
 #pragma once
+#include "esp_err.h"
+#include "driver/i2c.h"
+#include <stdbool.h>
+#include <stdint.h>
+
 void i2c_scan_and_log(void);
+
+// Address-only write; an absent device NACKs immediately, a stuck bus costs at most timeout_ms.
+esp_err_t i2c_probe_address(i2c_port_t port, uint8_t addr, uint32_t timeout_ms);
+
+// Exponential retry backoff for devices that went missing, so absent hardware is retried rarely.
+typedef struct {
+    int64_t retry_at_us;
+    uint32_t delay_ms;
+} i2c_backoff_t;
+
+bool i2c_backoff_ready(const i2c_backoff_t *backoff);
+void i2c_backoff_fail(i2c_backoff_t *backoff, uint32_t initial_ms, uint32_t max_ms);
+void i2c_backoff_reset(i2c_backoff_t *backoff);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// One sensor's contribution to an air cycle. Temperatures already include the user offset.
+typedef struct {
+    bool attempted;       // sensor was read this cycle (false = no health change)
+    bool valid;           // read succeeded and passed driver checks
+    bool has_humidity;
+    bool has_pressure;
+    float temperature_c;
+    float humidity_percent;
+    float pressure_hpa;
+} air_fusion_reading_t;
+
+typedef struct {
+    bool have_temperature;
+    bool have_humidity;
+    bool have_pressure;
+    float temperature_c;
+    float humidity_percent;
+    float pressure_hpa;
+    float dew_point_c;            // NAN without humidity
+    float sea_level_pressure_hpa; // NAN without pressure
+    float pressure_trend_hpa_3h;  // NAN without a sample from 2.5-3.5 h ago
+    float bme_health;             // 0..1
+    float aht_health;             // 0..1
+} air_fusion_output_t;
+
+void air_fusion_init(float station_altitude_m);
+void air_fusion_update(const air_fusion_reading_t *bme, const air_fusion_reading_t *aht,
+                       int64_t now_us, air_fusion_output_t *out);
@@ -1,6 +1,28 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// One point of the open-circuit-voltage -> state-of-charge curve; tables are ascending in mV.
+typedef struct {
+    uint16_t millivolts;
+    uint8_t percent;
+} battery_ocv_point_t;
+
+#define BATTERY_OCV_MAX_POINTS 24
+
+typedef struct {
+    float voltage;         // oversampled pack voltage
+    float percent;         // smoothed state of charge from the OCV curve
+    float percent_per_day; // smoothed slope, negative while discharging; NAN until known
+    float days_remaining;  // NAN while charging or before a slope is known
+} battery_status_t;
 
 esp_err_t battery_monitor_init(void);
 esp_err_t battery_monitor_read(float *voltage, float *percent);
+void battery_monitor_get_status(battery_status_t *out);
+
+// Replace the default 1S Li-ion curve (copied; 2..BATTERY_OCV_MAX_POINTS ascending points)
+esp_err_t battery_monitor_set_curve(const battery_ocv_point_t *points, size_t count);
+float battery_monitor_voltage_to_percent(float vbatt);
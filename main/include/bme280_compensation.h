@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Factory trimming parameters as stored in the sensor (0x88..0xA1, 0xE1..0xE7).
+typedef struct {
+    uint16_t dig_T1;
+    int16_t dig_T2;
+    int16_t dig_T3;
+    uint16_t dig_P1;
+    int16_t dig_P2;
+    int16_t dig_P3;
+    int16_t dig_P4;
+    int16_t dig_P5;
+    int16_t dig_P6;
+    int16_t dig_P7;
+    int16_t dig_P8;
+    int16_t dig_P9;
+    uint8_t dig_H1;
+    int16_t dig_H2;
+    uint8_t dig_H3;
+    int16_t dig_H4;
+    int16_t dig_H5;
+    int8_t dig_H6;
+} bme280_calib_t;
+
+// Calibration terms pre-widened and pre-shifted once, so the per-sample path is pure 32-bit math.
+typedef struct {
+    int32_t t1;
+    int32_t t1_x2;
+    int32_t t2;
+    int32_t t3;
+    int32_t p1;
+    int32_t p2;
+    int32_t p3;
+    int32_t p4_s16;
+    int32_t p5;
+    int32_t p6;
+    int32_t p7;
+    int32_t p8;
+    int32_t p9;
+    int32_t h1;
+    int32_t h2;
+    int32_t h3;
+    int32_t h4_s20;
+    int32_t h5;
+    int32_t h6;
+    bool has_humidity;
+} bme280_comp_table_t;
+
+typedef struct {
+    int32_t adc_T;
+    int32_t adc_P;
+    int32_t adc_H;
+} bme280_raw_sample_t;
+
+typedef struct {
+    int32_t temperature_centi_c; // 0.01 degC
+    uint32_t pressure_pa;        // Pa (0 if the calibration is unusable)
+    uint32_t humidity_milli_pct; // 0.001 %RH, 0 on BMP280
+} bme280_fixed_sample_t;
+
+void bme280_comp_parse_calib(const uint8_t block1[26], const uint8_t block2[7], bme280_calib_t *out);
+void bme280_comp_build_table(const bme280_calib_t *calib, bool has_humidity, bme280_comp_table_t *table);
+void bme280_comp_unpack_raw(const uint8_t data[8], bme280_raw_sample_t *out);
+
+// Integer compensation following the Bosch 32-bit reference (datasheet section 4.2.3 / BMP280 8.2):
+// temperature and pressure are bit-exact with BME280_compensate_T_int32 / BMP280_compensate_P_int32,
+// humidity is BME280_compensate_H_int32 (Q22.10 %RH) rescaled to milli-%RH.
+int32_t bme280_comp_t_fine(const bme280_comp_table_t *table, int32_t adc_T);
+void bme280_comp_sample(const bme280_comp_table_t *table, const bme280_raw_sample_t *raw, bme280_fixed_sample_t *out);
+void bme280_comp_batch(const bme280_comp_table_t *table, const bme280_raw_sample_t *raw,
+                       bme280_fixed_sample_t *out, size_t count);
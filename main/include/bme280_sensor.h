@@ -1,9 +1,72 @@
 #pragma once
 
+#include "bme280_compensation.h"
 #include "esp_err.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
+#include <stdint.h>
+
+typedef enum {
+    BME280_MODE_FORCED = 0, // one conversion per read, sensor sleeps in between
+    BME280_MODE_NORMAL,     // continuous conversions, reads are a single data burst
+} bme280_mode_t;
+
+typedef enum {
+    BME280_OSRS_SKIP = 0,
+    BME280_OSRS_X1,
+    BME280_OSRS_X2,
+    BME280_OSRS_X4,
+    BME280_OSRS_X8,
+    BME280_OSRS_X16,
+} bme280_oversampling_t;
+
+typedef enum {
+    BME280_FILTER_OFF = 0,
+    BME280_FILTER_2,
+    BME280_FILTER_4,
+    BME280_FILTER_8,
+    BME280_FILTER_16,
+} bme280_filter_t;
+
+// Register encoding of t_standby (config[7:5]); only used in normal mode.
+typedef enum {
+    BME280_STANDBY_0_5_MS = 0,
+    BME280_STANDBY_62_5_MS,
+    BME280_STANDBY_125_MS,
+    BME280_STANDBY_250_MS,
+    BME280_STANDBY_500_MS,
+    BME280_STANDBY_1000_MS,
+    BME280_STANDBY_10_MS,
+    BME280_STANDBY_20_MS,
+} bme280_standby_t;
+
+typedef struct {
+    bme280_mode_t mode;
+    bme280_oversampling_t osrs_t;
+    bme280_oversampling_t osrs_p;
+    bme280_oversampling_t osrs_h;
+    bme280_filter_t filter;
+    bme280_standby_t standby;
+} bme280_settings_t;
+
+#define BME280_DEFAULT_SETTINGS() {        \
+    .mode = BME280_MODE_FORCED,            \
+    .osrs_t = BME280_OSRS_X2,              \
+    .osrs_p = BME280_OSRS_X4,              \
+    .osrs_h = BME280_OSRS_X1,              \
+    .filter = BME280_FILTER_4,             \
+    .standby = BME280_STANDBY_1000_MS,     \
+}
 
 esp_err_t bme280_sensor_init(i2c_port_t port, gpio_num_t sda_pin, gpio_num_t scl_pin);
+esp_err_t bme280_sensor_configure(const bme280_settings_t *settings);
+uint32_t bme280_sensor_measurement_time_us(const bme280_settings_t *settings);
+// Raw ADC words plus the compensation table let loggers store samples cheaply and
+// compensate them later in bulk with bme280_comp_batch(). All reads return
+// ESP_ERR_INVALID_STATE while no conversion has completed; the settings are rewritten, so the
+// next read recovers without a re-init.
+esp_err_t bme280_sensor_read_raw(bme280_raw_sample_t *out);
+const bme280_comp_table_t *bme280_sensor_comp_table(void);
+esp_err_t bme280_sensor_read_fixed(bme280_fixed_sample_t *out);
+bool bme280_sensor_has_humidity(void);
 esp_err_t bme280_sensor_read(float *temperature_c, float *humidity_percent, float *pressure_hpa);
-
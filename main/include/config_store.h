@@ -12,6 +12,10 @@ typedef struct {
 #define CONFIG_STORE_MAX_NAME_LEN 32
 #define CONFIG_STORE_MAX_WIFI_SSID_LEN 32
 #define CONFIG_STORE_MAX_WIFI_PASS_LEN 64
+#define CONFIG_STORE_MAX_MQTT_URI_LEN 96
+#define CONFIG_STORE_MAX_MQTT_USER_LEN 32
+#define CONFIG_STORE_MAX_MQTT_PASS_LEN 64
+#define CONFIG_STORE_MAX_MQTT_TOPIC_LEN 48
 
 typedef enum {
     SCREEN_ITEM_WATER_TEMP = 0,
@@ -31,6 +35,13 @@ typedef struct {
     float air_temp_c;
 } measurement_offsets_t;
 
+typedef struct {
+    char uri[CONFIG_STORE_MAX_MQTT_URI_LEN]; // e.g. mqtt://192.168.1.10:1883; empty = MQTT off
+    char username[CONFIG_STORE_MAX_MQTT_USER_LEN];
+    char password[CONFIG_STORE_MAX_MQTT_PASS_LEN];
+    char topic[CONFIG_STORE_MAX_MQTT_TOPIC_LEN]; // base topic; state, history and status live under it
+} mqtt_settings_t;
+
 typedef struct {
     measurement_interval_t battery;
     measurement_interval_t air;
@@ -38,18 +49,67 @@ typedef struct {
     measurement_interval_t wifi;
     measurement_interval_t web_ui;
     uint16_t display_on_seconds;
+    uint16_t display_off_seconds; // panel-sleep time before the display domain is power-gated (0 = never)
+    bool display_dim;             // lower contrast shortly before panel sleep
     char device_name[CONFIG_STORE_MAX_NAME_LEN];
     char wifi_ssid[CONFIG_STORE_MAX_WIFI_SSID_LEN];
     char wifi_password[CONFIG_STORE_MAX_WIFI_PASS_LEN];
     uint32_t screen_items[2];
     measurement_offsets_t offsets;
+    mqtt_settings_t mqtt;
 } measurement_config_t;
 
+// Change mask bits, one per user-visible setting group (see config_store_diff)
+typedef enum {
+    CONFIG_FIELD_BATTERY_INTERVAL = 1u << 0,
+    CONFIG_FIELD_AIR_INTERVAL = 1u << 1,
+    CONFIG_FIELD_SEA_INTERVAL = 1u << 2,
+    CONFIG_FIELD_WIFI_INTERVAL = 1u << 3,
+    CONFIG_FIELD_WEB_UI_INTERVAL = 1u << 4,
+    CONFIG_FIELD_DISPLAY_ON = 1u << 5,
+    CONFIG_FIELD_DISPLAY_OFF = 1u << 6,
+    CONFIG_FIELD_DISPLAY_DIM = 1u << 7,
+    CONFIG_FIELD_DEVICE_NAME = 1u << 8,
+    CONFIG_FIELD_WIFI_SSID = 1u << 9,
+    CONFIG_FIELD_WIFI_PASSWORD = 1u << 10,
+    CONFIG_FIELD_SCREENS = 1u << 11,
+    CONFIG_FIELD_OFFSETS = 1u << 12,
+    CONFIG_FIELD_MQTT = 1u << 13,
+} config_field_t;
+
+#define CONFIG_FIELDS_SCHEDULER (CONFIG_FIELD_BATTERY_INTERVAL | CONFIG_FIELD_AIR_INTERVAL | CONFIG_FIELD_SEA_INTERVAL)
+#define CONFIG_FIELDS_WIFI (CONFIG_FIELD_DEVICE_NAME | CONFIG_FIELD_WIFI_SSID | CONFIG_FIELD_WIFI_PASSWORD)
+#define CONFIG_FIELDS_DISPLAY \
+    (CONFIG_FIELD_DISPLAY_ON | CONFIG_FIELD_DISPLAY_OFF | CONFIG_FIELD_DISPLAY_DIM | CONFIG_FIELD_SCREENS)
+#define CONFIG_FIELDS_GOOGLE CONFIG_FIELD_DEVICE_NAME
+
+// Called after a new config generation is published, from the context of config_store_set;
+// `changed` holds the CONFIG_FIELD_* bits that differ from the previous generation. Writers
+// are serialized, so a listener must not call config_store_set itself.
+typedef void (*config_store_listener_t)(const measurement_config_t *cfg, uint32_t changed, void *ctx);
+
+#define CONFIG_STORE_MAX_LISTENERS 8
+
 esp_err_t config_store_init(void);
+// Copy of the active config, for callers that keep it
 measurement_config_t config_store_get(void);
+// Read-only view of the active config without copying. The pointer stays intact across the
+// next config_store_set but not the one after, so use it for short non-blocking reads (and in
+// listeners, which run with writers serialized) rather than caching it.
+const measurement_config_t *config_store_current(uint32_t *generation);
+// Like config_store_current, but pins the generation until config_store_release, however
+// many sets happen meanwhile. For readers that block (sensor reads, delays) while holding it.
+const measurement_config_t *config_store_acquire(uint32_t *generation);
+void config_store_release(const measurement_config_t *cfg);
+uint32_t config_store_generation(void);
 esp_err_t config_store_set(const measurement_config_t *cfg);
+esp_err_t config_store_subscribe(config_store_listener_t listener, void *ctx);
 
 void config_store_reset_defaults(void);
+// Clamp/sanitize in place exactly as config_store_set would before persisting
+void config_store_normalize(measurement_config_t *cfg);
+// CONFIG_FIELD_* bits whose values differ between a and b
+uint32_t config_store_diff(const measurement_config_t *a, const measurement_config_t *b);
 
 uint32_t config_store_interval_to_seconds(measurement_interval_t interval);
 void config_store_normalize_interval(measurement_interval_t *interval);
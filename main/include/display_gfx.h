@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Drawing into an SSD1306-layout framebuffer: DISPLAY_GFX_PAGES rows of 8-pixel-high pages,
+// one byte per column per page, LSB at the top.
+#define DISPLAY_GFX_WIDTH 128
+#define DISPLAY_GFX_HEIGHT 64
+#define DISPLAY_GFX_PAGES (DISPLAY_GFX_HEIGHT / 8)
+#define DISPLAY_GFX_FB_SIZE (DISPLAY_GFX_WIDTH * DISPLAY_GFX_PAGES)
+#define DISPLAY_GFX_FONT_WIDTH 6  // 5 glyph columns + 1 spacing
+#define DISPLAY_GFX_FONT_HEIGHT 8
+
+#define DISPLAY_SPARK_CAPACITY 256
+
+// Bucketed history for a sparkline. Each slot keeps the min/max (value * 10) seen during one
+// bucket so short spikes survive both bucketing and the column decimation when drawn.
+typedef struct {
+    int16_t lo[DISPLAY_SPARK_CAPACITY];
+    int16_t hi[DISPLAY_SPARK_CAPACITY];
+    uint16_t head;  // next slot to open
+    uint16_t count; // filled slots
+    int64_t bucket_start_us;
+    uint32_t revision; // bumped on every change, lets callers skip identical redraws
+} display_spark_ring_t;
+
+void display_gfx_clear(uint8_t *fb);
+void display_gfx_char(uint8_t *fb, int x, int y, char c);
+// Returns the x position after the last drawn glyph
+int display_gfx_text(uint8_t *fb, int x, int y, const char *text);
+// 2x/3x glyphs on page boundaries (page..page+scale-1); returns x after the last glyph
+int display_gfx_text_scaled(uint8_t *fb, int x, int page, const char *text, int scale);
+
+void display_spark_push(display_spark_ring_t *ring, float value, int64_t now_us, int64_t bucket_us);
+// Draws the ring right-aligned into width x (pages * 8) pixels, one column per bucket or
+// min/max-decimated when there are more buckets than columns. min_span is in value * 10.
+void display_gfx_sparkline(uint8_t *fb, int x, int page, int width, int pages,
+                           const display_spark_ring_t *ring, int16_t min_span);
@@ -4,8 +4,18 @@
 #include "sensor_manager.h"
 #include "wifi_manager.h"
 #include "esp_err.h"
+#include <stdint.h>
+
+typedef struct {
+    uint32_t last_bytes;     // I2C payload bytes of the last flush (commands + data)
+    uint32_t last_flush_us;  // wall time of the last flush
+    uint32_t last_render_us; // framebuffer drawing time of the last redraw
+    uint32_t flushes;        // refreshes that reached the panel
+    uint32_t skipped;        // refreshes skipped because the text was unchanged
+} display_flush_stats_t;
 
 esp_err_t display_manager_init(const measurement_config_t *config);
 void display_manager_update_config(const measurement_config_t *config);
 void display_manager_show_snapshot(const sensor_snapshot_t *snapshot, const wifi_status_t *wifi_status);
 void display_manager_next_screen(void);
+void display_manager_get_flush_stats(display_flush_stats_t *out);
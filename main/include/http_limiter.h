@@ -0,0 +1,18 @@
+#pragma once
+
+#include "esp_http_server.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Token buckets per client address and endpoint class, so one chatty display cannot starve
+// the others or the measurement tasks. A small table keeps the most recently seen clients;
+// an evicted client simply comes back with a full bucket.
+
+typedef struct {
+    uint16_t per_minute; // sustained rate
+    uint16_t burst;      // bucket size, i.e. back-to-back requests allowed after a quiet spell
+} http_limit_t;
+
+// Takes one token for this client in bucket_class. false means the request should get the
+// cheap answer instead of the full one; requests whose peer cannot be read are always allowed.
+bool http_limiter_allow(httpd_req_t *req, uint8_t bucket_class, const http_limit_t *limit);
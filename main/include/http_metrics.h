@@ -0,0 +1,65 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-endpoint request statistics for the web server and a small writer for the Prometheus
+// text exposition format.
+//
+// Response bytes are counted on the socket (headers included) through a send override that
+// http_metrics_session_open installs, so every httpd_resp_* path is covered without touching
+// the handlers. A request is measured from http_metrics_request_begin until its last
+// http_metrics_request_end; a handler that hands the request to another task calls
+// http_metrics_request_detach first and that task ends it once the response is out.
+
+#define HTTP_METRICS_BUCKETS 10 // finite latency buckets; a +Inf bucket follows
+
+typedef struct {
+    const char *path;
+    const char *method;
+    uint32_t requests;
+    uint32_t errors;    // handler failures and 4xx/5xx responses
+    uint32_t shed;      // rate-limited requests that got the cheap cached answer
+    uint32_t coalesced; // requests answered with a payload serialized once for many
+    uint64_t response_bytes;
+    uint64_t duration_us_sum;
+    uint32_t duration_buckets[HTTP_METRICS_BUCKETS + 1]; // non-cumulative; last is +Inf
+    uint32_t heap_low_water; // lowest free heap seen while a request was in flight; 0 = none yet
+} http_endpoint_stats_t;
+
+// httpd_config_t.open_fn: resets the socket's counters and installs the counting send
+esp_err_t http_metrics_session_open(httpd_handle_t hd, int sockfd);
+
+void http_metrics_request_begin(httpd_req_t *req, http_endpoint_stats_t *stats);
+void http_metrics_request_detach(httpd_req_t *req);
+void http_metrics_request_end(httpd_req_t *req, esp_err_t handler_err);
+// Tally the current request of req's endpoint as shed / coalesced
+void http_metrics_count_shed(httpd_req_t *req);
+void http_metrics_count_coalesced(httpd_req_t *req);
+
+typedef esp_err_t (*metrics_text_flush_fn)(void *ctx, const char *data, size_t len);
+
+// Line-oriented text buffer that hands full buffers to flush (e.g. as HTTP chunks)
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    metrics_text_flush_fn flush;
+    void *ctx;
+    esp_err_t err;
+} metrics_text_t;
+
+void metrics_text_init(metrics_text_t *t, char *buf, size_t cap, metrics_text_flush_fn flush, void *ctx);
+void metrics_text_printf(metrics_text_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+// HELP/TYPE header plus one unlabelled sample; non-finite values are left out entirely
+void metrics_text_gauge(metrics_text_t *t, const char *name, const char *help, double value);
+// Same for a monotonic count since boot; name it *_total
+void metrics_text_counter(metrics_text_t *t, const char *name, const char *help, uint64_t value);
+esp_err_t metrics_text_finish(metrics_text_t *t);
+
+// Writes the HTTP families (requests, errors, shed, coalesced, bytes, latency histogram, heap low-water)
+// plus process-wide heap and uptime gauges
+void http_metrics_write(metrics_text_t *t, const http_endpoint_stats_t *stats, size_t count);
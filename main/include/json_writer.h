@@ -0,0 +1,47 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming JSON serializer over a caller-owned buffer. Nothing is allocated: when the buffer
+// fills up it is handed to the flush callback (e.g. an HTTP chunk) and reused; without a
+// callback an overflow is reported as ESP_ERR_NO_MEM from json_writer_finish.
+//
+// Every call takes the member key; pass NULL for array elements and the root value.
+
+#define JSON_WRITER_MAX_DEPTH 16
+
+typedef esp_err_t (*json_writer_flush_fn)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    size_t flushed; // bytes already handed to flush
+    json_writer_flush_fn flush;
+    void *ctx;
+    uint32_t has_items; // bit per depth: container already holds a value (comma needed)
+    uint8_t depth;
+    esp_err_t err;
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap, json_writer_flush_fn flush, void *ctx);
+
+void json_begin_object(json_writer_t *w, const char *key);
+void json_end_object(json_writer_t *w);
+void json_begin_array(json_writer_t *w, const char *key);
+void json_end_array(json_writer_t *w);
+
+void json_write_string(json_writer_t *w, const char *key, const char *value);
+// Fixed-point, rounded as printf("%.*f") with trailing zeros trimmed; NAN/Inf become null (as cJSON does)
+void json_write_number(json_writer_t *w, const char *key, double value, uint8_t decimals);
+void json_write_int(json_writer_t *w, const char *key, int64_t value);
+void json_write_bool(json_writer_t *w, const char *key, bool value);
+void json_write_null(json_writer_t *w, const char *key);
+
+// Flushes any buffered tail if the writer has streamed before; otherwise the complete
+// document stays in buf[0..len) so it can go out in a single send.
+esp_err_t json_writer_finish(json_writer_t *w);
+bool json_writer_streamed(const json_writer_t *w);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+
+// UDP discovery responder for the Local Home scan. A broadcast of LOCAL_DISCOVERY_PACKET to
+// LOCAL_DISCOVERY_PORT is answered to the sender with a small JSON object:
+// {"id":"<Google device ID>","port":<HTTP port>,"fw":"<app version>","model":"esp32-dock"}.
+
+#define LOCAL_DISCOVERY_PORT 3311
+#define LOCAL_DISCOVERY_PACKET "SEASENSOR_DISCOVER" // hex 53454153454e534f525f444953434f564552
+
+typedef struct {
+    uint32_t replies;
+    int64_t last_reply_us;          // 0 = never
+    int32_t discovery_to_query_ms;  // last reply to the first QUERY after it; -1 = not measured yet
+} local_discovery_stats_t;
+
+esp_err_t local_discovery_start(uint16_t http_port);
+// Called for every QUERY; the first one after a discovery reply completes the measurement
+void local_discovery_note_query(void);
+local_discovery_stats_t local_discovery_get_stats(void);
@@ -2,7 +2,32 @@
 
 #include "sensor_manager.h"
 #include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
 
+// MQTT publisher for Home Assistant/Fibaro. Broker and base topic come from the config
+// (measurement_config_t.mqtt) and are followed at runtime. Under the base topic:
+//   <base>/state    latest snapshot, retained, QoS 1
+//   <base>/history  JSON array of snapshots taken while the broker was unreachable, QoS 1
+//   <base>/status   "online" / "offline" (last will), retained
+// Snapshots wait in a bounded queue in RTC memory until the broker acknowledges them. While
+// they cannot be sent the queue keeps the latest snapshot per 15 min, 48 of them, so a reset
+// or an outage of up to 12 h keeps that resolution; longer outages drop the oldest entries.
+
+typedef struct {
+    bool connected;
+    uint32_t queued;              // snapshots not yet acknowledged by the broker
+    uint32_t dropped;             // oldest snapshots discarded because the queue was full
+    uint32_t coalesced;           // unsent snapshots replaced by a newer one in the same 15 min
+    uint32_t acked;               // snapshots acknowledged since boot
+    uint32_t publishes;           // publish messages handed to the client since boot
+    uint64_t bytes;               // payload bytes in those messages
+    int32_t last_drain_ms;        // connect until the backlog was acknowledged; -1 = none yet
+    uint32_t last_drain_snapshots;
+} mqtt_bridge_stats_t;
+
+// Call after wifi_manager_init (the client needs the network stack)
 esp_err_t mqtt_bridge_init(void);
+// Non-blocking; hands the snapshot to the bridge task
 void mqtt_bridge_publish_snapshot(const sensor_snapshot_t *snapshot);
-
+mqtt_bridge_stats_t mqtt_bridge_get_stats(void);
@@ -12,8 +12,20 @@ typedef enum {
     SCHED_TASK_SEA,
 } scheduler_task_id_t;
 
+typedef struct {
+    uint32_t runs;        // completed runs since boot, scheduled or on demand
+    int64_t last_done_us; // esp_timer time of the last completed run; 0 = never
+    bool busy;            // a run is queued or executing
+} scheduler_task_status_t;
+
 esp_err_t scheduler_init(const measurement_config_t *config);
 void scheduler_register_task(scheduler_task_id_t task_id, scheduler_callback_t cb, void *ctx);
+// Runs the task once on the scheduler's timer task as soon as it is free, serialized with the
+// periodic runs. A run that is already queued or executing is shared instead of starting a
+// second one (single-flight). *baseline_runs receives the completed-run count; the caller's
+// run is done once scheduler_get_status reports more runs than that.
+esp_err_t scheduler_run_now(scheduler_task_id_t task_id, uint32_t *baseline_runs);
+void scheduler_get_status(scheduler_task_id_t task_id, scheduler_task_status_t *out);
 esp_err_t scheduler_apply_config(const measurement_config_t *config);
 void scheduler_stop(void);
 
@@ -1,15 +1,22 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdint.h>
 
+// Kept in RTC memory by mqtt_bridge.c across resets: bump MQTT_QUEUE_VERSION when fields change
 typedef struct {
     float water_temp_c;
     float sea_level_cm;
     float air_temp_c;
     float humidity_percent;
     float air_pressure_hpa;
+    float dew_point_c;            // derived by the air fusion stage; NAN until known
+    float sea_level_pressure_hpa;
+    float pressure_trend_hpa_3h;
     float battery_percent;
     float battery_voltage;
+    float battery_days_remaining; // forecast from the discharge slope; NAN while charging/unknown
+    uint32_t seq;                 // bumped on every completed measurement; 0 = boot defaults
 } sensor_snapshot_t;
 
 esp_err_t sensor_manager_init(void);
@@ -18,3 +25,4 @@ void sensor_manager_trigger_air_measurement(void);
 void sensor_manager_trigger_battery_measurement(void);
 
 void sensor_manager_get_snapshot(sensor_snapshot_t *out);
+uint32_t sensor_manager_get_seq(void);
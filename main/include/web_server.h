@@ -2,7 +2,10 @@
 
 #include "config_store.h"
 #include "esp_err.h"
+#include "sensor_manager.h"
 
-esp_err_t web_server_start(void);
-void web_server_update_config(const measurement_config_t *config);
+#define WEB_SERVER_PORT 80
 
+esp_err_t web_server_start(void);
+// Wakes /api/events subscribers; cheap when nobody is listening
+void web_server_publish_snapshot(const sensor_snapshot_t *snapshot);
@@ -10,6 +10,6 @@ typedef struct {
     esp_ip4_addr_t ap_ip;
 } wifi_status_t;
 
-esp_err_t wifi_manager_init(const measurement_config_t *config);
-void wifi_manager_update_config(const measurement_config_t *config);
+// Follows config_store changes itself (hostname, AP SSID, STA credentials)
+esp_err_t wifi_manager_init(void);
 wifi_status_t wifi_manager_get_status(void);
@@ -0,0 +1,268 @@
+#include "json_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define JSON_MAX_DECIMALS 6
+#define JSON_FIXED_LIMIT 1e15 // beyond this the scaled value no longer fits the integer path
+
+static const uint32_t k_pow10[JSON_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap, json_writer_flush_fn flush, void *ctx)
+{
+    *w = (json_writer_t){
+        .buf = buf,
+        .cap = cap,
+        .flush = flush,
+        .ctx = ctx,
+        .err = ESP_OK,
+    };
+}
+
+static bool flush_buffer(json_writer_t *w)
+{
+    if (!w->flush) {
+        w->err = ESP_ERR_NO_MEM;
+        return false;
+    }
+    if (w->len > 0) {
+        esp_err_t err = w->flush(w->ctx, w->buf, w->len);
+        if (err != ESP_OK) {
+            w->err = err;
+            return false;
+        }
+        w->flushed += w->len;
+        w->len = 0;
+    }
+    return true;
+}
+
+static void put(json_writer_t *w, const char *data, size_t len)
+{
+    while (len > 0 && w->err == ESP_OK) {
+        if (w->len == w->cap && !flush_buffer(w)) {
+            return;
+        }
+        size_t room = w->cap - w->len;
+        size_t n = len < room ? len : room;
+        memcpy(&w->buf[w->len], data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void put_char(json_writer_t *w, char c)
+{
+    if (w->len < w->cap) {
+        w->buf[w->len++] = c;
+        return;
+    }
+    put(w, &c, 1);
+}
+
+static void put_escaped(json_writer_t *w, const char *s)
+{
+    put_char(w, '"');
+    const char *run = s;
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put(w, run, (size_t)(s - run));
+        run = s + 1;
+        switch (c) {
+            case '"': put(w, "\\\"", 2); break;
+            case '\\': put(w, "\\\\", 2); break;
+            case '\n': put(w, "\\n", 2); break;
+            case '\r': put(w, "\\r", 2); break;
+            case '\t': put(w, "\\t", 2); break;
+            default: {
+                char esc[7];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                put(w, esc, 6);
+                break;
+            }
+        }
+    }
+    put(w, run, (size_t)(s - run));
+    put_char(w, '"');
+}
+
+static void begin_value(json_writer_t *w, const char *key)
+{
+    uint32_t bit = 1u << w->depth;
+    if (w->has_items & bit) {
+        put_char(w, ',');
+    }
+    w->has_items |= bit;
+    if (key) {
+        put_escaped(w, key);
+        put_char(w, ':');
+    }
+}
+
+static void open_container(json_writer_t *w, const char *key, char brace)
+{
+    begin_value(w, key);
+    put_char(w, brace);
+    if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth++;
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void close_container(json_writer_t *w, char brace)
+{
+    if (w->depth == 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    put_char(w, brace);
+}
+
+void json_begin_object(json_writer_t *w, const char *key)
+{
+    open_container(w, key, '{');
+}
+
+void json_end_object(json_writer_t *w)
+{
+    close_container(w, '}');
+}
+
+void json_begin_array(json_writer_t *w, const char *key)
+{
+    open_container(w, key, '[');
+}
+
+void json_end_array(json_writer_t *w)
+{
+    close_container(w, ']');
+}
+
+void json_write_string(json_writer_t *w, const char *key, const char *value)
+{
+    begin_value(w, key);
+    if (!value) {
+        put(w, "null", 4);
+        return;
+    }
+    put_escaped(w, value);
+}
+
+static size_t format_uint(char *end, uint64_t v)
+{
+    // Writes digits backwards ending just before `end`; returns the digit count
+    size_t n = 0;
+    do {
+        *--end = (char)('0' + (v % 10));
+        v /= 10;
+        ++n;
+    } while (v);
+    return n;
+}
+
+void json_write_int(json_writer_t *w, const char *key, int64_t value)
+{
+    begin_value(w, key);
+    char digits[21];
+    char *end = digits + sizeof(digits);
+    uint64_t mag = value < 0 ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+    size_t n = format_uint(end, mag);
+    if (value < 0) {
+        digits[sizeof(digits) - n - 1] = '-';
+        ++n;
+    }
+    put(w, end - n, n);
+}
+
+void json_write_number(json_writer_t *w, const char *key, double value, uint8_t decimals)
+{
+    begin_value(w, key);
+    if (!isfinite(value)) {
+        put(w, "null", 4);
+        return;
+    }
+    if (decimals > JSON_MAX_DECIMALS) {
+        decimals = JSON_MAX_DECIMALS;
+    }
+    double mag = fabs(value);
+    if (mag >= JSON_FIXED_LIMIT / k_pow10[decimals]) {
+        char text[32];
+        int n = snprintf(text, sizeof(text), "%.17g", value);
+        put(w, text, (size_t)n);
+        return;
+    }
+    // Round once in the scaled integer domain, then print integer and fraction digits. fma
+    // recovers the product's rounding error, so near-ties and exact ties (half to even) round
+    // the way printf("%.*f") does; below JSON_FIXED_LIMIT every step here is exact.
+    double product = mag * k_pow10[decimals];
+    double product_err = fma(mag, k_pow10[decimals], -product);
+    double whole = floor(product);
+    double above_half = product - whole - 0.5;
+    uint64_t scaled = (uint64_t)whole;
+    if (above_half > 0 || (above_half == 0 && (product_err > 0 || (product_err == 0 && (scaled & 1))))) {
+        ++scaled;
+    }
+    uint64_t ipart = scaled / k_pow10[decimals];
+    uint32_t frac = (uint32_t)(scaled % k_pow10[decimals]);
+
+    char text[32];
+    char *end = text + sizeof(text);
+    char *p = end;
+    int frac_digits = decimals;
+    while (frac_digits > 0 && frac % 10 == 0) { // trim trailing zeros
+        frac /= 10;
+        --frac_digits;
+    }
+    if (frac_digits > 0) {
+        for (int i = 0; i < frac_digits; ++i) {
+            *--p = (char)('0' + frac % 10);
+            frac /= 10;
+        }
+        *--p = '.';
+    }
+    p -= format_uint(p, ipart);
+    if (value < 0 && scaled != 0) {
+        *--p = '-';
+    }
+    put(w, p, (size_t)(end - p));
+}
+
+void json_write_bool(json_writer_t *w, const char *key, bool value)
+{
+    begin_value(w, key);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_write_null(json_writer_t *w, const char *key)
+{
+    begin_value(w, key);
+    put(w, "null", 4);
+}
+
+esp_err_t json_writer_finish(json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->depth != 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+    if (w->err == ESP_OK && w->flushed > 0) {
+        flush_buffer(w);
+    }
+    return w->err;
+}
+
+bool json_writer_streamed(const json_writer_t *w)
+{
+    return w->flushed > 0;
+}
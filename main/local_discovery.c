@@ -0,0 +1,127 @@
+#include "local_discovery.h"
+
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "google_bridge.h"
+#include "json_writer.h"
+#include "lwip/sockets.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define TAG "discovery"
+
+#define DISCOVERY_TASK_STACK 3072
+#define DISCOVERY_TASK_PRIO 4
+#define DISCOVERY_REPLY_MAX 160
+#define DISCOVERY_RETRY_MS 1000 // after a socket error, e.g. while the netif is down
+
+static int s_sock = -1;
+static uint16_t s_http_port;
+static local_discovery_stats_t s_stats = {.discovery_to_query_ms = -1};
+static bool s_awaiting_query; // a reply went out and no QUERY has followed yet
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t build_reply(char *buf, size_t cap)
+{
+    json_writer_t w;
+    json_writer_init(&w, buf, cap, NULL, NULL);
+    json_begin_object(&w, NULL);
+    json_write_string(&w, "id", google_bridge_device_id());
+    json_write_int(&w, "port", s_http_port);
+    json_write_string(&w, "fw", esp_app_get_description()->version);
+    json_write_string(&w, "model", "esp32-dock");
+    json_end_object(&w);
+    return json_writer_finish(&w) == ESP_OK ? w.len : 0;
+}
+
+static void discovery_task(void *ctx)
+{
+    (void)ctx;
+    char packet[sizeof(LOCAL_DISCOVERY_PACKET) + 1];
+    char reply[DISCOVERY_REPLY_MAX];
+    while (true) {
+        struct sockaddr_storage src;
+        socklen_t src_len = sizeof(src);
+        int n = recvfrom(s_sock, packet, sizeof(packet), 0, (struct sockaddr *)&src, &src_len);
+        if (n < 0) {
+            vTaskDelay(pdMS_TO_TICKS(DISCOVERY_RETRY_MS));
+            continue;
+        }
+        // Exact match only; the buffer is one byte larger so longer packets don't pass as a prefix
+        if (n != sizeof(LOCAL_DISCOVERY_PACKET) - 1 || memcmp(packet, LOCAL_DISCOVERY_PACKET, n) != 0) {
+            continue;
+        }
+        size_t len = build_reply(reply, sizeof(reply));
+        if (len == 0 || sendto(s_sock, reply, len, 0, (struct sockaddr *)&src, src_len) < 0) {
+            ESP_LOGW(TAG, "Discovery reply not sent");
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&s_lock);
+        s_stats.replies++;
+        s_stats.last_reply_us = now;
+        s_awaiting_query = true;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+esp_err_t local_discovery_start(uint16_t http_port)
+{
+    if (s_sock >= 0) {
+        return ESP_OK;
+    }
+    s_http_port = http_port;
+
+    // Counted in the lwIP socket budget next to HTTPD_MAX_SOCKETS in web_server.c
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(LOCAL_DISCOVERY_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "bind %d: errno %d", LOCAL_DISCOVERY_PORT, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+    s_sock = sock;
+    if (xTaskCreate(discovery_task, "discovery", DISCOVERY_TASK_STACK, NULL, DISCOVERY_TASK_PRIO, NULL) != pdPASS) {
+        close(sock);
+        s_sock = -1;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Answering Local Home discovery on UDP %d", LOCAL_DISCOVERY_PORT);
+    return ESP_OK;
+}
+
+void local_discovery_note_query(void)
+{
+    int64_t now = esp_timer_get_time();
+    int32_t elapsed_ms = -1;
+    portENTER_CRITICAL(&s_lock);
+    if (s_awaiting_query) {
+        s_awaiting_query = false;
+        elapsed_ms = (int32_t)((now - s_stats.last_reply_us) / 1000);
+        s_stats.discovery_to_query_ms = elapsed_ms;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (elapsed_ms >= 0) {
+        ESP_LOGI(TAG, "First QUERY %" PRId32 " ms after discovery", elapsed_ms);
+    }
+}
+
+local_discovery_stats_t local_discovery_get_stats(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    local_discovery_stats_t stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    return stats;
+}
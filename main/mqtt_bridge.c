@@ -1,26 +1,530 @@
 #include "mqtt_bridge.h"
 
+#include "config_store.h"
+#include "esp_attr.h"
+#include "esp_crc.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "json_writer.h"
+#include "mqtt_client.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 
 #define TAG "mqtt"
 
+#define MQTT_QUEUE_LEN 48          // snapshots kept for the broker (RTC slow memory, ~3.1 KB)
+#define MQTT_QUEUE_SLOT_US (15LL * 60 * 1000000) // unsent snapshots kept: one per 15 min, so 12 h
+#define MQTT_QUEUE_MAGIC 0x5153514D // "MQSQ"
+#define MQTT_QUEUE_VERSION 1        // bump with any change to sensor_snapshot_t or queued_snapshot_t
+#define MQTT_BATCH_MAX 8           // snapshots per history message
+#define MQTT_ENTRY_MAX_LEN 448     // worst-case JSON of one snapshot
+#define MQTT_BUFFER_SIZE 4096      // client buffer; a full history batch goes out in one message
+#define MQTT_MAX_INFLIGHT 8        // unacknowledged publishes that cover queue entries
+#define MQTT_QOS 1
+#define MQTT_DECIMALS 2
+#define MQTT_TASK_STACK 4096
+#define MQTT_TASK_PRIO 5
+#define MQTT_INBOX_LEN 8           // snapshots waiting for the bridge task
+#define MQTT_EVENTS_LEN (MQTT_MAX_INFLIGHT + 8)
+
+typedef struct {
+    sensor_snapshot_t snapshot;
+    uint32_t boot;     // s_queue.boot when taken; uptime_us is only comparable within one boot
+    int64_t uptime_us;
+} queued_snapshot_t;
+
+// Ring of unacknowledged snapshots. RTC_NOINIT memory keeps it across panics, watchdog and
+// software resets (not power loss), so it is validated by magic and CRC before use. An OTA
+// reboot is a software reset too: `layout` makes a ring written by firmware with a different
+// snapshot layout start over instead of being published with the new field offsets.
+typedef struct {
+    uint32_t magic;
+    uint32_t layout; // queue_layout()
+    uint32_t boot;
+    uint16_t head;
+    uint16_t count;
+    queued_snapshot_t entries[MQTT_QUEUE_LEN];
+    uint32_t crc; // over everything above
+} snapshot_queue_t;
+
+typedef enum {
+    BRIDGE_EV_CONNECTED,
+    BRIDGE_EV_DISCONNECTED,
+    BRIDGE_EV_PUBLISHED,
+    BRIDGE_EV_DELETED,
+    BRIDGE_EV_RECONFIGURE,
+} bridge_event_type_t;
+
+typedef struct {
+    bridge_event_type_t type;
+    int msg_id;
+} bridge_event_t;
+
+// A publish the broker has not acknowledged yet, covering `entries` snapshots at the queue front
+typedef struct {
+    int msg_id;
+    uint16_t entries;
+    bool acked;
+} inflight_t;
+
+static RTC_NOINIT_ATTR snapshot_queue_t s_queue;
+
+// Owned by the bridge task; other tasks only talk to it through the two queues below
+static esp_mqtt_client_handle_t s_client;
+static bool s_connected;
+static inflight_t s_inflight[MQTT_MAX_INFLIGHT];
+static size_t s_inflight_count;
+static size_t s_sent; // queue entries covered by s_inflight
+static int64_t s_connected_us;
+static bool s_draining; // a backlog existed at connect and is not acknowledged yet
+static uint32_t s_drain_acked;
+static char s_topic_state[CONFIG_STORE_MAX_MQTT_TOPIC_LEN + 8];
+static char s_topic_history[CONFIG_STORE_MAX_MQTT_TOPIC_LEN + 8];
+static char s_topic_status[CONFIG_STORE_MAX_MQTT_TOPIC_LEN + 8];
+static char s_payload[MQTT_BUFFER_SIZE];
+
+static TaskHandle_t s_task;
+static QueueHandle_t s_inbox;  // sensor_snapshot_t from mqtt_bridge_publish_snapshot
+static QueueHandle_t s_events; // bridge_event_t from the client and the config listener
+static uint32_t s_last_seq; // last snapshot queued this boot
+static mqtt_bridge_stats_t s_stats = {.last_drain_ms = -1};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t queue_layout(void)
+{
+    // The size catches most struct changes even when MQTT_QUEUE_VERSION was not bumped
+    return (uint32_t)MQTT_QUEUE_VERSION << 16 | (uint32_t)sizeof(queued_snapshot_t);
+}
+
+static void queue_seal(void)
+{
+    s_queue.crc = esp_crc32_le(0, (const uint8_t *)&s_queue, offsetof(snapshot_queue_t, crc));
+}
+
+static void queue_restore(void)
+{
+    bool valid = s_queue.magic == MQTT_QUEUE_MAGIC && s_queue.layout == queue_layout() &&
+                 s_queue.head < MQTT_QUEUE_LEN &&
+                 s_queue.count <= MQTT_QUEUE_LEN &&
+                 esp_crc32_le(0, (const uint8_t *)&s_queue, offsetof(snapshot_queue_t, crc)) == s_queue.crc;
+    if (!valid) {
+        memset(&s_queue, 0, sizeof(s_queue));
+        s_queue.magic = MQTT_QUEUE_MAGIC;
+        s_queue.layout = queue_layout();
+    } else if (s_queue.count > 0) {
+        ESP_LOGI(TAG, "%u unsent snapshots kept across reset", s_queue.count);
+    }
+    s_queue.boot++;
+    queue_seal();
+}
+
+static queued_snapshot_t *queue_at(size_t i)
+{
+    return &s_queue.entries[(s_queue.head + i) % MQTT_QUEUE_LEN];
+}
+
+static void stats_update_queue(uint32_t dropped, uint32_t coalesced, uint32_t acked)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.queued = s_queue.count;
+    s_stats.dropped += dropped;
+    s_stats.coalesced += coalesced;
+    s_stats.acked += acked;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void queue_push(const sensor_snapshot_t *snapshot)
+{
+    int64_t now_us = esp_timer_get_time();
+    // Every measurement group bumps seq, so at short intervals the ring would fill in seconds.
+    // An unsent newest entry from the same 15 min slot is replaced instead: the snapshot holds
+    // every field, so the latest one per slot loses nothing but intermediate readings.
+    if (s_queue.count > s_sent) {
+        queued_snapshot_t *newest = queue_at(s_queue.count - 1);
+        if (newest->boot == s_queue.boot && newest->uptime_us / MQTT_QUEUE_SLOT_US == now_us / MQTT_QUEUE_SLOT_US) {
+            *newest = (queued_snapshot_t){.snapshot = *snapshot, .boot = s_queue.boot, .uptime_us = now_us};
+            queue_seal();
+            stats_update_queue(0, 1, 0);
+            return;
+        }
+    }
+    uint32_t dropped = 0;
+    if (s_queue.count == MQTT_QUEUE_LEN) {
+        // Drop the oldest entry not awaiting an ack; flush() keeps s_sent below the capacity
+        for (size_t i = s_sent; i + 1 < s_queue.count; ++i) {
+            *queue_at(i) = *queue_at(i + 1);
+        }
+        s_queue.count--;
+        dropped = 1;
+    }
+    *queue_at(s_queue.count) = (queued_snapshot_t){
+        .snapshot = *snapshot,
+        .boot = s_queue.boot,
+        .uptime_us = now_us,
+    };
+    s_queue.count++;
+    queue_seal();
+    stats_update_queue(dropped, 0, 0);
+}
+
+static void queue_pop(size_t n)
+{
+    s_queue.head = (s_queue.head + n) % MQTT_QUEUE_LEN;
+    s_queue.count -= n;
+    queue_seal();
+    stats_update_queue(0, 0, n);
+}
+
+static void write_entry(json_writer_t *w, const queued_snapshot_t *e, int64_t now_us)
+{
+    const sensor_snapshot_t *s = &e->snapshot;
+    json_begin_object(w, NULL);
+    json_write_number(w, "water_temp_c", s->water_temp_c, MQTT_DECIMALS);
+    json_write_number(w, "sea_level_cm", s->sea_level_cm, MQTT_DECIMALS);
+    json_write_number(w, "air_temp_c", s->air_temp_c, MQTT_DECIMALS);
+    json_write_number(w, "humidity_percent", s->humidity_percent, MQTT_DECIMALS);
+    json_write_number(w, "air_pressure_hpa", s->air_pressure_hpa, MQTT_DECIMALS);
+    json_write_number(w, "dew_point_c", s->dew_point_c, MQTT_DECIMALS);
+    json_write_number(w, "sea_level_pressure_hpa", s->sea_level_pressure_hpa, MQTT_DECIMALS);
+    json_write_number(w, "pressure_trend_hpa_3h", s->pressure_trend_hpa_3h, MQTT_DECIMALS);
+    json_write_number(w, "battery_percent", s->battery_percent, MQTT_DECIMALS);
+    json_write_number(w, "battery_voltage", s->battery_voltage, 3);
+    json_write_number(w, "battery_days_remaining", s->battery_days_remaining, 1);
+    // (boot, seq) identifies a snapshot; QoS 1 may deliver one twice after a reconnect
+    json_write_int(w, "seq", s->seq);
+    json_write_int(w, "boot", e->boot);
+    json_write_int(w, "uptime_ms", e->uptime_us / 1000);
+    if (e->boot == s_queue.boot) {
+        json_write_int(w, "age_ms", (now_us - e->uptime_us) / 1000);
+    }
+    json_end_object(w);
+}
+
+// Formats queue entries [first, first + *n) as a history array; *n shrinks to what fits
+static size_t format_history(size_t first, size_t *n)
+{
+    int64_t now_us = esp_timer_get_time();
+    json_writer_t w;
+    json_writer_init(&w, s_payload, sizeof(s_payload), NULL, NULL);
+    json_begin_array(&w, NULL);
+    size_t written = 0;
+    while (written < *n && w.len + MQTT_ENTRY_MAX_LEN < sizeof(s_payload)) {
+        write_entry(&w, queue_at(first + written), now_us);
+        written++;
+    }
+    json_end_array(&w);
+    *n = written;
+    return json_writer_finish(&w) == ESP_OK ? w.len : 0;
+}
+
+static size_t format_state(size_t index)
+{
+    json_writer_t w;
+    json_writer_init(&w, s_payload, sizeof(s_payload), NULL, NULL);
+    write_entry(&w, queue_at(index), esp_timer_get_time());
+    return json_writer_finish(&w) == ESP_OK ? w.len : 0;
+}
+
+static void count_publish(size_t len)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.publishes++;
+    s_stats.bytes += len;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+// Sends every unsent entry: the backlog as history batches, then the newest as retained state.
+// Everything is enqueued at once so the radio handles the backlog in one burst.
+static void flush(void)
+{
+    if (!s_client || !s_connected) {
+        return;
+    }
+    while (s_inflight_count < MQTT_MAX_INFLIGHT && s_sent < s_queue.count) {
+        size_t pending = s_queue.count - s_sent;
+        size_t n = 1;
+        size_t len;
+        const char *topic;
+        bool retain;
+        if (pending == 1) {
+            len = format_state(s_sent);
+            topic = s_topic_state;
+            retain = true;
+        } else {
+            n = pending - 1;
+            if (n > MQTT_BATCH_MAX) {
+                n = MQTT_BATCH_MAX;
+            }
+            len = format_history(s_sent, &n);
+            topic = s_topic_history;
+            retain = false;
+        }
+        // A full queue must keep one entry outside the in-flight window that a push can drop
+        if (len == 0 || s_sent + n >= MQTT_QUEUE_LEN) {
+            break;
+        }
+        int msg_id = esp_mqtt_client_enqueue(s_client, topic, s_payload, (int)len, MQTT_QOS, retain, true);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Publish to %s not queued", topic);
+            break;
+        }
+        s_inflight[s_inflight_count++] = (inflight_t){.msg_id = msg_id, .entries = (uint16_t)n};
+        s_sent += n;
+        count_publish(len);
+    }
+}
+
+static void on_acked(int msg_id)
+{
+    for (size_t i = 0; i < s_inflight_count; ++i) {
+        if (s_inflight[i].msg_id == msg_id) {
+            s_inflight[i].acked = true;
+            break;
+        }
+    }
+    // Entries leave the queue in order, once every publish ahead of them is acknowledged too
+    size_t done = 0;
+    size_t entries = 0;
+    while (done < s_inflight_count && s_inflight[done].acked) {
+        entries += s_inflight[done].entries;
+        done++;
+    }
+    if (done == 0) {
+        return;
+    }
+    memmove(s_inflight, s_inflight + done, (s_inflight_count - done) * sizeof(s_inflight[0]));
+    s_inflight_count -= done;
+    s_sent -= entries;
+    queue_pop(entries);
+    s_drain_acked += entries;
+
+    if (s_draining && s_queue.count == 0) {
+        s_draining = false;
+        int64_t elapsed_us = esp_timer_get_time() - s_connected_us;
+        int32_t drain_ms = (int32_t)(elapsed_us / 1000);
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.last_drain_ms = drain_ms;
+        s_stats.last_drain_snapshots = s_drain_acked;
+        portEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGI(TAG, "Backlog of %" PRIu32 " snapshots drained %" PRId32 " ms after connect (%.1f/s)", s_drain_acked,
+                 drain_ms, elapsed_us > 0 ? s_drain_acked * 1e6 / elapsed_us : 0.0);
+    }
+}
+
+// The client gave up on a publish (outbox expiry): it and everything sent after it go out again
+static void on_deleted(int msg_id)
+{
+    for (size_t i = 0; i < s_inflight_count; ++i) {
+        if (s_inflight[i].msg_id != msg_id) {
+            continue;
+        }
+        for (size_t j = i; j < s_inflight_count; ++j) {
+            s_sent -= s_inflight[j].entries;
+        }
+        s_inflight_count = i;
+        return;
+    }
+}
+
+static void set_connected(bool connected)
+{
+    s_connected = connected;
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.connected = connected;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void on_mqtt_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    (void)arg;
+    (void)base;
+    esp_mqtt_event_handle_t event = data;
+    bridge_event_t ev = {.msg_id = event->msg_id};
+    switch ((esp_mqtt_event_id_t)id) {
+        case MQTT_EVENT_CONNECTED:
+            ev.type = BRIDGE_EV_CONNECTED;
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ev.type = BRIDGE_EV_DISCONNECTED;
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            ev.type = BRIDGE_EV_PUBLISHED;
+            break;
+        case MQTT_EVENT_DELETED:
+            ev.type = BRIDGE_EV_DELETED;
+            break;
+        case MQTT_EVENT_ERROR:
+            ESP_LOGW(TAG, "Client error (type %d)", event->error_handle ? event->error_handle->error_type : -1);
+            return;
+        default:
+            return;
+    }
+    // Runs in the client task, which holds the client lock the bridge task may be waiting
+    // for, so it must not block; the queue is sized for every ack the window can produce
+    if (xQueueSend(s_events, &ev, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Bridge event %d dropped", ev.type);
+    }
+    xTaskNotifyGive(s_task);
+}
+
+static void stop_client(void)
+{
+    if (!s_client) {
+        return;
+    }
+    // The outbox goes with the client, so the window is sent again by the next one
+    esp_mqtt_client_destroy(s_client);
+    s_client = NULL;
+    set_connected(false);
+    s_inflight_count = 0;
+    s_sent = 0;
+}
+
+static void start_client(void)
+{
+    // A copy, since client init and start block while the config may move on
+    const mqtt_settings_t settings = config_store_current(NULL)->mqtt;
+    const mqtt_settings_t *m = &settings;
+    if (m->uri[0] == '\0') {
+        ESP_LOGI(TAG, "No broker configured; snapshots are kept for when one is");
+        return;
+    }
+    snprintf(s_topic_state, sizeof(s_topic_state), "%s/state", m->topic);
+    snprintf(s_topic_history, sizeof(s_topic_history), "%s/history", m->topic);
+    snprintf(s_topic_status, sizeof(s_topic_status), "%s/status", m->topic);
+
+    // The client copies every string it is given
+    const esp_mqtt_client_config_t cfg = {
+        .broker.address.uri = m->uri,
+        .credentials.username = m->username[0] ? m->username : NULL,
+        .credentials.authentication.password = m->password[0] ? m->password : NULL,
+        .session.last_will = {.topic = s_topic_status, .msg = "offline", .qos = MQTT_QOS, .retain = 1},
+        .buffer.size = MQTT_BUFFER_SIZE,
+    };
+    s_client = esp_mqtt_client_init(&cfg);
+    if (!s_client) {
+        ESP_LOGE(TAG, "Client init failed for %s", m->uri);
+        return;
+    }
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, on_mqtt_event, NULL);
+    if (esp_mqtt_client_start(s_client) != ESP_OK) {
+        ESP_LOGE(TAG, "Client start failed");
+        stop_client();
+        return;
+    }
+    ESP_LOGI(TAG, "Publishing to %s under %s/", m->uri, m->topic);
+}
+
+static void handle_event(const bridge_event_t *ev)
+{
+    switch (ev->type) {
+        case BRIDGE_EV_CONNECTED:
+            set_connected(true);
+            // The in-flight window is kept: the client's outbox retransmits those publishes
+            // itself, and re-enqueueing them would send every batch twice per reconnect
+            s_connected_us = esp_timer_get_time();
+            s_draining = s_queue.count > 1;
+            s_drain_acked = 0;
+            esp_mqtt_client_enqueue(s_client, s_topic_status, "online", 0, MQTT_QOS, 1, true);
+            ESP_LOGI(TAG, "Connected, %u snapshots queued", s_queue.count);
+            break;
+        case BRIDGE_EV_DISCONNECTED:
+            set_connected(false);
+            s_draining = false;
+            break;
+        case BRIDGE_EV_PUBLISHED:
+            on_acked(ev->msg_id);
+            break;
+        case BRIDGE_EV_DELETED:
+            on_deleted(ev->msg_id);
+            break;
+        case BRIDGE_EV_RECONFIGURE:
+            stop_client();
+            start_client();
+            break;
+    }
+}
+
+static void bridge_task(void *ctx)
+{
+    (void)ctx;
+    start_client();
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bridge_event_t ev;
+        while (xQueueReceive(s_events, &ev, 0) == pdTRUE) {
+            handle_event(&ev);
+        }
+        sensor_snapshot_t snapshot;
+        while (xQueueReceive(s_inbox, &snapshot, 0) == pdTRUE) {
+            // Every sensor task publishes the shared snapshot, so one seq can arrive repeatedly
+            if (snapshot.seq != s_last_seq) {
+                s_last_seq = snapshot.seq;
+                queue_push(&snapshot);
+            }
+        }
+        flush();
+    }
+}
+
+static void on_config_changed(const measurement_config_t *cfg, uint32_t changed, void *ctx)
+{
+    (void)cfg;
+    (void)ctx;
+    if (!(changed & CONFIG_FIELD_MQTT)) {
+        return;
+    }
+    bridge_event_t ev = {.type = BRIDGE_EV_RECONFIGURE};
+    if (xQueueSend(s_events, &ev, 0) == pdTRUE) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
 esp_err_t mqtt_bridge_init(void)
 {
-    ESP_LOGI(TAG, "MQTT bridge init (stub)");
-    // TODO: configure MQTT client for Fibaro integration
+    if (s_task) {
+        return ESP_OK;
+    }
+    queue_restore();
+    stats_update_queue(0, 0, 0);
+    s_inbox = xQueueCreate(MQTT_INBOX_LEN, sizeof(sensor_snapshot_t));
+    s_events = xQueueCreate(MQTT_EVENTS_LEN, sizeof(bridge_event_t));
+    if (!s_inbox || !s_events) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(bridge_task, "mqtt_bridge", MQTT_TASK_STACK, NULL, MQTT_TASK_PRIO, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (config_store_subscribe(on_config_changed, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "Broker changes apply after restart");
+    }
     return ESP_OK;
 }
 
 void mqtt_bridge_publish_snapshot(const sensor_snapshot_t *snapshot)
 {
-    if (!snapshot) {
+    // seq 0 is the boot placeholder, not a measurement
+    if (!snapshot || !s_task || snapshot->seq == 0) {
+        return;
+    }
+    if (xQueueSend(s_inbox, snapshot, 0) != pdTRUE) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_stats_lock);
         return;
     }
-    ESP_LOGI(TAG, "Publishing to MQTT: water=%.2fC level=%.1fcm air=%.2fC hum=%.1f%% pres=%.1fhPa batt=%.2fV",
-             snapshot->water_temp_c,
-             snapshot->sea_level_cm,
-             snapshot->air_temp_c,
-             snapshot->humidity_percent,
-             snapshot->air_pressure_hpa,
-             snapshot->battery_voltage);
+    xTaskNotifyGive(s_task);
+}
+
+mqtt_bridge_stats_t mqtt_bridge_get_stats(void)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    mqtt_bridge_stats_t stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return stats;
 }
@@ -3,6 +3,7 @@
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "freertos/FreeRTOS.h"
 
 #define TAG "scheduler"
 
@@ -10,18 +11,50 @@ typedef struct {
     scheduler_callback_t cb;
     void *ctx;
     esp_timer_handle_t timer;
+    esp_timer_handle_t run_now_timer; // one-shot for scheduler_run_now, same timer task
     measurement_interval_t interval;
     scheduler_task_id_t id;
+    bool running;
+    bool queued;
+    uint32_t queued_at_runs;
+    uint32_t runs;
+    int64_t last_done_us;
 } scheduler_entry_t;
 
 static scheduler_entry_t s_tasks[SCHED_TASK_SEA + 1];
-static measurement_config_t s_config;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED; // running/queued/runs/last_done_us
+
+static void run_entry(scheduler_entry_t *entry)
+{
+    portENTER_CRITICAL(&s_lock);
+    entry->running = true;
+    portEXIT_CRITICAL(&s_lock);
+    entry->cb(entry->ctx);
+    portENTER_CRITICAL(&s_lock);
+    entry->running = false;
+    entry->runs++;
+    entry->last_done_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_lock);
+}
 
 static void timer_callback(void *arg)
 {
     scheduler_entry_t *entry = (scheduler_entry_t *)arg;
     if (entry->cb) {
-        entry->cb(entry->ctx);
+        run_entry(entry);
+    }
+}
+
+static void run_now_callback(void *arg)
+{
+    scheduler_entry_t *entry = (scheduler_entry_t *)arg;
+    portENTER_CRITICAL(&s_lock);
+    entry->queued = false;
+    // A periodic run that got the timer task first already answered everyone who asked
+    bool served = entry->runs != entry->queued_at_runs;
+    portEXIT_CRITICAL(&s_lock);
+    if (entry->cb && !served) {
+        run_entry(entry);
     }
 }
 
@@ -55,20 +88,34 @@ static esp_err_t start_timer_for_entry(scheduler_entry_t *entry)
     return ESP_OK;
 }
 
-static void apply_intervals(void)
+static void apply_intervals(const measurement_config_t *config, bool keep_unchanged)
 {
-    s_tasks[SCHED_TASK_BATTERY].interval = s_config.battery;
-    s_tasks[SCHED_TASK_AIR].interval = s_config.air;
-    s_tasks[SCHED_TASK_SEA].interval = s_config.sea;
+    const measurement_interval_t next[] = {
+        [SCHED_TASK_BATTERY] = config->battery,
+        [SCHED_TASK_AIR] = config->air,
+        [SCHED_TASK_SEA] = config->sea,
+    };
 
     for (size_t i = 0; i < sizeof(s_tasks) / sizeof(s_tasks[0]); ++i) {
         scheduler_entry_t *entry = &s_tasks[i];
-        if (entry->cb) {
+        bool same = entry->interval.minutes == next[i].minutes && entry->interval.seconds == next[i].seconds;
+        entry->interval = next[i];
+        // Restarting a periodic timer resets its phase, so untouched intervals keep running
+        if (!entry->cb || (keep_unchanged && same && entry->timer)) {
+            continue;
+        }
         esp_err_t err = start_timer_for_entry(entry);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to schedule task %d: %s", entry->id, esp_err_to_name(err));
         }
-        }
+    }
+}
+
+static void on_config_changed(const measurement_config_t *config, uint32_t changed, void *ctx)
+{
+    (void)ctx;
+    if (changed & CONFIG_FIELDS_SCHEDULER) {
+        apply_intervals(config, true);
     }
 }
 
@@ -77,17 +124,18 @@ esp_err_t scheduler_init(const measurement_config_t *config)
     if (!config) {
         return ESP_ERR_INVALID_ARG;
     }
-    s_config = *config;
 
     for (size_t i = 0; i < sizeof(s_tasks) / sizeof(s_tasks[0]); ++i) {
         s_tasks[i].cb = NULL;
         s_tasks[i].ctx = NULL;
         s_tasks[i].timer = NULL;
         s_tasks[i].id = (scheduler_task_id_t)i;
+        s_tasks[i].running = false;
+        s_tasks[i].queued = false;
     }
 
-    apply_intervals();
-    return ESP_OK;
+    apply_intervals(config, false);
+    return config_store_subscribe(on_config_changed, NULL);
 }
 
 void scheduler_register_task(scheduler_task_id_t task_id, scheduler_callback_t cb, void *ctx)
@@ -106,13 +154,70 @@ void scheduler_register_task(scheduler_task_id_t task_id, scheduler_callback_t c
     }
 }
 
+esp_err_t scheduler_run_now(scheduler_task_id_t task_id, uint32_t *baseline_runs)
+{
+    if (task_id > SCHED_TASK_SEA || !baseline_runs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    scheduler_entry_t *entry = &s_tasks[task_id];
+    if (!entry->cb) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *baseline_runs = entry->runs;
+    bool shared = entry->running || entry->queued;
+    if (!shared) {
+        entry->queued = true;
+        entry->queued_at_runs = entry->runs;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (shared) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (!entry->run_now_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = run_now_callback,
+            .arg = entry,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "measure_now",
+        };
+        err = esp_timer_create(&args, &entry->run_now_timer);
+    }
+    if (err == ESP_OK) {
+        err = esp_timer_start_once(entry->run_now_timer, 0);
+    }
+    if (err != ESP_OK) {
+        portENTER_CRITICAL(&s_lock);
+        entry->queued = false;
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGE(TAG, "Task %d run-now failed: %s", task_id, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void scheduler_get_status(scheduler_task_id_t task_id, scheduler_task_status_t *out)
+{
+    if (task_id > SCHED_TASK_SEA || !out) {
+        return;
+    }
+    const scheduler_entry_t *entry = &s_tasks[task_id];
+    portENTER_CRITICAL(&s_lock);
+    *out = (scheduler_task_status_t){
+        .runs = entry->runs,
+        .last_done_us = entry->last_done_us,
+        .busy = entry->running || entry->queued,
+    };
+    portEXIT_CRITICAL(&s_lock);
+}
+
 esp_err_t scheduler_apply_config(const measurement_config_t *config)
 {
     if (!config) {
         return ESP_ERR_INVALID_ARG;
     }
-    s_config = *config;
-    apply_intervals();
+    apply_intervals(config, true);
     return ESP_OK;
 }
 
@@ -124,6 +229,11 @@ void scheduler_stop(void)
             esp_timer_delete(s_tasks[i].timer);
             s_tasks[i].timer = NULL;
         }
+        if (s_tasks[i].run_now_timer) {
+            esp_timer_stop(s_tasks[i].run_now_timer);
+            esp_timer_delete(s_tasks[i].run_now_timer);
+            s_tasks[i].run_now_timer = NULL;
+        }
         s_tasks[i].cb = NULL;
     }
 }
@@ -7,10 +7,15 @@
 #include "esp_check.h"
 #include "esp_log.h"
 #include "aht20_sensor.h"
+#include "air_fusion.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "power_manager.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
+#include "i2c_scan.h"
 #include "ultrasonic_sensor.h"
+#include <math.h>
 
 #define TAG "sensor_mgr"
 #define AIR_SENSOR_I2C_PORT I2C_NUM_0
@@ -20,12 +25,65 @@
 #define ULTRASONIC_TRIG_PIN GPIO_NUM_27
 #define ULTRASONIC_ECHO_PIN GPIO_NUM_27
 #define SENSOR_POWER_STABILIZE_MS 50
+#define AIR_STREAM_MAX_INTERVAL_S 10 // stream BME280 in normal mode when air runs this often
+#define AIR_CROSSCHECK_CYCLES 10     // read the AHT20 alongside a healthy BME280 this often
+#define AIR_STATION_ALTITUDE_M 2.0f  // barometer height above mean sea level (dock)
+#define AIR_RETRY_INITIAL_MS 30000   // first re-probe of a missing air sensor
+#define AIR_RETRY_MAX_MS 3600000     // then at most hourly
 
+// Each measurement group works on a local copy and publishes its own fields together with the
+// seq bump in one critical section, so a reader never sees seq N with fields of N+1
 static sensor_snapshot_t s_snapshot;
+static portMUX_TYPE s_snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
 static bool s_air_sensor_ready = false;
 static bool s_water_sensor_ready = false;
 static bool s_ultra_ready = false;
 static bool s_aht_ready = false;
+static uint32_t s_air_cycle = 0;
+static i2c_backoff_t s_bme_backoff;
+static i2c_backoff_t s_aht_backoff;
+
+static bool air_sensor_reinit(void)
+{
+    if (!i2c_backoff_ready(&s_bme_backoff)) {
+        return false;
+    }
+    if (bme280_sensor_init(AIR_SENSOR_I2C_PORT, AIR_SENSOR_SDA, AIR_SENSOR_SCL) != ESP_OK) {
+        i2c_backoff_fail(&s_bme_backoff, AIR_RETRY_INITIAL_MS, AIR_RETRY_MAX_MS);
+        return false;
+    }
+    i2c_backoff_reset(&s_bme_backoff);
+    return true;
+}
+
+static bool aht_sensor_reinit(void)
+{
+    if (!i2c_backoff_ready(&s_aht_backoff)) {
+        return false;
+    }
+    if (aht20_init(AIR_SENSOR_I2C_PORT, AIR_SENSOR_SDA, AIR_SENSOR_SCL) != ESP_OK) {
+        i2c_backoff_fail(&s_aht_backoff, AIR_RETRY_INITIAL_MS, AIR_RETRY_MAX_MS);
+        return false;
+    }
+    i2c_backoff_reset(&s_aht_backoff);
+    return true;
+}
+
+static void select_air_settings(const measurement_config_t *cfg)
+{
+    // Short air intervals: let the sensor convert continuously (1 s standby, IIR filter) so each
+    // read is one data burst. Longer intervals: forced mode keeps it asleep between readings.
+    bme280_settings_t settings = BME280_DEFAULT_SETTINGS();
+    uint32_t interval_s = config_store_interval_to_seconds(cfg->air);
+    if (interval_s > 0 && interval_s <= AIR_STREAM_MAX_INTERVAL_S) {
+        settings.mode = BME280_MODE_NORMAL;
+        settings.standby = BME280_STANDBY_1000_MS;
+    }
+    esp_err_t err = bme280_sensor_configure(&settings);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "BME/BMP configure failed: %s", esp_err_to_name(err));
+    }
+}
 
 esp_err_t sensor_manager_init(void)
 {
@@ -35,12 +93,14 @@ esp_err_t sensor_manager_init(void)
         s_air_sensor_ready = true;
     } else {
         ESP_LOGW(TAG, "BME/BMP init failed (%s), pressure/hum stubbed", esp_err_to_name(err));
+        i2c_backoff_fail(&s_bme_backoff, AIR_RETRY_INITIAL_MS, AIR_RETRY_MAX_MS);
     }
     err = aht20_init(AIR_SENSOR_I2C_PORT, AIR_SENSOR_SDA, AIR_SENSOR_SCL);
     if (err == ESP_OK) {
         s_aht_ready = true;
     } else {
         ESP_LOGW(TAG, "AHT20 init failed (%s)", esp_err_to_name(err));
+        i2c_backoff_fail(&s_aht_backoff, AIR_RETRY_INITIAL_MS, AIR_RETRY_MAX_MS);
     }
 
     power_manager_set(POWER_DOMAIN_SENSOR_POD, true);
@@ -57,6 +117,8 @@ esp_err_t sensor_manager_init(void)
     }
     power_manager_set(POWER_DOMAIN_SENSOR_POD, false);
 
+    air_fusion_init(AIR_STATION_ALTITUDE_M);
+
     if ((err = battery_monitor_init()) != ESP_OK) {
         ESP_LOGW(TAG, "Battery monitor init failed: %s", esp_err_to_name(err));
     }
@@ -67,8 +129,12 @@ esp_err_t sensor_manager_init(void)
         .air_temp_c = 5.0f,
         .humidity_percent = 80.0f,
         .air_pressure_hpa = 1013.25f,
+        .dew_point_c = NAN,
+        .sea_level_pressure_hpa = NAN,
+        .pressure_trend_hpa_3h = NAN,
         .battery_percent = 100.0f,
         .battery_voltage = 4.1f,
+        .battery_days_remaining = NAN,
     };
     return ESP_OK;
 }
@@ -76,11 +142,13 @@ esp_err_t sensor_manager_init(void)
 void sensor_manager_trigger_sea_measurement(void)
 {
     ESP_LOGI(TAG, "Sea measurement triggered");
-    measurement_config_t cfg = config_store_get();
+    const measurement_config_t *cfg = config_store_acquire(NULL); // held across the sensor reads
+    sensor_snapshot_t snap;
+    sensor_manager_get_snapshot(&snap);
     power_manager_set(POWER_DOMAIN_SENSOR_POD, true);
     vTaskDelay(pdMS_TO_TICKS(SENSOR_POWER_STABILIZE_MS));
 
-    float temp_c = s_snapshot.water_temp_c;
+    float temp_c = snap.water_temp_c;
     if (s_water_sensor_ready) {
         esp_err_t err = ds18b20_sensor_read(&temp_c);
         if (err != ESP_OK) {
@@ -88,9 +156,9 @@ void sensor_manager_trigger_sea_measurement(void)
             s_water_sensor_ready = (ds18b20_sensor_init(WATER_SENSOR_PIN) == ESP_OK);
         }
     }
-    s_snapshot.water_temp_c = temp_c + cfg.offsets.water_temp_c;
+    snap.water_temp_c = temp_c + cfg->offsets.water_temp_c;
 
-    float distance_cm = s_snapshot.sea_level_cm;
+    float distance_cm = snap.sea_level_cm;
     if (s_ultra_ready) {
         esp_err_t err = ultrasonic_sensor_measure(&distance_cm);
         if (err != ESP_OK) {
@@ -98,82 +166,130 @@ void sensor_manager_trigger_sea_measurement(void)
             s_ultra_ready = (ultrasonic_sensor_init(ULTRASONIC_TRIG_PIN, ULTRASONIC_ECHO_PIN) == ESP_OK);
         }
     }
-    s_snapshot.sea_level_cm = distance_cm + cfg.offsets.sea_level_cm;
-    if (s_snapshot.sea_level_cm < 0.0f) {
-        s_snapshot.sea_level_cm = 0.0f;
+    snap.sea_level_cm = distance_cm + cfg->offsets.sea_level_cm;
+    config_store_release(cfg);
+    if (snap.sea_level_cm < 0.0f) {
+        snap.sea_level_cm = 0.0f;
     }
 
     power_manager_set(POWER_DOMAIN_SENSOR_POD, false);
+    portENTER_CRITICAL(&s_snapshot_lock);
+    s_snapshot.water_temp_c = snap.water_temp_c;
+    s_snapshot.sea_level_cm = snap.sea_level_cm;
+    s_snapshot.seq++;
+    portEXIT_CRITICAL(&s_snapshot_lock);
 }
 
 void sensor_manager_trigger_air_measurement(void)
 {
     ESP_LOGI(TAG, "Air measurement triggered");
-    measurement_config_t cfg = config_store_get();
+    const measurement_config_t *cfg = config_store_acquire(NULL); // held across the sensor reads
 
-    bool have_temp = false;
-    bool have_hum = false;
+    air_fusion_reading_t bme = {0};
+    air_fusion_reading_t aht = {0};
+
+    // Absent sensors are re-probed on an exponential backoff instead of every cycle
+    if (!s_air_sensor_ready) {
+        s_air_sensor_ready = air_sensor_reinit();
+    }
+    if (!s_aht_ready) {
+        s_aht_ready = aht_sensor_reinit();
+    }
 
-    // Hvis BME (med fukt) er oppe, bruk den fullt ut
     if (s_air_sensor_ready) {
-        float bme_temp = 0.0f;
-        float bme_hum = 0.0f;
-        float bme_press = 0.0f;
-        esp_err_t err = bme280_sensor_read(&bme_temp, &bme_hum, &bme_press);
+        select_air_settings(cfg);
+        bme.attempted = true;
+        bme.has_humidity = bme280_sensor_has_humidity();
+        bme.has_pressure = true;
+        esp_err_t err = bme280_sensor_read(&bme.temperature_c, &bme.humidity_percent, &bme.pressure_hpa);
         if (err == ESP_OK) {
-            bool all_zero = (bme_temp == 0.0f && bme_hum == 0.0f && bme_press == 0.0f);
-            if (all_zero) {
-                ESP_LOGW(TAG, "BME/BMP all-zero sample, keeping previous values");
-            } else {
-                if (bme_press > 0.0f) {
-                    s_snapshot.air_pressure_hpa = bme_press;
-                } else {
-                    ESP_LOGW(TAG, "BME/BMP pressure invalid (%.1f)", bme_press);
-                }
-                if (!(bme_temp == 0.0f && bme_hum == 0.0f)) {
-                    s_snapshot.air_temp_c = bme_temp + cfg.offsets.air_temp_c;
-                    s_snapshot.humidity_percent = bme_hum;
-                    have_temp = true;
-                    have_hum = (bme_hum > 0.0f); // blir 0 hvis BMP
-                }
-                ESP_LOGI(TAG, "BME/BMP: t=%.2fC h=%.1f%% p=%.1fhPa", bme_temp, bme_hum, bme_press);
-            }
+            bme.valid = true;
+            bme.temperature_c += cfg->offsets.air_temp_c;
+            ESP_LOGI(TAG, "BME/BMP: t=%.2fC h=%.1f%% p=%.1fhPa", bme.temperature_c, bme.humidity_percent, bme.pressure_hpa);
+        } else if (err == ESP_ERR_INVALID_STATE) {
+            // No conversion finished yet (early read or brown-out); the driver reapplies its
+            // settings, so skip this cycle instead of treating the sensor as gone
+            ESP_LOGW(TAG, "BME/BMP sample not ready, skipping this cycle");
+            bme.attempted = false; // not a sensor fault, so the fusion health is left alone
         } else {
             ESP_LOGW(TAG, "BME/BMP read failed: %s", esp_err_to_name(err));
-            s_air_sensor_ready = false;
+            s_air_sensor_ready = air_sensor_reinit();
         }
     }
 
-    // Hvis vi ikke fikk temp/hum fra BME (eller den er BMP), bruk AHT20 hvis mulig
-    if ((!have_temp || !have_hum) && s_aht_ready) {
-        float aht_temp = 0.0f;
-        float aht_hum = 0.0f;
-        esp_err_t err_aht = aht20_read(&aht_temp, &aht_hum);
+    // AHT20 fills in humidity for a BMP280 and stands in for a failing BME; otherwise it is
+    // sampled every few cycles so the fusion stage can keep tracking how well the two agree.
+    bool need_aht = !bme.valid || !bme.has_humidity || (++s_air_cycle % AIR_CROSSCHECK_CYCLES) == 0;
+    if (need_aht && s_aht_ready) {
+        aht.attempted = true;
+        aht.has_humidity = true;
+        esp_err_t err_aht = aht20_read(&aht.temperature_c, &aht.humidity_percent);
         if (err_aht == ESP_OK) {
-            if (!(aht_temp == 0.0f && aht_hum == 0.0f)) {
-                s_snapshot.air_temp_c = aht_temp + cfg.offsets.air_temp_c;
-                if (aht_hum < 0.0f) aht_hum = 0.0f;
-                if (aht_hum > 100.0f) aht_hum = 100.0f;
-                s_snapshot.humidity_percent = aht_hum;
-            } else {
-                ESP_LOGW(TAG, "AHT20 all-zero sample, keeping previous values");
-            }
+            aht.valid = true;
+            aht.temperature_c += cfg->offsets.air_temp_c;
+        } else if (err_aht == ESP_ERR_INVALID_CRC || err_aht == ESP_ERR_INVALID_RESPONSE) {
+            // Driver rejected a corrupt frame; the sensor itself is fine
+            ESP_LOGW(TAG, "AHT20 sample rejected (%s)", esp_err_to_name(err_aht));
         } else {
             ESP_LOGW(TAG, "AHT20 read failed (%s)", esp_err_to_name(err_aht));
-            s_aht_ready = (aht20_init(AIR_SENSOR_I2C_PORT, AIR_SENSOR_SDA, AIR_SENSOR_SCL) == ESP_OK);
+            s_aht_ready = aht_sensor_reinit();
         }
     }
+
+    config_store_release(cfg);
+
+    air_fusion_output_t fused;
+    air_fusion_update(&bme, &aht, esp_timer_get_time(), &fused);
+    sensor_snapshot_t snap;
+    sensor_manager_get_snapshot(&snap);
+    if (fused.have_temperature) {
+        snap.air_temp_c = fused.temperature_c;
+    }
+    if (fused.have_humidity) {
+        snap.humidity_percent = fused.humidity_percent;
+    }
+    if (fused.have_temperature || fused.have_humidity) {
+        snap.dew_point_c = fused.dew_point_c;
+    }
+    if (fused.have_pressure) {
+        snap.air_pressure_hpa = fused.pressure_hpa;
+        snap.sea_level_pressure_hpa = fused.sea_level_pressure_hpa;
+        snap.pressure_trend_hpa_3h = fused.pressure_trend_hpa_3h;
+    }
+    ESP_LOGD(TAG, "Fusion: health bme=%.2f aht=%.2f dew=%.1fC msl=%.1fhPa trend=%.1fhPa/3h",
+             fused.bme_health, fused.aht_health, fused.dew_point_c, fused.sea_level_pressure_hpa,
+             fused.pressure_trend_hpa_3h);
+    portENTER_CRITICAL(&s_snapshot_lock);
+    s_snapshot.air_temp_c = snap.air_temp_c;
+    s_snapshot.humidity_percent = snap.humidity_percent;
+    s_snapshot.dew_point_c = snap.dew_point_c;
+    s_snapshot.air_pressure_hpa = snap.air_pressure_hpa;
+    s_snapshot.sea_level_pressure_hpa = snap.sea_level_pressure_hpa;
+    s_snapshot.pressure_trend_hpa_3h = snap.pressure_trend_hpa_3h;
+    s_snapshot.seq++;
+    portEXIT_CRITICAL(&s_snapshot_lock);
 }
 
 void sensor_manager_trigger_battery_measurement(void)
 {
     ESP_LOGI(TAG, "Battery measurement triggered");
-    float voltage = s_snapshot.battery_voltage;
-    float percent = s_snapshot.battery_percent;
+    sensor_snapshot_t snap;
+    sensor_manager_get_snapshot(&snap);
+    float voltage = snap.battery_voltage;
+    float percent = snap.battery_percent;
     if (battery_monitor_read(&voltage, &percent) == ESP_OK) {
-        s_snapshot.battery_voltage = voltage;
-        s_snapshot.battery_percent = percent;
+        snap.battery_voltage = voltage;
+        snap.battery_percent = percent;
+        battery_status_t status;
+        battery_monitor_get_status(&status);
+        snap.battery_days_remaining = status.days_remaining;
     }
+    portENTER_CRITICAL(&s_snapshot_lock);
+    s_snapshot.battery_voltage = snap.battery_voltage;
+    s_snapshot.battery_percent = snap.battery_percent;
+    s_snapshot.battery_days_remaining = snap.battery_days_remaining;
+    s_snapshot.seq++;
+    portEXIT_CRITICAL(&s_snapshot_lock);
 }
 
 void sensor_manager_get_snapshot(sensor_snapshot_t *out)
@@ -181,5 +297,15 @@ void sensor_manager_get_snapshot(sensor_snapshot_t *out)
     if (!out) {
         return;
     }
+    portENTER_CRITICAL(&s_snapshot_lock);
     *out = s_snapshot;
+    portEXIT_CRITICAL(&s_snapshot_lock);
+}
+
+uint32_t sensor_manager_get_seq(void)
+{
+    portENTER_CRITICAL(&s_snapshot_lock);
+    uint32_t seq = s_snapshot.seq;
+    portEXIT_CRITICAL(&s_snapshot_lock);
+    return seq;
 }
@@ -0,0 +1,12 @@
+#!/usr/bin/env python3
+"""Gzip a web asset for embedding: gzip_asset.py <input> <output>.
+
+mtime is pinned to 0 so identical sources produce identical firmware images.
+"""
+import gzip
+import sys
+
+with open(sys.argv[1], 'rb') as src:
+    data = src.read()
+with open(sys.argv[2], 'wb') as dst:
+    dst.write(gzip.compress(data, compresslevel=9, mtime=0))
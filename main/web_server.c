@@ -9,174 +9,119 @@
 #include "sensor_manager.h"
 #include "wifi_manager.h"
 #include "google_bridge.h"
+#include "json_writer.h"
+#include "http_metrics.h"
+#include "http_limiter.h"
+#include "local_discovery.h"
+#include "mqtt_bridge.h"
 #include "cJSON.h"
 #include "esp_netif_ip_addr.h"
 #include "esp_system.h"
+#include "esp_random.h"
+#include "esp_app_desc.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
 
 #define TAG "web"
 #define MAX_CONFIG_BODY_LEN 2048
 #define GOOGLE_MAX_BODY_LEN 2048
-
-static const char INDEX_HTML[] =
-    "<!DOCTYPE html>\n"
-    "<html lang=\"no\">\n"
-    "<head>\n"
-    "<meta charset=\"utf-8\"/>\n"
-    "<meta name=\"viewport\" content=\"width=device-width,initial-scale=1\"/>\n"
-    "<title>SeaMonitor</title>\n"
-    "<style>\n"
-    "body{font-family:-apple-system,BlinkMacSystemFont,'Segoe UI',sans-serif;margin:0;padding:20px;background:#0b1b2b;color:#f6f8fc;}\n"
-    "h1{margin-top:0;}\n"
-    "section,fieldset{background:#12263b;border:1px solid #1f3a56;border-radius:8px;padding:16px;margin-bottom:16px;}\n"
-    "label{display:block;margin:8px 0 4px;}\n"
-    "input,select,button,textarea{font-size:16px;padding:8px;border-radius:4px;border:1px solid#1f3a56;background:#0b1b2b;color:#f6f8fc;width:100%;box-sizing:border-box;}\n"
-    "button{background:#1f7aec;border:none;cursor:pointer;}\n"
-    ".dashboard{display:grid;grid-template-columns:repeat(auto-fit,minmax(150px,1fr));gap:12px;margin-bottom:16px;}\n"
-    ".metric-card{background:#12263b;border:1px solid #1f3a56;border-radius:8px;padding:12px;}\n"
-    ".metric-card span{display:block;font-size:28px;margin-top:6px;font-weight:600;}\n"
-    ".nav-stack{display:flex;flex-direction:column;gap:10px;margin-bottom:16px;}\n"
-    ".nav-stack button{width:100%;padding:14px;font-size:18px;}\n"
-    ".panel.hidden{display:none;}\n"
-    ".grid{display:grid;grid-template-columns:repeat(auto-fit,minmax(140px,1fr));gap:8px;}\n"
-    ".screen-box{border:1px solid #1f3a56;border-radius:8px;padding:12px;}\n"
-    ".screen-box h3{margin:0 0 8px;}\n"
-    ".status{display:flex;gap:16px;flex-wrap:wrap;margin-bottom:12px;}\n"
-    ".status div{flex:1 1 200px;}\n"
-    "small{color:#9fb3c8;}\n"
-    ".buttons{display:flex;gap:8px;flex-wrap:wrap;margin-top:12px;}\n"
-    ".buttons button{flex:1;}\n"
-    "#reboot-hint{margin-top:8px;color:#ffdf6b;}\n"
-    ".inline-fields{display:flex;gap:6px;}\n"
-    ".inline-fields input{width:100%;}\n"
-    "textarea{min-height:120px;}\n"
-    "</style>\n"
-    "</head>\n"
-    "<body>\n"
-    "<h1>SeaMonitor kontrollpanel</h1>\n"
-    "<section class=\"dashboard\">\n"
-    "  <div class=\"metric-card\"><strong>Vanntemp</strong><span id=\"water-temp\">-</span></div>\n"
-    "  <div class=\"metric-card\"><strong>Sjønivå</strong><span id=\"sea-level\">-</span></div>\n"
-    "  <div class=\"metric-card\"><strong>Lufttemp</strong><span id=\"air-temp\">-</span></div>\n"
-    "  <div class=\"metric-card\"><strong>Fuktighet</strong><span id=\"humidity\">-</span></div>\n"
-    "  <div class=\"metric-card\"><strong>Trykk</strong><span id=\"pressure\">-</span></div>\n"
-    "  <div class=\"metric-card\"><strong>Batteri</strong><span id=\"battery\">-</span></div>\n"
-    "</section>\n"
-    "<div id=\"metric-error\" style=\"color:#ff9d9d;margin-bottom:12px;display:none\">Fikk ikke hentet verdier</div>\n"
-    "<section class=\"status\">\n"
-    "  <div><strong>AP IP</strong><br/><span id=\"ap-ip\">-</span></div>\n"
-    "  <div><strong>STA IP</strong><br/><span id=\"sta-ip\">-</span><br/><small id=\"sta-state\">Ikke tilkoblet</small></div>\n"
-    "</section>\n"
-    "<div class=\"nav-stack\">\n"
-    "  <button type=\"button\" id=\"open-config\">Konfigurasjon</button>\n"
-    "  <button type=\"button\" id=\"open-offset\">Offset</button>\n"
-    "  <button type=\"button\" id=\"quick-restart\">Restart</button>\n"
-    "  <button type=\"button\" id=\"quick-save-reboot\">Lagre og restart</button>\n"
-    "</div>\n"
-    "<section id=\"config-panel\" class=\"panel hidden\">\n"
-    "<form id=\"config-form\">\n"
-    "  <fieldset>\n"
-    "    <legend>Navn og Wi-Fi</legend>\n"
-    "    <label for=\"device-name\">Enhetsnavn</label>\n"
-    "    <input id=\"device-name\" required maxlength=\"31\"/>\n"
-    "    <label for=\"wifi-ssid\">Wi-Fi SSID</label>\n"
-    "    <input id=\"wifi-ssid\" maxlength=\"31\" placeholder=\"(tom = kun SeaMonitor-AP)\"/>\n"
-    "    <label for=\"wifi-pass\">Wi-Fi passord</label>\n"
-    "    <input id=\"wifi-pass\" maxlength=\"63\" type=\"password\"/>\n"
-    "  </fieldset>\n"
-    "  <fieldset>\n"
-    "    <legend>Måleintervaller (min/sek)</legend>\n"
-    "    <div class=\"grid\" id=\"interval-grid\"></div>\n"
-    "    <label for=\"display-seconds\">Skjerm på-tid (sekunder, 0=alltid)</label>\n"
-    "    <input id=\"display-seconds\" type=\"number\" min=\"0\" max=\"3600\"/>\n"
-    "  </fieldset>\n"
-    "  <fieldset>\n"
-    "    <legend>Skjermer</legend>\n"
-    "    <div class=\"grid\">\n"
-    "      <div class=\"screen-box\"><h3>Skjerm 1</h3><div id=\"screen1-options\"></div></div>\n"
-    "      <div class=\"screen-box\"><h3>Skjerm 2</h3><div id=\"screen2-options\"></div><small>IP-adresse vises alltid her som fallback.</small></div>\n"
-    "    </div>\n"
-    "  </fieldset>\n"
-    "  <fieldset id=\"offset-fieldset\">\n"
-    "    <legend>Offsets</legend>\n"
-    "    <p>Justér måleverdier dersom sensoren trenger kalibrering.</p>\n"
-    "    <label for=\"offset-water\">Vanntemp (°C)</label>\n"
-    "    <input id=\"offset-water\" type=\"number\" step=\"0.1\" min=\"-20\" max=\"20\"/>\n"
-    "    <label for=\"offset-sea\">Sjønivå (cm)</label>\n"
-    "    <input id=\"offset-sea\" type=\"number\" step=\"0.1\" min=\"-200\" max=\"200\"/>\n"
-    "    <label for=\"offset-air\">Lufttemp (°C)</label>\n"
-    "    <input id=\"offset-air\" type=\"number\" step=\"0.1\" min=\"-20\" max=\"20\"/>\n"
-    "  </fieldset>\n"
-    "  <div class=\"buttons\">\n"
-    "    <button type=\"submit\" id=\"save-btn\">Lagre</button>\n"
-    "    <button type=\"button\" id=\"save-reboot-btn\">Lagre og restart</button>\n"
-    "    <button type=\"button\" id=\"reboot-btn\">Restart</button>\n"
-    "  </div>\n"
-    "  <div id=\"form-status\" aria-live=\"polite\"></div>\n"
-    "  <div id=\"reboot-hint\" style=\"display:none\">Enheten restarter. Vent 10 sekunder og koble til på nytt.</div>\n"
-    "</form>\n"
-    "</section>\n"
-    "<script>\n"
-    "const form=document.getElementById('config-form');\n"
-    "const statusEl=document.getElementById('form-status');\n"
-    "const rebootHint=document.getElementById('reboot-hint');\n"
-    "const configPanel=document.getElementById('config-panel');\n"
-    "const panels=[configPanel];\n"
-    "const intervals=[{key:'battery',label:'Batteri'},{key:'air',label:'Luft'},{key:'sea',label:'Sjø'},{key:'wifi',label:'Wi-Fi'},{key:'web_ui',label:'Web UI'}];\n"
-    "const sensors=[\n"
-    " {key:'water_temp',label:'Vanntemp'},\n"
-    " {key:'sea_level',label:'Sjønivå'},\n"
-    " {key:'air_temp',label:'Lufttemp'},\n"
-    " {key:'humidity',label:'Fuktighet'},\n"
-    " {key:'pressure',label:'Trykk'},\n"
-    " {key:'battery_percent',label:'Batteri %'},\n"
-    " {key:'battery_voltage',label:'Batteri V'},\n"
-    " {key:'ip_address',label:'IP-adresse'}\n"
-    "];\n"
-    "const intervalGrid=document.getElementById('interval-grid');\n"
-    "intervals.forEach(item=>{\n"
-    "  const wrapper=document.createElement('div');\n"
-    "  wrapper.innerHTML=`<label>${item.label}</label><div class=\"inline-fields\"><input type=number min=0 id=${item.key}-min placeholder=Minutter><input type=number min=0 max=59 id=${item.key}-sec placeholder=Sekunder></div>`;\n"
-    "  intervalGrid.appendChild(wrapper);\n"
-    "});\n"
-    "function renderScreenOptions(targetId){const container=document.getElementById(targetId);container.innerHTML='';sensors.forEach(sensor=>{const id=`${targetId}-${sensor.key}`;const wrapper=document.createElement('label');wrapper.innerHTML=`<input type=\"checkbox\" id=${id} value=${sensor.key}> ${sensor.label}`;container.appendChild(wrapper);});}\n"
-    "function showPanel(panel){panels.forEach(p=>p.classList.add('hidden'));if(panel){panel.classList.remove('hidden');panel.scrollIntoView({behavior:'smooth'});}}\n"
-    "renderScreenOptions('screen1-options');\n"
-    "renderScreenOptions('screen2-options');\n"
-    "function setIntervalFields(prefix,data){document.getElementById(`${prefix}-min`).value=data?.minutes??0;document.getElementById(`${prefix}-sec`).value=data?.seconds??0;}\n"
-    "function getIntervalFields(prefix){return{minutes:Number(document.getElementById(`${prefix}-min`).value)||0,seconds:Number(document.getElementById(`${prefix}-sec`).value)||0};}\n"
-    "function setScreenSelections(targetId,values){sensors.forEach(sensor=>{const box=document.getElementById(`${targetId}-${sensor.key}`);if(box){box.checked=values.includes(sensor.key);}});}\n"
-    "function collectScreenSelections(targetId){const result=[];sensors.forEach(sensor=>{const box=document.getElementById(`${targetId}-${sensor.key}`);if(box?.checked){result.push(sensor.key);}});return result;}\n"
-    "async function loadStatus(){try{const res=await fetch('/api/status');const data=await res.json();document.getElementById('ap-ip').textContent=data.ap_ip||'-';document.getElementById('sta-ip').textContent=data.sta_ip||'-';document.getElementById('sta-state').textContent=data.sta_connected?'Tilkoblet':'Ikke tilkoblet';}catch(e){console.warn('status',e);}}\n"
-    "function formatValue(val,suffix){if(val===undefined||val===null||Number.isNaN(val))return '-';return `${val}${suffix}`;}\n"
-    "function formatNumber(val,suffix){if(val===undefined||val===null||Number.isNaN(val))return '-';const fixed=(Math.abs(val)<10)?val.toFixed(2):val.toFixed(1);return `${fixed}${suffix}`;}\n"
-    "function renderMetrics(data){document.getElementById('water-temp').textContent=formatNumber(data.water_temp_c,'°C');document.getElementById('sea-level').textContent=formatNumber(data.sea_level_cm,' cm');document.getElementById('air-temp').textContent=formatNumber(data.air_temp_c,'°C');const humVal=typeof data.humidity_percent==='number'?data.humidity_percent.toFixed(1):null;document.getElementById('humidity').textContent=formatValue(humVal,'%');document.getElementById('pressure').textContent=formatNumber(data.air_pressure_hpa,' hPa');let batt='-';if(typeof data.battery_percent==='number'){const voltage=typeof data.battery_voltage==='number'?data.battery_voltage.toFixed(2)+'V':'';batt=`${data.battery_percent.toFixed(0)}% ${voltage?`(${voltage})`:''}`;}document.getElementById('battery').textContent=batt;}\n"
-    "async function loadMetrics(){try{const res=await fetch('/api/metrics');const data=await res.json();renderMetrics(data);document.getElementById('metric-error').style.display='none';}catch(err){document.getElementById('metric-error').style.display='block';console.warn('metrics',err);}}\n"
-    "async function loadConfig(){const res=await fetch('/api/config');const data=await res.json();setIntervalFields('battery',data.battery);setIntervalFields('air',data.air);setIntervalFields('sea',data.sea);setIntervalFields('wifi',data.wifi);setIntervalFields('web_ui',data.web_ui);document.getElementById('display-seconds').value=data.display_on_seconds;document.getElementById('device-name').value=data.device_name;document.getElementById('wifi-ssid').value=data.wifi_ssid||'';document.getElementById('wifi-pass').value=data.wifi_password||'';const screens=data.screens||{};setScreenSelections('screen1-options',screens.screen1||[]);setScreenSelections('screen2-options',screens.screen2||[]);const offsets=data.offsets||{};document.getElementById('offset-water').value=offsets.water_temp_c??0;document.getElementById('offset-sea').value=offsets.sea_level_cm??0;document.getElementById('offset-air').value=offsets.air_temp_c??0;}\n"
-    "async function submitConfig(rebootAfter){const payload={battery:getIntervalFields('battery'),air:getIntervalFields('air'),sea:getIntervalFields('sea'),wifi:getIntervalFields('wifi'),web_ui:getIntervalFields('web_ui'),display_on_seconds:Number(document.getElementById('display-seconds').value)||0,device_name:document.getElementById('device-name').value.trim()||'sea',wifi_ssid:document.getElementById('wifi-ssid').value.trim(),wifi_password:document.getElementById('wifi-pass').value, screens:{screen1:collectScreenSelections('screen1-options'),screen2:collectScreenSelections('screen2-options')}, offsets:{water_temp_c:Number(document.getElementById('offset-water').value)||0,sea_level_cm:Number(document.getElementById('offset-sea').value)||0,air_temp_c:Number(document.getElementById('offset-air').value)||0}};statusEl.textContent='Lagrer...';rebootHint.style.display='none';try{const res=await fetch('/api/config',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify(payload)});if(!res.ok) throw new Error('Feil '+res.status);statusEl.textContent='Lagret!';loadStatus();if(rebootAfter){await requestReboot();}}catch(err){statusEl.textContent='Feil: '+err.message;}setTimeout(()=>{if(statusEl.textContent==='Lagret!'){statusEl.textContent='';}},4000);}\n"
-    "async function requestReboot(){statusEl.textContent='Restarter...';rebootHint.style.display='block';try{await fetch('/api/reboot',{method:'POST'});}catch(err){console.warn('reboot',err);}setTimeout(()=>{statusEl.textContent='Vent 10 sekunder mens enheten starter på nytt';},200);}\n"
-    "form.addEventListener('submit',ev=>{ev.preventDefault();submitConfig(false);});\n"
-    "document.getElementById('save-reboot-btn').addEventListener('click',()=>submitConfig(true));\n"
-    "document.getElementById('reboot-btn').addEventListener('click',requestReboot);\n"
-    "document.getElementById('open-config').addEventListener('click',()=>showPanel(configPanel));\n"
-    "document.getElementById('open-offset').addEventListener('click',()=>{showPanel(configPanel);document.getElementById('offset-fieldset').scrollIntoView({behavior:'smooth'});});\n"
-    "document.getElementById('quick-restart').addEventListener('click',requestReboot);\n"
-    "document.getElementById('quick-save-reboot').addEventListener('click',()=>submitConfig(true));\n"
-    "\n"
-    "loadConfig();\n"
-    "loadStatus();\n"
-    "loadMetrics();\n"
-    "setInterval(loadMetrics,5000);\n"
-    "showPanel(configPanel);\n"
-    "</script>\n"
-    "</body></html>\n"
-    "\n";
+#define JSON_RESP_BUF_LEN 768 // on the handler stack; larger documents go out as chunks
+#define JSON_DECIMALS 2
+#define PROMETHEUS_BUF_LEN 1024
+#define EVENTS_MAX_CLIENTS 2       // each live stream pins one of the httpd sockets
+#define EVENTS_KEEPALIVE_MS 30000  // comment line on quiet streams so dead peers get noticed
+#define EVENTS_TASK_STACK 6144 // also renders EXECUTE responses for parked measurements
+#define LONGPOLL_MAX_WAITERS 2     // parked ?wait_for_seq requests, each holding a socket
+#define LONGPOLL_DEFAULT_S 30
+#define LONGPOLL_MAX_S 60
+// CONFIG_LWIP_MAX_SOCKETS=10: 3 httpd-internal, 1 MQTT client, 1 UDP discovery (local_discovery.c), rest httpd
+#define HTTPD_MAX_SOCKETS 5
+#define WORKER_COUNT 2       // slow handlers (NVS commit, Wi-Fi reconfigure, EXECUTE) run here
+#define WORKER_QUEUE_LEN 2   // beyond busy workers + queue, slow requests get 503
+#define WORKER_STACK 6144
+#define GOOGLE_CACHE_MAX_LEN 1536  // largest pre-serialized SYNC/QUERY/state payload
+#define GOOGLE_REQUEST_ID_MAX 96   // escaped requestId that still takes the cached path
+#define GOOGLE_CMD_MEASURE "com.seasensor.commands.Measure"
+#define MEASURE_TIMEOUT_MS 10000   // per request; sea pod power-up and both probes fit well inside this
+#define MEASURE_POLL_MS 50         // events task re-check while measurements are parked
+#define MEASURE_MAX_WAITERS 2      // parked /api/measure and Measure EXECUTEs, each holding a socket
+#define MEASURE_MAX_AGE_MS 86400000u
+
+// Built from web/index.html by gzip_asset.py (see CMakeLists.txt)
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
 
 static httpd_handle_t s_server = NULL;
-static measurement_config_t s_cached_config;
+static char s_asset_etag[24]; // quoted prefix of the app ELF SHA-256: changes with every build
+
+// /api/events: streams are detached from httpd with the async request API and owned by
+// the events task, which writes an SSE frame only when a new snapshot is published.
+static TaskHandle_t s_events_task;
+static QueueHandle_t s_events_join;
+static portMUX_TYPE s_events_lock = portMUX_INITIALIZER_UNLOCKED;
+static sensor_snapshot_t s_events_snapshot;
+static bool s_events_pending;
+static uint8_t s_events_clients; // admitted streams, including ones still queued for the task
+static uint8_t s_longpoll_waiters;
+static QueueHandle_t s_measure_join; // measure_wait_t, at most MEASURE_MAX_WAITERS
+static uint8_t s_measure_waiters;    // reserved slots, including waits still queued for the task
+static uint32_t s_boot_tag; // random per boot; prefixes snapshot ETags
+
+// Slow endpoints are detached from the httpd task and finished by a small worker pool, so
+// one NVS commit or Wi-Fi reconfigure no longer stalls every other client.
+typedef esp_err_t (*web_handler_fn)(httpd_req_t *req);
+typedef esp_err_t (*worker_fn)(httpd_req_t *req, void *arg);
+
+typedef struct {
+    web_handler_fn fn;
+} offload_target_t;
+
+typedef struct {
+    httpd_req_t *req; // async copy owned by the worker until httpd_req_async_handler_complete
+    worker_fn fn;
+    void *arg;
+} worker_job_t;
+
+// Pre-serialized Google payloads. Each blob is immutable once installed; a reader holds a
+// reference while sending, so a rebuild never writes under an in-flight response.
+typedef enum {
+    GOOGLE_CACHE_SYNC,  // keyed by config generation
+    GOOGLE_CACHE_QUERY, // keyed by snapshot seq and the OnOff state baked into it
+    GOOGLE_CACHE_STATE, // /api/google/state body for shed requests, keyed by snapshot seq
+    GOOGLE_CACHE_COUNT,
+} google_cache_kind_t;
+
+typedef struct {
+    uint32_t refs;
+    uint32_t key;
+    bool on;
+    size_t len;
+    char data[];
+} google_blob_t;
+
+static google_blob_t *s_google_cache[GOOGLE_CACHE_COUNT];
+static portMUX_TYPE s_google_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_google_build_lock; // one rebuild per stale payload; others wait for it
+
+static google_blob_t *google_cache_peek(google_cache_kind_t kind);
+static void google_blob_release(google_blob_t *blob);
+
+// Google Home displays and the Local Home app refresh together; past this rate a client gets
+// the last serialized payload instead of a freshly built one
+enum {
+    LIMIT_CLASS_HOMEGRAPH,
+    LIMIT_CLASS_GOOGLE_STATE,
+};
+static const http_limit_t k_google_limit = {.per_minute = 30, .burst = 5};
+
+static QueueHandle_t s_worker_queue;
+static SemaphoreHandle_t s_config_update_lock; // serializes read-modify-write of the config
 
 static void ip_to_string(const esp_ip4_addr_t *ip, char *out, size_t len)
 {
@@ -212,26 +157,92 @@ static cJSON *interval_to_json(measurement_interval_t interval)
     return obj;
 }
 
+static bool etag_matches(httpd_req_t *req, const char *etag)
+{
+    char value[96];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    // Substring match covers lists ("a", "b") and weak W/"..." forms
+    return strcmp(value, "*") == 0 || strstr(value, etag) != NULL;
+}
+
+static esp_err_t json_chunk_flush(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+static void json_resp_begin(httpd_req_t *req, json_writer_t *w, char *buf, size_t cap)
+{
+    httpd_resp_set_type(req, "application/json");
+    json_writer_init(w, buf, cap, json_chunk_flush, req);
+}
+
+static esp_err_t json_resp_end(httpd_req_t *req, json_writer_t *w)
+{
+    // Small documents go out in one send with Content-Length; streamed ones end the chunking
+    esp_err_t err = json_writer_finish(w);
+    if (err != ESP_OK) {
+        if (!json_writer_streamed(w)) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Serialize failed");
+        }
+        return err;
+    }
+    if (json_writer_streamed(w)) {
+        return httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return httpd_resp_send(req, w->buf, w->len);
+}
+
+static void json_write_snapshot(json_writer_t *w, const sensor_snapshot_t *snapshot)
+{
+    json_write_number(w, "water_temp_c", snapshot->water_temp_c, JSON_DECIMALS);
+    json_write_number(w, "sea_level_cm", snapshot->sea_level_cm, JSON_DECIMALS);
+    json_write_number(w, "air_temp_c", snapshot->air_temp_c, JSON_DECIMALS);
+    json_write_number(w, "humidity_percent", snapshot->humidity_percent, JSON_DECIMALS);
+    json_write_number(w, "air_pressure_hpa", snapshot->air_pressure_hpa, JSON_DECIMALS);
+    json_write_number(w, "dew_point_c", snapshot->dew_point_c, JSON_DECIMALS);
+    json_write_number(w, "sea_level_pressure_hpa", snapshot->sea_level_pressure_hpa, JSON_DECIMALS);
+    json_write_number(w, "pressure_trend_hpa_3h", snapshot->pressure_trend_hpa_3h, JSON_DECIMALS);
+    json_write_number(w, "battery_percent", snapshot->battery_percent, JSON_DECIMALS);
+    json_write_number(w, "battery_voltage", snapshot->battery_voltage, 3);
+    json_write_number(w, "battery_days_remaining", snapshot->battery_days_remaining, 1);
+    json_write_int(w, "seq", snapshot->seq);
+}
+
 static esp_err_t handle_get_root(httpd_req_t *req)
 {
+    // no-cache = always revalidate; with a per-build ETag a repeat visit costs one 304
+    httpd_resp_set_hdr(req, "ETag", s_asset_etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (etag_matches(req, s_asset_etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    // Only a gzip copy is stored; every browser that can run the SPA accepts it
     httpd_resp_set_type(req, "text/html; charset=utf-8");
-    return httpd_resp_send(req, INDEX_HTML, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    return httpd_resp_send(req, (const char *)index_html_gz_start, index_html_gz_end - index_html_gz_start);
 }
 
 static esp_err_t handle_get_config(httpd_req_t *req)
 {
+    const measurement_config_t *cfg = config_store_current(NULL);
     cJSON *root = cJSON_CreateObject();
     if (!root) {
         return ESP_ERR_NO_MEM;
     }
 
-    cJSON_AddItemToObject(root, "battery", interval_to_json(s_cached_config.battery));
-    cJSON_AddItemToObject(root, "air", interval_to_json(s_cached_config.air));
-    cJSON_AddItemToObject(root, "sea", interval_to_json(s_cached_config.sea));
-    cJSON_AddNumberToObject(root, "display_on_seconds", s_cached_config.display_on_seconds);
-    cJSON_AddStringToObject(root, "device_name", s_cached_config.device_name);
-    cJSON_AddItemToObject(root, "wifi", interval_to_json(s_cached_config.wifi));
-    cJSON_AddItemToObject(root, "web_ui", interval_to_json(s_cached_config.web_ui));
+    cJSON_AddItemToObject(root, "battery", interval_to_json(cfg->battery));
+    cJSON_AddItemToObject(root, "air", interval_to_json(cfg->air));
+    cJSON_AddItemToObject(root, "sea", interval_to_json(cfg->sea));
+    cJSON_AddNumberToObject(root, "display_on_seconds", cfg->display_on_seconds);
+    cJSON_AddNumberToObject(root, "display_off_seconds", cfg->display_off_seconds);
+    cJSON_AddBoolToObject(root, "display_dim", cfg->display_dim);
+    cJSON_AddStringToObject(root, "device_name", cfg->device_name);
+    cJSON_AddItemToObject(root, "wifi", interval_to_json(cfg->wifi));
+    cJSON_AddItemToObject(root, "web_ui", interval_to_json(cfg->web_ui));
     cJSON *screens = cJSON_CreateObject();
     if (screens) {
         cJSON *scr1 = cJSON_CreateArray();
@@ -240,10 +251,10 @@ static esp_err_t handle_get_config(httpd_req_t *req)
             for (size_t i = 0; i < config_store_screen_item_count(); ++i) {
                 const char *name = config_store_screen_item_name(i);
                 uint32_t bit = config_store_screen_item_bit(i);
-                if ((s_cached_config.screen_items[0] & bit) && name) {
+                if ((cfg->screen_items[0] & bit) && name) {
                     cJSON_AddItemToArray(scr1, cJSON_CreateString(name));
                 }
-                if ((s_cached_config.screen_items[1] & bit) && name) {
+                if ((cfg->screen_items[1] & bit) && name) {
                     cJSON_AddItemToArray(scr2, cJSON_CreateString(name));
                 }
             }
@@ -256,15 +267,23 @@ static esp_err_t handle_get_config(httpd_req_t *req)
             cJSON_Delete(screens);
         }
     }
-    cJSON_AddStringToObject(root, "wifi_ssid", s_cached_config.wifi_ssid);
-    cJSON_AddStringToObject(root, "wifi_password", s_cached_config.wifi_password);
+    cJSON_AddStringToObject(root, "wifi_ssid", cfg->wifi_ssid);
+    cJSON_AddStringToObject(root, "wifi_password", cfg->wifi_password);
     cJSON *offsets = cJSON_CreateObject();
     if (offsets) {
-        cJSON_AddNumberToObject(offsets, "water_temp_c", s_cached_config.offsets.water_temp_c);
-        cJSON_AddNumberToObject(offsets, "sea_level_cm", s_cached_config.offsets.sea_level_cm);
-        cJSON_AddNumberToObject(offsets, "air_temp_c", s_cached_config.offsets.air_temp_c);
+        cJSON_AddNumberToObject(offsets, "water_temp_c", cfg->offsets.water_temp_c);
+        cJSON_AddNumberToObject(offsets, "sea_level_cm", cfg->offsets.sea_level_cm);
+        cJSON_AddNumberToObject(offsets, "air_temp_c", cfg->offsets.air_temp_c);
         cJSON_AddItemToObject(root, "offsets", offsets);
     }
+    cJSON *mqtt = cJSON_CreateObject();
+    if (mqtt) {
+        cJSON_AddStringToObject(mqtt, "uri", cfg->mqtt.uri);
+        cJSON_AddStringToObject(mqtt, "username", cfg->mqtt.username);
+        cJSON_AddStringToObject(mqtt, "password", cfg->mqtt.password);
+        cJSON_AddStringToObject(mqtt, "topic", cfg->mqtt.topic);
+        cJSON_AddItemToObject(root, "mqtt", mqtt);
+    }
 
     const char *json = cJSON_PrintUnformatted(root);
     httpd_resp_set_type(req, "application/json");
@@ -291,7 +310,157 @@ static bool json_to_interval(const cJSON *obj, measurement_interval_t *out)
     return true;
 }
 
-static esp_err_t handle_post_config(httpd_req_t *req)
+#define CONFIG_FIELDS_REQUIRED                                                                                     \
+    (CONFIG_FIELDS_SCHEDULER | CONFIG_FIELD_WIFI_INTERVAL | CONFIG_FIELD_WEB_UI_INTERVAL | CONFIG_FIELD_DISPLAY_ON | \
+     CONFIG_FIELDS_WIFI | CONFIG_FIELD_SCREENS | CONFIG_FIELD_OFFSETS)
+
+static void take_interval(const cJSON *root, const char *key, measurement_interval_t *out, uint32_t field,
+                          uint32_t *present, bool *bad)
+{
+    const cJSON *obj = cJSON_GetObjectItem(root, key);
+    if (!obj) {
+        return;
+    }
+    if (json_to_interval(obj, out)) {
+        *present |= field;
+    } else {
+        *bad = true;
+    }
+}
+
+static void take_string(const cJSON *root, const char *key, char *out, size_t len, uint32_t field,
+                        uint32_t *present, bool *bad)
+{
+    const cJSON *obj = cJSON_GetObjectItem(root, key);
+    if (!obj) {
+        return;
+    }
+    if (cJSON_IsString(obj)) {
+        strlcpy(out, cJSON_GetStringValue(obj), len);
+        *present |= field;
+    } else {
+        *bad = true;
+    }
+}
+
+static bool json_to_screen_mask(const cJSON *arr, uint32_t *mask)
+{
+    if (!cJSON_IsArray(arr)) {
+        return false;
+    }
+    *mask = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, arr) {
+        uint32_t bit = 0;
+        if (cJSON_IsString(item) && config_store_screen_name_to_bit(item->valuestring, &bit)) {
+            *mask |= bit;
+        }
+    }
+    return true;
+}
+
+// Copies every setting present in `root` into cfg and returns the CONFIG_FIELD_* mask of what
+// was present. Sets *bad for a present field of the wrong type. Full (POST) bodies replace
+// whole groups; partial (PATCH) bodies may also name single screens or offsets.
+static uint32_t json_to_config(const cJSON *root, measurement_config_t *cfg, bool partial, bool *bad)
+{
+    uint32_t present = 0;
+    take_interval(root, "battery", &cfg->battery, CONFIG_FIELD_BATTERY_INTERVAL, &present, bad);
+    take_interval(root, "air", &cfg->air, CONFIG_FIELD_AIR_INTERVAL, &present, bad);
+    take_interval(root, "sea", &cfg->sea, CONFIG_FIELD_SEA_INTERVAL, &present, bad);
+    take_interval(root, "wifi", &cfg->wifi, CONFIG_FIELD_WIFI_INTERVAL, &present, bad);
+    take_interval(root, "web_ui", &cfg->web_ui, CONFIG_FIELD_WEB_UI_INTERVAL, &present, bad);
+    take_string(root, "device_name", cfg->device_name, sizeof(cfg->device_name), CONFIG_FIELD_DEVICE_NAME,
+                &present, bad);
+    take_string(root, "wifi_ssid", cfg->wifi_ssid, sizeof(cfg->wifi_ssid), CONFIG_FIELD_WIFI_SSID, &present, bad);
+    take_string(root, "wifi_password", cfg->wifi_password, sizeof(cfg->wifi_password), CONFIG_FIELD_WIFI_PASSWORD,
+                &present, bad);
+
+    const cJSON *display = cJSON_GetObjectItem(root, "display_on_seconds");
+    const cJSON *display_off = cJSON_GetObjectItem(root, "display_off_seconds");
+    const cJSON *display_dim = cJSON_GetObjectItem(root, "display_dim");
+    if (display) {
+        if (cJSON_IsNumber(display)) {
+            cfg->display_on_seconds = (uint16_t)cJSON_GetNumberValue(display);
+            present |= CONFIG_FIELD_DISPLAY_ON;
+        } else {
+            *bad = true;
+        }
+    }
+    if (display_off) {
+        if (cJSON_IsNumber(display_off)) {
+            cfg->display_off_seconds = (uint16_t)cJSON_GetNumberValue(display_off);
+            present |= CONFIG_FIELD_DISPLAY_OFF;
+        } else {
+            *bad = true;
+        }
+    }
+    if (display_dim) {
+        if (cJSON_IsBool(display_dim)) {
+            cfg->display_dim = cJSON_IsTrue(display_dim);
+            present |= CONFIG_FIELD_DISPLAY_DIM;
+        } else {
+            *bad = true;
+        }
+    }
+
+    const cJSON *screens = cJSON_GetObjectItem(root, "screens");
+    if (screens) {
+        if (!cJSON_IsObject(screens)) {
+            *bad = true;
+        } else {
+            // A full body that leaves out a screen clears it, as before
+            const char *keys[] = {"screen1", "screen2"};
+            for (size_t i = 0; i < 2; ++i) {
+                const cJSON *arr = cJSON_GetObjectItem(screens, keys[i]);
+                if (!arr && !partial) {
+                    cfg->screen_items[i] = 0;
+                } else if (arr && !json_to_screen_mask(arr, &cfg->screen_items[i])) {
+                    *bad = true;
+                }
+            }
+            present |= CONFIG_FIELD_SCREENS;
+        }
+    }
+
+    const cJSON *offsets = cJSON_GetObjectItem(root, "offsets");
+    if (offsets) {
+        const char *keys[] = {"water_temp_c", "sea_level_cm", "air_temp_c"};
+        float *dest[] = {&cfg->offsets.water_temp_c, &cfg->offsets.sea_level_cm, &cfg->offsets.air_temp_c};
+        size_t found = 0;
+        for (size_t i = 0; cJSON_IsObject(offsets) && i < 3; ++i) {
+            const cJSON *value = cJSON_GetObjectItem(offsets, keys[i]);
+            if (cJSON_IsNumber(value)) {
+                *dest[i] = (float)cJSON_GetNumberValue(value);
+                found++;
+            } else if (value) {
+                *bad = true;
+            }
+        }
+        if (found == 3 || (partial && found > 0)) {
+            present |= CONFIG_FIELD_OFFSETS;
+        } else {
+            *bad = true;
+        }
+    }
+
+    // Optional in full bodies too, so older clients keep the stored broker settings
+    const cJSON *mqtt = cJSON_GetObjectItem(root, "mqtt");
+    if (mqtt) {
+        if (!cJSON_IsObject(mqtt)) {
+            *bad = true;
+        } else {
+            mqtt_settings_t *m = &cfg->mqtt;
+            take_string(mqtt, "uri", m->uri, sizeof(m->uri), CONFIG_FIELD_MQTT, &present, bad);
+            take_string(mqtt, "username", m->username, sizeof(m->username), CONFIG_FIELD_MQTT, &present, bad);
+            take_string(mqtt, "password", m->password, sizeof(m->password), CONFIG_FIELD_MQTT, &present, bad);
+            take_string(mqtt, "topic", m->topic, sizeof(m->topic), CONFIG_FIELD_MQTT, &present, bad);
+        }
+    }
+    return present;
+}
+
+static esp_err_t handle_config_update(httpd_req_t *req, bool partial)
 {
     size_t total_len = req->content_len;
     if (total_len == 0 || total_len > MAX_CONFIG_BODY_LEN) {
@@ -324,304 +493,853 @@ static esp_err_t handle_post_config(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    measurement_config_t new_cfg = s_cached_config;
-    const cJSON *battery = cJSON_GetObjectItem(root, "battery");
-    const cJSON *air = cJSON_GetObjectItem(root, "air");
-    const cJSON *sea = cJSON_GetObjectItem(root, "sea");
-    const cJSON *display = cJSON_GetObjectItem(root, "display_on_seconds");
-    const cJSON *name = cJSON_GetObjectItem(root, "device_name");
-    const cJSON *wifi = cJSON_GetObjectItem(root, "wifi");
-    const cJSON *web_ui = cJSON_GetObjectItem(root, "web_ui");
-    const cJSON *ssid = cJSON_GetObjectItem(root, "wifi_ssid");
-    const cJSON *password = cJSON_GetObjectItem(root, "wifi_password");
-    const cJSON *screens = cJSON_GetObjectItem(root, "screens");
-    const cJSON *offsets = cJSON_GetObjectItem(root, "offsets");
+    // Two workers may run config updates at once; hold the lock from read to publish
+    xSemaphoreTake(s_config_update_lock, portMAX_DELAY);
+    measurement_config_t new_cfg = config_store_get();
+    bool bad = false;
+    uint32_t present = json_to_config(root, &new_cfg, partial, &bad);
+    cJSON_Delete(root);
+    if (bad || (!partial && (present & CONFIG_FIELDS_REQUIRED) != CONFIG_FIELDS_REQUIRED)) {
+        xSemaphoreGive(s_config_update_lock);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, bad ? "Invalid field" : "Missing fields");
+        return ESP_FAIL;
+    }
 
-    bool ok = true;
-    ok &= json_to_interval(battery, &new_cfg.battery);
-    ok &= json_to_interval(air, &new_cfg.air);
-    ok &= json_to_interval(sea, &new_cfg.sea);
-    if (cJSON_IsNumber(display)) {
-        new_cfg.display_on_seconds = (uint16_t)cJSON_GetNumberValue(display);
-    } else {
-        ok = false;
+    // config_store_set persists the record and then notifies each subscribed subsystem with
+    // the change mask; only those whose own settings moved reconfigure themselves
+    int64_t start_us = esp_timer_get_time();
+    config_store_normalize(&new_cfg);
+    uint32_t changed = config_store_diff(config_store_current(NULL), &new_cfg);
+    esp_err_t err = changed ? config_store_set(&new_cfg) : ESP_OK;
+    xSemaphoreGive(s_config_update_lock);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Persist failed");
+        return err;
     }
-    ok &= json_to_interval(wifi, &new_cfg.wifi);
-    ok &= json_to_interval(web_ui, &new_cfg.web_ui);
-    if (cJSON_IsString(name)) {
-        strlcpy(new_cfg.device_name, cJSON_GetStringValue(name), sizeof(new_cfg.device_name));
-    } else {
-        ok = false;
+    int64_t apply_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG, "Config changed 0x%04" PRIx32 " (generation %" PRIu32 "): applied in %lld us", changed,
+             config_store_generation(), (long long)apply_us);
+
+    char changed_hdr[12];
+    char timing_hdr[64];
+    snprintf(changed_hdr, sizeof(changed_hdr), "0x%04" PRIx32, changed);
+    snprintf(timing_hdr, sizeof(timing_hdr), "apply;dur=%.1f", apply_us / 1000.0);
+    httpd_resp_set_hdr(req, "X-Config-Changed", changed_hdr);
+    httpd_resp_set_hdr(req, "Server-Timing", timing_hdr);
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t handle_post_config(httpd_req_t *req)
+{
+    return handle_config_update(req, false);
+}
+
+static esp_err_t handle_patch_config(httpd_req_t *req)
+{
+    return handle_config_update(req, true);
+}
+
+static esp_err_t handle_post_reboot(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "204 No Content");
+    httpd_resp_send(req, NULL, 0);
+    schedule_reboot();
+    return ESP_OK;
+}
+
+static esp_err_t handle_get_status(httpd_req_t *req)
+{
+    wifi_status_t status = wifi_manager_get_status();
+    char ap_ip[16];
+    char sta_ip[16];
+    ip_to_string(&status.ap_ip, ap_ip, sizeof(ap_ip));
+    ip_to_string(&status.sta_ip, sta_ip, sizeof(sta_ip));
+    display_flush_stats_t flush;
+    display_manager_get_flush_stats(&flush);
+
+    char buf[JSON_RESP_BUF_LEN];
+    json_writer_t w;
+    json_resp_begin(req, &w, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_write_string(&w, "ap_ip", ap_ip);
+    json_write_string(&w, "sta_ip", sta_ip);
+    json_write_bool(&w, "sta_connected", status.sta_connected);
+    json_begin_object(&w, "display");
+    json_write_int(&w, "last_flush_bytes", flush.last_bytes);
+    json_write_int(&w, "last_flush_us", flush.last_flush_us);
+    json_write_int(&w, "last_render_us", flush.last_render_us);
+    json_write_int(&w, "flushes", flush.flushes);
+    json_write_int(&w, "skipped", flush.skipped);
+    json_end_object(&w);
+    json_end_object(&w);
+    return json_resp_end(req, &w);
+}
+
+typedef enum {
+    SNAPSHOT_DOC_METRICS,
+    SNAPSHOT_DOC_GOOGLE_STATE,
+} snapshot_doc_t;
+
+typedef struct {
+    snapshot_doc_t doc;
+    sensor_snapshot_t snapshot;
+    bool from_cache;
+    int64_t ts_us;
+} snapshot_view_t;
+
+// On-demand measurements go through scheduler_run_now, so they run on the same timer task as
+// the periodic ones and callers asking at the same time share one run per group. The caller
+// only starts the runs; the request is then parked in the events task, which answers it once
+// every started group has completed or the request's deadline passed. No worker sits out
+// the sensor power-up, so config writes and other EXECUTEs keep their workers meanwhile.
+static const char *const k_measure_groups[] = {
+    [SCHED_TASK_BATTERY] = "battery",
+    [SCHED_TASK_AIR] = "air",
+    [SCHED_TASK_SEA] = "sea",
+};
+
+#define MEASURE_GROUP_COUNT (sizeof(k_measure_groups) / sizeof(k_measure_groups[0]))
+#define MEASURE_ALL_GROUPS ((1u << MEASURE_GROUP_COUNT) - 1)
+
+typedef struct measure_wait measure_wait_t;
+
+// Answers a request whose measurements are done or timed out; it owns the response, the
+// caller ends the detached request afterwards
+typedef esp_err_t (*measure_finish_fn)(httpd_req_t *req, const measure_wait_t *wait);
+
+struct measure_wait {
+    httpd_req_t *req; // async copy from the worker that started the runs
+    measure_finish_fn finish;
+    void *arg;
+    int64_t since_us;    // when the request started; freshness is judged against this
+    int64_t deadline_us; // one deadline for all groups, however many commands asked for them
+    uint8_t requested;   // bit per scheduler task id (/api/measure only)
+    uint32_t max_age_ms; // (/api/measure only)
+    uint8_t pending;     // started groups without a completed run yet
+    uint8_t measured;    // groups that ran for this request (or shared a run already under way)
+    uint32_t baseline[MEASURE_GROUP_COUNT];
+};
+
+static bool measure_group_bit(const char *name, size_t len, uint8_t *mask)
+{
+    for (size_t g = 0; g < MEASURE_GROUP_COUNT; ++g) {
+        if (strlen(k_measure_groups[g]) == len && strncmp(name, k_measure_groups[g], len) == 0) {
+            *mask |= 1u << g;
+            return true;
+        }
     }
-    if (cJSON_IsString(ssid)) {
-        strlcpy(new_cfg.wifi_ssid, cJSON_GetStringValue(ssid), sizeof(new_cfg.wifi_ssid));
-    } else {
-        ok = false;
+    return false;
+}
+
+static void measure_wait_init(measure_wait_t *wait, httpd_req_t *req, measure_finish_fn finish, void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    *wait = (measure_wait_t){
+        .req = req,
+        .finish = finish,
+        .arg = arg,
+        .since_us = now_us,
+        .deadline_us = now_us + MEASURE_TIMEOUT_MS * 1000LL,
+    };
+}
+
+// Groups in mask whose last run completed at most max_age_ms before since_us, or after it
+static uint8_t measure_fresh_groups(uint8_t mask, uint32_t max_age_ms, int64_t since_us)
+{
+    uint8_t fresh = 0;
+    for (size_t g = 0; g < MEASURE_GROUP_COUNT; ++g) {
+        if (!(mask & (1u << g))) {
+            continue;
+        }
+        scheduler_task_status_t status;
+        scheduler_get_status((scheduler_task_id_t)g, &status);
+        if (status.last_done_us > 0 && status.last_done_us >= since_us - (int64_t)max_age_ms * 1000) {
+            fresh |= 1u << g;
+        }
+    }
+    return fresh;
+}
+
+// Starts a run of each group in mask older than max_age_ms; every Measure command of an
+// EXECUTE adds to the same wait
+static void measure_start(measure_wait_t *wait, uint8_t mask, uint32_t max_age_ms)
+{
+    uint8_t stale = mask & ~measure_fresh_groups(mask, max_age_ms, wait->since_us) & ~wait->pending;
+    for (size_t g = 0; g < MEASURE_GROUP_COUNT; ++g) {
+        if ((stale & (1u << g)) && scheduler_run_now((scheduler_task_id_t)g, &wait->baseline[g]) == ESP_OK) {
+            wait->pending |= 1u << g;
+        }
     }
-    if (cJSON_IsString(password)) {
-        strlcpy(new_cfg.wifi_password, cJSON_GetStringValue(password), sizeof(new_cfg.wifi_password));
+}
+
+// True once every started group has run or the deadline passed
+static bool measure_poll(measure_wait_t *wait, int64_t now_us)
+{
+    for (size_t g = 0; g < MEASURE_GROUP_COUNT; ++g) {
+        scheduler_task_status_t status;
+        scheduler_get_status((scheduler_task_id_t)g, &status);
+        if ((wait->pending & (1u << g)) && status.runs != wait->baseline[g]) {
+            wait->pending &= ~(1u << g);
+            wait->measured |= 1u << g;
+        }
+    }
+    return !wait->pending || now_us >= wait->deadline_us;
+}
+
+static bool measure_reserve(void)
+{
+    bool admitted = false;
+    portENTER_CRITICAL(&s_events_lock);
+    if (s_events_task && s_measure_waiters < MEASURE_MAX_WAITERS) {
+        s_measure_waiters++;
+        admitted = true;
+    }
+    portEXIT_CRITICAL(&s_events_lock);
+    return admitted;
+}
+
+static void measure_release(void)
+{
+    portENTER_CRITICAL(&s_events_lock);
+    s_measure_waiters--;
+    portEXIT_CRITICAL(&s_events_lock);
+}
+
+// Parks a started wait under a reserved slot. On false the slot and the request stay with
+// the caller.
+static bool measure_hand_off(const measure_wait_t *wait)
+{
+    if (xQueueSend(s_measure_join, wait, 0) != pdTRUE) {
+        return false;
+    }
+    xTaskNotifyGive(s_events_task);
+    return true;
+}
+
+// Ends a detached request the way httpd ends an attached one: a failed handler closes the socket
+static void async_request_finish(httpd_req_t *req, esp_err_t err)
+{
+    int fd = httpd_req_to_sockfd(req);
+    http_metrics_request_end(req, err);
+    httpd_req_async_handler_complete(req);
+    if (err != ESP_OK) {
+        httpd_sess_trigger_close(s_server, fd);
+    }
+}
+
+static void measure_complete(const measure_wait_t *wait)
+{
+    async_request_finish(wait->req, wait->finish(wait->req, wait));
+    measure_release();
+}
+
+// Handed from a handler to the events task: either a live stream or a parked long-poll
+typedef struct {
+    httpd_req_t *req;
+    bool stream;
+    snapshot_doc_t doc;
+    uint32_t after_seq;
+    int64_t deadline_us;
+} events_join_t;
+
+static void load_snapshot_view(snapshot_doc_t doc, snapshot_view_t *view)
+{
+    view->doc = doc;
+    view->from_cache = false;
+    view->ts_us = 0;
+    if (doc == SNAPSHOT_DOC_GOOGLE_STATE) {
+        view->from_cache = google_bridge_get_last_snapshot(&view->snapshot, &view->ts_us);
+    }
+    if (!view->from_cache) {
+        sensor_manager_get_snapshot(&view->snapshot);
+        view->ts_us = esp_timer_get_time();
+    }
+}
+
+static bool seq_newer(uint32_t seq, uint32_t than)
+{
+    return (int32_t)(seq - than) > 0;
+}
+
+static void snapshot_etag(char *out, size_t len, const snapshot_view_t *view)
+{
+    // The boot tag keeps a restarted device from matching validators issued before the reset;
+    // google/state also carries age_ms, so its tag is weak (same data, not same bytes)
+    snprintf(out, len, "%s\"%08" PRIx32 "-%" PRIu32 "\"", view->doc == SNAPSHOT_DOC_GOOGLE_STATE ? "W/" : "",
+             s_boot_tag, view->snapshot.seq);
+}
+
+static esp_err_t send_not_modified(httpd_req_t *req, const char *etag)
+{
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t send_snapshot_view(httpd_req_t *req, const snapshot_view_t *view, const char *etag)
+{
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char buf[JSON_RESP_BUF_LEN];
+    json_writer_t w;
+    json_resp_begin(req, &w, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    if (view->doc == SNAPSHOT_DOC_METRICS) {
+        json_write_snapshot(&w, &view->snapshot);
+        json_end_object(&w);
+        return json_resp_end(req, &w);
+    }
+
+    wifi_status_t status = wifi_manager_get_status();
+    char ap_ip[16];
+    char sta_ip[16];
+    ip_to_string(&status.ap_ip, ap_ip, sizeof(ap_ip));
+    ip_to_string(&status.sta_ip, sta_ip, sizeof(sta_ip));
+    json_write_bool(&w, "cached", view->from_cache);
+    if (view->ts_us > 0) {
+        int64_t age_ms = (esp_timer_get_time() - view->ts_us) / 1000;
+        if (age_ms < 0) age_ms = 0;
+        json_write_int(&w, "age_ms", age_ms);
+    }
+    json_write_snapshot(&w, &view->snapshot);
+    json_begin_object(&w, "wifi");
+    json_write_bool(&w, "sta_connected", status.sta_connected);
+    json_write_string(&w, "sta_ip", sta_ip);
+    json_write_string(&w, "ap_ip", ap_ip);
+    json_end_object(&w);
+    json_end_object(&w);
+    return json_resp_end(req, &w);
+}
+
+static size_t events_format(char *buf, size_t cap, const sensor_snapshot_t *snapshot)
+{
+    static const char prefix[] = "data: ";
+    size_t len = sizeof(prefix) - 1;
+    memcpy(buf, prefix, len);
+    json_writer_t w;
+    json_writer_init(&w, buf + len, cap - len - 2, NULL, NULL);
+    json_begin_object(&w, NULL);
+    json_write_snapshot(&w, snapshot);
+    json_end_object(&w);
+    if (json_writer_finish(&w) != ESP_OK) {
+        return 0;
+    }
+    len += w.len;
+    buf[len++] = '\n';
+    buf[len++] = '\n';
+    return len;
+}
+
+static void events_release(bool stream)
+{
+    portENTER_CRITICAL(&s_events_lock);
+    if (stream) {
+        s_events_clients--;
     } else {
-        ok = false;
-    }
-    if (cJSON_IsObject(screens)) {
-        const cJSON *screen1 = cJSON_GetObjectItem(screens, "screen1");
-        const cJSON *screen2 = cJSON_GetObjectItem(screens, "screen2");
-        uint32_t mask1 = 0;
-        uint32_t mask2 = 0;
-        if (cJSON_IsArray(screen1)) {
-            cJSON *item = NULL;
-            cJSON_ArrayForEach(item, screen1) {
-                if (cJSON_IsString(item)) {
-                    uint32_t bit = 0;
-                    if (config_store_screen_name_to_bit(item->valuestring, &bit)) {
-                        mask1 |= bit;
-                    }
-                }
+        s_longpoll_waiters--;
+    }
+    portEXIT_CRITICAL(&s_events_lock);
+}
+
+static void events_finish(httpd_req_t *req, bool stream, bool close)
+{
+    int fd = httpd_req_to_sockfd(req);
+    httpd_req_async_handler_complete(req);
+    if (close) {
+        httpd_sess_trigger_close(s_server, fd);
+    }
+    events_release(stream);
+}
+
+static bool longpoll_service(const events_join_t *waiter, int64_t now_us)
+{
+    // Answers a parked request once its snapshot moved past after_seq or its timeout expired
+    snapshot_view_t view;
+    load_snapshot_view(waiter->doc, &view);
+    bool changed = seq_newer(view.snapshot.seq, waiter->after_seq);
+    if (!changed && now_us < waiter->deadline_us) {
+        return false;
+    }
+    char etag[40];
+    snapshot_etag(etag, sizeof(etag), &view);
+    esp_err_t err = changed ? send_snapshot_view(waiter->req, &view, etag) : send_not_modified(waiter->req, etag);
+    events_finish(waiter->req, false, err != ESP_OK);
+    return true;
+}
+
+static void events_task(void *ctx)
+{
+    (void)ctx;
+    static const char retry[] = "retry: 5000\n\n";
+    static const char keepalive[] = ": keepalive\n\n";
+    httpd_req_t *streams[EVENTS_MAX_CLIENTS];
+    size_t stream_count = 0;
+    events_join_t waiters[LONGPOLL_MAX_WAITERS];
+    size_t waiter_count = 0;
+    measure_wait_t measures[MEASURE_MAX_WAITERS];
+    size_t measure_count = 0;
+    char event[JSON_RESP_BUF_LEN];
+    size_t event_len = 0;
+    sensor_snapshot_t snapshot;
+    int64_t next_keepalive_us = esp_timer_get_time() + EVENTS_KEEPALIVE_MS * 1000LL;
+
+    while (true) {
+        int64_t wake_us = next_keepalive_us;
+        for (size_t i = 0; i < waiter_count; ++i) {
+            if (waiters[i].deadline_us < wake_us) {
+                wake_us = waiters[i].deadline_us;
             }
         }
-        if (cJSON_IsArray(screen2)) {
-            cJSON *item = NULL;
-            cJSON_ArrayForEach(item, screen2) {
-                if (cJSON_IsString(item)) {
-                    uint32_t bit = 0;
-                    if (config_store_screen_name_to_bit(item->valuestring, &bit)) {
-                        mask2 |= bit;
-                    }
-                }
+        if (measure_count > 0) {
+            // A run is counted after its snapshot is published, so completion is polled
+            int64_t poll_us = esp_timer_get_time() + MEASURE_POLL_MS * 1000LL;
+            wake_us = poll_us < wake_us ? poll_us : wake_us;
+        }
+        int64_t wait_ms = (wake_us - esp_timer_get_time()) / 1000;
+        TickType_t wait_ticks = wait_ms > 0 ? pdMS_TO_TICKS(wait_ms) : 0;
+        ulTaskNotifyTake(pdTRUE, wait_ticks < 2 ? 2 : wait_ticks);
+        int64_t now_us = esp_timer_get_time();
+
+        portENTER_CRITICAL(&s_events_lock);
+        bool fresh = s_events_pending;
+        s_events_pending = false;
+        snapshot = s_events_snapshot;
+        portEXIT_CRITICAL(&s_events_lock);
+        if (fresh) {
+            event_len = events_format(event, sizeof(event), &snapshot);
+        }
+        bool ping = !fresh && now_us >= next_keepalive_us;
+        if (fresh || ping) {
+            next_keepalive_us = now_us + EVENTS_KEEPALIVE_MS * 1000LL;
+        }
+
+        for (size_t i = 0; i < stream_count;) {
+            esp_err_t err = ESP_OK;
+            if (fresh && event_len > 0) {
+                err = httpd_resp_send_chunk(streams[i], event, event_len);
+            } else if (ping) {
+                err = httpd_resp_send_chunk(streams[i], keepalive, sizeof(keepalive) - 1);
             }
+            if (err == ESP_OK) {
+                ++i;
+                continue;
+            }
+            events_finish(streams[i], true, true);
+            streams[i] = streams[--stream_count];
         }
-        new_cfg.screen_items[0] = mask1;
-        new_cfg.screen_items[1] = mask2;
-    } else {
-        ok = false;
-    }
-    if (cJSON_IsObject(offsets)) {
-        const cJSON *water = cJSON_GetObjectItem(offsets, "water_temp_c");
-        const cJSON *sea = cJSON_GetObjectItem(offsets, "sea_level_cm");
-        const cJSON *air = cJSON_GetObjectItem(offsets, "air_temp_c");
-        if (cJSON_IsNumber(water) && cJSON_IsNumber(sea) && cJSON_IsNumber(air)) {
-            new_cfg.offsets.water_temp_c = (float)cJSON_GetNumberValue(water);
-            new_cfg.offsets.sea_level_cm = (float)cJSON_GetNumberValue(sea);
-            new_cfg.offsets.air_temp_c = (float)cJSON_GetNumberValue(air);
-        } else {
-            ok = false;
+
+        for (size_t i = 0; i < waiter_count;) {
+            if (longpoll_service(&waiters[i], now_us)) {
+                waiters[i] = waiters[--waiter_count];
+            } else {
+                ++i;
+            }
         }
-    } else {
-        ok = false;
-    }
 
-    if (!ok) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing fields");
-        cJSON_Delete(root);
-        return ESP_FAIL;
+        measure_wait_t wait;
+        while (xQueueReceive(s_measure_join, &wait, 0) == pdTRUE) {
+            measures[measure_count++] = wait; // bounded by the reserved slots
+        }
+        for (size_t i = 0; i < measure_count;) {
+            if (measure_poll(&measures[i], now_us)) {
+                measure_complete(&measures[i]);
+                measures[i] = measures[--measure_count];
+            } else {
+                ++i;
+            }
+        }
+
+        events_join_t join;
+        while (xQueueReceive(s_events_join, &join, 0) == pdTRUE) {
+            if (!join.stream) {
+                // A snapshot may have landed between the handler's check and this point
+                if (!longpoll_service(&join, now_us) && waiter_count < LONGPOLL_MAX_WAITERS) {
+                    waiters[waiter_count++] = join;
+                }
+                continue;
+            }
+            // New streams start with the current values so the page renders immediately
+            if (event_len == 0) {
+                sensor_manager_get_snapshot(&snapshot);
+                event_len = events_format(event, sizeof(event), &snapshot);
+            }
+            bool ok = stream_count < EVENTS_MAX_CLIENTS &&
+                      httpd_resp_send_chunk(join.req, retry, sizeof(retry) - 1) == ESP_OK &&
+                      (event_len == 0 || httpd_resp_send_chunk(join.req, event, event_len) == ESP_OK);
+            if (ok) {
+                streams[stream_count++] = join.req;
+            } else {
+                events_finish(join.req, true, true);
+            }
+        }
     }
+}
 
-    esp_err_t err = config_store_set(&new_cfg);
+static esp_err_t events_hand_off(httpd_req_t *req, events_join_t *join)
+{
+    // The caller has already reserved the slot; it is released here on failure
+    esp_err_t err = s_events_task ? httpd_req_async_handler_begin(req, &join->req) : ESP_ERR_INVALID_STATE;
+    if (err == ESP_OK && xQueueSend(s_events_join, join, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(join->req);
+        err = ESP_ERR_NO_MEM;
+    }
     if (err != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Persist failed");
-        cJSON_Delete(root);
+        events_release(join->stream);
         return err;
     }
+    xTaskNotifyGive(s_events_task);
+    return ESP_OK;
+}
+
+static bool events_reserve(bool stream)
+{
+    bool admitted = false;
+    portENTER_CRITICAL(&s_events_lock);
+    if (stream && s_events_clients < EVENTS_MAX_CLIENTS) {
+        s_events_clients++;
+        admitted = true;
+    } else if (!stream && s_longpoll_waiters < LONGPOLL_MAX_WAITERS) {
+        s_longpoll_waiters++;
+        admitted = true;
+    }
+    portEXIT_CRITICAL(&s_events_lock);
+    return admitted;
+}
 
-    s_cached_config = new_cfg;
-    google_bridge_update_config(&s_cached_config);
-    scheduler_apply_config(&s_cached_config);
-    wifi_manager_update_config(&s_cached_config);
-    display_manager_update_config(&s_cached_config);
+static bool parse_longpoll(httpd_req_t *req, uint32_t *after_seq, uint32_t *timeout_s)
+{
+    char query[64];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "wait_for_seq", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    char *end = NULL;
+    unsigned long seq = strtoul(value, &end, 10);
+    if (end == value || *end != '\0') {
+        return false;
+    }
+    *after_seq = (uint32_t)seq;
+    *timeout_s = LONGPOLL_DEFAULT_S;
+    if (httpd_query_key_value(query, "timeout", value, sizeof(value)) == ESP_OK) {
+        unsigned long t = strtoul(value, NULL, 10);
+        *timeout_s = t < 1 ? 1 : (t > LONGPOLL_MAX_S ? LONGPOLL_MAX_S : (uint32_t)t);
+    }
+    return true;
+}
 
-    httpd_resp_set_status(req, "204 No Content");
-    httpd_resp_send(req, NULL, 0);
+static esp_err_t send_shed_state(httpd_req_t *req)
+{
+    // Cheap answer for a client over its rate: the body serialized at the last publish
+    google_blob_t *blob = google_cache_peek(GOOGLE_CACHE_STATE);
+    if (!blob) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    http_metrics_count_shed(req);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "X-Load-Shed", "1");
+    esp_err_t err = httpd_resp_send(req, blob->data, blob->len);
+    google_blob_release(blob);
+    return err;
+}
 
-    cJSON_Delete(root);
-    return ESP_OK;
+static esp_err_t handle_snapshot_doc(httpd_req_t *req, snapshot_doc_t doc)
+{
+    if (doc == SNAPSHOT_DOC_GOOGLE_STATE) {
+        local_discovery_note_query(); // the Local Home app's QUERY
+    }
+    if (doc == SNAPSHOT_DOC_GOOGLE_STATE && !http_limiter_allow(req, LIMIT_CLASS_GOOGLE_STATE, &k_google_limit)) {
+        esp_err_t err = send_shed_state(req);
+        if (err != ESP_ERR_NOT_FOUND) {
+            return err;
+        }
+    }
+    snapshot_view_t view;
+    load_snapshot_view(doc, &view);
+
+    // ?wait_for_seq=N parks the request in the events task until seq > N (or the timeout
+    // passes, answered with 304); when every slot is taken it degrades to a plain GET
+    uint32_t after_seq = 0;
+    uint32_t timeout_s = 0;
+    if (parse_longpoll(req, &after_seq, &timeout_s) && !seq_newer(view.snapshot.seq, after_seq) &&
+        events_reserve(false)) {
+        events_join_t join = {
+            .stream = false,
+            .doc = doc,
+            .after_seq = after_seq,
+            .deadline_us = esp_timer_get_time() + (int64_t)timeout_s * 1000000,
+        };
+        if (events_hand_off(req, &join) == ESP_OK) {
+            return ESP_OK;
+        }
+    }
+
+    char etag[40];
+    snapshot_etag(etag, sizeof(etag), &view);
+    if (etag_matches(req, strchr(etag, '"'))) {
+        return send_not_modified(req, etag);
+    }
+    return send_snapshot_view(req, &view, etag);
+}
+
+static esp_err_t handle_get_metrics(httpd_req_t *req)
+{
+    return handle_snapshot_doc(req, SNAPSHOT_DOC_METRICS);
+}
+
+static esp_err_t handle_get_google_state(httpd_req_t *req)
+{
+    return handle_snapshot_doc(req, SNAPSHOT_DOC_GOOGLE_STATE);
+}
+
+static esp_err_t handle_get_events(httpd_req_t *req)
+{
+    if (!events_reserve(true)) {
+        // EventSource gives up on a non-200 answer; the SPA then falls back to polling
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "30");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    events_join_t join = {.stream = true};
+    esp_err_t err = events_hand_off(req, &join);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Stream unavailable");
+    }
+    return err;
 }
 
-static esp_err_t handle_post_reboot(httpd_req_t *req)
+static esp_err_t send_busy(httpd_req_t *req)
 {
-    httpd_resp_set_status(req, "204 No Content");
-    httpd_resp_send(req, NULL, 0);
-    schedule_reboot();
-    return ESP_OK;
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_send(req, NULL, 0);
 }
 
-static esp_err_t handle_get_status(httpd_req_t *req)
+static bool parse_measure_query(httpd_req_t *req, uint8_t *mask, uint32_t *max_age_ms)
 {
-    wifi_status_t status = wifi_manager_get_status();
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return ESP_ERR_NO_MEM;
+    char query[96];
+    char value[40];
+    *mask = MEASURE_ALL_GROUPS;
+    *max_age_ms = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return true;
     }
-    char ap_ip[16];
-    char sta_ip[16];
-    ip_to_string(&status.ap_ip, ap_ip, sizeof(ap_ip));
-    ip_to_string(&status.sta_ip, sta_ip, sizeof(sta_ip));
-    cJSON_AddStringToObject(root, "ap_ip", ap_ip);
-    cJSON_AddStringToObject(root, "sta_ip", sta_ip);
-    cJSON_AddBoolToObject(root, "sta_connected", status.sta_connected);
-    const char *json = cJSON_PrintUnformatted(root);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
-    cJSON_free((void *)json);
-    cJSON_Delete(root);
-    return ESP_OK;
+    if (httpd_query_key_value(query, "groups", value, sizeof(value)) == ESP_OK) {
+        *mask = 0;
+        for (const char *p = value; *p;) {
+            size_t len = strcspn(p, ",");
+            if (!measure_group_bit(p, len, mask)) {
+                return false;
+            }
+            p += len + (p[len] == ',');
+        }
+        if (*mask == 0) {
+            return false;
+        }
+    }
+    if (httpd_query_key_value(query, "max_age_ms", value, sizeof(value)) == ESP_OK) {
+        char *end = NULL;
+        unsigned long age = strtoul(value, &end, 10);
+        if (end == value || *end != '\0') {
+            return false;
+        }
+        *max_age_ms = age > MEASURE_MAX_AGE_MS ? MEASURE_MAX_AGE_MS : (uint32_t)age;
+    }
+    return true;
 }
 
-static esp_err_t handle_get_metrics(httpd_req_t *req)
+static esp_err_t send_measure_result(httpd_req_t *req, const measure_wait_t *wait)
 {
+    bool fresh = measure_fresh_groups(wait->requested, wait->max_age_ms, wait->since_us) == wait->requested;
     sensor_snapshot_t snapshot;
     sensor_manager_get_snapshot(&snapshot);
 
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return ESP_ERR_NO_MEM;
+    if (!fresh) {
+        httpd_resp_set_status(req, "504 Gateway Timeout");
     }
-
-    cJSON_AddNumberToObject(root, "water_temp_c", snapshot.water_temp_c);
-    cJSON_AddNumberToObject(root, "sea_level_cm", snapshot.sea_level_cm);
-    cJSON_AddNumberToObject(root, "air_temp_c", snapshot.air_temp_c);
-    cJSON_AddNumberToObject(root, "humidity_percent", snapshot.humidity_percent);
-    cJSON_AddNumberToObject(root, "air_pressure_hpa", snapshot.air_pressure_hpa);
-    cJSON_AddNumberToObject(root, "battery_percent", snapshot.battery_percent);
-    cJSON_AddNumberToObject(root, "battery_voltage", snapshot.battery_voltage);
-
-    const char *json = cJSON_PrintUnformatted(root);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
-    cJSON_free((void *)json);
-    cJSON_Delete(root);
-    return ESP_OK;
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    char buf[JSON_RESP_BUF_LEN];
+    json_writer_t w;
+    json_resp_begin(req, &w, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_write_bool(&w, "fresh", fresh);
+    json_begin_object(&w, "groups");
+    int64_t now_us = esp_timer_get_time();
+    for (size_t g = 0; g < MEASURE_GROUP_COUNT; ++g) {
+        if (!(wait->requested & (1u << g))) {
+            continue;
+        }
+        scheduler_task_status_t status;
+        scheduler_get_status((scheduler_task_id_t)g, &status);
+        json_begin_object(&w, k_measure_groups[g]);
+        json_write_bool(&w, "measured", wait->measured & (1u << g));
+        if (status.last_done_us > 0) {
+            json_write_int(&w, "age_ms", (now_us - status.last_done_us) / 1000);
+        } else {
+            json_write_null(&w, "age_ms");
+        }
+        json_end_object(&w);
+    }
+    json_end_object(&w);
+    json_write_snapshot(&w, &snapshot);
+    json_end_object(&w);
+    return json_resp_end(req, &w);
 }
 
-static esp_err_t handle_get_google_state(httpd_req_t *req)
+// Runs on a web worker (see handle_offload) only long enough to start the runs; a request
+// that has to wait is parked in the events task and answered from there
+static esp_err_t handle_post_measure(httpd_req_t *req)
 {
-    sensor_snapshot_t snapshot;
-    int64_t ts_us = 0;
-    bool from_cache = google_bridge_get_last_snapshot(&snapshot, &ts_us);
-    if (!from_cache) {
-        sensor_manager_get_snapshot(&snapshot);
-        ts_us = esp_timer_get_time();
+    uint8_t mask = 0;
+    uint32_t max_age_ms = 0;
+    if (!parse_measure_query(req, &mask, &max_age_ms)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "groups=battery,air,sea&max_age_ms=N");
+        return ESP_FAIL;
     }
-    wifi_status_t status = wifi_manager_get_status();
-
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return ESP_ERR_NO_MEM;
+    if (!measure_reserve()) {
+        return send_busy(req);
     }
-    cJSON_AddBoolToObject(root, "cached", from_cache);
-    if (ts_us > 0) {
-        int64_t age_ms = (esp_timer_get_time() - ts_us) / 1000;
-        if (age_ms < 0) age_ms = 0;
-        cJSON_AddNumberToObject(root, "age_ms", (double)age_ms);
-    }
-    cJSON_AddNumberToObject(root, "water_temp_c", snapshot.water_temp_c);
-    cJSON_AddNumberToObject(root, "sea_level_cm", snapshot.sea_level_cm);
-    cJSON_AddNumberToObject(root, "air_temp_c", snapshot.air_temp_c);
-    cJSON_AddNumberToObject(root, "humidity_percent", snapshot.humidity_percent);
-    cJSON_AddNumberToObject(root, "air_pressure_hpa", snapshot.air_pressure_hpa);
-    cJSON_AddNumberToObject(root, "battery_percent", snapshot.battery_percent);
-    cJSON_AddNumberToObject(root, "battery_voltage", snapshot.battery_voltage);
-
-    cJSON *wifi = cJSON_AddObjectToObject(root, "wifi");
-    if (wifi) {
-        char ap_ip[16];
-        char sta_ip[16];
-        ip_to_string(&status.ap_ip, ap_ip, sizeof(ap_ip));
-        ip_to_string(&status.sta_ip, sta_ip, sizeof(sta_ip));
-        cJSON_AddBoolToObject(wifi, "sta_connected", status.sta_connected);
-        cJSON_AddStringToObject(wifi, "sta_ip", sta_ip);
-        cJSON_AddStringToObject(wifi, "ap_ip", ap_ip);
+    measure_wait_t wait;
+    measure_wait_init(&wait, req, send_measure_result, NULL);
+    wait.requested = mask;
+    wait.max_age_ms = max_age_ms;
+    measure_start(&wait, mask, max_age_ms);
+    if (wait.pending && measure_hand_off(&wait)) {
+        return ESP_ERR_NOT_FINISHED;
     }
-
-    const char *json = cJSON_PrintUnformatted(root);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
-    cJSON_free((void *)json);
-    cJSON_Delete(root);
-    return ESP_OK;
+    measure_release();
+    return send_measure_result(req, &wait);
 }
 
-static void google_add_supported_sensor(cJSON *array, const char *name, const char *unit)
+static void google_add_supported_sensor(json_writer_t *w, const char *name, const char *unit)
 {
-    if (!array || !name) {
-        return;
-    }
-    cJSON *entry = cJSON_CreateObject();
-    if (!entry) {
-        return;
-    }
-    cJSON_AddStringToObject(entry, "name", name);
+    json_begin_object(w, NULL);
+    json_write_string(w, "name", name);
     if (unit) {
-        cJSON_AddStringToObject(entry, "unit", unit);
+        json_write_string(w, "unit", unit);
     }
-    cJSON_AddItemToArray(array, entry);
+    json_end_object(w);
 }
 
-static void google_fill_state(cJSON *state, const sensor_snapshot_t *snapshot, const wifi_status_t *wifi)
+static void google_fill_state(json_writer_t *w, const sensor_snapshot_t *snapshot, const wifi_status_t *wifi)
 {
-    if (!state || !snapshot) {
-        return;
-    }
     wifi_status_t wifi_status = wifi ? *wifi : wifi_manager_get_status();
     bool online = wifi_status.sta_connected || wifi_status.ap_ip.addr != 0;
-    cJSON_AddBoolToObject(state, "online", online);
-    cJSON_AddNumberToObject(state, "temperatureAmbientCelsius", snapshot->air_temp_c);
-    cJSON_AddNumberToObject(state, "humidityAmbientPercent", snapshot->humidity_percent);
-    cJSON_AddBoolToObject(state, "on", google_bridge_is_automation_enabled());
-    cJSON *custom = cJSON_AddObjectToObject(state, "customState");
-    if (custom) {
-        cJSON_AddNumberToObject(custom, "waterTempC", snapshot->water_temp_c);
-        cJSON_AddNumberToObject(custom, "waterLevelCm", snapshot->sea_level_cm);
-        cJSON_AddNumberToObject(custom, "airTempC", snapshot->air_temp_c);
-        cJSON_AddNumberToObject(custom, "airPressureHpa", snapshot->air_pressure_hpa);
-        cJSON_AddNumberToObject(custom, "batteryPercent", snapshot->battery_percent);
-        cJSON_AddNumberToObject(custom, "batteryVoltage", snapshot->battery_voltage);
+    json_write_bool(w, "online", online);
+    json_write_number(w, "temperatureAmbientCelsius", snapshot->air_temp_c, JSON_DECIMALS);
+    json_write_number(w, "humidityAmbientPercent", snapshot->humidity_percent, JSON_DECIMALS);
+    json_write_bool(w, "on", google_bridge_is_automation_enabled());
+    json_begin_object(w, "customState");
+    json_write_number(w, "waterTempC", snapshot->water_temp_c, JSON_DECIMALS);
+    json_write_number(w, "waterLevelCm", snapshot->sea_level_cm, JSON_DECIMALS);
+    json_write_number(w, "airTempC", snapshot->air_temp_c, JSON_DECIMALS);
+    json_write_number(w, "airPressureHpa", snapshot->air_pressure_hpa, JSON_DECIMALS);
+    json_write_number(w, "dewPointC", snapshot->dew_point_c, JSON_DECIMALS);
+    json_write_number(w, "seaLevelPressureHpa", snapshot->sea_level_pressure_hpa, JSON_DECIMALS);
+    json_write_number(w, "pressureTrendHpa3h", snapshot->pressure_trend_hpa_3h, JSON_DECIMALS);
+    json_write_number(w, "batteryPercent", snapshot->battery_percent, JSON_DECIMALS);
+    json_write_number(w, "batteryVoltage", snapshot->battery_voltage, 3);
+    json_write_number(w, "batteryDaysRemaining", snapshot->battery_days_remaining, 1);
+    json_end_object(w);
+}
+
+static void google_add_device_descriptor(json_writer_t *w)
+{
+    json_begin_object(w, NULL);
+    json_write_string(w, "id", google_bridge_device_id());
+    json_write_string(w, "type", "action.devices.types.SENSOR");
+    json_begin_array(w, "traits");
+    json_write_string(w, NULL, "action.devices.traits.SensorState");
+    json_write_string(w, NULL, "action.devices.traits.OnOff");
+    json_end_array(w);
+    json_begin_object(w, "name");
+    json_write_string(w, "name", google_bridge_friendly_name());
+    json_end_object(w);
+    json_write_bool(w, "willReportState", false);
+    json_begin_object(w, "attributes");
+    json_begin_array(w, "sensorStatesSupported");
+    google_add_supported_sensor(w, "airTemperatureC", "degC");
+    google_add_supported_sensor(w, "humidityPercent", "pct");
+    google_add_supported_sensor(w, "waterTemperatureC", "degC");
+    google_add_supported_sensor(w, "waterLevelCm", "cm");
+    google_add_supported_sensor(w, "airPressureHpa", "hPa");
+    google_add_supported_sensor(w, "batteryPercent", "pct");
+    json_end_array(w);
+    json_end_object(w);
+    json_begin_object(w, "deviceInfo");
+    json_write_string(w, "manufacturer", "SeaMonitor");
+    json_write_string(w, "model", "esp32-dock");
+    json_write_string(w, "hwVersion", "1");
+    json_write_string(w, "swVersion", "1.0");
+    json_end_object(w);
+    json_begin_object(w, "customData");
+    json_write_string(w, "stateEndpoint", "/api/google/state");
+    json_write_string(w, "homegraphEndpoint", "/api/google/homegraph");
+    json_write_int(w, "port", WEB_SERVER_PORT);
+    json_end_object(w);
+    // Local Home matches the verificationId from the UDP discovery reply against this
+    json_begin_array(w, "otherDeviceIds");
+    json_begin_object(w, NULL);
+    json_write_string(w, "deviceId", google_bridge_device_id());
+    json_end_object(w);
+    json_end_array(w);
+    json_end_object(w);
+}
+
+static void worker_task(void *ctx)
+{
+    (void)ctx;
+    worker_job_t job;
+    while (true) {
+        if (xQueueReceive(s_worker_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        esp_err_t err = job.fn(job.req, job.arg);
+        if (err == ESP_ERR_NOT_FINISHED) {
+            continue; // parked in the events task, which ends the request
+        }
+        async_request_finish(job.req, err);
     }
 }
 
-static void google_add_device_descriptor(cJSON *devices)
+// Detaches req from the httpd task and queues fn(req, arg) for a worker. On failure the
+// request is still attached and the caller owns both req and arg.
+static esp_err_t worker_submit(httpd_req_t *req, worker_fn fn, void *arg)
 {
-    if (!devices) {
-        return;
+    if (!s_worker_queue) {
+        return ESP_ERR_INVALID_STATE;
     }
-    cJSON *device = cJSON_CreateObject();
-    if (!device) {
-        return;
+    worker_job_t job = {.fn = fn, .arg = arg};
+    ESP_RETURN_ON_ERROR(httpd_req_async_handler_begin(req, &job.req), TAG, "async begin");
+    http_metrics_request_detach(req); // measured until the worker has sent the response
+    if (xQueueSend(s_worker_queue, &job, 0) != pdTRUE) {
+        http_metrics_request_end(req, ESP_OK);
+        httpd_req_async_handler_complete(job.req);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t run_offloaded(httpd_req_t *req, void *arg)
+{
+    return ((const offload_target_t *)arg)->fn(req);
+}
+
+// URI handler for endpoints that always run on a worker; user_ctx points at the target
+static esp_err_t handle_offload(httpd_req_t *req)
+{
+    const offload_target_t *target = (const offload_target_t *)req->user_ctx;
+    if (worker_submit(req, run_offloaded, (void *)target) == ESP_OK) {
+        return ESP_OK;
     }
-    cJSON_AddStringToObject(device, "id", google_bridge_device_id());
-    cJSON_AddStringToObject(device, "type", "action.devices.types.SENSOR");
-    cJSON *traits = cJSON_AddArrayToObject(device, "traits");
-    if (traits) {
-        cJSON_AddItemToArray(traits, cJSON_CreateString("action.devices.traits.SensorState"));
-        cJSON_AddItemToArray(traits, cJSON_CreateString("action.devices.traits.OnOff"));
-    }
-    cJSON *name = cJSON_AddObjectToObject(device, "name");
-    if (name) {
-        cJSON_AddStringToObject(name, "name", google_bridge_friendly_name());
-    }
-    cJSON_AddBoolToObject(device, "willReportState", false);
-    cJSON *attributes = cJSON_AddObjectToObject(device, "attributes");
-    if (attributes) {
-        cJSON *supported = cJSON_AddArrayToObject(attributes, "sensorStatesSupported");
-        google_add_supported_sensor(supported, "airTemperatureC", "degC");
-        google_add_supported_sensor(supported, "humidityPercent", "pct");
-        google_add_supported_sensor(supported, "waterTemperatureC", "degC");
-        google_add_supported_sensor(supported, "waterLevelCm", "cm");
-        google_add_supported_sensor(supported, "airPressureHpa", "hPa");
-        google_add_supported_sensor(supported, "batteryPercent", "pct");
-    }
-    cJSON *device_info = cJSON_AddObjectToObject(device, "deviceInfo");
-    if (device_info) {
-        cJSON_AddStringToObject(device_info, "manufacturer", "SeaMonitor");
-        cJSON_AddStringToObject(device_info, "model", "esp32-dock");
-        cJSON_AddStringToObject(device_info, "hwVersion", "1");
-        cJSON_AddStringToObject(device_info, "swVersion", "1.0");
-    }
-    cJSON *custom = cJSON_AddObjectToObject(device, "customData");
-    if (custom) {
-        cJSON_AddStringToObject(custom, "stateEndpoint", "/api/google/state");
-        cJSON_AddStringToObject(custom, "homegraphEndpoint", "/api/google/homegraph");
-    }
-    cJSON_AddItemToArray(devices, device);
+    return send_busy(req);
 }
 
 static cJSON *google_parse_body(httpd_req_t *req)
@@ -658,91 +1376,316 @@ static cJSON *google_parse_body(httpd_req_t *req)
     return root;
 }
 
-static esp_err_t google_handle_sync(httpd_req_t *req, cJSON *payload)
+static esp_err_t google_handle_sync(json_writer_t *w)
 {
-    if (!payload) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    cJSON_AddStringToObject(payload, "agentUserId", google_bridge_agent_user_id());
-    cJSON *devices = cJSON_AddArrayToObject(payload, "devices");
-    if (!devices) {
-        return ESP_ERR_NO_MEM;
-    }
-    google_add_device_descriptor(devices);
+    json_write_string(w, "agentUserId", google_bridge_agent_user_id());
+    json_begin_array(w, "devices");
+    google_add_device_descriptor(w);
+    json_end_array(w);
     return ESP_OK;
 }
 
-static esp_err_t google_handle_query(httpd_req_t *req, cJSON *payload, const cJSON *input)
+static esp_err_t google_handle_query(json_writer_t *w, const cJSON *input)
 {
-    if (!payload || !input) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    cJSON *devices_obj = cJSON_AddObjectToObject(payload, "devices");
-    if (!devices_obj) {
-        return ESP_ERR_NO_MEM;
-    }
     sensor_snapshot_t snapshot;
     sensor_manager_get_snapshot(&snapshot);
     wifi_status_t wifi = wifi_manager_get_status();
 
+    json_begin_object(w, "devices");
     const cJSON *input_payload = cJSON_GetObjectItem(input, "payload");
     const cJSON *devices = input_payload ? cJSON_GetObjectItem(input_payload, "devices") : NULL;
     if (!cJSON_IsArray(devices) || cJSON_GetArraySize(devices) == 0) {
-        cJSON *state = cJSON_CreateObject();
-        if (!state) {
-            return ESP_ERR_NO_MEM;
-        }
-        cJSON_AddStringToObject(state, "status", "SUCCESS");
-        google_fill_state(state, &snapshot, &wifi);
-        cJSON_AddItemToObject(devices_obj, google_bridge_device_id(), state);
+        json_begin_object(w, google_bridge_device_id());
+        json_write_string(w, "status", "SUCCESS");
+        google_fill_state(w, &snapshot, &wifi);
+        json_end_object(w);
+        json_end_object(w);
         return ESP_OK;
     }
     cJSON *device = NULL;
     cJSON_ArrayForEach(device, devices) {
         const cJSON *id_obj = cJSON_GetObjectItem(device, "id");
         const char *dev_id = cJSON_IsString(id_obj) ? id_obj->valuestring : google_bridge_device_id();
-        cJSON *state = cJSON_CreateObject();
-        if (!state) {
-            return ESP_ERR_NO_MEM;
-        }
+        json_begin_object(w, dev_id);
         if (strcmp(dev_id, google_bridge_device_id()) == 0) {
-            cJSON_AddStringToObject(state, "status", "SUCCESS");
-            google_fill_state(state, &snapshot, &wifi);
+            json_write_string(w, "status", "SUCCESS");
+            google_fill_state(w, &snapshot, &wifi);
         } else {
-            cJSON_AddStringToObject(state, "status", "ERROR");
-            cJSON_AddStringToObject(state, "errorCode", "deviceNotFound");
+            json_write_string(w, "status", "ERROR");
+            json_write_string(w, "errorCode", "deviceNotFound");
         }
-        cJSON_AddItemToObject(devices_obj, dev_id, state);
+        json_end_object(w);
     }
+    json_end_object(w);
     return ESP_OK;
 }
 
-static esp_err_t google_handle_execute(httpd_req_t *req, cJSON *payload, const cJSON *input)
+static void google_blob_release(google_blob_t *blob)
 {
-    if (!payload || !input) {
-        return ESP_ERR_INVALID_ARG;
+    if (!blob) {
+        return;
     }
-    cJSON *commands_resp = cJSON_AddArrayToObject(payload, "commands");
-    if (!commands_resp) {
-        return ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_google_cache_lock);
+    bool last = --blob->refs == 0;
+    portEXIT_CRITICAL(&s_google_cache_lock);
+    if (last) {
+        free(blob);
+    }
+}
+
+// Serializes the payload object for kind into a right-sized blob; snapshot is unused for SYNC
+static google_blob_t *google_blob_build(google_cache_kind_t kind, const sensor_snapshot_t *snapshot)
+{
+    google_blob_t *blob = malloc(sizeof(*blob) + GOOGLE_CACHE_MAX_LEN);
+    if (!blob) {
+        return NULL;
+    }
+    json_writer_t w;
+    json_writer_init(&w, blob->data, GOOGLE_CACHE_MAX_LEN, NULL, NULL);
+    json_begin_object(&w, NULL);
+    if (kind == GOOGLE_CACHE_SYNC) {
+        blob->key = config_store_generation();
+        blob->on = false;
+        google_handle_sync(&w);
+    } else if (kind == GOOGLE_CACHE_STATE) {
+        blob->key = snapshot->seq;
+        blob->on = false;
+        json_write_bool(&w, "cached", true);
+        json_write_snapshot(&w, snapshot);
+    } else {
+        blob->key = snapshot->seq;
+        blob->on = google_bridge_is_automation_enabled();
+        json_begin_object(&w, "devices");
+        json_begin_object(&w, google_bridge_device_id());
+        json_write_string(&w, "status", "SUCCESS");
+        google_fill_state(&w, snapshot, NULL);
+        json_end_object(&w);
+        json_end_object(&w);
+    }
+    json_end_object(&w);
+    if (json_writer_finish(&w) != ESP_OK) {
+        ESP_LOGW(TAG, "Google payload %d exceeds %d bytes", kind, GOOGLE_CACHE_MAX_LEN);
+        free(blob);
+        return NULL;
+    }
+    blob->refs = 1;
+    blob->len = w.len;
+    google_blob_t *shrunk = realloc(blob, sizeof(*blob) + blob->len);
+    return shrunk ? shrunk : blob;
+}
+
+static void google_cache_install(google_cache_kind_t kind, google_blob_t *blob)
+{
+    portENTER_CRITICAL(&s_google_cache_lock);
+    google_blob_t *old = s_google_cache[kind];
+    s_google_cache[kind] = blob;
+    portEXIT_CRITICAL(&s_google_cache_lock);
+    google_blob_release(old);
+}
+
+static bool google_blob_fresh(google_cache_kind_t kind, const google_blob_t *blob)
+{
+    if (kind == GOOGLE_CACHE_SYNC) {
+        return blob->key == config_store_generation();
+    }
+    if (kind == GOOGLE_CACHE_STATE) {
+        return blob->key == sensor_manager_get_seq();
+    }
+    return blob->key == sensor_manager_get_seq() && blob->on == google_bridge_is_automation_enabled();
+}
+
+// Returns a referenced blob as cached, fresh or not, or NULL if none was built yet
+static google_blob_t *google_cache_peek(google_cache_kind_t kind)
+{
+    portENTER_CRITICAL(&s_google_cache_lock);
+    google_blob_t *blob = s_google_cache[kind];
+    if (blob) {
+        blob->refs++;
+    }
+    portEXIT_CRITICAL(&s_google_cache_lock);
+    return blob;
+}
+
+// Returns a referenced, current blob or NULL. A stale one is rebuilt by the first caller;
+// callers arriving meanwhile wait for that build and share it. *shared tells whether the
+// bytes were serialized for someone else (the coalesced case).
+static google_blob_t *google_cache_acquire(google_cache_kind_t kind, bool *shared)
+{
+    *shared = true;
+    google_blob_t *blob = google_cache_peek(kind);
+    if (blob && google_blob_fresh(kind, blob)) {
+        return blob;
     }
+    google_blob_release(blob);
+
+    xSemaphoreTake(s_google_build_lock, portMAX_DELAY);
+    blob = google_cache_peek(kind);
+    if (blob && google_blob_fresh(kind, blob)) {
+        xSemaphoreGive(s_google_build_lock);
+        return blob;
+    }
+    google_blob_release(blob);
     sensor_snapshot_t snapshot;
-    sensor_manager_get_snapshot(&snapshot);
-    wifi_status_t wifi = wifi_manager_get_status();
+    if (kind != GOOGLE_CACHE_SYNC) {
+        sensor_manager_get_snapshot(&snapshot);
+    }
+    blob = google_blob_build(kind, &snapshot);
+    if (blob) {
+        blob->refs++; // one for the cache, one for the caller
+        google_cache_install(kind, blob);
+        *shared = false;
+    }
+    xSemaphoreGive(s_google_build_lock);
+    return blob;
+}
+
+// The cached QUERY payload answers the common case: no device list or just this device
+static bool google_query_cacheable(const cJSON *input)
+{
+    const cJSON *input_payload = cJSON_GetObjectItem(input, "payload");
+    const cJSON *devices = input_payload ? cJSON_GetObjectItem(input_payload, "devices") : NULL;
+    if (!cJSON_IsArray(devices) || cJSON_GetArraySize(devices) == 0) {
+        return true;
+    }
+    const cJSON *id_obj = cJSON_GetObjectItem(cJSON_GetArrayItem(devices, 0), "id");
+    return cJSON_GetArraySize(devices) == 1 &&
+           (!cJSON_IsString(id_obj) || strcmp(id_obj->valuestring, google_bridge_device_id()) == 0);
+}
+
+// Sends {"requestId":<id>,"payload":<blob>} in one response. ESP_ERR_INVALID_SIZE means
+// nothing was sent and the caller should serialize the usual way.
+static esp_err_t google_send_cached(httpd_req_t *req, const char *req_id, const google_blob_t *blob)
+{
+    static const char k_head[] = "{\"requestId\":";
+    static const char k_mid[] = ",\"payload\":";
+    char id[GOOGLE_REQUEST_ID_MAX];
+    json_writer_t w;
+    json_writer_init(&w, id, sizeof(id), NULL, NULL);
+    json_write_string(&w, NULL, req_id);
+    if (json_writer_finish(&w) != ESP_OK) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t total = sizeof(k_head) - 1 + w.len + sizeof(k_mid) - 1 + blob->len + 1;
+    char stack_buf[JSON_RESP_BUF_LEN];
+    char *out = total <= sizeof(stack_buf) ? stack_buf : malloc(total);
+    if (!out) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    char *p = out;
+    memcpy(p, k_head, sizeof(k_head) - 1);
+    p += sizeof(k_head) - 1;
+    memcpy(p, w.buf, w.len);
+    p += w.len;
+    memcpy(p, k_mid, sizeof(k_mid) - 1);
+    p += sizeof(k_mid) - 1;
+    memcpy(p, blob->data, blob->len);
+    p += blob->len;
+    *p = '}';
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, out, total);
+    if (out != stack_buf) {
+        free(out);
+    }
+    return err;
+}
+
+static bool google_measure_params(const cJSON *params, uint8_t *mask_out, uint32_t *max_age_out)
+{
+    // {"groups": ["sea", "air"], "maxAgeMs": 60000}; both optional
+    uint8_t mask = MEASURE_ALL_GROUPS;
+    const cJSON *groups = params ? cJSON_GetObjectItem(params, "groups") : NULL;
+    if (cJSON_IsArray(groups) && cJSON_GetArraySize(groups) > 0) {
+        mask = 0;
+        const cJSON *group = NULL;
+        cJSON_ArrayForEach(group, groups) {
+            if (!cJSON_IsString(group) || !measure_group_bit(group->valuestring, strlen(group->valuestring), &mask)) {
+                return false;
+            }
+        }
+    }
+    const cJSON *max_age = params ? cJSON_GetObjectItem(params, "maxAgeMs") : NULL;
+    uint32_t max_age_ms = 0;
+    if (cJSON_IsNumber(max_age) && max_age->valuedouble > 0) {
+        max_age_ms = max_age->valuedouble > MEASURE_MAX_AGE_MS ? MEASURE_MAX_AGE_MS : (uint32_t)max_age->valuedouble;
+    }
+    *mask_out = mask;
+    *max_age_out = max_age_ms;
+    return true;
+}
 
+static bool google_command_targets_device(const cJSON *cmd)
+{
+    const cJSON *devices = cJSON_GetObjectItem(cmd, "devices");
+    if (!cJSON_IsArray(devices)) {
+        return false;
+    }
+    const cJSON *entry = NULL;
+    cJSON_ArrayForEach(entry, devices) {
+        const cJSON *id_obj = cJSON_GetObjectItem(entry, "id");
+        if (!cJSON_IsString(id_obj) || strcmp(id_obj->valuestring, google_bridge_device_id()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// First half of an EXECUTE, on the worker: applies OnOff and Reboot and starts every
+// Measure on the one wait, so N Measure commands share a single deadline
+static void google_run_execute(const cJSON *input, measure_wait_t *wait)
+{
+    const cJSON *input_payload = cJSON_GetObjectItem(input, "payload");
+    const cJSON *commands = input_payload ? cJSON_GetObjectItem(input_payload, "commands") : NULL;
+    if (!cJSON_IsArray(commands)) {
+        return;
+    }
+    const cJSON *cmd = NULL;
+    cJSON_ArrayForEach(cmd, commands) {
+        const cJSON *execution = cJSON_GetObjectItem(cmd, "execution");
+        if (!cJSON_IsArray(execution) || !google_command_targets_device(cmd)) {
+            continue;
+        }
+        const cJSON *exec_item = NULL;
+        cJSON_ArrayForEach(exec_item, execution) {
+            const cJSON *cmd_obj = cJSON_GetObjectItem(exec_item, "command");
+            const char *cmd_name = cJSON_IsString(cmd_obj) ? cmd_obj->valuestring : NULL;
+            const cJSON *params = cJSON_GetObjectItem(exec_item, "params");
+            if (!cmd_name) {
+                continue;
+            }
+            if (strcmp(cmd_name, "action.devices.commands.OnOff") == 0) {
+                const cJSON *on = params ? cJSON_GetObjectItem(params, "on") : NULL;
+                google_bridge_set_automation_enabled(!cJSON_IsBool(on) ? true : cJSON_IsTrue(on));
+            } else if (strcmp(cmd_name, "action.devices.commands.Reboot") == 0) {
+                schedule_reboot();
+            } else if (strcmp(cmd_name, GOOGLE_CMD_MEASURE) == 0) {
+                uint8_t mask = 0;
+                uint32_t max_age_ms = 0;
+                if (google_measure_params(params, &mask, &max_age_ms)) {
+                    measure_start(wait, mask, max_age_ms);
+                }
+            }
+        }
+    }
+}
+
+// Second half: writes the per-command results once the commands in google_run_execute ran
+// at since_us and their measurements are done or timed out
+static esp_err_t google_handle_execute(json_writer_t *w, const cJSON *input, int64_t since_us)
+{
+    json_begin_array(w, "commands");
     const cJSON *input_payload = cJSON_GetObjectItem(input, "payload");
     const cJSON *commands = input_payload ? cJSON_GetObjectItem(input_payload, "commands") : NULL;
     if (!cJSON_IsArray(commands)) {
+        json_end_array(w);
         return ESP_ERR_INVALID_ARG;
     }
 
     cJSON *cmd = NULL;
     cJSON_ArrayForEach(cmd, commands) {
-        cJSON *result = cJSON_CreateObject();
-        if (!result) {
-            return ESP_ERR_NO_MEM;
-        }
-        cJSON *ids = cJSON_AddArrayToObject(result, "ids");
+        json_begin_object(w, NULL);
+        json_begin_array(w, "ids");
         bool targets_device = false;
         const cJSON *devices = cJSON_GetObjectItem(cmd, "devices");
         if (cJSON_IsArray(devices)) {
@@ -750,19 +1693,21 @@ static esp_err_t google_handle_execute(httpd_req_t *req, cJSON *payload, const c
             cJSON_ArrayForEach(entry, devices) {
                 const cJSON *id_obj = cJSON_GetObjectItem(entry, "id");
                 const char *dev_id = cJSON_IsString(id_obj) ? id_obj->valuestring : google_bridge_device_id();
-                cJSON_AddItemToArray(ids, cJSON_CreateString(dev_id));
+                json_write_string(w, NULL, dev_id);
                 if (strcmp(dev_id, google_bridge_device_id()) == 0) {
                     targets_device = true;
                 }
             }
         }
+        json_end_array(w);
         if (!targets_device) {
-            cJSON_AddStringToObject(result, "status", "ERROR");
-            cJSON_AddStringToObject(result, "errorCode", "deviceNotFound");
-            cJSON_AddItemToArray(commands_resp, result);
+            json_write_string(w, "status", "ERROR");
+            json_write_string(w, "errorCode", "deviceNotFound");
+            json_end_object(w);
             continue;
         }
         bool supported = false;
+        bool completed = true;
         const cJSON *execution = cJSON_GetObjectItem(cmd, "execution");
         if (cJSON_IsArray(execution)) {
             cJSON *exec_item = NULL;
@@ -772,129 +1717,270 @@ static esp_err_t google_handle_execute(httpd_req_t *req, cJSON *payload, const c
                 if (!cmd_name) {
                     continue;
                 }
-                if (strcmp(cmd_name, "action.devices.commands.OnOff") == 0) {
-                    const cJSON *params = cJSON_GetObjectItem(exec_item, "params");
-                    const cJSON *on = params ? cJSON_GetObjectItem(params, "on") : NULL;
-                    bool enable = !cJSON_IsBool(on) ? true : cJSON_IsTrue(on);
-                    google_bridge_set_automation_enabled(enable);
+                if (strcmp(cmd_name, "action.devices.commands.OnOff") == 0 ||
+                    strcmp(cmd_name, "action.devices.commands.Reboot") == 0) {
                     supported = true;
-                } else if (strcmp(cmd_name, "action.devices.commands.Reboot") == 0) {
+                } else if (strcmp(cmd_name, GOOGLE_CMD_MEASURE) == 0) {
+                    uint8_t mask = 0;
+                    uint32_t max_age_ms = 0;
                     supported = true;
-                    schedule_reboot();
+                    // Fresh now if it was at since_us or a run completed while the request was parked
+                    const cJSON *params = cJSON_GetObjectItem(exec_item, "params");
+                    completed &= google_measure_params(params, &mask, &max_age_ms) &&
+                                 measure_fresh_groups(mask, max_age_ms, since_us) == mask;
                 }
             }
         }
         if (!supported) {
-            cJSON_AddStringToObject(result, "status", "ERROR");
-            cJSON_AddStringToObject(result, "errorCode", "functionNotSupported");
-            cJSON_AddItemToArray(commands_resp, result);
+            json_write_string(w, "status", "ERROR");
+            json_write_string(w, "errorCode", "functionNotSupported");
+            json_end_object(w);
             continue;
         }
-        cJSON_AddStringToObject(result, "status", "SUCCESS");
-        cJSON *states = cJSON_AddObjectToObject(result, "states");
-        if (states) {
-            google_fill_state(states, &snapshot, &wifi);
+        if (!completed) {
+            json_write_string(w, "status", "ERROR");
+            json_write_string(w, "errorCode", "transientError");
+            json_end_object(w);
+            continue;
         }
-        cJSON_AddItemToArray(commands_resp, result);
+        // Read after the commands ran, so a Measure answers with the values it just produced
+        sensor_snapshot_t snapshot;
+        sensor_manager_get_snapshot(&snapshot);
+        json_write_string(w, "status", "SUCCESS");
+        json_begin_object(w, "states");
+        google_fill_state(w, &snapshot, NULL);
+        json_end_object(w);
+        json_end_object(w);
     }
+    json_end_array(w);
     return ESP_OK;
 }
 
+static esp_err_t google_respond(httpd_req_t *req, cJSON *root, bool shed, int64_t since_us);
+
+static esp_err_t google_execute_finish(httpd_req_t *req, const measure_wait_t *wait)
+{
+    return google_respond(req, (cJSON *)wait->arg, false, wait->since_us);
+}
+
+// EXECUTE on a worker: runs the commands, then answers at once or, when a Measure started
+// runs, parks the request until they are done. Without a free slot the answer goes out now
+// and Measure commands whose groups have not run yet report transientError.
+static esp_err_t google_execute_job(httpd_req_t *req, void *arg)
+{
+    cJSON *root = (cJSON *)arg;
+    measure_wait_t wait;
+    measure_wait_init(&wait, req, google_execute_finish, root);
+    google_run_execute(cJSON_GetArrayItem(cJSON_GetObjectItem(root, "inputs"), 0), &wait);
+    if (wait.pending && measure_reserve()) {
+        if (measure_hand_off(&wait)) {
+            return ESP_ERR_NOT_FINISHED;
+        }
+        measure_release();
+    }
+    return google_respond(req, root, false, wait.since_us);
+}
+
 static esp_err_t handle_post_google_homegraph(httpd_req_t *req)
 {
     cJSON *root = google_parse_body(req);
     if (!root) {
         return ESP_FAIL;
     }
-    const cJSON *request_id = cJSON_GetObjectItem(root, "requestId");
-    const char *req_id = cJSON_IsString(request_id) ? request_id->valuestring : "local";
     const cJSON *inputs = cJSON_GetObjectItem(root, "inputs");
     if (!cJSON_IsArray(inputs) || cJSON_GetArraySize(inputs) == 0) {
         cJSON_Delete(root);
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing inputs");
         return ESP_FAIL;
     }
-    const cJSON *first_input = cJSON_GetArrayItem(inputs, 0);
-    const cJSON *intent_obj = cJSON_GetObjectItem(first_input, "intent");
-    const char *intent = cJSON_IsString(intent_obj) ? intent_obj->valuestring : NULL;
-    if (!intent) {
+    const cJSON *intent_obj = cJSON_GetObjectItem(cJSON_GetArrayItem(inputs, 0), "intent");
+    if (!cJSON_IsString(intent_obj)) {
         cJSON_Delete(root);
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing intent");
         return ESP_FAIL;
     }
+    // SYNC and QUERY are answered from memory right here; EXECUTE may block, so it goes to
+    // a worker instead of holding up the Local Home QUERYs queued behind it
+    if (strcmp(intent_obj->valuestring, "action.devices.EXECUTE") != 0) {
+        if (strcmp(intent_obj->valuestring, "action.devices.QUERY") == 0) {
+            local_discovery_note_query();
+        }
+        bool shed = !http_limiter_allow(req, LIMIT_CLASS_HOMEGRAPH, &k_google_limit);
+        return google_respond(req, root, shed, 0);
+    }
+    if (worker_submit(req, google_execute_job, root) == ESP_OK) {
+        return ESP_OK;
+    }
+    cJSON_Delete(root);
+    return send_busy(req);
+}
+
+// Builds the fulfillment response for a validated request and frees root. A shed request
+// takes whatever payload is cached, even one from before the latest measurement. since_us is
+// when an EXECUTE's commands ran (google_execute_job); other intents ignore it.
+static esp_err_t google_respond(httpd_req_t *req, cJSON *root, bool shed, int64_t since_us)
+{
+    const cJSON *request_id = cJSON_GetObjectItem(root, "requestId");
+    const char *req_id = cJSON_IsString(request_id) ? request_id->valuestring : "local";
+    const cJSON *first_input = cJSON_GetArrayItem(cJSON_GetObjectItem(root, "inputs"), 0);
+    const char *intent = cJSON_GetObjectItem(first_input, "intent")->valuestring;
+
+    // SYNC and the usual QUERY only splice the requestId in front of cached bytes
+    google_cache_kind_t kind = GOOGLE_CACHE_COUNT;
+    if (strcmp(intent, "action.devices.SYNC") == 0) {
+        kind = GOOGLE_CACHE_SYNC;
+    } else if (strcmp(intent, "action.devices.QUERY") == 0 && google_query_cacheable(first_input)) {
+        kind = GOOGLE_CACHE_QUERY;
+    }
+    bool shared = true;
+    google_blob_t *blob = NULL;
+    if (kind != GOOGLE_CACHE_COUNT) {
+        blob = shed ? google_cache_peek(kind) : NULL;
+        blob = blob ? blob : google_cache_acquire(kind, &shared);
+    }
+    if (blob) {
+        if (shed) {
+            httpd_resp_set_hdr(req, "X-Load-Shed", "1");
+            http_metrics_count_shed(req);
+        } else if (shared) {
+            http_metrics_count_coalesced(req);
+        }
+        esp_err_t cached_err = google_send_cached(req, req_id, blob);
+        google_blob_release(blob);
+        if (cached_err != ESP_ERR_INVALID_SIZE) {
+            cJSON_Delete(root);
+            return cached_err;
+        }
+    }
 
-    cJSON *resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "requestId", req_id);
-    cJSON *payload = cJSON_AddObjectToObject(resp, "payload");
+    // The request is still parsed with cJSON; the response is streamed without a tree
+    char buf[JSON_RESP_BUF_LEN];
+    json_writer_t w;
+    json_resp_begin(req, &w, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_write_string(&w, "requestId", req_id);
+    json_begin_object(&w, "payload");
     esp_err_t err = ESP_ERR_NOT_SUPPORTED;
 
     if (strcmp(intent, "action.devices.SYNC") == 0) {
-        err = google_handle_sync(req, payload);
+        err = google_handle_sync(&w);
     } else if (strcmp(intent, "action.devices.QUERY") == 0) {
-        err = google_handle_query(req, payload, first_input);
+        err = google_handle_query(&w, first_input);
     } else if (strcmp(intent, "action.devices.EXECUTE") == 0) {
-        err = google_handle_execute(req, payload, first_input);
+        err = google_handle_execute(&w, first_input, since_us);
     } else {
-        cJSON_AddStringToObject(payload, "errorCode", "intentNotSupported");
+        json_write_string(&w, "errorCode", "intentNotSupported");
     }
+    json_end_object(&w);
+    json_end_object(&w);
 
-    const char *json = cJSON_PrintUnformatted(resp);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
-    cJSON_free((void *)json);
-    cJSON_Delete(resp);
+    esp_err_t send_err = json_resp_end(req, &w);
     cJSON_Delete(root);
-
-    return (err == ESP_OK) ? ESP_OK : ESP_FAIL;
+    return (err == ESP_OK && send_err == ESP_OK) ? ESP_OK : ESP_FAIL;
 }
 
-static const httpd_uri_t get_config_uri = {
-    .uri = "/api/config",
-    .method = HTTP_GET,
-    .handler = handle_get_config,
-};
-
-static const httpd_uri_t post_config_uri = {
-    .uri = "/api/config",
-    .method = HTTP_POST,
-    .handler = handle_post_config,
-};
-
-static const httpd_uri_t status_uri = {
-    .uri = "/api/status",
-    .method = HTTP_GET,
-    .handler = handle_get_status,
+static const offload_target_t post_config_target = {.fn = handle_post_config};
+static const offload_target_t patch_config_target = {.fn = handle_patch_config};
+static const offload_target_t measure_target = {.fn = handle_post_measure};
+
+static esp_err_t handle_get_prometheus(httpd_req_t *req);
+
+// Every endpoint is registered through handle_instrumented, which looks up the real handler
+// here and keeps the matching entry of s_endpoint_stats
+static const httpd_uri_t s_endpoints[] = {
+    {.uri = "/api/config", .method = HTTP_GET, .handler = handle_get_config},
+    {.uri = "/api/config", .method = HTTP_POST, .handler = handle_offload,
+     .user_ctx = (void *)&post_config_target},
+    {.uri = "/api/config", .method = HTTP_PATCH, .handler = handle_offload,
+     .user_ctx = (void *)&patch_config_target},
+    {.uri = "/api/status", .method = HTTP_GET, .handler = handle_get_status},
+    {.uri = "/api/metrics", .method = HTTP_GET, .handler = handle_get_metrics},
+    {.uri = "/api/google/state", .method = HTTP_GET, .handler = handle_get_google_state},
+    {.uri = "/api/google/homegraph", .method = HTTP_POST, .handler = handle_post_google_homegraph},
+    {.uri = "/", .method = HTTP_GET, .handler = handle_get_root},
+    {.uri = "/api/reboot", .method = HTTP_POST, .handler = handle_post_reboot},
+    {.uri = "/api/measure", .method = HTTP_POST, .handler = handle_offload, .user_ctx = (void *)&measure_target},
+    {.uri = "/metrics", .method = HTTP_GET, .handler = handle_get_prometheus},
+    {.uri = "/api/events", .method = HTTP_GET, .handler = handle_get_events}, // keep last
 };
 
-static const httpd_uri_t metrics_uri = {
-    .uri = "/api/metrics",
-    .method = HTTP_GET,
-    .handler = handle_get_metrics,
-};
+#define WEB_ENDPOINT_COUNT (sizeof(s_endpoints) / sizeof(s_endpoints[0]))
 
-static const httpd_uri_t google_uri = {
-    .uri = "/api/google/state",
-    .method = HTTP_GET,
-    .handler = handle_get_google_state,
-};
+static http_endpoint_stats_t s_endpoint_stats[WEB_ENDPOINT_COUNT];
 
-static const httpd_uri_t google_homegraph_uri = {
-    .uri = "/api/google/homegraph",
-    .method = HTTP_POST,
-    .handler = handle_post_google_homegraph,
-};
+static esp_err_t handle_instrumented(httpd_req_t *req)
+{
+    const httpd_uri_t *ep = (const httpd_uri_t *)req->user_ctx;
+    req->user_ctx = ep->user_ctx; // the request copy is per-call, the registration is untouched
+    http_metrics_request_begin(req, &s_endpoint_stats[ep - s_endpoints]);
+    esp_err_t err = ep->handler(req);
+    http_metrics_request_end(req, err);
+    return err;
+}
 
-static const httpd_uri_t root_uri = {
-    .uri = "/",
-    .method = HTTP_GET,
-    .handler = handle_get_root,
-};
+static esp_err_t handle_get_prometheus(httpd_req_t *req)
+{
+    // Prometheus text format 0.0.4: HTTP endpoint series first, then device and sensor gauges
+    char buf[PROMETHEUS_BUF_LEN];
+    metrics_text_t t;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+    metrics_text_init(&t, buf, sizeof(buf), json_chunk_flush, req);
+    http_metrics_write(&t, s_endpoint_stats, WEB_ENDPOINT_COUNT);
+
+    sensor_snapshot_t snap;
+    sensor_manager_get_snapshot(&snap);
+    metrics_text_gauge(&t, "seasensor_water_temperature_celsius", "Water temperature.", snap.water_temp_c);
+    metrics_text_gauge(&t, "seasensor_sea_level_centimeters", "Distance-derived sea level.", snap.sea_level_cm);
+    metrics_text_gauge(&t, "seasensor_air_temperature_celsius", "Air temperature.", snap.air_temp_c);
+    metrics_text_gauge(&t, "seasensor_humidity_percent", "Relative humidity.", snap.humidity_percent);
+    metrics_text_gauge(&t, "seasensor_air_pressure_hpa", "Station air pressure.", snap.air_pressure_hpa);
+    metrics_text_gauge(&t, "seasensor_sea_level_pressure_hpa", "Air pressure reduced to sea level.",
+                       snap.sea_level_pressure_hpa);
+    metrics_text_gauge(&t, "seasensor_pressure_trend_hpa_3h", "Pressure change over three hours.",
+                       snap.pressure_trend_hpa_3h);
+    metrics_text_gauge(&t, "seasensor_dew_point_celsius", "Dew point.", snap.dew_point_c);
+    metrics_text_gauge(&t, "seasensor_battery_percent", "Battery state of charge.", snap.battery_percent);
+    metrics_text_gauge(&t, "seasensor_battery_volts", "Battery voltage.", snap.battery_voltage);
+    metrics_text_gauge(&t, "seasensor_battery_days_remaining", "Forecast battery life.", snap.battery_days_remaining);
+    metrics_text_gauge(&t, "seasensor_measurement_seq", "Completed measurements since boot.", snap.seq);
+    metrics_text_gauge(&t, "seasensor_wifi_sta_connected", "1 when joined to the home network.",
+                       wifi_manager_get_status().sta_connected ? 1 : 0);
+    local_discovery_stats_t discovery = local_discovery_get_stats();
+    metrics_text_counter(&t, "seasensor_discovery_replies_total", "Local Home UDP discovery replies since boot.",
+                         discovery.replies);
+    metrics_text_gauge(&t, "seasensor_discovery_to_query_seconds",
+                       "Time from the last discovery reply to the first QUERY after it.",
+                       discovery.discovery_to_query_ms < 0 ? NAN : discovery.discovery_to_query_ms / 1000.0);
+    mqtt_bridge_stats_t mqtt = mqtt_bridge_get_stats();
+    metrics_text_gauge(&t, "seasensor_mqtt_connected", "1 while connected to the MQTT broker.", mqtt.connected ? 1 : 0);
+    metrics_text_gauge(&t, "seasensor_mqtt_queue_depth", "Snapshots not yet acknowledged by the broker.", mqtt.queued);
+    metrics_text_counter(&t, "seasensor_mqtt_dropped_snapshots_total", "Snapshots dropped from a full offline queue.",
+                         mqtt.dropped);
+    metrics_text_counter(&t, "seasensor_mqtt_coalesced_snapshots_total",
+                         "Unsent snapshots replaced by a newer one from the same 15 min.", mqtt.coalesced);
+    metrics_text_counter(&t, "seasensor_mqtt_publishes_total", "MQTT publishes since boot.", mqtt.publishes);
+    metrics_text_counter(&t, "seasensor_mqtt_published_bytes_total", "MQTT payload bytes since boot.", mqtt.bytes);
+    metrics_text_gauge(&t, "seasensor_mqtt_last_drain_seconds", "Time from reconnect until the backlog was acknowledged.",
+                       mqtt.last_drain_ms < 0 ? NAN : mqtt.last_drain_ms / 1000.0);
+
+    esp_err_t err = metrics_text_finish(&t);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
 
-static const httpd_uri_t reboot_uri = {
-    .uri = "/api/reboot",
-    .method = HTTP_POST,
-    .handler = handle_post_reboot,
-};
+static void on_config_changed(const measurement_config_t *cfg, uint32_t changed, void *ctx)
+{
+    (void)cfg;
+    (void)changed;
+    (void)ctx;
+    // Subscribed after google_bridge, so its device name/ID are already updated here
+    google_blob_t *blob = google_blob_build(GOOGLE_CACHE_SYNC, NULL);
+    if (blob) {
+        google_cache_install(GOOGLE_CACHE_SYNC, blob);
+    }
+}
 
 esp_err_t web_server_start(void)
 {
@@ -903,7 +1989,22 @@ esp_err_t web_server_start(void)
     }
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 10;
+    config.server_port = WEB_SERVER_PORT;
+    config.max_uri_handlers = 14;
+    config.max_open_sockets = HTTPD_MAX_SOCKETS;
+    config.lru_purge_enable = true; // a new client evicts the idlest keep-alive socket instead of failing
+    config.keep_alive_enable = true; // TCP keep-alive reaps phones that left the network
+    config.keep_alive_idle = 10;
+    config.keep_alive_interval = 5;
+    config.keep_alive_count = 3;
+    config.send_wait_timeout = 3;
+    config.open_fn = http_metrics_session_open;
+
+    s_config_update_lock = xSemaphoreCreateMutex();
+    s_google_build_lock = xSemaphoreCreateMutex();
+    if (!s_config_update_lock || !s_google_build_lock) {
+        return ESP_ERR_NO_MEM;
+    }
 
     esp_err_t err = httpd_start(&s_server, &config);
     if (err != ESP_OK) {
@@ -911,25 +2012,67 @@ esp_err_t web_server_start(void)
         return err;
     }
 
-    s_cached_config = config_store_get();
+    s_boot_tag = esp_random();
+    on_config_changed(config_store_current(NULL), 0, NULL);
+    if (config_store_subscribe(on_config_changed, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "Config changes will rebuild the SYNC payload lazily");
+    }
+    s_events_join = xQueueCreate(EVENTS_MAX_CLIENTS + LONGPOLL_MAX_WAITERS, sizeof(events_join_t));
+    s_measure_join = xQueueCreate(MEASURE_MAX_WAITERS, sizeof(measure_wait_t));
+    if (!s_events_join || !s_measure_join ||
+        xTaskCreate(events_task, "web_events", EVENTS_TASK_STACK, NULL, 4, &s_events_task) != pdPASS) {
+        ESP_LOGW(TAG, "Live event stream unavailable");
+    }
+
+    s_worker_queue = xQueueCreate(WORKER_QUEUE_LEN, sizeof(worker_job_t));
+    for (int i = 0; s_worker_queue && i < WORKER_COUNT; ++i) {
+        if (xTaskCreate(worker_task, "web_worker", WORKER_STACK, NULL, 5, NULL) != pdPASS) {
+            ESP_LOGW(TAG, "Web worker %d not started", i);
+        }
+    }
 
-    httpd_register_uri_handler(s_server, &get_config_uri);
-    httpd_register_uri_handler(s_server, &post_config_uri);
-    httpd_register_uri_handler(s_server, &status_uri);
-    httpd_register_uri_handler(s_server, &metrics_uri);
-    httpd_register_uri_handler(s_server, &google_uri);
-    httpd_register_uri_handler(s_server, &google_homegraph_uri);
-    httpd_register_uri_handler(s_server, &root_uri);
-    httpd_register_uri_handler(s_server, &reboot_uri);
+    char elf_sha[17];
+    esp_app_get_elf_sha256(elf_sha, sizeof(elf_sha));
+    snprintf(s_asset_etag, sizeof(s_asset_etag), "\"%s\"", elf_sha);
+
+    // Without the events task the live stream endpoint (last entry) is left out
+    size_t endpoints = s_events_task ? WEB_ENDPOINT_COUNT : WEB_ENDPOINT_COUNT - 1;
+    for (size_t i = 0; i < WEB_ENDPOINT_COUNT; ++i) {
+        s_endpoint_stats[i].path = s_endpoints[i].uri;
+        s_endpoint_stats[i].method = http_method_str(s_endpoints[i].method);
+        if (i < endpoints) {
+            httpd_uri_t uri = {
+                .uri = s_endpoints[i].uri,
+                .method = s_endpoints[i].method,
+                .handler = handle_instrumented,
+                .user_ctx = (void *)&s_endpoints[i],
+            };
+            httpd_register_uri_handler(s_server, &uri);
+        }
+    }
 
     ESP_LOGI(TAG, "Web server started");
     return ESP_OK;
 }
 
-void web_server_update_config(const measurement_config_t *config)
+void web_server_publish_snapshot(const sensor_snapshot_t *snapshot)
 {
-    if (config) {
-        s_cached_config = *config;
-        display_manager_update_config(config);
+    if (!snapshot || !s_server) {
+        return;
+    }
+    // Serialize the QUERY state once here so Local Home polls between measurements only copy
+    for (google_cache_kind_t kind = GOOGLE_CACHE_QUERY; kind <= GOOGLE_CACHE_STATE; ++kind) {
+        google_blob_t *blob = google_blob_build(kind, snapshot);
+        if (blob) {
+            google_cache_install(kind, blob);
+        }
+    }
+    if (!s_events_task) {
+        return;
     }
+    portENTER_CRITICAL(&s_events_lock);
+    s_events_snapshot = *snapshot;
+    s_events_pending = true;
+    portEXIT_CRITICAL(&s_events_lock);
+    xTaskNotifyGive(s_events_task);
 }
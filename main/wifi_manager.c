@@ -13,16 +13,21 @@
 
 #define TAG "wifi_mgr"
 
-static measurement_config_t s_cached_config;
 static bool s_wifi_started = false;
 static wifi_status_t s_status;
 static esp_netif_t *s_sta_netif = NULL;
 static esp_netif_t *s_ap_netif = NULL;
 static bool s_mdns_ready = false;
 
+static const measurement_config_t *active_config(void)
+{
+    return config_store_current(NULL);
+}
+
 static const char *device_hostname(void)
 {
-    return s_cached_config.device_name[0] ? s_cached_config.device_name : "sea";
+    const measurement_config_t *cfg = active_config();
+    return cfg->device_name[0] ? cfg->device_name : "sea";
 }
 
 static void ensure_mdns_started(void)
@@ -95,10 +100,11 @@ static void update_hostnames(void)
 
 static void reconnect_sta_if_ready(void)
 {
+    const measurement_config_t *cfg = active_config();
     if (!s_wifi_started) {
         return;
     }
-    if (s_cached_config.wifi_ssid[0] == '\0') {
+    if (cfg->wifi_ssid[0] == '\0') {
         (void)esp_wifi_disconnect();
         s_status.sta_connected = false;
         memset(&s_status.sta_ip, 0, sizeof(s_status.sta_ip));
@@ -127,24 +133,25 @@ static void refresh_ap_ip(void)
 
 static void handle_wifi_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
+    const measurement_config_t *cfg = active_config();
     (void)arg;
     if (event_base == WIFI_EVENT) {
         switch (event_id) {
             case WIFI_EVENT_STA_START:
                 ESP_LOGI(TAG, "STA start");
-                if (s_cached_config.wifi_ssid[0] != '\0') {
+                if (cfg->wifi_ssid[0] != '\0') {
                     esp_wifi_connect();
                 }
                 break;
             case WIFI_EVENT_STA_CONNECTED:
-                ESP_LOGI(TAG, "Connected to %s", s_cached_config.wifi_ssid);
+                ESP_LOGI(TAG, "Connected to %s", cfg->wifi_ssid);
                 s_status.sta_connected = true;
                 break;
             case WIFI_EVENT_STA_DISCONNECTED:
                 ESP_LOGW(TAG, "STA disconnected, retrying");
                 s_status.sta_connected = false;
                 memset(&s_status.sta_ip, 0, sizeof(s_status.sta_ip));
-                if (s_cached_config.wifi_ssid[0] != '\0') {
+                if (cfg->wifi_ssid[0] != '\0') {
                     esp_wifi_connect();
                 }
                 break;
@@ -161,41 +168,50 @@ static void handle_wifi_event(void *arg, esp_event_base_t event_base, int32_t ev
 
 static void make_ap_ssid(char *out_ssid, size_t len)
 {
+    const measurement_config_t *cfg = active_config();
     if (!out_ssid || len == 0) {
         return;
     }
-    if (s_cached_config.device_name[0] != '\0') {
-        snprintf(out_ssid, len, "SeaMonitor-%s", s_cached_config.device_name);
+    if (cfg->device_name[0] != '\0') {
+        snprintf(out_ssid, len, "SeaMonitor-%s", cfg->device_name);
     } else {
         strlcpy(out_ssid, "SeaMonitor", len);
     }
 }
 
+static void make_ap_config(wifi_config_t *ap_cfg)
+{
+    const measurement_config_t *cfg = active_config();
+    *ap_cfg = (wifi_config_t){0};
+    make_ap_ssid((char *)ap_cfg->ap.ssid, sizeof(ap_cfg->ap.ssid));
+    ap_cfg->ap.ssid_len = strlen((char *)ap_cfg->ap.ssid);
+    ap_cfg->ap.channel = 1;
+    ap_cfg->ap.max_connection = 4;
+    ap_cfg->ap.authmode = WIFI_AUTH_OPEN;
+
+    if (cfg->wifi_password[0] != '\0') {
+        strlcpy((char *)ap_cfg->ap.password, cfg->wifi_password, sizeof(ap_cfg->ap.password));
+        if (strlen((char *)ap_cfg->ap.password) >= 8) {
+            ap_cfg->ap.authmode = WIFI_AUTH_WPA_WPA2_PSK;
+        }
+    }
+}
+
 static void apply_wifi_config(void)
 {
+    const measurement_config_t *cfg = active_config();
     wifi_config_t sta_cfg = {0};
-    if (s_cached_config.wifi_ssid[0] != '\0') {
-        strlcpy((char *)sta_cfg.sta.ssid, s_cached_config.wifi_ssid, sizeof(sta_cfg.sta.ssid));
-        strlcpy((char *)sta_cfg.sta.password, s_cached_config.wifi_password, sizeof(sta_cfg.sta.password));
+    if (cfg->wifi_ssid[0] != '\0') {
+        strlcpy((char *)sta_cfg.sta.ssid, cfg->wifi_ssid, sizeof(sta_cfg.sta.ssid));
+        strlcpy((char *)sta_cfg.sta.password, cfg->wifi_password, sizeof(sta_cfg.sta.password));
         sta_cfg.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
     }
 
-    wifi_config_t ap_cfg = {0};
-    make_ap_ssid((char *)ap_cfg.ap.ssid, sizeof(ap_cfg.ap.ssid));
-    ap_cfg.ap.ssid_len = strlen((char *)ap_cfg.ap.ssid);
-    ap_cfg.ap.channel = 1;
-    ap_cfg.ap.max_connection = 4;
-    ap_cfg.ap.authmode = WIFI_AUTH_OPEN;
-
-    if (s_cached_config.wifi_password[0] != '\0') {
-        strlcpy((char *)ap_cfg.ap.password, s_cached_config.wifi_password, sizeof(ap_cfg.ap.password));
-        if (strlen((char *)ap_cfg.ap.password) >= 8) {
-            ap_cfg.ap.authmode = WIFI_AUTH_WPA_WPA2_PSK;
-        }
-    }
+    wifi_config_t ap_cfg;
+    make_ap_config(&ap_cfg);
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
-    if (s_cached_config.wifi_ssid[0] != '\0') {
+    if (cfg->wifi_ssid[0] != '\0') {
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &sta_cfg));
     }
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &ap_cfg));
@@ -211,13 +227,29 @@ static void apply_wifi_config(void)
     reconnect_sta_if_ready();
 }
 
-esp_err_t wifi_manager_init(const measurement_config_t *config)
+static void on_config_changed(const measurement_config_t *config, uint32_t changed, void *ctx)
 {
-    if (!config) {
-        return ESP_ERR_INVALID_ARG;
+    (void)config;
+    (void)ctx;
+    if (changed & CONFIG_FIELD_DEVICE_NAME) {
+        update_hostnames();
+    }
+    if (!s_wifi_started || !(changed & CONFIG_FIELDS_WIFI)) {
+        return;
+    }
+    if (changed & (CONFIG_FIELD_WIFI_SSID | CONFIG_FIELD_WIFI_PASSWORD)) {
+        apply_wifi_config();
+        return;
     }
-    s_cached_config = *config;
+    // Only the AP SSID follows the device name; the STA link stays up
+    wifi_config_t ap_cfg;
+    make_ap_config(&ap_cfg);
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &ap_cfg));
+    ESP_LOGI(TAG, "AP SSID=%s", ap_cfg.ap.ssid);
+}
 
+esp_err_t wifi_manager_init(void)
+{
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &handle_wifi_event, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &handle_wifi_event, NULL));
@@ -230,20 +262,7 @@ esp_err_t wifi_manager_init(const measurement_config_t *config)
     ESP_ERROR_CHECK(esp_wifi_init(&wifi_init_cfg));
 
     apply_wifi_config();
-    return ESP_OK;
-}
-
-void wifi_manager_update_config(const measurement_config_t *config)
-{
-    if (!config) {
-        return;
-    }
-    s_cached_config = *config;
-    update_hostnames();
-    if (!s_wifi_started) {
-        return;
-    }
-    apply_wifi_config();
+    return config_store_subscribe(on_config_changed, NULL);
 }
 
 wifi_status_t wifi_manager_get_status(void)
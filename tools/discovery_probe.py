@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Time Local Home discovery against a SeaSensor: discovery_probe.py [options].
+
+Broadcasts the UDP discovery packet the way the Local Home scan does, then sends the first
+QUERY (GET /api/google/state) to the address that answered. Prints discovery and
+discovery-to-first-QUERY times per run. With --mdns-host the same QUERY is timed behind an
+mDNS lookup instead, for comparison. The device keeps its own measurement in /metrics as
+seasensor_discovery_to_query_seconds.
+"""
+import argparse
+import http.client
+import json
+import socket
+import time
+
+DISCOVERY_PACKET = b'SEASENSOR_DISCOVER'
+
+
+def discover(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', args.listen_port))
+    sock.settimeout(args.timeout)
+    try:
+        sock.sendto(DISCOVERY_PACKET, (args.broadcast, args.port))
+        data, (addr, _) = sock.recvfrom(512)
+    finally:
+        sock.close()
+    return addr, json.loads(data)
+
+
+def first_query(host, port, timeout):
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.request('GET', '/api/google/state')
+        resp = conn.getresponse()
+        resp.read()
+        return resp.status
+    finally:
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--broadcast', default='255.255.255.255')
+    parser.add_argument('--port', type=int, default=3311, help='device discovery port')
+    parser.add_argument('--listen-port', type=int, default=3312, help='local port replies come back to')
+    parser.add_argument('--runs', type=int, default=5)
+    parser.add_argument('--timeout', type=float, default=2.0)
+    parser.add_argument('--mdns-host', help='also time an mDNS lookup of this name, e.g. sea.local')
+    args = parser.parse_args()
+
+    print(f'{"run":<5}{"discovery ms":>14}{"to QUERY ms":>14}  device')
+    for run in range(args.runs):
+        start = time.perf_counter()
+        try:
+            addr, info = discover(args)
+        except (OSError, ValueError) as err:
+            print(f'{run:<5}{"-":>14}{"-":>14}  no answer ({err})')
+            continue
+        found = time.perf_counter()
+        status = first_query(addr, info.get('port', 80), args.timeout)
+        done = time.perf_counter()
+        print(f'{run:<5}{(found - start) * 1000:>14.1f}{(done - start) * 1000:>14.1f}'
+              f'  {info.get("id")} @ {addr} fw {info.get("fw")} (HTTP {status})')
+
+    if args.mdns_host:
+        for run in range(args.runs):
+            start = time.perf_counter()
+            try:
+                addr = socket.getaddrinfo(args.mdns_host, 80, socket.AF_INET)[0][4][0]
+            except OSError as err:
+                print(f'mdns {run}: lookup failed ({err})')
+                continue
+            found = time.perf_counter()
+            status = first_query(addr, 80, args.timeout)
+            done = time.perf_counter()
+            print(f'mdns {run}: lookup {(found - start) * 1000:.1f} ms, '
+                  f'to QUERY {(done - start) * 1000:.1f} ms (HTTP {status})')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,184 @@
+// Host discharge simulation and LUT benchmark for main/battery_monitor.c.
+//
+// The unchanged module is compiled against shim/ and fed by a simulated clock and ADC: a cell
+// discharging linearly in SoC over SIM_DAYS, read back through the OCV curve, with ADC noise
+// and a Wi-Fi TX sag on some bursts. Each battery interval is run from a full cell; after
+// SIM_SETTLE_DAYS the mean reported %/day must be within SIM_SLOPE_TOLERANCE of the true rate.
+// Single readings stray further (12-bit ADC steps are ~1 % SoC on the 3.8 V plateau), so the
+// worst case is printed but not checked; a timing error in the fit shows up as a bias.
+// Then battery_monitor_voltage_to_percent is timed per call.
+//
+// Usage: battery_sim   exit status 1 if a scenario misses the tolerance
+
+#include "battery_monitor.h"
+
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define SIM_DAYS 10.0
+#define SIM_START_PERCENT 95.0
+#define SIM_SETTLE_DAYS 3.0       // the fit needs a few hourly buckets and the EWMA to catch up
+#define SIM_SLOPE_TOLERANCE 0.10  // relative error allowed on the mean %/day
+#define SIM_DIVIDER_RATIO (100.0 / 320.0)
+#define SIM_NOISE_MV 10           // uniform ADC noise at the pin, +/-
+#define SIM_TX_SAG_MV 60          // pin sag while a TX frame overlaps a burst
+#define LUT_CALLS 10000000
+
+static int64_t s_now_us;
+static double s_cell_v;
+static uint32_t s_rng = 0x9E3779B9u;
+static unsigned s_adc_reads;
+
+static uint32_t next_random(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+// ---- ESP-IDF functions declared by shim/ ----
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    s_now_us += (int64_t)ticks * 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_ERR";
+}
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *init_config, adc_oneshot_unit_handle_t *ret_unit)
+{
+    (void)init_config;
+    *ret_unit = NULL;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel,
+                                     const adc_oneshot_chan_cfg_t *config)
+{
+    (void)handle;
+    (void)channel;
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t chan, int *out_raw)
+{
+    (void)handle;
+    (void)chan;
+    double pin_mv = s_cell_v * SIM_DIVIDER_RATIO * 1000.0;
+    pin_mv += (int)(next_random() % (2 * SIM_NOISE_MV + 1)) - SIM_NOISE_MV;
+    // Every fourth burst of 8 reads may overlap a TX frame
+    if ((s_adc_reads / 8) % 4 == 1 && next_random() % 3 == 0) {
+        pin_mv -= SIM_TX_SAG_MV;
+    }
+    s_adc_reads++;
+    *out_raw = (int)(pin_mv / 3300.0 * 4095.0);
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *voltage)
+{
+    (void)handle;
+    *voltage = raw * 3300 / 4095;
+    return ESP_OK;
+}
+// ---- end of ESP-IDF functions ----
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Resting voltage for a SoC, by bisection on the module's own (monotonic) curve
+static double cell_voltage_for(double percent)
+{
+    double lo = 3.0;
+    double hi = 4.3;
+    for (int i = 0; i < 40; ++i) {
+        double mid = 0.5 * (lo + hi);
+        if (battery_monitor_voltage_to_percent((float)mid) < percent) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0.5 * (lo + hi);
+}
+
+static bool run_scenario(int interval_s)
+{
+    const double true_per_day = -SIM_START_PERCENT / SIM_DAYS;
+    s_now_us = 0;
+    s_adc_reads = 0;
+    battery_monitor_init();
+
+    double worst_err = 0.0;
+    double slope_sum = 0.0;
+    int slope_count = 0;
+    double days_at_half = NAN;
+    for (int64_t t_s = 0; t_s < (int64_t)(SIM_DAYS * 86400.0); t_s += interval_s) {
+        s_now_us = t_s * 1000000LL;
+        double day = t_s / 86400.0;
+        s_cell_v = cell_voltage_for(SIM_START_PERCENT + true_per_day * day);
+        battery_monitor_read(NULL, NULL);
+
+        battery_status_t st;
+        battery_monitor_get_status(&st);
+        if (day >= SIM_SETTLE_DAYS && isfinite(st.percent_per_day)) {
+            double err = fabs(st.percent_per_day / true_per_day - 1.0);
+            worst_err = err > worst_err ? err : worst_err;
+            slope_sum += st.percent_per_day;
+            slope_count++;
+            if (isnan(days_at_half) && day >= SIM_DAYS / 2) {
+                days_at_half = st.days_remaining;
+            }
+        }
+    }
+    double mean_slope = slope_count ? slope_sum / slope_count : NAN;
+    double mean_err = fabs(mean_slope / true_per_day - 1.0);
+    bool ok = mean_err <= SIM_SLOPE_TOLERANCE;
+    printf("interval %5d s: mean %6.2f %%/day (true %.2f, error %4.1f%%, worst %4.1f%%), "
+           "at day %.0f %.2f days left (true %.2f) %s\n",
+           interval_s, mean_slope, true_per_day, mean_err * 100.0, worst_err * 100.0, SIM_DAYS / 2, days_at_half,
+           SIM_DAYS / 2, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static void bench_lut(void)
+{
+    volatile float sink = 0.0f;
+    double start = now_ns();
+    for (int i = 0; i < LUT_CALLS; ++i) {
+        sink += battery_monitor_voltage_to_percent(3.2f + (float)(i % 1100) * 0.001f);
+    }
+    double per_call = (now_ns() - start) / LUT_CALLS;
+    (void)sink;
+    printf("battery_monitor_voltage_to_percent: %.1f ns/call (%d calls over 3.2-4.3 V)\n", per_call, LUT_CALLS);
+}
+
+int main(void)
+{
+    static const int k_intervals_s[] = {60, 900, 3600, 5400};
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(k_intervals_s) / sizeof(k_intervals_s[0]); ++i) {
+        ok &= run_scenario(k_intervals_s[i]);
+    }
+    bench_lut();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+// Host check and benchmark for main/bme280_compensation.c.
+//
+// 1. The datasheet example (BMP280 datasheet 3.12, calibration and raw words) must give
+//    25.08 degC and the pressure of the Bosch 32-bit reference.
+// 2. Random raw samples must match the Bosch 32-bit reference code (copied below from the
+//    BME280 datasheet 4.2.3 / BMP280 8.2) bit for bit: T and P exactly, H after the Q22.10 to
+//    milli-%RH rescale.
+// 3. bme280_comp_batch is timed per sample (plus TSC cycles on x86).
+//
+// Usage: bme280_comp_bench [samples]   exit status 1 on any mismatch
+
+#include "bme280_compensation.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define DEFAULT_SAMPLES 2000000
+#define BATCH_LEN 4096
+#define BATCH_ROUNDS 500
+
+static const bme280_calib_t k_datasheet_calib = {
+    .dig_T1 = 27504, .dig_T2 = 26435, .dig_T3 = -1000,
+    .dig_P1 = 36477, .dig_P2 = -10685, .dig_P3 = 3024, .dig_P4 = 2855, .dig_P5 = 140,
+    .dig_P6 = -7, .dig_P7 = 15500, .dig_P8 = -14600, .dig_P9 = 6000,
+    .dig_H1 = 75, .dig_H2 = 362, .dig_H3 = 0, .dig_H4 = 313, .dig_H5 = 50, .dig_H6 = 30,
+};
+#define DATASHEET_ADC_T 519888
+#define DATASHEET_ADC_P 415148
+#define DATASHEET_T_CENTI_C 2508
+
+// ---- Bosch reference, kept in its original form ----
+typedef int32_t BME280_S32_t;
+typedef uint32_t BME280_U32_t;
+static const bme280_calib_t *ref_calib;
+static BME280_S32_t t_fine;
+
+static BME280_S32_t ref_compensate_T(BME280_S32_t adc_T)
+{
+    const bme280_calib_t *c = ref_calib;
+    BME280_S32_t var1, var2, T;
+    var1 = ((((adc_T >> 3) - ((BME280_S32_t)c->dig_T1 << 1))) * ((BME280_S32_t)c->dig_T2)) >> 11;
+    var2 = (((((adc_T >> 4) - ((BME280_S32_t)c->dig_T1)) * ((adc_T >> 4) - ((BME280_S32_t)c->dig_T1))) >> 12) *
+            ((BME280_S32_t)c->dig_T3)) >> 14;
+    t_fine = var1 + var2;
+    T = (t_fine * 5 + 128) >> 8;
+    return T;
+}
+
+static BME280_U32_t ref_compensate_P(BME280_S32_t adc_P)
+{
+    const bme280_calib_t *c = ref_calib;
+    BME280_S32_t var1, var2;
+    BME280_U32_t p;
+    var1 = (((BME280_S32_t)t_fine) >> 1) - (BME280_S32_t)64000;
+    var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((BME280_S32_t)c->dig_P6);
+    var2 = var2 + ((var1 * ((BME280_S32_t)c->dig_P5)) << 1);
+    var2 = (var2 >> 2) + (((BME280_S32_t)c->dig_P4) << 16);
+    var1 = (((c->dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((BME280_S32_t)c->dig_P2) * var1) >> 1)) >> 18;
+    var1 = ((((32768 + var1)) * ((BME280_S32_t)c->dig_P1)) >> 15);
+    if (var1 == 0) {
+        return 0;
+    }
+    p = (((BME280_U32_t)(((BME280_S32_t)1048576) - adc_P) - (var2 >> 12))) * 3125;
+    if (p < 0x80000000) {
+        p = (p << 1) / ((BME280_U32_t)var1);
+    } else {
+        p = (p / (BME280_U32_t)var1) * 2;
+    }
+    var1 = (((BME280_S32_t)c->dig_P9) * ((BME280_S32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+    var2 = (((BME280_S32_t)(p >> 2)) * ((BME280_S32_t)c->dig_P8)) >> 13;
+    p = (BME280_U32_t)((BME280_S32_t)p + ((var1 + var2 + c->dig_P7) >> 4));
+    return p;
+}
+
+static BME280_U32_t ref_compensate_H(BME280_S32_t adc_H)
+{
+    const bme280_calib_t *c = ref_calib;
+    BME280_S32_t v_x1_u32r;
+    v_x1_u32r = (t_fine - ((BME280_S32_t)76800));
+    v_x1_u32r = (((((adc_H << 14) - (((BME280_S32_t)c->dig_H4) << 20) - (((BME280_S32_t)c->dig_H5) * v_x1_u32r)) +
+                   ((BME280_S32_t)16384)) >> 15) *
+                 (((((((v_x1_u32r * ((BME280_S32_t)c->dig_H6)) >> 10) *
+                      (((v_x1_u32r * ((BME280_S32_t)c->dig_H3)) >> 11) + ((BME280_S32_t)32768))) >> 10) +
+                    ((BME280_S32_t)2097152)) * ((BME280_S32_t)c->dig_H2) + 8192) >> 14));
+    v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((BME280_S32_t)c->dig_H1)) >> 4));
+    v_x1_u32r = (v_x1_u32r < 0 ? 0 : v_x1_u32r);
+    v_x1_u32r = (v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r);
+    return (BME280_U32_t)(v_x1_u32r >> 12);
+}
+// ---- end of reference ----
+
+static uint32_t s_rng = 0x2545F491u;
+
+static uint32_t next_random(void)
+{
+    // xorshift32: same sequence on every host, unlike rand()
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int check_datasheet_vector(const bme280_comp_table_t *table)
+{
+    ref_calib = &k_datasheet_calib;
+    int32_t ref_t = ref_compensate_T(DATASHEET_ADC_T);
+    uint32_t ref_p = ref_compensate_P(DATASHEET_ADC_P);
+
+    bme280_raw_sample_t raw = {.adc_T = DATASHEET_ADC_T, .adc_P = DATASHEET_ADC_P, .adc_H = 0};
+    bme280_fixed_sample_t out;
+    bme280_comp_sample(table, &raw, &out);
+    bool ok = out.temperature_centi_c == DATASHEET_T_CENTI_C && ref_t == DATASHEET_T_CENTI_C &&
+              out.pressure_pa == ref_p;
+    printf("datasheet vector: T %" PRId32 " (want %d), P %" PRIu32 " Pa (reference %" PRIu32 ") %s\n",
+           out.temperature_centi_c, DATASHEET_T_CENTI_C, out.pressure_pa, ref_p, ok ? "ok" : "MISMATCH");
+    return ok ? 0 : 1;
+}
+
+static long compare_random(const bme280_comp_table_t *table, long samples)
+{
+    long mismatches = 0;
+    for (long i = 0; i < samples; ++i) {
+        // Raw words over the range a real sensor produces (roughly -40..85 degC, 300..1100 hPa)
+        bme280_raw_sample_t raw = {
+            .adc_T = 250000 + (int32_t)(next_random() % 400000),
+            .adc_P = 200000 + (int32_t)(next_random() % 400000),
+            .adc_H = (int32_t)(next_random() % 65536),
+        };
+        bme280_fixed_sample_t out;
+        bme280_comp_sample(table, &raw, &out);
+        int32_t t = ref_compensate_T(raw.adc_T);
+        uint32_t p = ref_compensate_P(raw.adc_P);
+        uint32_t h = (ref_compensate_H(raw.adc_H) * 1000u + 512u) >> 10;
+        if (t != out.temperature_centi_c || p != out.pressure_pa || h != out.humidity_milli_pct) {
+            if (mismatches++ < 5) {
+                printf("  raw T=%" PRId32 " P=%" PRId32 " H=%" PRId32 ": got %" PRId32 "/%" PRIu32 "/%" PRIu32
+                       ", reference %" PRId32 "/%" PRIu32 "/%" PRIu32 "\n",
+                       raw.adc_T, raw.adc_P, raw.adc_H, out.temperature_centi_c, out.pressure_pa,
+                       out.humidity_milli_pct, t, p, h);
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void bench_batch(const bme280_comp_table_t *table)
+{
+    static bme280_raw_sample_t raw[BATCH_LEN];
+    static bme280_fixed_sample_t out[BATCH_LEN];
+    for (size_t i = 0; i < BATCH_LEN; ++i) {
+        raw[i] = (bme280_raw_sample_t){
+            .adc_T = 500000 + (int32_t)(next_random() % 50000),
+            .adc_P = 400000 + (int32_t)(next_random() % 50000),
+            .adc_H = 30000 + (int32_t)(next_random() % 10000),
+        };
+    }
+    bme280_comp_batch(table, raw, out, BATCH_LEN); // warm up
+    double start = now_ns();
+#ifdef HAVE_TSC
+    uint64_t start_tsc = __rdtsc();
+#endif
+    for (int r = 0; r < BATCH_ROUNDS; ++r) {
+        bme280_comp_batch(table, raw, out, BATCH_LEN);
+        __asm__ volatile("" : : "r"(out) : "memory");
+    }
+    double per_sample = (now_ns() - start) / ((double)BATCH_ROUNDS * BATCH_LEN);
+#ifdef HAVE_TSC
+    double cycles = (double)(__rdtsc() - start_tsc) / ((double)BATCH_ROUNDS * BATCH_LEN);
+    printf("bme280_comp_batch: %.1f ns/sample, %.0f TSC cycles/sample (%d x %d samples)\n", per_sample, cycles,
+           BATCH_ROUNDS, BATCH_LEN);
+#else
+    printf("bme280_comp_batch: %.1f ns/sample (%d x %d samples)\n", per_sample, BATCH_ROUNDS, BATCH_LEN);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    long samples = argc > 1 ? strtol(argv[1], NULL, 10) : DEFAULT_SAMPLES;
+
+    bme280_comp_table_t table;
+    bme280_comp_build_table(&k_datasheet_calib, true, &table);
+
+    int failed = check_datasheet_vector(&table);
+    long mismatches = compare_random(&table, samples);
+    printf("random samples vs Bosch reference: %ld of %ld mismatched\n", mismatches, samples);
+    if (mismatches) {
+        failed = 1;
+    }
+    bench_batch(&table);
+    return failed;
+}
@@ -0,0 +1,628 @@
+// Host check for main/config_store.c: the NVS record and the import of the per-key layout.
+//
+// The unchanged module is compiled against shim/ and runs over an in-memory NVS fake that
+// counts blob writes, erases and commits. The fake lives in a shared mapping and every boot
+// is a forked child, so module state starts clean each boot while flash survives it.
+//
+// 1. Empty flash: defaults, nothing written.
+// 2. Legacy v6 keys: imported and normalized, written as one record, legacy keys erased.
+// 3. Reboot on that record: same values, no write; saving an identical (or identical after
+//    normalization) config writes nothing; a changed one writes once and survives a reboot.
+// 4. Every field non-default round-trips through config_store_set and a reboot.
+// 5. A corrupted CRC, a bad magic or a wrong length fall back to defaults, and the next save
+//    rewrites the record even though it equals the defaults.
+// 6. A legacy version other than v6 is not imported and its keys are left alone.
+// 7. A shorter payload from older firmware keeps its fields and takes defaults for the rest;
+//    a longer one from newer firmware is read for the fields this build knows.
+//
+// Usage: config_store_test   exit status 1 on any failure
+
+#include "config_store.h"
+
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NVS_FAKE_ENTRIES 32
+#define NVS_FAKE_MAX_LEN 640
+#define NVS_FAKE_NAMESPACE "config"
+
+// Record layout as written by config_store.c v7 (packed, little-endian)
+#define RECORD_HEADER_LEN 10
+#define RECORD_VERSION_OFFSET 2
+#define RECORD_LENGTH_OFFSET 4
+#define RECORD_CRC_OFFSET 6
+#define RECORD_MQTT_OFFSET 168 // payload bytes before the MQTT strings, i.e. a pre-MQTT record
+#define LEGACY_KEY_COUNT 17
+
+typedef enum { NVS_TYPE_U8, NVS_TYPE_U16, NVS_TYPE_I32, NVS_TYPE_U32, NVS_TYPE_STR, NVS_TYPE_BLOB } nvs_type_t;
+
+typedef struct {
+    bool used;
+    char key[16];
+    nvs_type_t type;
+    size_t len;
+    uint8_t data[NVS_FAKE_MAX_LEN];
+} nvs_entry_t;
+
+typedef struct {
+    bool namespace_exists;
+    nvs_entry_t entries[NVS_FAKE_ENTRIES];
+    unsigned sets;
+    unsigned erases;
+    unsigned commits;
+} nvs_fake_t;
+
+static nvs_fake_t *s_nvs; // shared with the boot children
+static int s_failures;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            printf("  %s:%d: %s\n", __func__, __LINE__, #cond);            \
+            s_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+// ---- ESP-IDF functions declared by shim/ ----
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)ticks;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_ERR";
+}
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    static int s_mutex;
+    return (SemaphoreHandle_t)&s_mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)sem;
+    (void)ticks;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    (void)sem;
+    return pdTRUE;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(s_nvs->entries, 0, sizeof(s_nvs->entries));
+    s_nvs->namespace_exists = false;
+    return ESP_OK;
+}
+
+// ---- NVS fake: one namespace, typed entries, writes visible at once ----
+static nvs_entry_t *find_entry(const char *key)
+{
+    for (size_t i = 0; i < NVS_FAKE_ENTRIES; ++i) {
+        if (s_nvs->entries[i].used && strcmp(s_nvs->entries[i].key, key) == 0) {
+            return &s_nvs->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void put_entry(const char *key, nvs_type_t type, const void *data, size_t len)
+{
+    nvs_entry_t *e = find_entry(key);
+    for (size_t i = 0; !e && i < NVS_FAKE_ENTRIES; ++i) {
+        if (!s_nvs->entries[i].used) {
+            e = &s_nvs->entries[i];
+        }
+    }
+    if (!e || len > NVS_FAKE_MAX_LEN) {
+        abort();
+    }
+    e->used = true;
+    snprintf(e->key, sizeof(e->key), "%s", key);
+    e->type = type;
+    e->len = len;
+    memcpy(e->data, data, len);
+    s_nvs->namespace_exists = true;
+}
+
+static esp_err_t get_scalar(const char *key, nvs_type_t type, void *out, size_t len)
+{
+    const nvs_entry_t *e = find_entry(key);
+    if (!e || e->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memcpy(out, e->data, len);
+    return ESP_OK;
+}
+
+static esp_err_t get_bytes(const char *key, nvs_type_t type, void *out, size_t *length)
+{
+    const nvs_entry_t *e = find_entry(key);
+    if (!e || e->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (!out) {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, e->data, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (strcmp(name, NVS_FAKE_NAMESPACE) != 0) {
+        abort();
+    }
+    if (open_mode == NVS_READONLY && !s_nvs->namespace_exists) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    s_nvs->namespace_exists = true;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    s_nvs->commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    (void)handle;
+    nvs_entry_t *e = find_entry(key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    e->used = false;
+    s_nvs->erases++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    (void)handle;
+    return get_scalar(key, NVS_TYPE_U8, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value)
+{
+    (void)handle;
+    return get_scalar(key, NVS_TYPE_U16, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value)
+{
+    (void)handle;
+    return get_scalar(key, NVS_TYPE_I32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    (void)handle;
+    return get_scalar(key, NVS_TYPE_U32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    (void)handle;
+    return get_bytes(key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    (void)handle;
+    return get_bytes(key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    (void)handle;
+    put_entry(key, NVS_TYPE_BLOB, value, length);
+    s_nvs->sets++;
+    return ESP_OK;
+}
+
+// ---- helpers ----
+static void seed_u8(const char *key, uint8_t v) { put_entry(key, NVS_TYPE_U8, &v, sizeof(v)); }
+static void seed_u16(const char *key, uint16_t v) { put_entry(key, NVS_TYPE_U16, &v, sizeof(v)); }
+static void seed_i32(const char *key, int32_t v) { put_entry(key, NVS_TYPE_I32, &v, sizeof(v)); }
+static void seed_u32(const char *key, uint32_t v) { put_entry(key, NVS_TYPE_U32, &v, sizeof(v)); }
+static void seed_str(const char *key, const char *v) { put_entry(key, NVS_TYPE_STR, v, strlen(v) + 1); }
+
+static void seed_interval(const char *key, uint16_t minutes, uint8_t seconds)
+{
+    measurement_interval_t v = {.minutes = minutes, .seconds = seconds};
+    put_entry(key, NVS_TYPE_BLOB, &v, sizeof(v));
+}
+
+static void reset_flash(void)
+{
+    memset(s_nvs, 0, sizeof(*s_nvs));
+}
+
+static void reset_counters(void)
+{
+    s_nvs->sets = 0;
+    s_nvs->erases = 0;
+    s_nvs->commits = 0;
+}
+
+static unsigned used_entries(void)
+{
+    unsigned n = 0;
+    for (size_t i = 0; i < NVS_FAKE_ENTRIES; ++i) {
+        n += s_nvs->entries[i].used;
+    }
+    return n;
+}
+
+static bool near(float a, float b)
+{
+    return fabsf(a - b) < 1e-6f;
+}
+
+static bool interval_is(measurement_interval_t v, uint16_t minutes, uint8_t seconds)
+{
+    return v.minutes == minutes && v.seconds == seconds;
+}
+
+static uint32_t screen_bit(screen_item_t item)
+{
+    return 1u << item;
+}
+
+static void rewrite_record_crc(nvs_entry_t *rec)
+{
+    uint16_t length = (uint16_t)(rec->len - RECORD_HEADER_LEN);
+    memcpy(&rec->data[RECORD_LENGTH_OFFSET], &length, sizeof(length));
+    uint32_t crc = esp_crc32_le(0, &rec->data[RECORD_HEADER_LEN], length);
+    memcpy(&rec->data[RECORD_CRC_OFFSET], &crc, sizeof(crc));
+}
+
+// Runs one boot in a child: config_store_init must succeed, then fn checks and may save.
+// Counters are reset first so fn sees only what this boot did.
+static void boot(const char *name, void (*fn)(void))
+{
+    reset_counters();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        s_failures = 0;
+        esp_err_t err = config_store_init();
+        CHECK(err == ESP_OK);
+        if (err == ESP_OK) {
+            fn();
+        }
+        fflush(stdout);
+        _exit(s_failures ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    printf("%-44s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) {
+        s_failures++;
+    }
+}
+
+// ---- scenarios ----
+static void expect_defaults(void)
+{
+    const measurement_config_t *cfg = config_store_current(NULL);
+    CHECK(interval_is(cfg->battery, 0, 1));
+    CHECK(interval_is(cfg->air, 0, 1));
+    CHECK(interval_is(cfg->sea, 0, 1));
+    CHECK(interval_is(cfg->wifi, 0, 0));
+    CHECK(interval_is(cfg->web_ui, 0, 0));
+    CHECK(cfg->display_on_seconds == 30);
+    CHECK(cfg->display_off_seconds == 600);
+    CHECK(cfg->display_dim);
+    CHECK(strcmp(cfg->device_name, "sea") == 0);
+    CHECK(cfg->screen_items[1] & screen_bit(SCREEN_ITEM_IP_ADDRESS));
+    CHECK(cfg->offsets.water_temp_c == 0.0f && cfg->offsets.sea_level_cm == 0.0f && cfg->offsets.air_temp_c == 0.0f);
+    CHECK(cfg->mqtt.uri[0] == '\0');
+    CHECK(strcmp(cfg->mqtt.topic, "seasensor") == 0);
+}
+
+static void check_empty_flash(void)
+{
+    expect_defaults();
+    CHECK(s_nvs->sets == 0 && s_nvs->erases == 0 && s_nvs->commits == 0);
+}
+
+static void seed_legacy(int32_t version)
+{
+    seed_i32("ver", version);
+    seed_interval("int_b", 5, 30);
+    seed_interval("int_a", 0, 90); // normalized to 1:30
+    seed_interval("int_s", 2, 0);
+    seed_interval("int_wifi", 10, 0);
+    seed_interval("int_web", 0, 15);
+    seed_u16("disp_sec", 120);
+    seed_u16("disp_off", 900);
+    seed_u8("disp_dim", 0);
+    seed_str("dev_name", "Brygge 1"); // sanitized to brygge-1
+    seed_str("wifi_ssid", "Naust");
+    seed_str("wifi_pass", "tang og tare");
+    seed_u32("scr1", screen_bit(SCREEN_ITEM_WATER_TEMP) | screen_bit(SCREEN_ITEM_PRESSURE));
+    seed_u32("scr2", screen_bit(SCREEN_ITEM_BATTERY_PERCENT)); // IP is forced onto screen 2
+    seed_i32("off_w", -1250);
+    seed_i32("off_s", 4500);
+    seed_i32("off_a", 300);
+}
+
+static void expect_legacy_values(void)
+{
+    const measurement_config_t *cfg = config_store_current(NULL);
+    CHECK(interval_is(cfg->battery, 5, 30));
+    CHECK(interval_is(cfg->air, 1, 30));
+    CHECK(interval_is(cfg->sea, 2, 0));
+    CHECK(interval_is(cfg->wifi, 10, 0));
+    CHECK(interval_is(cfg->web_ui, 0, 15));
+    CHECK(cfg->display_on_seconds == 120);
+    CHECK(cfg->display_off_seconds == 900);
+    CHECK(!cfg->display_dim);
+    CHECK(strcmp(cfg->device_name, "brygge-1") == 0);
+    CHECK(strcmp(cfg->wifi_ssid, "Naust") == 0);
+    CHECK(strcmp(cfg->wifi_password, "tang og tare") == 0);
+    CHECK(cfg->screen_items[0] == (screen_bit(SCREEN_ITEM_WATER_TEMP) | screen_bit(SCREEN_ITEM_PRESSURE)));
+    CHECK(cfg->screen_items[1] ==
+          (screen_bit(SCREEN_ITEM_BATTERY_PERCENT) | screen_bit(SCREEN_ITEM_IP_ADDRESS)));
+    CHECK(near(cfg->offsets.water_temp_c, -1.25f));
+    CHECK(near(cfg->offsets.sea_level_cm, 4.5f));
+    CHECK(near(cfg->offsets.air_temp_c, 0.3f));
+    CHECK(cfg->mqtt.uri[0] == '\0');
+    CHECK(strcmp(cfg->mqtt.topic, "seasensor") == 0);
+}
+
+static void check_legacy_import(void)
+{
+    expect_legacy_values();
+    CHECK(s_nvs->sets == 1);
+    CHECK(s_nvs->erases == LEGACY_KEY_COUNT);
+    CHECK(s_nvs->commits == 1);
+    CHECK(find_entry("cfg") != NULL);
+    CHECK(used_entries() == 1);
+}
+
+static void check_identical_saves(void)
+{
+    expect_legacy_values();
+    CHECK(s_nvs->sets == 0 && s_nvs->commits == 0);
+
+    measurement_config_t cfg = config_store_get();
+    CHECK(config_store_set(&cfg) == ESP_OK);
+    CHECK(s_nvs->sets == 0 && s_nvs->commits == 0);
+
+    cfg.air = (measurement_interval_t){.minutes = 0, .seconds = 90}; // same after normalization
+    CHECK(config_store_set(&cfg) == ESP_OK);
+    CHECK(s_nvs->sets == 0 && s_nvs->commits == 0);
+
+    uint32_t generation = config_store_generation();
+    cfg.display_on_seconds = 45;
+    CHECK(config_store_set(&cfg) == ESP_OK);
+    CHECK(s_nvs->sets == 1 && s_nvs->commits == 1);
+    CHECK(config_store_generation() == generation + 1);
+
+    CHECK(config_store_set(&cfg) == ESP_OK);
+    CHECK(s_nvs->sets == 1 && s_nvs->commits == 1);
+}
+
+static void check_changed_save_persisted(void)
+{
+    CHECK(config_store_current(NULL)->display_on_seconds == 45);
+    CHECK(strcmp(config_store_current(NULL)->device_name, "brygge-1") == 0);
+    CHECK(s_nvs->sets == 0);
+}
+
+static measurement_config_t full_config(void)
+{
+    measurement_config_t cfg = {
+        .battery = {.minutes = 90, .seconds = 0},
+        .air = {.minutes = 3, .seconds = 7},
+        .sea = {.minutes = 0, .seconds = 59},
+        .wifi = {.minutes = 15, .seconds = 0},
+        .web_ui = {.minutes = 0, .seconds = 5},
+        .display_on_seconds = 3600,
+        .display_off_seconds = 43200,
+        .display_dim = false,
+        .device_name = "fyr_02",
+        .wifi_ssid = "Havna gjest",
+        .wifi_password = "0123456789012345678901234567890123456789012345678901234567890",
+        .screen_items = {screen_bit(SCREEN_ITEM_HUMIDITY),
+                         screen_bit(SCREEN_ITEM_IP_ADDRESS) | screen_bit(SCREEN_ITEM_BATTERY_VOLTAGE)},
+        .offsets = {.water_temp_c = -19.999f, .sea_level_cm = 200.0f, .air_temp_c = 0.001f},
+        .mqtt = {.uri = "mqtts://broker.example:8883", .username = "sensor", .password = "hemmelig",
+                 .topic = "hjem/brygge"},
+    };
+    return cfg;
+}
+
+static void save_full_config(void)
+{
+    measurement_config_t cfg = full_config();
+    CHECK(config_store_set(&cfg) == ESP_OK);
+    CHECK(s_nvs->sets == 1 && s_nvs->commits == 1);
+}
+
+static void check_full_round_trip(void)
+{
+    measurement_config_t want = full_config();
+    config_store_normalize(&want);
+    measurement_config_t got = config_store_get();
+    CHECK(config_store_diff(&want, &got) == 0);
+    CHECK(near(got.offsets.water_temp_c, -19.999f));
+    CHECK(near(got.offsets.air_temp_c, 0.001f));
+    CHECK(s_nvs->sets == 0);
+}
+
+static void check_fallback_then_repair(void)
+{
+    expect_defaults();
+    CHECK(s_nvs->sets == 0);
+    // Nothing valid is stored, so saving the defaults must still write a record
+    measurement_config_t cfg = config_store_get();
+    CHECK(config_store_set(&cfg) == ESP_OK);
+    CHECK(s_nvs->sets == 1 && s_nvs->commits == 1);
+}
+
+static void check_legacy_not_imported(void)
+{
+    expect_defaults();
+    CHECK(s_nvs->sets == 0 && s_nvs->erases == 0);
+    CHECK(used_entries() == LEGACY_KEY_COUNT);
+}
+
+static void check_older_payload(void)
+{
+    const measurement_config_t *cfg = config_store_current(NULL);
+    CHECK(strcmp(cfg->device_name, "fyr_02") == 0);
+    CHECK(cfg->display_on_seconds == 3600);
+    CHECK(near(cfg->offsets.sea_level_cm, 200.0f));
+    CHECK(cfg->mqtt.uri[0] == '\0');
+    CHECK(strcmp(cfg->mqtt.topic, "seasensor") == 0);
+    // Not the current layout, so the first save rewrites it even without a change
+    measurement_config_t copy = *cfg;
+    CHECK(config_store_set(&copy) == ESP_OK);
+    CHECK(s_nvs->sets == 1);
+}
+
+static void check_newer_payload(void)
+{
+    measurement_config_t want = full_config();
+    config_store_normalize(&want);
+    measurement_config_t got = config_store_get();
+    CHECK(config_store_diff(&want, &got) == 0);
+}
+
+// Boots on a full-config record after edit(record); returns with the record restored
+static void boot_on_record(const char *name, void (*edit)(nvs_entry_t *rec), void (*fn)(void))
+{
+    nvs_entry_t saved = *find_entry("cfg");
+    edit(find_entry("cfg"));
+    boot(name, fn);
+    *find_entry("cfg") = saved;
+}
+
+static void corrupt_crc(nvs_entry_t *rec)
+{
+    rec->data[RECORD_HEADER_LEN + 20] ^= 0x01;
+}
+
+static void corrupt_magic(nvs_entry_t *rec)
+{
+    rec->data[0] ^= 0xFF;
+}
+
+static void corrupt_length(nvs_entry_t *rec)
+{
+    rec->len -= 1;
+}
+
+static void truncate_to_pre_mqtt(nvs_entry_t *rec)
+{
+    rec->len = RECORD_HEADER_LEN + RECORD_MQTT_OFFSET;
+    rewrite_record_crc(rec);
+}
+
+static void extend_as_newer(nvs_entry_t *rec)
+{
+    rec->data[RECORD_VERSION_OFFSET] += 1;
+    memset(&rec->data[rec->len], 0xA5, 24);
+    rec->len += 24;
+    rewrite_record_crc(rec);
+}
+
+int main(void)
+{
+    s_nvs = mmap(NULL, sizeof(*s_nvs), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s_nvs == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    reset_flash();
+    boot("empty flash -> defaults", check_empty_flash);
+
+    reset_flash();
+    seed_legacy(6);
+    boot("legacy v6 keys -> record", check_legacy_import);
+    boot("reboot, identical and changed saves", check_identical_saves);
+    boot("changed save survives reboot", check_changed_save_persisted);
+
+    reset_flash();
+    boot("save every field", save_full_config);
+    boot("every field round-trips", check_full_round_trip);
+    boot_on_record("CRC mismatch -> defaults, rewritten", corrupt_crc, check_fallback_then_repair);
+    boot_on_record("bad magic -> defaults, rewritten", corrupt_magic, check_fallback_then_repair);
+    boot_on_record("wrong length -> defaults, rewritten", corrupt_length, check_fallback_then_repair);
+    boot_on_record("older payload -> defaults for new fields", truncate_to_pre_mqtt, check_older_payload);
+    boot_on_record("newer payload -> known fields", extend_as_newer, check_newer_payload);
+
+    reset_flash();
+    seed_legacy(5);
+    boot("legacy v5 keys -> defaults, kept", check_legacy_not_imported);
+
+    if (s_failures) {
+        printf("%d failed scenarios\n", s_failures);
+    }
+    return s_failures ? 1 : 0;
+}
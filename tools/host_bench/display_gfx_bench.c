@@ -0,0 +1,307 @@
+// Host check and benchmark for main/display_gfx.c.
+//
+// 1. The text screen (8 lines of 6x8 text) and the graph screen (3x headline, two sparklines
+//    and a caption, as display_manager draws it) must match a per-pixel reference renderer
+//    byte for byte. The reference sets one framebuffer bit per lit pixel, the way the module
+//    drew before the page-aligned blit.
+// 2. Random strings at random (also unaligned and clipped) positions must match as well, so
+//    the fallback path stays covered.
+// 3. Both screens are timed per render, module vs reference.
+//
+// Usage: display_gfx_bench   exit status 1 on any mismatch
+
+#include "display_gfx.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define RANDOM_CASES 20000
+#define RENDER_ROUNDS 20000
+#define SPARK_BUCKET_US (5LL * 60 * 1000000) // as display_manager
+#define SPARK_MIN_SPAN 20
+
+static const uint8_t k_font[][DISPLAY_GFX_FONT_WIDTH - 1] = {
+#include "font5x7.inc"
+};
+
+static const char *const k_text_screen[DISPLAY_GFX_PAGES] = {
+    "Vanntemp 12.4C", "Sjoen 143.2cm", "Luft 8.9C", "Fukt 81.0%",
+    "Trykk 1013hPa", "Batt 87%", "Batt 3.98V", "IP 192.168.4.1",
+};
+
+// ---- per-pixel reference ----
+static void ref_pixel(uint8_t *fb, int x, int y)
+{
+    if (x >= 0 && x < DISPLAY_GFX_WIDTH && y >= 0 && y < DISPLAY_GFX_HEIGHT) {
+        fb[(y / 8) * DISPLAY_GFX_WIDTH + x] |= (uint8_t)(1u << (y & 7));
+    }
+}
+
+static const uint8_t *ref_glyph(char c)
+{
+    return k_font[(c < 32 || c > 126 ? '?' : c) - 32];
+}
+
+static void ref_char(uint8_t *fb, int x, int y, char c, int scale)
+{
+    const uint8_t *glyph = ref_glyph(c);
+    for (int col = 0; col < DISPLAY_GFX_FONT_WIDTH - 1; ++col) {
+        for (int row = 0; row < DISPLAY_GFX_FONT_HEIGHT; ++row) {
+            if (!(glyph[col] & (1u << row))) {
+                continue;
+            }
+            for (int dx = 0; dx < scale; ++dx) {
+                for (int dy = 0; dy < scale; ++dy) {
+                    ref_pixel(fb, x + col * scale + dx, y + row * scale + dy);
+                }
+            }
+        }
+    }
+}
+
+static int ref_text(uint8_t *fb, int x, int y, const char *text)
+{
+    while (*text && x <= DISPLAY_GFX_WIDTH - DISPLAY_GFX_FONT_WIDTH) {
+        ref_char(fb, x, y, *text++, 1);
+        x += DISPLAY_GFX_FONT_WIDTH;
+    }
+    return x;
+}
+
+static int ref_text_scaled(uint8_t *fb, int x, int page, const char *text, int scale)
+{
+    while (*text && x + (DISPLAY_GFX_FONT_WIDTH - 1) * scale <= DISPLAY_GFX_WIDTH) {
+        ref_char(fb, x, page * 8, *text++, scale);
+        x += DISPLAY_GFX_FONT_WIDTH * scale;
+    }
+    return x;
+}
+
+// Same bucket-to-column mapping and scaling as the module, drawn one pixel at a time
+static void ref_sparkline(uint8_t *fb, int x, int page, int width, int pages, const display_spark_ring_t *ring,
+                          int16_t min_span)
+{
+    size_t n = ring->count;
+    size_t first = (ring->head + DISPLAY_SPARK_CAPACITY - n) % DISPLAY_SPARK_CAPACITY;
+    int32_t lo = INT16_MAX;
+    int32_t hi = INT16_MIN;
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = (first + i) % DISPLAY_SPARK_CAPACITY;
+        lo = ring->lo[idx] < lo ? ring->lo[idx] : lo;
+        hi = ring->hi[idx] > hi ? ring->hi[idx] : hi;
+    }
+    if (hi - lo < min_span) {
+        lo -= (min_span - (hi - lo)) / 2;
+        hi = lo + min_span;
+    }
+    const int rows = pages * 8 - 1;
+    size_t cols = n < (size_t)width ? n : (size_t)width;
+    for (size_t c = 0; c < cols; ++c) {
+        size_t start = n <= (size_t)width ? c : c * n / (size_t)width;
+        size_t end = n <= (size_t)width ? c + 1 : (c + 1) * n / (size_t)width;
+        int32_t col_lo = INT16_MAX;
+        int32_t col_hi = INT16_MIN;
+        for (size_t i = start; i < end; ++i) {
+            size_t idx = (first + i) % DISPLAY_SPARK_CAPACITY;
+            col_lo = ring->lo[idx] < col_lo ? ring->lo[idx] : col_lo;
+            col_hi = ring->hi[idx] > col_hi ? ring->hi[idx] : col_hi;
+        }
+        int y_hi = page * 8 + rows - (int)((col_hi - lo) * rows / (hi - lo));
+        int y_lo = page * 8 + rows - (int)((col_lo - lo) * rows / (hi - lo));
+        for (int y = y_hi; y <= y_lo; ++y) {
+            ref_pixel(fb, x + width - (int)cols + (int)c, y);
+        }
+    }
+}
+// ---- end of reference ----
+
+static uint32_t s_rng = 0x6C8E9CF5u;
+
+static uint32_t next_random(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void render_text_screen(uint8_t *fb)
+{
+    display_gfx_clear(fb);
+    for (int i = 0; i < DISPLAY_GFX_PAGES; ++i) {
+        display_gfx_text(fb, 0, i * DISPLAY_GFX_FONT_HEIGHT, k_text_screen[i]);
+    }
+}
+
+static void ref_text_screen(uint8_t *fb)
+{
+    memset(fb, 0, DISPLAY_GFX_FB_SIZE);
+    for (int i = 0; i < DISPLAY_GFX_PAGES; ++i) {
+        ref_text(fb, 0, i * DISPLAY_GFX_FONT_HEIGHT, k_text_screen[i]);
+    }
+}
+
+// Pages 0-2 sea level headline, 3-4 sea sparkline, 5 pressure text, 6-7 pressure sparkline
+static void render_graph_screen(uint8_t *fb, const display_spark_ring_t *sea, const display_spark_ring_t *pressure)
+{
+    display_gfx_clear(fb);
+    int x = display_gfx_text_scaled(fb, 0, 0, "143.2", 3);
+    display_gfx_text(fb, x, 2 * 8, "cm");
+    display_gfx_sparkline(fb, 0, 3, DISPLAY_GFX_WIDTH, 2, sea, SPARK_MIN_SPAN);
+    display_gfx_text(fb, 0, 5 * 8, "Trykk 1013hPa -1.4");
+    display_gfx_sparkline(fb, 0, 6, DISPLAY_GFX_WIDTH, 2, pressure, SPARK_MIN_SPAN);
+}
+
+static void ref_graph_screen(uint8_t *fb, const display_spark_ring_t *sea, const display_spark_ring_t *pressure)
+{
+    memset(fb, 0, DISPLAY_GFX_FB_SIZE);
+    int x = ref_text_scaled(fb, 0, 0, "143.2", 3);
+    ref_text(fb, x, 2 * 8, "cm");
+    ref_sparkline(fb, 0, 3, DISPLAY_GFX_WIDTH, 2, sea, SPARK_MIN_SPAN);
+    ref_text(fb, 0, 5 * 8, "Trykk 1013hPa -1.4");
+    ref_sparkline(fb, 0, 6, DISPLAY_GFX_WIDTH, 2, pressure, SPARK_MIN_SPAN);
+}
+
+static void fill_rings(display_spark_ring_t *sea, display_spark_ring_t *pressure, int buckets)
+{
+    memset(sea, 0, sizeof(*sea));
+    memset(pressure, 0, sizeof(*pressure));
+    for (int i = 0; i < buckets; ++i) {
+        int64_t t_us = (int64_t)i * SPARK_BUCKET_US;
+        // Tide plus a one-bucket wave spike; pressure drifts with a slow front
+        float tide = 140.0f + 35.0f * sinf((float)i * 0.0524f) + (i % 97 == 0 ? 12.0f : 0.0f);
+        display_spark_push(sea, tide, t_us, SPARK_BUCKET_US);
+        display_spark_push(sea, tide - 1.5f, t_us + 1, SPARK_BUCKET_US);
+        display_spark_push(pressure, 1013.0f - (float)i * 0.02f + 0.4f * sinf((float)i * 0.3f), t_us,
+                           SPARK_BUCKET_US);
+    }
+}
+
+static bool same_fb(const char *what, const uint8_t *got, const uint8_t *want)
+{
+    for (size_t i = 0; i < DISPLAY_GFX_FB_SIZE; ++i) {
+        if (got[i] != want[i]) {
+            printf("  %s: first difference at page %zu column %zu: 0x%02x, reference 0x%02x\n", what,
+                   i / DISPLAY_GFX_WIDTH, i % DISPLAY_GFX_WIDTH, got[i], want[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int check_screens(void)
+{
+    static uint8_t got[DISPLAY_GFX_FB_SIZE];
+    static uint8_t want[DISPLAY_GFX_FB_SIZE];
+    static display_spark_ring_t sea;
+    static display_spark_ring_t pressure;
+    int failed = 0;
+
+    render_text_screen(got);
+    ref_text_screen(want);
+    bool ok = same_fb("text screen", got, want);
+    printf("text screen vs per-pixel reference: %s\n", ok ? "identical" : "MISMATCH");
+    failed |= !ok;
+
+    // Fewer buckets than columns (one per column) and a wrapped, decimated full ring
+    static const int k_buckets[] = {3, 90, DISPLAY_SPARK_CAPACITY + 40};
+    for (size_t i = 0; i < sizeof(k_buckets) / sizeof(k_buckets[0]); ++i) {
+        fill_rings(&sea, &pressure, k_buckets[i]);
+        render_graph_screen(got, &sea, &pressure);
+        ref_graph_screen(want, &sea, &pressure);
+        ok = same_fb("graph screen", got, want);
+        printf("graph screen, %d buckets, vs per-pixel reference: %s\n", k_buckets[i],
+               ok ? "identical" : "MISMATCH");
+        failed |= !ok;
+    }
+    return failed;
+}
+
+static int check_random_text(void)
+{
+    static uint8_t got[DISPLAY_GFX_FB_SIZE];
+    static uint8_t want[DISPLAY_GFX_FB_SIZE];
+    long mismatches = 0;
+    for (int n = 0; n < RANDOM_CASES; ++n) {
+        char text[12];
+        size_t len = 1 + next_random() % (sizeof(text) - 1);
+        for (size_t i = 0; i < len; ++i) {
+            text[i] = (char)(28 + next_random() % 102); // a few outside 32..126 for the '?' fallback
+        }
+        text[len] = '\0';
+        memset(got, 0, sizeof(got));
+        memset(want, 0, sizeof(want));
+        if (n % 4 == 0) {
+            int scale = 2 + (int)(next_random() % 2);
+            int x = (int)(next_random() % DISPLAY_GFX_WIDTH);
+            int page = (int)(next_random() % (DISPLAY_GFX_PAGES - scale + 1));
+            display_gfx_text_scaled(got, x, page, text, scale);
+            ref_text_scaled(want, x, page, text, scale);
+        } else {
+            // Half page-aligned (blit), half anywhere including partly off the panel
+            int x = (int)(next_random() % (DISPLAY_GFX_WIDTH + 8)) - 4;
+            int y = n % 2 ? (int)(next_random() % DISPLAY_GFX_PAGES) * 8
+                          : (int)(next_random() % (DISPLAY_GFX_HEIGHT + 8)) - 4;
+            display_gfx_text(got, x, y, text);
+            ref_text(want, x, y, text);
+        }
+        if (memcmp(got, want, sizeof(got)) != 0 && mismatches++ < 5) {
+            same_fb(text, got, want);
+        }
+    }
+    printf("random text vs per-pixel reference: %ld of %d mismatched\n", mismatches, RANDOM_CASES);
+    return mismatches != 0;
+}
+
+static void bench_screens(void)
+{
+    static uint8_t fb[DISPLAY_GFX_FB_SIZE];
+    static display_spark_ring_t sea;
+    static display_spark_ring_t pressure;
+    fill_rings(&sea, &pressure, DISPLAY_SPARK_CAPACITY);
+
+    double start = now_ns();
+    for (int r = 0; r < RENDER_ROUNDS; ++r) {
+        render_text_screen(fb);
+        __asm__ volatile("" : : "r"(fb) : "memory");
+    }
+    double text_us = (now_ns() - start) / RENDER_ROUNDS / 1000.0;
+    start = now_ns();
+    for (int r = 0; r < RENDER_ROUNDS; ++r) {
+        ref_text_screen(fb);
+        __asm__ volatile("" : : "r"(fb) : "memory");
+    }
+    double ref_text_us = (now_ns() - start) / RENDER_ROUNDS / 1000.0;
+    start = now_ns();
+    for (int r = 0; r < RENDER_ROUNDS; ++r) {
+        render_graph_screen(fb, &sea, &pressure);
+        __asm__ volatile("" : : "r"(fb) : "memory");
+    }
+    double graph_us = (now_ns() - start) / RENDER_ROUNDS / 1000.0;
+    start = now_ns();
+    for (int r = 0; r < RENDER_ROUNDS; ++r) {
+        ref_graph_screen(fb, &sea, &pressure);
+        __asm__ volatile("" : : "r"(fb) : "memory");
+    }
+    double ref_graph_us = (now_ns() - start) / RENDER_ROUNDS / 1000.0;
+    printf("text screen: %.2f us/render (per-pixel reference %.2f us)\n", text_us, ref_text_us);
+    printf("graph screen, full rings: %.2f us/render (per-pixel reference %.2f us)\n", graph_us, ref_graph_us);
+}
+
+int main(void)
+{
+    int failed = check_screens();
+    failed |= check_random_text();
+    bench_screens();
+    return failed;
+}
@@ -0,0 +1,365 @@
+// Host check and benchmark for main/json_writer.c.
+//
+// 1. json_write_number against printf("%.*f") with trailing zeros trimmed, over random values
+//    at 0-6 decimals plus edge cases (-0, values rounding to zero, the %.17g fallback).
+// 2. json_write_int at INT64_MIN/INT64_MAX.
+// 3. Escaping of every control character, quotes and backslashes, in keys and values.
+// 4. NaN and +/-Inf written as null.
+// 5. Nesting past JSON_WRITER_MAX_DEPTH and unbalanced closes give ESP_ERR_INVALID_STATE;
+//    overflow without a flush callback gives ESP_ERR_NO_MEM, a failing callback its error.
+// 6. A document streamed through the flush callback at every buffer size from 1 byte must be
+//    byte for byte the single-buffer document.
+// 7. A snapshot-sized document is timed per serialization.
+//
+// Usage: json_writer_test [values]   exit status 1 on any failure
+
+#include "json_writer.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_VALUES 1000000
+#define DOC_BUF_LEN 4096
+#define SERIALIZE_ROUNDS 200000
+
+static int s_failures;
+static uint32_t s_rng = 0x1B873593u;
+
+static uint32_t next_random(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void expect(bool ok, const char *what, const char *got, const char *want)
+{
+    if (!ok) {
+        if (s_failures < 10) {
+            printf("  %s: got '%s', want '%s'\n", what, got, want);
+        }
+        s_failures++;
+    }
+}
+
+// Serializes one root value with fn into out; returns the writer's status
+static esp_err_t write_root(char *out, size_t cap, void (*fn)(json_writer_t *w, const void *arg), const void *arg)
+{
+    json_writer_t w;
+    json_writer_init(&w, out, cap - 1, NULL, NULL);
+    fn(&w, arg);
+    esp_err_t err = json_writer_finish(&w);
+    out[err == ESP_OK ? w.len : 0] = '\0';
+    return err;
+}
+
+typedef struct {
+    double value;
+    uint8_t decimals;
+} number_arg_t;
+
+static void put_number(json_writer_t *w, const void *arg)
+{
+    const number_arg_t *n = (const number_arg_t *)arg;
+    json_write_number(w, NULL, n->value, n->decimals);
+}
+
+// printf("%.*f") in the writer's form: trailing zeros and a bare '.' trimmed, "-0" as "0"
+static void printf_reference(char *out, size_t cap, double value, int decimals)
+{
+    snprintf(out, cap, "%.*f", decimals, value);
+    if (strchr(out, '.')) {
+        size_t len = strlen(out);
+        while (out[len - 1] == '0') {
+            out[--len] = '\0';
+        }
+        if (out[len - 1] == '.') {
+            out[--len] = '\0';
+        }
+    }
+    if (strcmp(out, "-0") == 0) {
+        strcpy(out, "0");
+    }
+}
+
+static double random_value(void)
+{
+    // Sensor-like magnitudes most of the time, sometimes up to 1e9
+    double unit = (double)next_random() / 4294967296.0;
+    double mag = (next_random() % 8 == 0) ? 1e9 : (next_random() % 2 ? 2000.0 : 2.0);
+    return (next_random() % 2 ? -1.0 : 1.0) * unit * mag;
+}
+
+static void check_numbers(long values)
+{
+    char got[64];
+    char want[64];
+    long mismatches = 0;
+    for (long i = 0; i < values; ++i) {
+        number_arg_t n = {.value = random_value(), .decimals = (uint8_t)(next_random() % 7)};
+        write_root(got, sizeof(got), put_number, &n);
+        printf_reference(want, sizeof(want), n.value, n.decimals);
+        if (strcmp(got, want) != 0) {
+            mismatches++;
+            expect(false, "number", got, want);
+        }
+    }
+    printf("random numbers vs printf(\"%%.*f\"): %ld of %ld mismatched\n", mismatches, values);
+
+    static const number_arg_t k_edges[] = {
+        {0.0, 2}, {-0.0, 2}, {-0.004, 2}, {0.005, 2}, {-0.005, 2}, {1.5, 0}, {2.5, 0}, {12.3456789, 6},
+        {999.995, 2}, {-999.999, 2}, {1013.25, 1}, {4.2, 3}, {123456789.123, 3},
+    };
+    for (size_t i = 0; i < sizeof(k_edges) / sizeof(k_edges[0]); ++i) {
+        write_root(got, sizeof(got), put_number, &k_edges[i]);
+        printf_reference(want, sizeof(want), k_edges[i].value, k_edges[i].decimals);
+        expect(strcmp(got, want) == 0, "number edge", got, want);
+    }
+    // Past the fixed-point range the shortest round-trip form is used
+    number_arg_t big = {.value = -3.25e17, .decimals = 2};
+    write_root(got, sizeof(got), put_number, &big);
+    expect(strtod(got, NULL) == big.value, "%.17g fallback", got, "-3.25e+17");
+}
+
+static void put_int(json_writer_t *w, const void *arg)
+{
+    json_write_int(w, NULL, *(const int64_t *)arg);
+}
+
+static void check_ints(void)
+{
+    static const int64_t k_values[] = {INT64_MIN, INT64_MIN + 1, -1, 0, 7, INT64_MAX};
+    char got[32];
+    char want[32];
+    for (size_t i = 0; i < sizeof(k_values) / sizeof(k_values[0]); ++i) {
+        write_root(got, sizeof(got), put_int, &k_values[i]);
+        snprintf(want, sizeof(want), "%" PRId64, k_values[i]);
+        expect(strcmp(got, want) == 0, "int", got, want);
+    }
+    printf("json_write_int INT64_MIN..INT64_MAX: checked\n");
+}
+
+static void put_escapes(json_writer_t *w, const void *arg)
+{
+    json_begin_object(w, NULL);
+    json_write_string(w, (const char *)arg, (const char *)arg);
+    json_write_string(w, "none", NULL);
+    json_end_object(w);
+}
+
+static void check_escaping(void)
+{
+    // Every control character, then quote, backslash, a slash and UTF-8 (passed through)
+    char raw[64];
+    size_t n = 0;
+    for (int c = 1; c < 0x20; ++c) {
+        raw[n++] = (char)c;
+    }
+    memcpy(&raw[n], "\"\\/\xc3\xa6", 6);
+    raw[n + 6] = '\0';
+
+    char escaped[256] = "\"";
+    for (int c = 1; c < 0x20; ++c) {
+        const char *shortcut = c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\t' ? "\\t" : NULL;
+        char esc[8];
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        strcat(escaped, shortcut ? shortcut : esc);
+    }
+    strcat(escaped, "\\\"\\\\/\xc3\xa6\"");
+    char want[600];
+    snprintf(want, sizeof(want), "{%s:%s,\"none\":null}", escaped, escaped);
+
+    char got[600];
+    write_root(got, sizeof(got), put_escapes, raw);
+    expect(strcmp(got, want) == 0, "escaping", got, want);
+    printf("escaping of control characters, quotes and backslashes: checked\n");
+}
+
+static void put_non_finite(json_writer_t *w, const void *arg)
+{
+    (void)arg;
+    json_begin_array(w, NULL);
+    json_write_number(w, NULL, NAN, 2);
+    json_write_number(w, NULL, INFINITY, 2);
+    json_write_number(w, NULL, -INFINITY, 0);
+    json_end_array(w);
+}
+
+static void put_nested(json_writer_t *w, const void *arg)
+{
+    int levels = *(const int *)arg;
+    for (int i = 0; i < levels; ++i) {
+        json_begin_array(w, NULL);
+    }
+    for (int i = 0; i < levels; ++i) {
+        json_end_array(w);
+    }
+}
+
+static void put_extra_close(json_writer_t *w, const void *arg)
+{
+    (void)arg;
+    json_begin_object(w, NULL);
+    json_end_object(w);
+    json_end_object(w);
+}
+
+static void put_unclosed(json_writer_t *w, const void *arg)
+{
+    (void)arg;
+    json_begin_object(w, NULL);
+    json_write_bool(w, "open", true);
+}
+
+static void check_errors(void)
+{
+    char got[128];
+    write_root(got, sizeof(got), put_non_finite, NULL);
+    expect(strcmp(got, "[null,null,null]") == 0, "NaN/Inf", got, "[null,null,null]");
+
+    int deepest = JSON_WRITER_MAX_DEPTH - 1;
+    int too_deep = JSON_WRITER_MAX_DEPTH;
+    expect(write_root(got, sizeof(got), put_nested, &deepest) == ESP_OK, "max depth - 1", got, "ok");
+    expect(write_root(got, sizeof(got), put_nested, &too_deep) == ESP_ERR_INVALID_STATE, "depth overflow", "",
+           "ESP_ERR_INVALID_STATE");
+    expect(write_root(got, sizeof(got), put_extra_close, NULL) == ESP_ERR_INVALID_STATE, "extra close", "",
+           "ESP_ERR_INVALID_STATE");
+    expect(write_root(got, sizeof(got), put_unclosed, NULL) == ESP_ERR_INVALID_STATE, "unclosed", "",
+           "ESP_ERR_INVALID_STATE");
+    expect(write_root(got, 8, put_unclosed, NULL) == ESP_ERR_NO_MEM, "overflow without flush", "",
+           "ESP_ERR_NO_MEM");
+    printf("NaN/Inf as null, depth and overflow errors: checked\n");
+}
+
+// A snapshot-shaped document: mixed members, nesting and an array of readings
+static void put_document(json_writer_t *w, const void *arg)
+{
+    (void)arg;
+    json_begin_object(w, NULL);
+    json_write_bool(w, "cached", false);
+    json_write_int(w, "age_ms", 1234);
+    json_write_number(w, "water_temp_c", 12.375, 2);
+    json_write_number(w, "sea_level_cm", 143.2, 2);
+    json_write_number(w, "air_temp_c", -3.25, 2);
+    json_write_number(w, "humidity_percent", 81.0, 2);
+    json_write_number(w, "air_pressure_hpa", 1013.25, 2);
+    json_write_number(w, "pressure_trend_hpa_3h", NAN, 2);
+    json_write_number(w, "battery_voltage", 3.987, 3);
+    json_write_number(w, "battery_days_remaining", 41.52, 1);
+    json_write_int(w, "seq", 4294967295LL);
+    json_begin_object(w, "wifi");
+    json_write_bool(w, "sta_connected", true);
+    json_write_string(w, "sta_ip", "192.168.1.57");
+    json_write_string(w, "note", "tab\there \"quoted\"");
+    json_end_object(w);
+    json_begin_array(w, "history");
+    for (int i = 0; i < 24; ++i) {
+        json_begin_object(w, NULL);
+        json_write_int(w, "seq", 1000 + i);
+        json_write_number(w, "sea_level_cm", 140.0 + i * 0.37, 2);
+        json_end_object(w);
+    }
+    json_end_array(w);
+    json_end_object(w);
+}
+
+typedef struct {
+    char data[DOC_BUF_LEN];
+    size_t len;
+    int calls;
+    int fail_after; // flush calls that succeed before ESP_FAIL; -1 = never fail
+} sink_t;
+
+static esp_err_t sink_flush(void *ctx, const char *data, size_t len)
+{
+    sink_t *sink = (sink_t *)ctx;
+    if (sink->fail_after >= 0 && sink->calls >= sink->fail_after) {
+        return ESP_FAIL;
+    }
+    sink->calls++;
+    memcpy(&sink->data[sink->len], data, len);
+    sink->len += len;
+    return ESP_OK;
+}
+
+static void check_streaming(void)
+{
+    static char single[DOC_BUF_LEN];
+    esp_err_t err = write_root(single, sizeof(single), put_document, NULL);
+    expect(err == ESP_OK, "single-buffer document", "", "ok");
+    size_t doc_len = strlen(single);
+
+    int mismatches = 0;
+    for (size_t cap = 1; cap <= doc_len + 1; ++cap) {
+        static sink_t sink;
+        char buf[DOC_BUF_LEN];
+        sink.len = 0;
+        sink.calls = 0;
+        sink.fail_after = -1;
+        json_writer_t w;
+        json_writer_init(&w, buf, cap, sink_flush, &sink);
+        put_document(&w, NULL);
+        err = json_writer_finish(&w);
+        // A document that fits is left in buf for a single send, not flushed
+        bool streamed = json_writer_streamed(&w);
+        const char *out = streamed ? sink.data : buf;
+        size_t out_len = streamed ? sink.len : w.len;
+        bool ok = err == ESP_OK && streamed == (cap < doc_len) && out_len == doc_len &&
+                  memcmp(out, single, doc_len) == 0;
+        if (!ok && mismatches++ < 5) {
+            printf("  buffer %zu: err %d, streamed %d, %zu of %zu bytes\n", cap, err, streamed, out_len, doc_len);
+        }
+    }
+    printf("streamed vs single-buffer document (%zu B) at buffer sizes 1..%zu: %d mismatched\n", doc_len,
+           doc_len + 1, mismatches);
+    s_failures += mismatches;
+
+    static sink_t failing = {.fail_after = 2};
+    char buf[64];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), sink_flush, &failing);
+    put_document(&w, NULL);
+    expect(json_writer_finish(&w) == ESP_FAIL, "flush error", "", "ESP_FAIL");
+}
+
+static void bench_document(void)
+{
+    static char buf[DOC_BUF_LEN];
+    double start = now_ns();
+    for (int r = 0; r < SERIALIZE_ROUNDS; ++r) {
+        json_writer_t w;
+        json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+        put_document(&w, NULL);
+        json_writer_finish(&w);
+        __asm__ volatile("" : : "r"(buf) : "memory");
+    }
+    double per_doc_us = (now_ns() - start) / SERIALIZE_ROUNDS / 1000.0;
+    printf("snapshot document (%zu B): %.2f us/serialization\n", strlen(buf), per_doc_us);
+}
+
+int main(int argc, char **argv)
+{
+    long values = argc > 1 ? strtol(argv[1], NULL, 10) : DEFAULT_VALUES;
+    check_numbers(values);
+    check_ints();
+    check_escaping();
+    check_errors();
+    check_streaming();
+    bench_document();
+    if (s_failures) {
+        printf("%d failed checks\n", s_failures);
+    }
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_adc/adc_cali.h"
+
+// No calibration scheme on the host: battery_monitor.c takes its raw 3.3 V scaling path
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "esp_err.h"
+
+#define ESP_RETURN_ON_ERROR(x, tag, fmt, ...) \
+    do {                                      \
+        esp_err_t err_rc_ = (x);              \
+        if (err_rc_ != ESP_OK) {              \
+            return err_rc_;                   \
+        }                                     \
+    } while (0)
+
+// As in ESP-IDF, jumps with the error stored in the caller's `ret`
+#define ESP_GOTO_ON_ERROR(x, goto_tag, tag, fmt, ...) \
+    do {                                              \
+        esp_err_t err_rc_ = (x);                      \
+        if (err_rc_ != ESP_OK) {                      \
+            ret = err_rc_;                            \
+            goto goto_tag;                            \
+        }                                             \
+    } while (0)
+
+#define ESP_RETURN_ON_FALSE(a, err_code, tag, fmt, ...) \
+    do {                                                \
+        if (!(a)) {                                     \
+            return err_code;                            \
+        }                                               \
+    } while (0)
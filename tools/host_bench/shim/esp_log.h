@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+
+// Logging is compiled out (the simulation prints its own summary), but the format is still
+// checked and the arguments count as used
+#define ESP_LOG_DISCARD(tag, fmt, ...)          \
+    do {                                        \
+        if (0) {                                \
+            printf("%s " fmt, tag, ##__VA_ARGS__); \
+        }                                       \
+    } while (0)
+#define ESP_LOGE ESP_LOG_DISCARD
+#define ESP_LOGW ESP_LOG_DISCARD
+#define ESP_LOGI ESP_LOG_DISCARD
+#define ESP_LOGD ESP_LOG_DISCARD
+#define ESP_LOGV ESP_LOG_DISCARD
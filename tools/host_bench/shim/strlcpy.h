@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+// Force-included where the host libc predates strlcpy (glibc < 2.38); newlib has it
+static inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Concurrent HTTP load against a SeaSensor: http_load.py <host> [options].
+
+Each client thread keeps one keep-alive connection and loops over the endpoint mix,
+optionally interleaving a PATCH /api/config (the slow NVS path). Prints count, errors,
+p50/p99/max latency per endpoint, so a stalled httpd task shows up as QUERY tail latency.
+"""
+import argparse
+import http.client
+import json
+import threading
+import time
+
+QUERY_BODY = json.dumps({
+    'requestId': 'load',
+    'inputs': [{'intent': 'action.devices.QUERY',
+                'payload': {'devices': [{'id': 'seasensor'}]}}],
+})
+
+
+def percentile(sorted_ms, pct):
+    if not sorted_ms:
+        return float('nan')
+    idx = min(len(sorted_ms) - 1, int(round(pct / 100.0 * (len(sorted_ms) - 1))))
+    return sorted_ms[idx]
+
+
+def build_mix(args):
+    mix = [
+        ('GET /api/metrics', 'GET', '/api/metrics', None),
+        ('GET /api/status', 'GET', '/api/status', None),
+        ('POST homegraph QUERY', 'POST', '/api/google/homegraph', QUERY_BODY),
+    ]
+    if args.patch_every > 0:
+        # Rewrites the current name, so the device ends up unchanged but still hits the path
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        conn.request('GET', '/api/config')
+        name = json.loads(conn.getresponse().read()).get('device_name', 'SeaSensor')
+        conn.close()
+        mix.append(('PATCH /api/config', 'PATCH', '/api/config', json.dumps({'device_name': name})))
+    return mix
+
+
+def client(args, mix, results, lock, stop_at):
+    conn = None
+    i = 0
+    while time.monotonic() < stop_at:
+        name, method, path, body = mix[i % len(mix)]
+        if name.startswith('PATCH') and (i // len(mix)) % args.patch_every != 0:
+            i += 1
+            continue
+        i += 1
+        headers = {'Content-Type': 'application/json'} if body else {}
+        start = time.perf_counter()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            conn.request(method, path, body=body, headers=headers)
+            resp = conn.getresponse()
+            resp.read()
+            ok = resp.status < 400
+            if resp.will_close:
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            ok = False
+            if conn is not None:
+                conn.close()
+            conn = None
+        elapsed_ms = (time.perf_counter() - start) * 1000.0
+        with lock:
+            entry = results.setdefault(name, {'ms': [], 'errors': 0})
+            entry['ms'].append(elapsed_ms)
+            entry['errors'] += 0 if ok else 1
+    if conn is not None:
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('-c', '--clients', type=int, default=4, help='concurrent connections')
+    parser.add_argument('-d', '--duration', type=float, default=20.0, help='seconds')
+    parser.add_argument('--patch-every', type=int, default=0,
+                        help='add a PATCH /api/config every N rounds per client (0 = never)')
+    parser.add_argument('--timeout', type=float, default=10.0)
+    args = parser.parse_args()
+
+    mix = build_mix(args)
+    results, lock = {}, threading.Lock()
+    stop_at = time.monotonic() + args.duration
+    threads = [threading.Thread(target=client, args=(args, mix, results, lock, stop_at))
+               for _ in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    print(f'{args.clients} clients, {args.duration:.0f} s')
+    print(f'{"endpoint":<24}{"count":>7}{"errors":>8}{"p50 ms":>9}{"p99 ms":>9}{"max ms":>9}')
+    for name, _, _, _ in mix:
+        entry = results.get(name)
+        if not entry:
+            continue
+        ms = sorted(entry['ms'])
+        print(f'{name:<24}{len(ms):>7}{entry["errors"]:>8}'
+              f'{percentile(ms, 50):>9.1f}{percentile(ms, 99):>9.1f}{ms[-1]:>9.1f}')
+
+
+if __name__ == '__main__':
+    main()
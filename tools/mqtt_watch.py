@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Watch a SeaSensor's MQTT topics: mqtt_watch.py <broker> [options].
+
+Subscribes to <topic>/# with QoS 1 (plain MQTT 3.1.1, no dependencies) and prints every
+status change, state and history message as it arrives. After each "online" it reports how
+long the device took to send its offline backlog (time from "online" to the state message
+that follows the history batches) and how many snapshots that covered. Duplicates are
+counted by (boot, seq); QoS 1 redelivers whatever was unacknowledged when the link dropped.
+The device keeps its own figure in /metrics as seasensor_mqtt_last_drain_seconds.
+"""
+import argparse
+import json
+import socket
+import struct
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK, SUBSCRIBE, SUBACK, PINGREQ, PINGRESP = 1, 2, 3, 4, 8, 9, 12, 13
+
+
+def encode_string(s):
+    data = s.encode()
+    return struct.pack('!H', len(data)) + data
+
+
+def encode_packet(ptype, flags, body):
+    length, header = len(body), bytearray([ptype << 4 | flags])
+    while True:
+        byte, length = length % 128, length // 128
+        header.append(byte | (0x80 if length else 0))
+        if not length:
+            return bytes(header) + body
+
+
+def recv_exact(sock, n):
+    data = b''
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError('broker closed the connection')
+        data += chunk
+    return data
+
+
+def recv_packet(sock):
+    first = recv_exact(sock, 1)[0]
+    length, shift = 0, 0
+    while True:
+        byte = recv_exact(sock, 1)[0]
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return first >> 4, first & 0x0F, recv_exact(sock, length)
+
+
+def connect(args):
+    sock = socket.create_connection((args.broker, args.port), timeout=args.keepalive)
+    flags = 0x02  # clean session
+    payload = encode_string(args.client_id)
+    if args.username:
+        flags |= 0x80
+        payload += encode_string(args.username)
+        if args.password:
+            flags |= 0x40
+            payload += encode_string(args.password)
+    body = encode_string('MQTT') + bytes([4, flags]) + struct.pack('!H', args.keepalive) + payload
+    sock.sendall(encode_packet(CONNECT, 0, body))
+    ptype, _, body = recv_packet(sock)
+    if ptype != CONNACK or body[1] != 0:
+        raise ConnectionError(f'connect refused (code {body[1] if len(body) > 1 else "?"})')
+    sock.sendall(encode_packet(SUBSCRIBE, 0x02, struct.pack('!H', 1) + encode_string(args.topic + '/#') + b'\x01'))
+    return sock
+
+
+def parse_publish(flags, body):
+    (topic_len,) = struct.unpack('!H', body[:2])
+    topic = body[2:2 + topic_len].decode()
+    pos, packet_id = 2 + topic_len, None
+    if (flags >> 1) & 0x03:
+        (packet_id,) = struct.unpack('!H', body[pos:pos + 2])
+        pos += 2
+    return topic, body[pos:], packet_id, bool(flags & 0x01)
+
+
+class Watcher:
+    def __init__(self, topic):
+        self.topic = topic
+        self.seen = set()
+        self.messages = self.snapshots = self.duplicates = self.bytes = 0
+        self.online_at = None
+        self.backlog = 0
+        self.started = time.monotonic()
+
+    def snapshot(self, entry):
+        key = (entry.get('boot'), entry.get('seq'))
+        if key in self.seen:
+            self.duplicates += 1
+        self.seen.add(key)
+        self.snapshots += 1
+
+    def handle(self, topic, payload, retained):
+        now = time.monotonic()
+        stamp = time.strftime('%H:%M:%S')
+        self.messages += 1
+        self.bytes += len(payload)
+        suffix = topic[len(self.topic) + 1:]
+        if suffix == 'status':
+            status = payload.decode(errors='replace')
+            print(f'{stamp} status {status}{" (retained)" if retained else ""}')
+            if status == 'online' and not retained:
+                self.online_at, self.backlog = now, 0
+            return
+        entries = json.loads(payload)
+        if suffix == 'history':
+            for entry in entries:
+                self.snapshot(entry)
+            self.backlog += len(entries)
+            print(f'{stamp} history {len(entries)} snapshots, seq {entries[0].get("seq")}..{entries[-1].get("seq")}, '
+                  f'{len(payload)} B')
+        elif suffix == 'state':
+            self.snapshot(entries)
+            age = entries.get('age_ms')
+            print(f'{stamp} state seq {entries.get("seq")} boot {entries.get("boot")}'
+                  f'{f", age {age} ms" if age is not None else ""}{" (retained)" if retained else ""}')
+            if self.online_at is not None:
+                print(f'         backlog {self.backlog + 1} snapshots sent {(now - self.online_at) * 1000:.0f} ms '
+                      f'after online')
+                self.online_at = None
+
+    def summary(self):
+        elapsed = time.monotonic() - self.started
+        print(f'{self.messages} messages, {self.snapshots} snapshots, {self.duplicates} duplicates, '
+              f'{self.bytes} B in {elapsed:.0f} s ({self.bytes / max(elapsed, 1e-3):.0f} B/s)')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('broker')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('-t', '--topic', default='seasensor', help='base topic configured on the device')
+    parser.add_argument('-u', '--username')
+    parser.add_argument('-P', '--password')
+    parser.add_argument('--client-id', default=f'mqtt_watch-{int(time.time())}')
+    parser.add_argument('--keepalive', type=int, default=30)
+    parser.add_argument('-d', '--duration', type=float, default=0, help='seconds (0 = until Ctrl-C)')
+    args = parser.parse_args()
+
+    args.topic = args.topic.rstrip('/')
+    watcher = Watcher(args.topic)
+    sock = connect(args)
+    sock.settimeout(args.keepalive / 2)
+    stop_at = time.monotonic() + args.duration if args.duration > 0 else None
+    try:
+        while stop_at is None or time.monotonic() < stop_at:
+            try:
+                ptype, flags, body = recv_packet(sock)
+            except socket.timeout:
+                sock.sendall(encode_packet(PINGREQ, 0, b''))
+                continue
+            if ptype == PUBLISH:
+                topic, payload, packet_id, retained = parse_publish(flags, body)
+                if packet_id is not None:
+                    sock.sendall(encode_packet(PUBACK, 0, struct.pack('!H', packet_id)))
+                watcher.handle(topic, payload, retained)
+    except KeyboardInterrupt:
+        pass
+    except ConnectionError as err:
+        print(err)
+    finally:
+        sock.close()
+        watcher.summary()
+
+
+if __name__ == '__main__':
+    main()